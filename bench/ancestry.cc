@@ -0,0 +1,62 @@
+
+// Ancestry query benchmark: is_in_subtree and lowest_common_ancestor on
+// random node pairs of a random tree, for plain nodes (walks over the
+// parents) and for indexed nodes (ancestry index, built on first use).
+// Reported as ns per query. Run as
+//
+//    ./ancestry [number of nodes] [number of queries]
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include "bench.hh"
+
+long hits;
+
+template<class Tree>
+void run(const char *name, size_t n, size_t queries)
+	{
+	Tree tr;
+	bench::build_random(tr, n);
+	std::vector<typename Tree::iterator> nodes;
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it)
+		nodes.push_back(it);
+
+	std::mt19937 gen(1);
+	std::uniform_int_distribution<size_t> pick(0, n-1);
+	std::vector<size_t> one(queries), two(queries);
+	for(size_t q=0; q<queries; ++q) {
+		one[q]=pick(gen);
+		two[q]=pick(gen);
+		}
+	// The top of a subtree is more useful when it is not too high up.
+	std::vector<typename Tree::iterator> tops(queries);
+	for(size_t q=0; q<queries; ++q) {
+		tops[q]=nodes[one[q]];
+		for(int up=0; up<2 && tops[q].node->parent!=0; ++up)
+			tops[q]=tr.parent(tops[q]);
+		}
+
+	double first=bench::ns_per_node([&]() { hits+=tr.is_in_subtree(nodes[two[0]], nodes[0]); }, 1);
+	double subtree=bench::ns_per_node([&]() {
+		for(size_t q=0; q<queries; ++q)
+			if(tr.is_in_subtree(nodes[two[q]], tops[q])) ++hits;
+		}, queries);
+	double lca=bench::ns_per_node([&]() {
+		for(size_t q=0; q<queries; ++q)
+			if(tr.lowest_common_ancestor(nodes[one[q]], nodes[two[q]])==tr.begin()) ++hits;
+		}, queries);
+
+	std::cout << name << "\t" << n << "\t" << first/1e6 << "\t" << subtree << "\t" << lca << std::endl;
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv);
+	size_t queries=(argc>2)?std::strtoul(argv[2], 0, 10):1000000;
+
+	std::cout << "tree\tnodes\tfirst(ms)\tis_in_subtree\tlca  (ns/query)" << std::endl;
+	run<tree<int> >("plain", n, queries);
+	run<tree<int, std::allocator<tree_node_indexed_<int> > > >("indexed", n, queries);
+	if(hits==0) std::cout << std::endl;
+	}
@@ -0,0 +1,62 @@
+// Concurrent append benchmark: building a tree with a parent per thread,
+// serially with append_child against threads adding through a
+// concurrent_appender, below parents of their own, all below one parent,
+// and by moving in trees built on the side. Reported as ns per node. Run as
+//
+//    ./append [number of nodes]
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "bench.hh"
+#include "tree_concurrent.hh"
+
+typedef tree<int> tree_t;
+
+double threaded(size_t n, unsigned int threads, int mode)
+	{
+	tree_t tr;
+	tree_t::iterator top=tr.set_head(0);
+	std::vector<tree_t::iterator> own;
+	for(unsigned int t=0; t<threads; ++t)
+		own.push_back(tr.append_child(top, 0));
+	kptree::concurrent_appender<int> app(tr);
+	size_t per=n/threads;
+	return bench::ns_per_node([&]() {
+		std::vector<std::thread> workers;
+		for(unsigned int t=0; t<threads; ++t)
+			workers.push_back(std::thread([&, t]() {
+				if(mode==0)
+					for(size_t i=0; i<per; ++i) app.append_child(own[t], int(i));
+				else if(mode==1)
+					for(size_t i=0; i<per; ++i) app.append_child(top, int(i));
+				else {
+					tree_t side;
+					tree_t::iterator head=side.set_head(0);
+					for(size_t i=1; i<per; ++i) side.append_child(head, int(i));
+					app.move_in_below(own[t], side);
+					}
+				}));
+		for(std::thread& w: workers)
+			w.join();
+		}, per*threads);
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv);
+	unsigned int most=std::max(1u, std::thread::hardware_concurrency());
+
+	tree_t tr;
+	tree_t::iterator top=tr.set_head(0);
+	double serial=bench::ns_per_node([&]() {
+		for(size_t i=0; i<n; ++i)
+			tr.append_child(top, int(i));
+		}, n);
+	std::cout << "serial\t" << n << "\t" << serial << " ns/node" << std::endl;
+
+	std::cout << "threads\town\tshared\tside  (ns/node)" << std::endl;
+	for(unsigned int threads=1; threads<=most; threads*=2)
+		std::cout << threads << "\t" << threaded(n, threads, 0) << "\t" << threaded(n, threads, 1)
+					 << "\t" << threaded(n, threads, 2) << std::endl;
+	}
@@ -0,0 +1,59 @@
+// Batch benchmark: an edit script of appends and moves deep down a chain,
+// applied change by change and inside one batch() scope, for nodes which
+// keep subtree sizes (tree_node_counted_) and nodes which keep depths
+// (tree_node_depth_). Reported as ns per change, including the repair at
+// the end of the batch. Run as
+//
+//    ./batch [number of nodes]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench.hh"
+
+long sum;
+
+template<class Tree>
+void edit(Tree& tr, std::vector<typename Tree::iterator>& chain, size_t changes)
+	{
+	std::mt19937 gen(7);
+	for(size_t i=0; i<changes; ++i) {
+		typename Tree::iterator at=chain[chain.size()/2+gen()%(chain.size()/2)];
+		typename Tree::iterator leaf=tr.append_child(at, int(i));
+		if(i%2==1) tr.move_after(chain[chain.size()/2+gen()%(chain.size()/2)], leaf);
+		}
+	}
+
+template<class Tree>
+void run(const std::string& name, size_t n, size_t changes)
+	{
+	double times[2];
+	for(int batched=0; batched<2; ++batched) {
+		Tree tr;
+		std::vector<typename Tree::iterator> chain;
+		typename Tree::iterator it=tr.set_head(0);
+		for(size_t i=1; i<n; ++i) {
+			chain.push_back(it);
+			it=tr.append_child(it, int(i));
+			}
+		times[batched]=bench::ns_per_node([&]() {
+			if(batched) {
+				typename Tree::batch_scope b=tr.batch();
+				edit(tr, chain, changes);
+				b.commit();
+				}
+			else edit(tr, chain, changes);
+			}, changes);
+		sum+=tr.size()+tr.max_depth();
+		}
+	std::cout << name << "\t" << times[0] << "\t" << times[1] << std::endl;
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv, 10000);
+
+	std::cout << "nodes\tone by one\tbatched  (ns/change, " << n << "-node chain, " << 10*n << " changes)" << std::endl;
+	run<tree<int, std::allocator<tree_node_counted_<int> > > >("counted", n, 10*n);
+	run<tree<int, std::allocator<tree_node_depth_<int> > > >("depth", n, 10*n);
+	}
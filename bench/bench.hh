@@ -0,0 +1,67 @@
+
+// Shared helpers for the benchmark programs: tree shapes and timing.
+
+#ifndef bench_hh_
+#define bench_hh_
+
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "tree.hh"
+
+namespace bench {
+
+/// One head node with all other nodes as its children.
+template<class Tree>
+void build_wide(Tree& tr, size_t n)
+	{
+	typename Tree::iterator top=tr.set_head(0);
+	for(size_t i=1; i<n; ++i)
+		tr.append_child(top, typename Tree::value_type(i));
+	}
+
+/// A single chain of nodes, each one the only child of the previous one.
+template<class Tree>
+void build_deep(Tree& tr, size_t n)
+	{
+	typename Tree::iterator it=tr.set_head(0);
+	for(size_t i=1; i<n; ++i)
+		it=tr.append_child(it, typename Tree::value_type(i));
+	}
+
+/// Every node gets attached below a uniformly chosen earlier node.
+template<class Tree>
+void build_random(Tree& tr, size_t n)
+	{
+	std::mt19937 gen(42);
+	std::vector<typename Tree::iterator> nodes;
+	nodes.reserve(n);
+	nodes.push_back(tr.set_head(0));
+	for(size_t i=1; i<n; ++i) {
+		std::uniform_int_distribution<size_t> pick(0, nodes.size()-1);
+		nodes.push_back(tr.append_child(nodes[pick(gen)], typename Tree::value_type(i)));
+		}
+	}
+
+/// Run f once and return the time it took, divided by n, in nanoseconds.
+template<class F>
+double ns_per_node(F f, size_t n)
+	{
+	std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+	f();
+	std::chrono::steady_clock::time_point stop=std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(stop-start).count()/n;
+	}
+
+/// Number of nodes from the command line, or the given default.
+inline size_t nodes_from_args(int argc, char **argv, size_t dflt=1000000)
+	{
+	if(argc>1)
+		return std::strtoul(argv[1], 0, 10);
+	return dflt;
+	}
+
+}
+
+#endif
@@ -0,0 +1,46 @@
+
+// Breadth-first traversal benchmark: the queued iterator against the
+// level-order iterator, with pre-order as the baseline, on wide, deep and
+// random trees. Reported as ns per node. Run as
+//
+//    ./bfs [number of nodes]
+
+#include <iostream>
+#include "bench.hh"
+
+typedef tree<int> tree_t;
+
+long sum;
+
+template<class Iter>
+void walk(Iter it, Iter end)
+	{
+	while(it!=end) {
+		sum+=*it;
+		++it;
+		}
+	}
+
+void run(const char *shape, void (*build)(tree_t&, size_t), size_t n)
+	{
+	tree_t tr;
+	build(tr, n);
+
+	double pre=bench::ns_per_node([&]() { walk(tr.begin(), tr.end()); }, n);
+	double queued=bench::ns_per_node([&]() { walk(tr.begin_breadth_first(), tr.end_breadth_first()); }, n);
+	double level=bench::ns_per_node([&]() { walk(tr.begin_level_order(), tr.end_level_order()); }, n);
+
+	std::cout << shape << "\t" << n << "\t" 
+				 << pre << "\t" << queued << "\t" << level << std::endl;
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv);
+
+	std::cout << "shape\tnodes\tpre_order\tqueued\tlevel_order  (ns/node)" << std::endl;
+	run("wide",   bench::build_wide<tree_t>,   n);
+	run("deep",   bench::build_deep<tree_t>,   n);
+	run("random", bench::build_random<tree_t>, n);
+	if(sum==0) std::cout << std::endl;
+	}
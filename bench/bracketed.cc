@@ -0,0 +1,85 @@
+// Bracketed text benchmark: the recursive printer that tree_util.hh used
+// to have, against the current single-pass writer, and the parser reading
+// the text back, on wide, deep and random trees. Reported as ns per node
+// and MB/s of text. Run as
+//
+//    ./bracketed [number of nodes]
+//
+// The recursive printer needs a stack frame per level, so it is left out
+// for the deep chain.
+
+#include <iostream>
+#include <sstream>
+#include "bench.hh"
+#include "tree_util.hh"
+
+typedef tree<int> tree_t;
+
+/// The printer as it was, calling number_of_siblings on every internal node.
+void print_recursive(const tree_t& t, tree_t::iterator iRoot, std::ostream& str)
+	{
+	if (t.number_of_children(iRoot) == 0) {
+		str << *iRoot;
+		}
+	else {
+		str << *iRoot;
+		str << "(";
+		int siblingCount = t.number_of_siblings(t.begin(iRoot));
+		int siblingNum;
+		tree_t::sibling_iterator iChildren;
+		for (iChildren = t.begin(iRoot), siblingNum = 0; iChildren != t.end(iRoot); ++iChildren, ++siblingNum) {
+			print_recursive(t,iChildren,str);
+			if (siblingNum != siblingCount ) {
+				str << ", ";
+				}
+			}
+		str << ")";
+		}
+	}
+
+double mb_per_s(double ns_per_node, size_t n, size_t bytes)
+	{
+	return bytes/(ns_per_node*n)*1000.0;
+	}
+
+void run(const char *shape, void (*build)(tree_t&, size_t), size_t n, bool with_recursive=true)
+	{
+	tree_t tr;
+	build(tr, n);
+
+	double old_print=0;
+	if(with_recursive)
+		old_print=bench::ns_per_node([&]() {
+			std::ostringstream str;
+			print_recursive(tr, tr.begin(), str);
+			}, n);
+
+	std::string text;
+	double print=bench::ns_per_node([&]() {
+		std::ostringstream str;
+		kptree::print_tree_bracketed(tr, str);
+		text=str.str();
+		}, n);
+
+	tree_t back;
+	double parse=bench::ns_per_node([&]() {
+		std::istringstream str(text);
+		kptree::parse_bracketed(str, back);
+		}, n);
+	if(back.size()!=n)
+		std::cout << "parse lost nodes" << std::endl;
+
+	std::cout << shape << "\t" << n << "\t" << text.size() << "\t" << old_print << "\t"
+				 << print << " (" << mb_per_s(print, n, text.size()) << " MB/s)\t"
+				 << parse << " (" << mb_per_s(parse, n, text.size()) << " MB/s)" << std::endl;
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv);
+
+	std::cout << "shape\tnodes\tbytes\trecursive\tprint\tparse  (ns/node)" << std::endl;
+	run("wide",   bench::build_wide<tree_t>,   n);
+	run("deep",   bench::build_deep<tree_t>,   n, false);
+	run("random", bench::build_random<tree_t>, n);
+	}
@@ -0,0 +1,55 @@
+// Build benchmark: making a tree out of many subtrees produced separately,
+// by building them one after the other and moving each in on its own, by
+// moving them all in at once, and with kptree::parallel_build. Reported
+// as ns per node. Run as
+//
+//    ./build [number of nodes]
+
+#include <iostream>
+#include <vector>
+#include "bench.hh"
+#include "tree_parallel.hh"
+
+typedef tree<int> tree_t;
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv);
+
+	std::cout << "subtrees\tnodes\tone by one\tat once\tsplice only\tparallel  (ns/node)" << std::endl;
+	size_t counts[]={ 10, 1000, 100000 };
+	for(size_t c=0; c<3; ++c) {
+		size_t subtrees=counts[c], per=n/subtrees, total=subtrees*per+1;
+		auto factory=[per](size_t i) {
+			tree_t tr;
+			bench::build_random(tr, per);
+			*tr.begin()=int(i);
+			return tr;
+			};
+
+		tree_t one;
+		tree_t::iterator top=one.set_head(0);
+		double single=bench::ns_per_node([&]() {
+			for(size_t i=0; i<subtrees; ++i) {
+				tree_t sub=factory(i);
+				one.move_in_below(top, sub);
+				}
+			}, total);
+
+		tree_t all;
+		top=all.set_head(0);
+		std::vector<tree_t> subs;
+		double batch_build=bench::ns_per_node([&]() {
+			for(size_t i=0; i<subtrees; ++i)
+				subs.push_back(factory(i));
+			}, total);
+		double splice=bench::ns_per_node([&]() { all.move_in_below(top, subs.begin(), subs.end()); }, total);
+
+		tree_t par;
+		top=par.set_head(0);
+		double parallel=bench::ns_per_node([&]() { kptree::parallel_build(par, top, subtrees, factory); }, total);
+
+		std::cout << subtrees << "\t\t" << total << "\t" << single << "\t\t" << batch_build+splice << "\t"
+					 << splice << "\t\t" << parallel << std::endl;
+		}
+	}
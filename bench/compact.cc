@@ -0,0 +1,47 @@
+// Compact node benchmark: trees of ints with nodes holding pointers, from
+// std::allocator and from the pool allocator, against compact nodes
+// holding 32-bit indices. Reports the bytes per node and the time to build
+// a random tree, to walk it in pre-order, post-order and along the
+// siblings of the top, to copy and to destroy it, as ns per node. Run as
+//
+//    ./compact [number of nodes]
+
+#include <iostream>
+#include <string>
+#include "bench.hh"
+
+long sum;
+
+template<class Tree>
+void run(const std::string& name, size_t bytes, size_t n)
+	{
+	Tree *tr=new Tree;
+	double build=bench::ns_per_node([&]() { bench::build_random(*tr, n); }, n);
+	double pre=bench::ns_per_node([&]() {
+		for(typename Tree::iterator it=tr->begin(); it!=tr->end(); ++it) sum+=*it;
+		}, n);
+	double post=bench::ns_per_node([&]() {
+		for(typename Tree::post_order_iterator it=tr->begin_post(); it!=tr->end_post(); ++it) sum+=*it;
+		}, n);
+	Tree wide;
+	bench::build_wide(wide, n);
+	double siblings=bench::ns_per_node([&]() {
+		for(typename Tree::sibling_iterator it=wide.begin(wide.begin()); it!=wide.end(wide.begin()); ++it) sum+=*it;
+		}, n);
+	Tree *copy=0;
+	double copying=bench::ns_per_node([&]() { copy=new Tree(*tr); }, n);
+	double destroy=bench::ns_per_node([&]() { delete copy; }, n);
+	delete tr;
+	std::cout << name << "\t" << bytes << "\t" << build << "\t" << pre << "\t" << post << "\t"
+				 << siblings << "\t" << copying << "\t" << destroy << std::endl;
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv);
+
+	std::cout << "nodes\t\tbytes\tbuild\tpre\tpost\tsibling\tcopy\tdestroy  (ns/node)" << std::endl;
+	run<tree<int> >("pointers", sizeof(tree_node_<int>), n);
+	run<tree<int, tree_node_pool_allocator<tree_node_<int> > > >("pointers, pool", sizeof(tree_node_<int>), n);
+	run<tree<int, tree_node_compact_allocator<tree_node_compact_<int> > > >("compact", sizeof(tree_node_compact_<int>), n);
+	}
@@ -0,0 +1,46 @@
+
+// Copy benchmark: copy construction, copy assignment and subtree() on wide,
+// deep and random trees, for plain nodes from std::allocator and from the
+// pool allocator. Reported as ns per node. Run as
+//
+//    ./copy [number of nodes]
+
+#include <iostream>
+#include "bench.hh"
+
+template<class Tree>
+void run(const char *name, const char *shape, void (*build)(Tree&, size_t), size_t n)
+	{
+	Tree tr;
+	build(tr, n);
+
+	Tree *cp=0;
+	double construct=bench::ns_per_node([&]() { cp=new Tree(tr); }, n);
+	delete cp;
+
+	Tree as;
+	as.set_head(0);
+	double assign=bench::ns_per_node([&]() { as=tr; }, n);
+
+	double sub=bench::ns_per_node([&]() { Tree st=tr.subtree(tr.begin(), tr.end()); }, n);
+
+	std::cout << name << "\t" << shape << "\t" << n << "\t" 
+				 << construct << "\t" << assign << "\t" << sub << std::endl;
+	}
+
+template<class Tree>
+void run_all(const char *name, size_t n)
+	{
+	run<Tree>(name, "wide",   bench::build_wide<Tree>,   n);
+	run<Tree>(name, "deep",   bench::build_deep<Tree>,   n);
+	run<Tree>(name, "random", bench::build_random<Tree>, n);
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv);
+
+	std::cout << "alloc\tshape\tnodes\tcopy\tassign\tsubtree  (ns/node)" << std::endl;
+	run_all<tree<int> >("plain", n);
+	run_all<tree<int, tree_node_pool_allocator<tree_node_<int> > > >("pooled", n);
+	}
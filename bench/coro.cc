@@ -0,0 +1,59 @@
+// Coroutine benchmark: the generators of tree_coro.hh against the plain
+// iterator loops they wrap, in ns per node on a random tree; and the time
+// it takes to visit the nodes of a smaller tree when each one first needs
+// a fetch with a fixed latency (a sleep on a thread of its own), one at a
+// time and with growing numbers of fetches in flight, in us per node.
+// Run as
+//
+//    ./coro [number of nodes]
+
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <thread>
+#include "bench.hh"
+#include "tree_coro.hh"
+
+typedef tree<int> tree_t;
+
+long sum;
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv, 1000000);
+	tree_t tr;
+	bench::build_random(tr, n);
+
+	std::cout << "order\titerator\tgenerator  (ns/node)" << std::endl;
+	std::cout << "pre\t" 
+				 << bench::ns_per_node([&]() { for(tree_t::iterator it=tr.begin(); it!=tr.end(); ++it) sum+=*it; }, n) << "\t"
+				 << bench::ns_per_node([&]() { for(auto& it: kptree::pre_order(tr)) sum+=*it; }, n) << std::endl;
+	std::cout << "post\t" 
+				 << bench::ns_per_node([&]() { for(tree_t::post_order_iterator it=tr.begin_post(); it!=tr.end_post(); ++it) sum+=*it; }, n) << "\t"
+				 << bench::ns_per_node([&]() { for(auto& it: kptree::post_order(tr)) sum+=*it; }, n) << std::endl;
+	std::cout << "leaves\t" 
+				 << bench::ns_per_node([&]() { for(tree_t::leaf_iterator it=tr.begin_leaf(); it!=tr.end_leaf(); ++it) sum+=*it; }, n) << "\t"
+				 << bench::ns_per_node([&]() { for(auto& it: kptree::leaves(tr)) sum+=*it; }, n) << std::endl;
+
+	// Fetches of 200us each.
+	const size_t fetched=2000;
+	tree_t small;
+	bench::build_random(small, fetched);
+	auto fetch=[](tree_t::iterator it) {
+		int val=*it;
+		return std::async(std::launch::async, [val]() {
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+			return val;
+			});
+		};
+	std::cout << "in flight\tordered\tunordered  (us/node, 200us per fetch)" << std::endl;
+	for(size_t k: {1, 4, 16, 64}) {
+		double ordered=bench::ns_per_node([&]() {
+			kptree::async_visit(kptree::pre_order(small), k, fetch, [](tree_t::iterator, int val) { sum+=val; });
+			}, fetched);
+		double unordered=bench::ns_per_node([&]() {
+			kptree::async_visit(kptree::pre_order(small), k, fetch, [](tree_t::iterator, int val) { sum+=val; }, false);
+			}, fetched);
+		std::cout << k << "\t" << ordered/1000 << "\t" << unordered/1000 << std::endl;
+		}
+	}
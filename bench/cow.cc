@@ -0,0 +1,74 @@
+// Copy-on-write benchmark: handing readers a consistent view after every
+// change, by copying the whole tree as before and by publishing a cow_tree
+// snapshot, on random trees. Reported as us per change for the updates and
+// ns per node for walking the tree and the snapshot. Run as
+//
+//    ./cow [number of nodes]
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include "bench.hh"
+#include "cow_tree.hh"
+
+typedef tree<int>             tree_t;
+typedef kptree::cow_tree<int> cow_t;
+
+long sum;
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv, 100000);
+
+	std::cout << "nodes\tcopy\tcow  (us/change)\twalk tree\twalk cow  (ns/node)" << std::endl;
+	size_t sizes[]={ n/100, n/10, n };
+	for(size_t s=0; s<3; ++s) {
+		tree_t tr;
+		bench::build_random(tr, sizes[s]);
+		std::vector<tree_t::iterator> nodes;
+		for(tree_t::iterator it=tr.begin(); it!=tr.end(); ++it)
+			nodes.push_back(it);
+		std::mt19937 gen(5);
+		std::uniform_int_distribution<size_t> pick(0, nodes.size()-1);
+		const size_t changes=100;
+		std::vector<tree_t::iterator> targets;
+		std::vector<tree_path<> >     paths;
+		for(size_t c=0; c<changes; ++c) {
+			targets.push_back(nodes[pick(gen)]);
+			paths.push_back(tree_path<>());
+			tr.path_from_iterator(targets.back(), tr.begin(), paths.back());
+			}
+
+		// Change the writer's tree, then copy it for the readers.
+		tree_t published;
+		double copy=bench::ns_per_node([&]() {
+			for(size_t c=0; c<changes; ++c) {
+				*targets[c]=int(c);
+				published=tr;
+				}
+			}, changes)/1000;
+
+		cow_t mine(tr);
+		kptree::cow_publisher<int> pub(mine);
+		double cow=bench::ns_per_node([&]() {
+			for(size_t c=0; c<changes; ++c) {
+				mine.replace(paths[c], int(c));
+				pub.publish(mine);
+				}
+			}, changes)/1000;
+
+		double walk_tree=bench::ns_per_node([&]() {
+			for(tree_t::iterator it=published.begin(); it!=published.end(); ++it)
+				sum+=*it;
+			}, sizes[s]);
+		cow_t snapshot=pub.load();
+		double walk_cow=bench::ns_per_node([&]() {
+			for(cow_t::iterator it=snapshot.begin(); it!=snapshot.end(); ++it)
+				sum+=*it;
+			}, sizes[s]);
+
+		std::cout << sizes[s] << "\t" << copy << "\t" << cow << "\t\t" << walk_tree << "\t\t"
+					 << walk_cow << std::endl;
+		}
+	if(sum==0) std::cout << std::endl;
+	}
@@ -0,0 +1,56 @@
+// Deduplicated storage benchmark: a tree made of copies of a few distinct
+// fragments, taken into a dag_tree, against the tree itself. Reports the
+// memory taken by both, and the time to build the dag_tree, to walk it in
+// pre-order and to expand it back, as ns per node of the tree. Run as
+//
+//    ./dag [number of nodes]
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include "bench.hh"
+#include "tree_dag.hh"
+
+typedef tree<int> tree_t;
+
+long sum;
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv);
+
+	std::cout << "fragments\tnodes\tstored\tmemory saved\tbuild\twalk (tree)\texpand  (ns/node)" << std::endl;
+	size_t counts[]={ 10, 100, 1000 };
+	for(size_t c=0; c<3; ++c) {
+		std::vector<tree_t> fragments(counts[c]);
+		for(size_t f=0; f<fragments.size(); ++f) {
+			bench::build_random(fragments[f], 100);
+			std::mt19937 values(static_cast<unsigned int>(f));
+			for(tree_t::iterator it=fragments[f].begin(); it!=fragments[f].end(); ++it)
+				*it=int(values()%1000);
+			}
+		tree_t tr;
+		tree_t::iterator top=tr.set_head(0);
+		std::mt19937 gen(11);
+		std::uniform_int_distribution<size_t> pick(0, fragments.size()-1);
+		size_t nodes=1;
+		for(; nodes+100<=n; nodes+=100)
+			tr.insert_subtree(tr.end(top), fragments[pick(gen)].begin());
+
+		kptree::dag_tree<int> dag;
+		double build=bench::ns_per_node([&]() { dag.add(tr); }, nodes);
+		dag.release_index();
+		double walk=bench::ns_per_node([&]() {
+			for(kptree::dag_tree<int>::iterator it=dag.begin(); it!=dag.end(); ++it) sum+=*it;
+			}, nodes);
+		double walk_tree=bench::ns_per_node([&]() {
+			for(tree_t::iterator it=tr.begin(); it!=tr.end(); ++it) sum+=*it;
+			}, nodes);
+		tree_t expanded;
+		double expand=bench::ns_per_node([&]() { dag.expand(expanded); }, nodes);
+
+		double saved=double(nodes*sizeof(tree_node_<int>))/dag.memory();
+		std::cout << counts[c] << "\t\t" << nodes << "\t" << dag.stored() << "\t" << saved << "x\t\t"
+					 << build << "\t" << walk << " (" << walk_tree << ")\t" << expand << std::endl;
+		}
+	}
@@ -0,0 +1,51 @@
+// Depth benchmark: depth() of every node in pre-order, as a layout pass
+// would ask for it, and max_depth() after moving one subtree, for plain
+// nodes which walk the tree for both against nodes keeping their depth
+// (tree_node_depth_). Reported as ns per node, on a random and on a deep
+// tree. Run as
+//
+//    ./depth [number of nodes]
+
+#include <iostream>
+#include <string>
+#include "bench.hh"
+
+long sum;
+
+template<class Tree>
+void run(const std::string& name, Tree& tr, size_t n)
+	{
+	double depths=bench::ns_per_node([&]() {
+		for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it) sum+=tr.depth(it);
+		}, n);
+	typename Tree::iterator last=tr.begin();
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it) last=it;
+	sum+=tr.max_depth();
+	double changed=bench::ns_per_node([&]() {
+		for(int i=0; i<100; ++i) {
+			tr.move_ontop(tr.append_child(tr.begin(), 0), last);
+			last=tr.append_child(last, 0);
+			sum+=tr.max_depth();
+			}
+		}, 100*n);
+	std::cout << name << "\t" << depths << "\t" << changed << std::endl;
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv, 100000);
+
+	std::cout << "nodes\t\tdepth()\tmax_depth() after a move  (ns/node)" << std::endl;
+	typedef tree<int>                                          plain_t;
+	typedef tree<int, std::allocator<tree_node_depth_<int> > > kept_t;
+	plain_t plain, plain_deep;
+	bench::build_random(plain, n);
+	bench::build_deep(plain_deep, n/10);
+	kept_t kept, kept_deep;
+	bench::build_random(kept, n);
+	bench::build_deep(kept_deep, n/10);
+	run("random", plain, n);
+	run("random, kept", kept, n);
+	run("deep", plain_deep, n/10);
+	run("deep, kept", kept_deep, n/10);
+	}
@@ -0,0 +1,42 @@
+// Diff benchmark: kptree::diff between a random tree and a copy with a
+// number of values changed and leaves added, and apply_patch of the result
+// on another copy. Reported as ns per node of the tree, with the number of
+// steps and of inserted nodes in the patch. Run as
+//
+//    ./diff [number of nodes]
+
+#include <iostream>
+#include "bench.hh"
+#include "tree_diff.hh"
+
+typedef tree<int> tree_t;
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv, 100000);
+
+	tree_t orig;
+	bench::build_random(orig, n);
+	std::vector<tree_t::iterator> nodes;
+	std::cout << "changes\tdiff\tapply\t(ns/node)\tsteps\tnodes sent" << std::endl;
+	for(size_t changes: {size_t(1), size_t(100), n/100}) {
+		tree_t changed(orig);
+		nodes.clear();
+		for(tree_t::iterator it=changed.begin(); it!=changed.end(); ++it)
+			nodes.push_back(it);
+		std::mt19937 gen(changes);
+		for(size_t i=0; i<changes; ++i) {
+			tree_t::iterator at=nodes[gen()%nodes.size()];
+			if(i%2==0) *at=-1;
+			else       changed.append_child(at, -2);
+			}
+		kptree::tree_patch<int> patch;
+		double diffed=bench::ns_per_node([&]() { patch=kptree::diff(orig, changed); }, n);
+		tree_t copy(orig);
+		double applied=bench::ns_per_node([&]() { kptree::apply_patch(copy, patch); }, n);
+		size_t sent=0;
+		for(const kptree::tree_edit<int>& e: patch)
+			sent+=e.subtree.size();
+		std::cout << changes << "\t" << diffed << "\t" << applied << "\t\t" << patch.size() << "\t" << sent << std::endl;
+		}
+	}
@@ -0,0 +1,40 @@
+
+// Teardown benchmark: time erase_children, clear and the destructor on
+// wide, deep and random trees, reported as ns per node. Run as
+//
+//    ./erase [number of nodes]
+//
+// The deep tree is a single chain, which used to overflow the stack.
+
+#include <iostream>
+#include "bench.hh"
+
+typedef tree<int> tree_t;
+
+void run(const char *shape, void (*build)(tree_t&, size_t), size_t n)
+	{
+	tree_t tr;
+	build(tr, n);
+	double erase_children=bench::ns_per_node([&]() { tr.erase_children(tr.begin()); }, n);
+
+	tr.clear();
+	build(tr, n);
+	double clear=bench::ns_per_node([&]() { tr.clear(); }, n);
+
+	tree_t *tp=new tree_t;
+	build(*tp, n);
+	double destructor=bench::ns_per_node([&]() { delete tp; }, n);
+
+	std::cout << shape << "\t" << n << "\t" 
+				 << erase_children << "\t" << clear << "\t" << destructor << std::endl;
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv);
+
+	std::cout << "shape\tnodes\terase_children\tclear\t~tree  (ns/node)" << std::endl;
+	run("wide",   bench::build_wide<tree_t>,   n);
+	run("deep",   bench::build_deep<tree_t>,   n);
+	run("random", bench::build_random<tree_t>, n);
+	}
@@ -0,0 +1,71 @@
+
+// Frozen tree benchmark: freezing, thawing, and read-only pre-order and
+// child walks over a tree against its frozen copy, on wide, deep and
+// random trees. Reported as ns per node. Run as
+//
+//    ./frozen [number of nodes]
+
+#include <iostream>
+#include "bench.hh"
+#include "frozen_tree.hh"
+
+typedef tree<int>                tree_t;
+typedef kptree::frozen_tree<int> frozen_t;
+
+long sum;
+
+template<class Tree>
+void walk(const Tree& tr)
+	{
+	typename Tree::pre_order_iterator it=tr.begin();
+	while(it!=tr.end()) {
+		sum+=*it;
+		++it;
+		}
+	}
+
+/// Visit every node by going through the children of each node in turn.
+template<class Tree>
+void walk_children(const Tree& tr)
+	{
+	typename Tree::pre_order_iterator it=tr.begin();
+	while(it!=tr.end()) {
+		typename Tree::sibling_iterator ch=tr.begin(it);
+		while(ch!=tr.end(it)) {
+			sum+=*ch;
+			++ch;
+			}
+		++it;
+		}
+	}
+
+void run(const char *shape, void (*build)(tree_t&, size_t), size_t n)
+	{
+	tree_t tr;
+	build(tr, n);
+
+	frozen_t ft;
+	double freeze=bench::ns_per_node([&]() { ft=kptree::freeze(tr); }, n);
+	tree_t back;
+	double thaw=bench::ns_per_node([&]() { ft.thaw(back); }, n);
+
+	double walk_tree=bench::ns_per_node([&]() { walk(tr); }, n);
+	double walk_frozen=bench::ns_per_node([&]() { walk(ft); }, n);
+	double children_tree=bench::ns_per_node([&]() { walk_children(tr); }, n);
+	double children_frozen=bench::ns_per_node([&]() { walk_children(ft); }, n);
+
+	std::cout << shape << "\t" << n << "\t" << freeze << "\t" << thaw << "\t"
+				 << walk_tree << "\t" << walk_frozen << "\t" 
+				 << children_tree << "\t" << children_frozen << std::endl;
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv);
+
+	std::cout << "shape\tnodes\tfreeze\tthaw\twalk\tfrozen\tchildren\tfrozen  (ns/node)" << std::endl;
+	run("wide",   bench::build_wide<tree_t>,   n);
+	run("deep",   bench::build_deep<tree_t>,   n);
+	run("random", bench::build_random<tree_t>, n);
+	if(sum==0) std::cout << std::endl;
+	}
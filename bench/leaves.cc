@@ -0,0 +1,52 @@
+// Leaf scan benchmark: summing the values of all leaves of a random tree
+// and of a wide one, with leaf_iterator, with for_each_leaf_block, and on
+// a frozen copy with for_each_leaf_span. Reported as ns per leaf. Run as
+//
+//    ./leaves [number of nodes]
+
+#include <iostream>
+#include "bench.hh"
+#include "frozen_tree.hh"
+
+typedef tree<int> tree_t;
+
+long sum;
+
+void run(const char *name, const tree_t& tr)
+	{
+	size_t leaves=0;
+	for(tree_t::leaf_iterator it=tr.begin_leaf(); it!=tr.end_leaf(); ++it)
+		++leaves;
+	double iterator=bench::ns_per_node([&]() {
+		for(tree_t::leaf_iterator it=tr.begin_leaf(); it!=tr.end_leaf(); ++it) sum+=*it;
+		}, leaves);
+	double blocks=bench::ns_per_node([&]() {
+		tr.for_each_leaf_block([](int * const *data, size_t n) {
+			long s=0;
+			for(size_t i=0; i<n; ++i) s+=*data[i];
+			sum+=s;
+			});
+		}, leaves);
+	kptree::frozen_tree<int> frozen(tr);
+	double spans=bench::ns_per_node([&]() {
+		frozen.for_each_leaf_span([](const int *values, size_t n) {
+			long s=0;
+			for(size_t i=0; i<n; ++i) s+=values[i];
+			sum+=s;
+			});
+		}, leaves);
+	std::cout << name << "\t" << leaves << "\t" << iterator << "\t" << blocks << "\t" << spans << std::endl;
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv);
+
+	std::cout << "tree\tleaves\titerator\tblocks\tspans  (ns/leaf)" << std::endl;
+	tree_t random;
+	bench::build_random(random, n);
+	run("random", random);
+	tree_t wide;
+	bench::build_wide(wide, n);
+	run("wide", wide);
+	}
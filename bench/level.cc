@@ -0,0 +1,51 @@
+// Level benchmark: all nodes at one depth with begin_fixed/end_fixed, on a
+// sparse tree of long chains, each ending in a few leaves, so that most of
+// the tree lies on paths which never reach that depth. Plain nodes walk
+// the tree, indexed nodes (tree_node_indexed_) step through the lists of
+// the ancestry index; the first pass for those includes building it.
+// Reported as ns per node at that depth. Run as
+//
+//    ./level [number of nodes]
+
+#include <iostream>
+#include <string>
+#include "bench.hh"
+
+long sum;
+
+template<class Tree>
+void run(const std::string& name, size_t n)
+	{
+	// Chains of random length below the top node; only the longest reach 'depth'.
+	Tree tr;
+	typename Tree::iterator top=tr.set_head(0);
+	std::mt19937 gen(1);
+	const unsigned int depth=100;
+	size_t nodes=1, width=0;
+	while(nodes<n) {
+		typename Tree::iterator it=top;
+		unsigned int len=1+gen()%(depth+1);
+		for(unsigned int i=0; i<len; ++i, ++nodes)
+			it=tr.append_child(it, int(i));
+		if(len==depth)
+			for(int i=0; i<4; ++i, ++nodes, ++width)
+				tr.append_child(tr.parent(it), i);
+		}
+	double first=bench::ns_per_node([&]() {
+		for(typename Tree::fixed_depth_iterator it=tr.begin_fixed(top, depth); it!=tr.end_fixed(top, depth); ++it) sum+=*it;
+		}, width);
+	double again=bench::ns_per_node([&]() {
+		for(int i=0; i<10; ++i)
+			for(typename Tree::fixed_depth_iterator it=tr.begin_fixed(top, depth); it!=tr.end_fixed(top, depth); ++it) sum+=*it;
+		}, 10*width);
+	std::cout << name << "\t" << width << "\t" << first << "\t" << again << std::endl;
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv, 1000000);
+
+	std::cout << "nodes\twidth\tfirst\tagain  (ns/node at depth)" << std::endl;
+	run<tree<int> >("plain", n);
+	run<tree<int, std::allocator<tree_node_indexed_<int> > > >("indexed", n);
+	}
@@ -0,0 +1,59 @@
+// Merge benchmark: the searching merge against the hashed one, merging a
+// tree into another one with half of the siblings on each level in
+// common, for trees of a few levels with many siblings per level, like
+// configuration trees. Reported as ns per merged node. Run as
+//
+//    ./merge [number of siblings per level]
+
+#include <functional>
+#include <iostream>
+#include "bench.hh"
+
+typedef tree<int> tree_t;
+
+/// 'width' children below 'top' with keys from 'offset' on; the ten with keys from
+/// width/2 on get children in the same way, down to 'depth' levels. Both trees have
+/// their subtrees under the same keys, so those get merged level by level.
+void build_levels(tree_t& tr, tree_t::iterator top, size_t width, int offset, int depth)
+	{
+	for(size_t i=0; i<width; ++i) {
+		int key=int(i)+offset;
+		tree_t::iterator ch=tr.append_child(top, key);
+		if(depth>1 && key>=int(width/2) && key<int(width/2)+10)
+			build_levels(tr, ch, width, offset, depth-1);
+		}
+	}
+
+void run(size_t width, bool with_search)
+	{
+	tree_t to, from;
+	build_levels(to, to.set_head(0), width, 0, 3);
+	build_levels(from, from.set_head(0), width, int(width/2), 3);
+	size_t n=from.size();
+
+	double searched=0;
+	if(with_search) {
+		tree_t work(to);
+		searched=bench::ns_per_node([&]() { work.merge(work.begin(), from.begin(), false); }, n);
+		}
+	tree_t work(to);
+	double hashed=bench::ns_per_node([&]() {
+		work.merge(work.begin(), from.begin(), std::hash<int>(), std::equal_to<int>(), tree_t::merge_keep(), false);
+		}, n);
+
+	std::cout << width << "\t" << n << "\t" << work.size() << "\t" << searched << "\t" << hashed << std::endl;
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t width=bench::nodes_from_args(argc, argv, 0);
+
+	std::cout << "width\tmerged\tresult\tsearch\thashed  (ns/node)" << std::endl;
+	if(width>0)
+		run(width, true);
+	else {
+		size_t widths[]={ 4, 16, 100, 1000, 10000 };
+		for(size_t i=0; i<5; ++i)
+			run(widths[i], widths[i]<=10000);
+		}
+	}
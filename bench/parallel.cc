@@ -0,0 +1,53 @@
+
+// Parallel traversal benchmark: a per-node scoring pass done serially with
+// a pre-order iterator and with kptree::parallel_for_each on 1, 2, 4 and 8
+// threads, for plain and counted nodes. Reported as ns per node. Run as
+//
+//    ./parallel [number of nodes]
+
+#include <cmath>
+#include <iostream>
+#include "bench.hh"
+#include "tree_parallel.hh"
+
+struct scored {
+	scored(int i=0) : value(i), score(0) {}
+	int    value;
+	double score;
+};
+
+inline void score(scored& s)
+	{
+	double x=s.value;
+	for(int i=0; i<20; ++i)
+		x=std::sqrt(x+i)*1.0001;
+	s.score=x;
+	}
+
+template<class Tree>
+void run(const char *name, size_t n)
+	{
+	Tree tr;
+	bench::build_random(tr, n);
+
+	double serial=bench::ns_per_node([&]() { 
+		typename Tree::iterator it=tr.begin();
+		while(it!=tr.end()) {
+			score(*it);
+			++it;
+			}
+		}, n);
+	std::cout << name << "\t" << n << "\t" << serial;
+	for(unsigned int threads=1; threads<=8; threads*=2) 
+		std::cout << "\t" << bench::ns_per_node([&]() { kptree::parallel_for_each(tr, tr.begin(), score, 0, threads); }, n);
+	std::cout << std::endl;
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv);
+
+	std::cout << "tree\tnodes\tserial\t1\t2\t4\t8 threads  (ns/node)" << std::endl;
+	run<tree<scored> >("plain", n);
+	run<tree<scored, std::allocator<tree_node_counted_<scored> > > >("counted", n);
+	}
@@ -0,0 +1,92 @@
+// Random access benchmark: child(), index() and iterator_from_path() on
+// plain nodes, which walk the siblings, against nodes with child arrays
+// (tree_node_random_access_), on wide, deep and random trees. Also shows
+// the cost of the bigger nodes when building, and of a first round of
+// index() calls after building ('cold'), which builds the arrays.
+// Reported as ns per call (ns per node for building). Run as
+//
+//    ./path [number of nodes]
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include "bench.hh"
+
+typedef tree<int>                                                   plain_t;
+typedef tree<int, std::allocator<tree_node_random_access_<int> > >  random_t;
+
+long sum;
+
+template<class Tree>
+void measure(const char *shape, const char *name, void (*build)(Tree&, size_t), size_t n)
+	{
+	Tree tr;
+	double building=bench::ns_per_node([&]() { build(tr, n); }, n);
+
+	std::vector<typename Tree::iterator> nodes;
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it)
+		nodes.push_back(it);
+	std::mt19937 gen(3);
+	std::uniform_int_distribution<size_t> pick(0, n-1);
+	const size_t queries=2000;
+	std::vector<typename Tree::iterator> picked, parents;
+	std::vector<typename Tree::path_t>   paths;
+	for(size_t q=0; q<queries; ++q) {
+		typename Tree::iterator it=nodes[pick(gen)];
+		if(it.node->parent==0) it=nodes[1];
+		picked.push_back(it);
+		parents.push_back(Tree::parent(it));
+		}
+
+	double cold=bench::ns_per_node([&]() {
+		for(size_t q=0; q<queries; ++q)
+			sum+=tr.index(picked[q]);
+		}, queries);
+	double index=bench::ns_per_node([&]() {
+		for(size_t q=0; q<queries; ++q)
+			sum+=tr.index(picked[q]);
+		}, queries);
+	std::vector<unsigned int> nums;
+	for(size_t q=0; q<queries; ++q)
+		nums.push_back(tr.index(picked[q]));
+	double child=bench::ns_per_node([&]() {
+		for(size_t q=0; q<queries; ++q)
+			sum+=*tr.child(parents[q], nums[q]);
+		}, queries);
+	for(size_t q=0; q<queries; ++q)
+		paths.push_back(tr.path_from_iterator(picked[q], tr.begin()));
+	double path=bench::ns_per_node([&]() {
+		for(size_t q=0; q<queries; ++q)
+			sum+=*tr.iterator_from_path(paths[q], tr.begin());
+		}, queries);
+
+	std::cout << shape << "\t" << name << "\t" << n << "\t" << building << "\t" << cold << "\t"
+				 << index << "\t" << child << "\t" << path << std::endl;
+	}
+
+template<class Tree>
+void deep_path(Tree& tr, size_t n)
+	{
+	// A chain with a few extra siblings on every level, so that paths have something to
+	// skip; bench::build_deep would give paths of zeros only.
+	typename Tree::iterator it=tr.set_head(0);
+	for(size_t i=1; i<n; i+=4) {
+		for(int j=0; j<3; ++j)
+			tr.append_child(it, int(i)+j);
+		it=tr.append_child(it, int(i)+3);
+		}
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv, 100000);
+
+	std::cout << "shape\tnodes\t\tbuild\tcold\tindex\tchild\tpath  (ns)" << std::endl;
+	measure<plain_t>("wide",    "plain",  bench::build_wide<plain_t>,    n);
+	measure<random_t>("wide",   "random", bench::build_wide<random_t>,   n);
+	measure<plain_t>("deep",    "plain",  deep_path<plain_t>,            n);
+	measure<random_t>("deep",   "random", deep_path<random_t>,           n);
+	measure<plain_t>("random",  "plain",  bench::build_random<plain_t>,  n);
+	measure<random_t>("random", "random", bench::build_random<random_t>, n);
+	if(sum==0) std::cout << std::endl;
+	}
@@ -0,0 +1,85 @@
+// Path lookup benchmark: a set of hot paths, as sent by clients, looked up
+// over and over by turning them into a path_t each time, into a tree_path
+// (no allocation), and through a kptree::path_cache, which only walks the
+// tree the first time a path is seen. On random trees and on chains with
+// a few siblings on every level. Reported as ns per lookup. Run as
+//
+//    ./pathcache [number of nodes]
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include "bench.hh"
+#include "tree_path_cache.hh"
+
+typedef tree<int> tree_t;
+
+long sum;
+
+void run(const char *shape, void (*build)(tree_t&, size_t), size_t n)
+	{
+	tree_t tr;
+	build(tr, n);
+
+	std::vector<tree_t::iterator> nodes;
+	for(tree_t::iterator it=tr.begin(); it!=tr.end(); ++it)
+		nodes.push_back(it);
+	std::mt19937 gen(3);
+	std::uniform_int_distribution<size_t> pick(0, n-1);
+	const size_t hot=500, queries=20000;
+	std::vector<std::vector<int> > wire; // the paths as they come in
+	for(size_t h=0; h<hot; ++h)
+		wire.push_back(tr.path_from_iterator(nodes[pick(gen)], tr.begin()));
+	std::vector<size_t> order;
+	std::uniform_int_distribution<size_t> pick_hot(0, hot-1);
+	for(size_t q=0; q<queries; ++q)
+		order.push_back(pick_hot(gen));
+	size_t steps=0;
+	for(size_t h=0; h<hot; ++h)
+		steps+=wire[h].size();
+
+	double plain=bench::ns_per_node([&]() {
+		for(size_t q=0; q<queries; ++q) {
+			const std::vector<int>& in=wire[order[q]];
+			tree_t::path_t path(in.begin(), in.end());
+			sum+=*tr.iterator_from_path(path, tr.begin());
+			}
+		}, queries);
+	double handle=bench::ns_per_node([&]() {
+		for(size_t q=0; q<queries; ++q) {
+			tree_path<> path(wire[order[q]]);
+			sum+=*tr.iterator_from_path(path, tr.begin());
+			}
+		}, queries);
+	std::vector<tree_path<> > handles;
+	for(size_t h=0; h<hot; ++h)
+		handles.push_back(tree_path<>(wire[h]));
+	kptree::path_cache<int> pc(tr, 2*hot);
+	double cached=bench::ns_per_node([&]() {
+		for(size_t q=0; q<queries; ++q)
+			sum+=*pc.find(handles[order[q]]);
+		}, queries);
+
+	std::cout << shape << "\t" << n << "\t" << steps/hot << "\t" << plain << "\t" << handle << "\t"
+				 << cached << std::endl;
+	}
+
+void deep_path(tree_t& tr, size_t n)
+	{
+	// A chain with a few extra siblings on every level, so that paths have something to skip.
+	tree_t::iterator it=tr.set_head(0);
+	for(size_t i=1; i<n; i+=4) {
+		for(int j=0; j<3; ++j)
+			tr.append_child(it, int(i)+j);
+		it=tr.append_child(it, int(i)+3);
+		}
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv, 100000);
+
+	std::cout << "shape\tnodes\tsteps\tpath_t\ttree_path\tcached  (ns)" << std::endl;
+	run("random", bench::build_random<tree_t>, n);
+	run("deep",   deep_path,                   n/50); // paths of n/200 steps
+	}
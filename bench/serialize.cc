@@ -0,0 +1,87 @@
+// Binary file benchmark: writing a tree as bracketed text against the
+// binary format, reading the binary file back into memory, and mapping
+// it, with and without checking the indices, followed by a pre-order
+// walk. Reported as ns per node. Run as
+//
+//    ./serialize [number of nodes]
+//
+// The binary file is written to serialize.bin in the current directory
+// and removed afterwards. Mapping a file that was just written finds it
+// in the page cache; the numbers show the cost of the format, not of the
+// disk. The text printer recurses once per level, so it is left out for
+// the deep chain.
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "bench.hh"
+#include "frozen_tree.hh"
+#include "tree_binary.hh"
+#include "tree_util.hh"
+
+typedef tree<int>                tree_t;
+typedef kptree::frozen_tree<int> frozen_t;
+
+const char *filename="serialize.bin";
+
+long sum;
+
+void walk(const frozen_t& ft)
+	{
+	frozen_t::pre_order_iterator it=ft.begin();
+	while(it!=ft.end()) {
+		sum+=*it;
+		++it;
+		}
+	}
+
+void run(const char *shape, void (*build)(tree_t&, size_t), size_t n, bool with_text=true)
+	{
+	tree_t tr;
+	build(tr, n);
+
+	double text=0;
+	if(with_text)
+		text=bench::ns_per_node([&]() {
+			std::ostringstream str;
+			kptree::print_tree_bracketed(tr, str);
+			sum+=str.str().size();
+			}, n);
+	double write=bench::ns_per_node([&]() {
+		std::ofstream str(filename, std::ios::binary);
+		kptree::write_binary(str, tr);
+		}, n);
+	double read=bench::ns_per_node([&]() {
+		std::ifstream str(filename, std::ios::binary);
+		frozen_t ft=kptree::read_binary<int>(str);
+		walk(ft);
+		}, n);
+	double map=bench::ns_per_node([&]() {
+		frozen_t ft=kptree::map_binary<int>(filename);
+		walk(ft);
+		}, n);
+	double map_unchecked=bench::ns_per_node([&]() {
+		frozen_t ft=kptree::map_binary<int>(filename, false);
+		walk(ft);
+		}, n);
+	double thaw=bench::ns_per_node([&]() {
+		tree_t back;
+		kptree::map_binary<int>(filename).thaw(back);
+		}, n);
+	std::remove(filename);
+
+	std::cout << shape << "\t" << n << "\t" << text << "\t" << write << "\t"
+				 << read << "\t" << map << "\t" << map_unchecked << "\t" << thaw << std::endl;
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv);
+
+	std::cout << "shape\tnodes\ttext\twrite\tread+walk\tmap+walk\tunchecked\tthaw  (ns/node)" << std::endl;
+	run("wide",   bench::build_wide<tree_t>,   n);
+	run("deep",   bench::build_deep<tree_t>,   n, false);
+	run("random", bench::build_random<tree_t>, n);
+	if(sum==0) std::cout << std::endl;
+	}
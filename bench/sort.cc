@@ -0,0 +1,46 @@
+// Sort benchmark: sorting the children of the head, a deep sort of the
+// whole tree, and parallel_sort of the whole tree, on wide, deep and
+// random trees with random values. Reported as ns per node. Run as
+//
+//    ./sort [number of nodes]
+
+#include <iostream>
+#include <random>
+#include "bench.hh"
+#include "tree_parallel.hh"
+
+typedef tree<int> tree_t;
+
+void shuffle_values(tree_t& tr)
+	{
+	std::mt19937 gen(7);
+	std::uniform_int_distribution<int> value(0, 1000000);
+	for(tree_t::iterator it=tr.begin(); it!=tr.end(); ++it)
+		*it=value(gen);
+	}
+
+void run(const char *shape, void (*build)(tree_t&, size_t), size_t n)
+	{
+	tree_t tr;
+	build(tr, n);
+	shuffle_values(tr);
+
+	// Separate copies made up front: copying into memory just freed by another tree
+	// scatters the nodes, which would be measured instead of the sort.
+	tree_t one(tr), two(tr), three(tr);
+	double children=bench::ns_per_node([&]() { one.sort(one.begin(one.begin()), one.end(one.begin())); }, n);
+	double deep=bench::ns_per_node([&]() { two.sort(two.begin(), two.end(), true); }, n);
+	double parallel=bench::ns_per_node([&]() { kptree::parallel_sort(three, three.begin()); }, n);
+
+	std::cout << shape << "\t" << n << "\t" << children << "\t" << deep << "\t" << parallel << std::endl;
+	}
+
+int main(int argc, char **argv)
+	{
+	size_t n=bench::nodes_from_args(argc, argv);
+
+	std::cout << "shape\tnodes\tchildren\tdeep\tparallel  (ns/node)" << std::endl;
+	run("wide",   bench::build_wide<tree_t>,   n);
+	run("deep",   bench::build_deep<tree_t>,   n);
+	run("random", bench::build_random<tree_t>, n);
+	}
@@ -0,0 +1,307 @@
+// Benchmark suite: every iterator type, size and depth queries, copying,
+// sorting, merging, erasing, moving, path resolution, subtree hashing and
+// finding duplicate subtrees, on wide, deep and random trees of each of
+// the given sizes, so that changes to any of these can be measured
+// against each other. Each line gives the time and the number of heap
+// allocations per node of the tree, except for 'path', which is per path
+// (a sample of leaves turned into paths and back). Small trees are run
+// repeatedly. Run as
+//
+//    ./suite [number of nodes ...]
+//
+// which defaults to 1000 10000 100000 1000000 nodes; 'make report' runs it
+// with the sizes in SIZES (100000000 nodes takes some 10Gb of memory).
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "bench.hh"
+#include "tree_hash.hh"
+
+// All heap allocations made while an operation runs get counted.
+static size_t allocations=0;
+
+void *operator new(size_t size)
+	{
+	++allocations;
+	if(void *p=std::malloc(size==0?1:size))
+		return p;
+	throw std::bad_alloc();
+	}
+
+void operator delete(void *p) noexcept
+	{
+	std::free(p);
+	}
+
+typedef tree<int> tree_t;
+
+long sum;
+
+/// Time and allocations of the operations timed so far.
+struct measured {
+	double ns=0;
+	size_t allocs=0;
+	};
+
+template<class F>
+void timed(measured& m, F f)
+	{
+	size_t before=allocations;
+	m.ns+=bench::ns_per_node(f, 1);
+	m.allocs+=allocations-before;
+	}
+
+// The operations; each one does its own setup, times the part to be measured, and
+// returns the number of nodes (or paths) it handled.
+
+size_t pre_order(const tree_t& tr, measured& m)
+	{
+	size_t ret=0;
+	timed(m, [&]() {
+		for(tree_t::pre_order_iterator it=tr.begin(); it!=tr.end(); ++it) { sum+=*it; ++ret; }
+		});
+	return ret;
+	}
+
+size_t post_order(const tree_t& tr, measured& m)
+	{
+	size_t ret=0;
+	timed(m, [&]() {
+		for(tree_t::post_order_iterator it=tr.begin_post(); it!=tr.end_post(); ++it) { sum+=*it; ++ret; }
+		});
+	return ret;
+	}
+
+size_t breadth_first(const tree_t& tr, measured& m)
+	{
+	size_t ret=0;
+	timed(m, [&]() {
+		for(tree_t::breadth_first_queued_iterator it=tr.begin_breadth_first(); it!=tr.end_breadth_first(); ++it) {
+			sum+=*it;
+			++ret;
+			}
+		});
+	return ret;
+	}
+
+size_t level_order(const tree_t& tr, measured& m)
+	{
+	size_t ret=0;
+	timed(m, [&]() {
+		for(tree_t::level_order_iterator it=tr.begin_level_order(); it!=tr.end_level_order(); ++it) { sum+=*it; ++ret; }
+		});
+	return ret;
+	}
+
+/// Walks the deepest level, which is the sparsest one on random trees.
+size_t fixed_depth(const tree_t& tr, measured& m)
+	{
+	unsigned int level=tr.max_depth();
+	timed(m, [&]() {
+		for(tree_t::fixed_depth_iterator it=tr.begin_fixed(tr.begin(), level); tr.is_valid(it); ++it) sum+=*it;
+		});
+	return tr.size();
+	}
+
+size_t leaf(const tree_t& tr, measured& m)
+	{
+	timed(m, [&]() {
+		for(tree_t::leaf_iterator it=tr.begin_leaf(); it!=tr.end_leaf(); ++it) sum+=*it;
+		});
+	return tr.size();
+	}
+
+/// Walks the children of every node.
+size_t sibling(const tree_t& tr, measured& m)
+	{
+	std::vector<tree_t::iterator> nodes;
+	for(tree_t::iterator it=tr.begin(); it!=tr.end(); ++it)
+		nodes.push_back(it);
+	timed(m, [&]() {
+		for(size_t i=0; i<nodes.size(); ++i)
+			for(tree_t::sibling_iterator ch=tr.begin(nodes[i]); ch!=tr.end(nodes[i]); ++ch) sum+=*ch;
+		});
+	return tr.size();
+	}
+
+size_t size(const tree_t& tr, measured& m)
+	{
+	size_t ret=0;
+	timed(m, [&]() { ret=tr.size(); });
+	return ret;
+	}
+
+size_t max_depth(const tree_t& tr, measured& m)
+	{
+	timed(m, [&]() { sum+=tr.max_depth(); });
+	return tr.size();
+	}
+
+/// Takes the depth of every leaf.
+size_t depth(const tree_t& tr, measured& m)
+	{
+	std::vector<tree_t::leaf_iterator> leaves;
+	for(tree_t::leaf_iterator it=tr.begin_leaf(); it!=tr.end_leaf(); ++it)
+		leaves.push_back(it);
+	timed(m, [&]() {
+		for(size_t i=0; i<leaves.size(); ++i)
+			sum+=tr.depth(leaves[i]);
+		});
+	return tr.size();
+	}
+
+size_t copy(const tree_t& tr, measured& m)
+	{
+	tree_t *other=0;
+	timed(m, [&]() { other=new tree_t(tr); });
+	delete other;
+	return tr.size();
+	}
+
+/// Sorts the children of every node (which have values in no particular order).
+size_t sort(const tree_t& tr, measured& m)
+	{
+	tree_t other(tr);
+	timed(m, [&]() { other.sort(other.begin(), other.end(), true); });
+	return other.size();
+	}
+
+/// Merges a copy of the tree into the tree, with the hashed merge: each node has its
+/// counterpart, and the leaves are not duplicated, so nothing gets added.
+size_t merge(const tree_t& tr, measured& m)
+	{
+	tree_t to(tr);
+	timed(m, [&]() {
+		to.merge(to.begin(), tr.begin(), std::hash<int>(), std::equal_to<int>(), tree_t::merge_keep(), false);
+		});
+	return tr.size();
+	}
+
+size_t erase(const tree_t& tr, measured& m)
+	{
+	tree_t other(tr);
+	timed(m, [&]() { other.erase(other.begin()); });
+	return tr.size();
+	}
+
+/// Moves every node but the head up to the top level, after the head, in post-order so
+/// that each one is a leaf by the time it gets moved.
+size_t move(const tree_t& tr, measured& m)
+	{
+	tree_t other(tr);
+	std::vector<tree_t::iterator> nodes;
+	for(tree_t::post_order_iterator it=other.begin_post(); it!=other.end_post(); ++it)
+		nodes.push_back(it);
+	nodes.pop_back(); // the head
+	tree_t::iterator head=other.begin();
+	timed(m, [&]() {
+		for(size_t i=0; i<nodes.size(); ++i)
+			other.move_after(head, nodes[i]);
+		});
+	return nodes.size();
+	}
+
+/// Turns 100 leaves, spread over the tree, into paths and back.
+size_t path(const tree_t& tr, measured& m)
+	{
+	std::vector<tree_t::leaf_iterator> leaves, sample;
+	for(tree_t::leaf_iterator it=tr.begin_leaf(); it!=tr.end_leaf(); ++it)
+		leaves.push_back(it);
+	for(size_t i=0; i<100 && i<leaves.size(); ++i)
+		sample.push_back(leaves[i*leaves.size()/std::min<size_t>(100, leaves.size())]);
+	timed(m, [&]() {
+		for(size_t i=0; i<sample.size(); ++i) {
+			tree_t::path_t p=tr.path_from_iterator(sample[i], tr.begin());
+			sum+=*tr.iterator_from_path(p, tr.begin());
+			}
+		});
+	return sample.size();
+	}
+
+/// Hashes every subtree, keeping the hashes.
+size_t hash(const tree_t& tr, measured& m)
+	{
+	kptree::subtree_hash<int> hashes(tr);
+	timed(m, [&]() {
+		for(tree_t::sibling_iterator it=tr.begin(); it!=tr.end(); ++it)
+			sum+=hashes(it);
+		});
+	return tr.size();
+	}
+
+size_t duplicates(const tree_t& tr, measured& m)
+	{
+	timed(m, [&]() { sum+=kptree::find_duplicate_subtrees(tr).size(); });
+	return tr.size();
+	}
+
+struct operation {
+	const char *name;
+	size_t (*run)(const tree_t&, measured&);
+	};
+
+const operation operations[]={
+	{ "pre_order",     pre_order },
+	{ "post_order",    post_order },
+	{ "breadth_first", breadth_first },
+	{ "level_order",   level_order },
+	{ "fixed_depth",   fixed_depth },
+	{ "leaf",          leaf },
+	{ "sibling",       sibling },
+	{ "size",          size },
+	{ "max_depth",     max_depth },
+	{ "depth",         depth },
+	{ "copy",          copy },
+	{ "sort",          sort },
+	{ "merge",         merge },
+	{ "erase",         erase },
+	{ "move",          move },
+	{ "path",          path },
+	{ "hash",          hash },
+	{ "duplicates",    duplicates }
+	};
+
+void run(const char *shape, void (*build)(tree_t&, size_t), size_t n)
+	{
+	tree_t tr;
+	build(tr, n);
+	std::mt19937 gen(7);
+	std::uniform_int_distribution<int> value(0, 1000000);
+	for(tree_t::iterator it=tr.begin(); it!=tr.end(); ++it)
+		*it=value(gen);
+
+	size_t repeats=std::max<size_t>(1, 1000000/n);
+	for(const operation& op: operations) {
+		measured m;
+		size_t items=0;
+		for(size_t r=0; r<repeats; ++r)
+			items+=op.run(tr, m);
+		char line[128];
+		std::snprintf(line, sizeof(line), "%-14s %-7s %10zu %10.2f %10.3f", op.name, shape, n,
+						  m.ns/std::max<size_t>(1, items), double(m.allocs)/std::max<size_t>(1, items));
+		std::cout << line << std::endl;
+		}
+	}
+
+int main(int argc, char **argv)
+	{
+	std::vector<size_t> sizes;
+	for(int i=1; i<argc; ++i)
+		sizes.push_back(std::strtoul(argv[i], 0, 10));
+	if(sizes.empty())
+		sizes={ 1000, 10000, 100000, 1000000 };
+
+	std::cout << "operation      shape        nodes    ns/item allocs/item" << std::endl;
+	for(size_t n: sizes) {
+		run("wide",   bench::build_wide<tree_t>,   n);
+		run("deep",   bench::build_deep<tree_t>,   n);
+		run("random", bench::build_random<tree_t>, n);
+		}
+	}
@@ -0,0 +1,541 @@
+/*
+
+	Copy-on-write trees: copies of a cow_tree share all their nodes, and
+	a change to one of them only copies the nodes from the head down to
+	the node it touches, leaving every other copy as it was. Hand readers
+	a copy (a snapshot) and they see a tree which never changes, for as
+	long as they hold on to it, while the writer goes on changing its own
+	copy. cow_publisher passes snapshots from writers to readers through
+	one atomic pointer, so no one ever waits for a snapshot to be copied.
+
+	Nodes are addressed by paths as for tree::iterator_from_path, taken
+	from the first head (path_t or tree_path).
+
+   This program is free software: you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef cow_tree_hh_
+#define cow_tree_hh_
+
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "tree.hh"
+
+namespace kptree {
+
+/// Tree with value semantics in which copies share their nodes: copying takes constant
+/// time, and the changes below copy the nodes along the path to the changed node if they
+/// are shared with another copy (they are changed in place otherwise). Different copies
+/// can be used by different threads at the same time, one copy only by one thread.
+template<class T>
+class cow_tree {
+	private:
+		struct node_;
+		typedef std::shared_ptr<node_> node_ptr_;
+		typedef std::vector<node_ptr_> level_;
+
+	public:
+		typedef T value_type;
+		class pre_order_iterator;
+		typedef pre_order_iterator iterator;
+
+		cow_tree();
+		/// Copy all nodes of the given tree.
+		template<class A>
+		explicit cow_tree(const tree<T, A>&);
+
+		/// Depth-first iterator, first accessing the node, then its children. It stays
+		/// valid as long as the cow_tree it came from is neither changed nor destroyed;
+		/// copies made of that tree meanwhile may change freely.
+		class pre_order_iterator {
+			public:
+				typedef T                               value_type;
+				typedef const T*                        pointer;
+				typedef const T&                        reference;
+				typedef size_t                          size_type;
+				typedef ptrdiff_t                       difference_type;
+				typedef std::forward_iterator_tag       iterator_category;
+
+				pre_order_iterator();
+
+				const T&     operator*() const;
+				const T*     operator->() const;
+				bool         operator==(const pre_order_iterator&) const;
+				bool         operator!=(const pre_order_iterator&) const;
+				pre_order_iterator&  operator++();
+				pre_order_iterator   operator++(int);
+
+				/// When called, the next increment skips children of this node.
+				void         skip_children();
+				unsigned int number_of_children() const;
+				/// Number of steps below the heads (0 for a head).
+				int          depth() const;
+				/// The path to this node, as taken by at(), replace() and the like.
+				template<unsigned int N>
+				void         path(tree_path<N>&) const;
+
+			private:
+				friend class cow_tree;
+				explicit pre_order_iterator(const level_ *heads);
+
+				const node_ *node_here_() const;
+
+				std::vector<std::pair<const level_ *, size_t> > stack_; // level and position, per depth
+				bool skip_current_children_;
+		};
+
+		/// Return iterator to the beginning of the tree.
+		pre_order_iterator begin() const;
+		/// Return iterator to the end of the tree.
+		pre_order_iterator end() const;
+		/// Count the total number of nodes.
+		size_t   size() const;
+		/// Check if tree is empty.
+		bool     empty() const;
+		/// Data of the node at the given path. All functions taking a path throw
+		/// std::range_error if it does not lead to a node.
+		template<class Path>
+		const T& at(const Path&) const;
+		/// Replace the contents of 'tr' with copies of all nodes.
+		template<class A>
+		void     copy_to(tree<T, A>& tr) const;
+
+		/// Replace the data of the node at the given path.
+		template<class Path>
+		void     replace(const Path&, const T&);
+		/// Add a node as the last child of the node at 'parent'; an empty path adds a head.
+		template<class Path>
+		void     append_child(const Path& parent, const T&);
+		/// Add a node in front of the node at 'position', or after the last of its
+		/// siblings if the last step of the path is the number of siblings.
+		template<class Path>
+		void     insert(const Path& position, const T&);
+		/// Remove the node at the given path and all nodes below it.
+		template<class Path>
+		void     erase(const Path&);
+		/// Remove all nodes.
+		void     clear();
+
+	private:
+		struct node_ {
+			node_(const T& d) : data(d), size(1) {}
+			~node_();
+			T      data;
+			level_ children;
+			size_t size;  // number of nodes in the subtree
+		};
+
+		/// True if nobody else holds on to 'p', so that it can be changed in place.
+		template<class P>
+		static bool unique_(const std::shared_ptr<P>& p);
+		/// Make the heads and the nodes along the first 'steps' steps of 'path' our own,
+		/// storing the nodes in 'along', and return the children of the last of them.
+		template<class Path>
+		level_&     own_(const Path& path, size_t steps, std::vector<node_ *>& along);
+		static void add_size_(std::vector<node_ *>& along, ptrdiff_t size);
+		static size_t checked_(const level_&, int step, size_t num, size_t limit);
+
+		std::shared_ptr<level_> heads_;
+};
+
+/// Keeps the latest published version of a cow_tree, for any number of threads to take a
+/// snapshot of. Taking a snapshot and publishing a new version are single atomic
+/// operations on a shared pointer: a reader never waits for a writer to finish a change,
+/// and a snapshot stays as it was no matter what gets published after it.
+template<class T>
+class cow_publisher {
+	public:
+		cow_publisher();
+		explicit cow_publisher(cow_tree<T>);
+
+		/// The current version.
+		cow_tree<T> load() const;
+		/// Make 'tr' the current version.
+		void        publish(cow_tree<T> tr);
+		/// Apply f (taking a cow_tree<T>&) to a copy of the current version and publish
+		/// the result, starting over if another version got published meanwhile; f may
+		/// thus be called more than once by concurrent writers.
+		template<class F>
+		void        update(F f);
+
+	private:
+		std::shared_ptr<const cow_tree<T> > current_;
+};
+
+
+
+template<class T>
+cow_tree<T>::cow_tree()
+	{
+	}
+
+template<class T>
+template<class A>
+cow_tree<T>::cow_tree(const tree<T, A>& other)
+	{
+	typedef decltype(other.begin().node) tree_node_ptr;
+
+	// Walk in pre-order while keeping the nodes above the current one, so that deep trees
+	// need no recursion. A node's size is complete once the walk leaves it.
+	heads_=std::make_shared<level_>();
+	std::vector<std::pair<tree_node_ptr, node_ *> > above;
+	for(typename tree<T, A>::iterator it=other.begin(); it!=other.end(); ++it) {
+		while(!above.empty() && above.back().first!=it.node->parent) {
+			node_ *done=above.back().second;
+			above.pop_back();
+			if(!above.empty()) above.back().second->size+=done->size;
+			}
+		level_& level=above.empty()?*heads_:above.back().second->children;
+		level.push_back(std::make_shared<node_>(*it));
+		above.push_back(std::make_pair(it.node, level.back().get()));
+		}
+	while(!above.empty()) {
+		node_ *done=above.back().second;
+		above.pop_back();
+		if(!above.empty()) above.back().second->size+=done->size;
+		}
+	}
+
+template<class T>
+cow_tree<T>::node_::~node_()
+	{
+	// Take the subtree apart from here, so that deep chains of nodes which nobody else
+	// holds on to do not go down recursively through the destructors.
+	level_ pending;
+	pending.swap(children);
+	while(!pending.empty()) {
+		node_ptr_ n=std::move(pending.back());
+		pending.pop_back();
+		if(n.use_count()==1) {
+			for(node_ptr_& child: n->children)
+				pending.push_back(std::move(child));
+			n->children.clear();
+			}
+		}
+	}
+
+template<class T>
+typename cow_tree<T>::pre_order_iterator cow_tree<T>::begin() const
+	{
+	return pre_order_iterator(heads_.get());
+	}
+
+template<class T>
+typename cow_tree<T>::pre_order_iterator cow_tree<T>::end() const
+	{
+	return pre_order_iterator();
+	}
+
+template<class T>
+size_t cow_tree<T>::size() const
+	{
+	size_t ret=0;
+	if(heads_)
+		for(const node_ptr_& head: *heads_)
+			ret+=head->size;
+	return ret;
+	}
+
+template<class T>
+bool cow_tree<T>::empty() const
+	{
+	return !heads_ || heads_->empty();
+	}
+
+template<class T>
+size_t cow_tree<T>::checked_(const level_& level, int step, size_t num, size_t limit)
+	{
+	if(step<0 || size_t(step)>=limit) {
+		if(level.empty() && num>0)
+			throw std::range_error("cow_tree: no more nodes at step "+std::to_string(num));
+		throw std::range_error("cow_tree: out of siblings at step "+std::to_string(num));
+		}
+	return size_t(step);
+	}
+
+template<class T>
+template<class Path>
+const T& cow_tree<T>::at(const Path& path) const
+	{
+	if(path.size()==0)
+		throw std::range_error("cow_tree: empty path");
+	static const level_ none;
+	const level_ *level=heads_?heads_.get():&none;
+	const node_ *n=0;
+	for(size_t step=0; step<path.size(); ++step) {
+		n=(*level)[checked_(*level, path[step], step, level->size())].get();
+		level=&n->children;
+		}
+	return n->data;
+	}
+
+template<class T>
+template<class A>
+void cow_tree<T>::copy_to(tree<T, A>& tr) const
+	{
+	tr.clear();
+	std::vector<typename tree<T, A>::iterator> above;
+	for(pre_order_iterator it=begin(); it!=end(); ++it) {
+		above.resize(it.depth());
+		if(above.empty()) above.push_back(tr.insert(tr.end(), *it));
+		else              above.push_back(tr.append_child(above.back(), *it));
+		}
+	}
+
+template<class T>
+template<class P>
+bool cow_tree<T>::unique_(const std::shared_ptr<P>& p)
+	{
+	if(p.use_count()!=1) return false;
+	// Whoever let go of it last may have been reading it in another thread; make sure
+	// that is over before we write.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return true;
+	}
+
+template<class T>
+template<class Path>
+typename cow_tree<T>::level_& cow_tree<T>::own_(const Path& path, size_t steps, std::vector<node_ *>& along)
+	{
+	if(!heads_)
+		heads_=std::make_shared<level_>();
+	else if(!unique_(heads_))
+		heads_=std::make_shared<level_>(*heads_);
+	level_ *level=heads_.get();
+	for(size_t step=0; step<steps; ++step) {
+		node_ptr_& n=(*level)[checked_(*level, path[step], step, level->size())];
+		// Once a node got copied, its children are shared by the copy and the original.
+		if(!unique_(n))
+			n=std::make_shared<node_>(*n);
+		along.push_back(n.get());
+		level=&n->children;
+		}
+	return *level;
+	}
+
+template<class T>
+void cow_tree<T>::add_size_(std::vector<node_ *>& along, ptrdiff_t size)
+	{
+	for(node_ *n: along)
+		n->size+=size;
+	}
+
+template<class T>
+template<class Path>
+void cow_tree<T>::replace(const Path& path, const T& x)
+	{
+	if(path.size()==0)
+		throw std::range_error("cow_tree: empty path");
+	std::vector<node_ *> along;
+	level_& level=own_(path, path.size()-1, along);
+	node_ptr_& n=level[checked_(level, path[path.size()-1], path.size()-1, level.size())];
+	if(unique_(n))
+		n->data=x;
+	else {
+		node_ptr_ fresh=std::make_shared<node_>(x);
+		fresh->children=n->children;
+		fresh->size=n->size;
+		n=fresh;
+		}
+	}
+
+template<class T>
+template<class Path>
+void cow_tree<T>::append_child(const Path& parent, const T& x)
+	{
+	std::vector<node_ *> along;
+	level_& level=own_(parent, parent.size(), along);
+	level.push_back(std::make_shared<node_>(x));
+	add_size_(along, 1);
+	}
+
+template<class T>
+template<class Path>
+void cow_tree<T>::insert(const Path& position, const T& x)
+	{
+	if(position.size()==0)
+		throw std::range_error("cow_tree: empty path");
+	std::vector<node_ *> along;
+	level_& level=own_(position, position.size()-1, along);
+	size_t num=checked_(level, position[position.size()-1], position.size()-1, level.size()+1);
+	level.insert(level.begin()+num, std::make_shared<node_>(x));
+	add_size_(along, 1);
+	}
+
+template<class T>
+template<class Path>
+void cow_tree<T>::erase(const Path& path)
+	{
+	if(path.size()==0)
+		throw std::range_error("cow_tree: empty path");
+	std::vector<node_ *> along;
+	level_& level=own_(path, path.size()-1, along);
+	size_t num=checked_(level, path[path.size()-1], path.size()-1, level.size());
+	ptrdiff_t gone=ptrdiff_t(level[num]->size);
+	level.erase(level.begin()+num);
+	add_size_(along, -gone);
+	}
+
+template<class T>
+void cow_tree<T>::clear()
+	{
+	heads_.reset();
+	}
+
+// Iterator
+
+template<class T>
+cow_tree<T>::pre_order_iterator::pre_order_iterator()
+	: skip_current_children_(false)
+	{
+	}
+
+template<class T>
+cow_tree<T>::pre_order_iterator::pre_order_iterator(const level_ *heads)
+	: skip_current_children_(false)
+	{
+	if(heads && !heads->empty())
+		stack_.push_back(std::make_pair(heads, size_t(0)));
+	}
+
+template<class T>
+const typename cow_tree<T>::node_ *cow_tree<T>::pre_order_iterator::node_here_() const
+	{
+	return (*stack_.back().first)[stack_.back().second].get();
+	}
+
+template<class T>
+const T& cow_tree<T>::pre_order_iterator::operator*() const
+	{
+	return node_here_()->data;
+	}
+
+template<class T>
+const T* cow_tree<T>::pre_order_iterator::operator->() const
+	{
+	return &(node_here_()->data);
+	}
+
+template<class T>
+bool cow_tree<T>::pre_order_iterator::operator==(const pre_order_iterator& other) const
+	{
+	if(stack_.empty() || other.stack_.empty()) return stack_.empty()==other.stack_.empty();
+	return stack_.back()==other.stack_.back();
+	}
+
+template<class T>
+bool cow_tree<T>::pre_order_iterator::operator!=(const pre_order_iterator& other) const
+	{
+	return !(*this==other);
+	}
+
+template<class T>
+typename cow_tree<T>::pre_order_iterator& cow_tree<T>::pre_order_iterator::operator++()
+	{
+	assert(!stack_.empty());
+	const node_ *n=node_here_();
+	if(!skip_current_children_ && !n->children.empty()) {
+		stack_.push_back(std::make_pair(&n->children, size_t(0)));
+		return *this;
+		}
+	skip_current_children_=false;
+	while(!stack_.empty() && ++stack_.back().second==stack_.back().first->size())
+		stack_.pop_back();
+	return *this;
+	}
+
+template<class T>
+typename cow_tree<T>::pre_order_iterator cow_tree<T>::pre_order_iterator::operator++(int)
+	{
+	pre_order_iterator copy=*this;
+	++(*this);
+	return copy;
+	}
+
+template<class T>
+void cow_tree<T>::pre_order_iterator::skip_children()
+	{
+	skip_current_children_=true;
+	}
+
+template<class T>
+unsigned int cow_tree<T>::pre_order_iterator::number_of_children() const
+	{
+	return (unsigned int)node_here_()->children.size();
+	}
+
+template<class T>
+int cow_tree<T>::pre_order_iterator::depth() const
+	{
+	return int(stack_.size())-1;
+	}
+
+template<class T>
+template<unsigned int N>
+void cow_tree<T>::pre_order_iterator::path(tree_path<N>& p) const
+	{
+	p.clear();
+	for(const auto& frame: stack_)
+		p.push_back(int(frame.second));
+	}
+
+// Publisher
+
+template<class T>
+cow_publisher<T>::cow_publisher()
+	: current_(std::make_shared<const cow_tree<T> >())
+	{
+	}
+
+template<class T>
+cow_publisher<T>::cow_publisher(cow_tree<T> tr)
+	: current_(std::make_shared<const cow_tree<T> >(std::move(tr)))
+	{
+	}
+
+template<class T>
+cow_tree<T> cow_publisher<T>::load() const
+	{
+	return *std::atomic_load(&current_);
+	}
+
+template<class T>
+void cow_publisher<T>::publish(cow_tree<T> tr)
+	{
+	std::atomic_store(&current_, std::shared_ptr<const cow_tree<T> >(std::make_shared<const cow_tree<T> >(std::move(tr))));
+	}
+
+template<class T>
+template<class F>
+void cow_publisher<T>::update(F f)
+	{
+	std::shared_ptr<const cow_tree<T> > seen=std::atomic_load(&current_);
+	for(;;) {
+		cow_tree<T> next(*seen);
+		f(next);
+		std::shared_ptr<const cow_tree<T> > fresh=std::make_shared<const cow_tree<T> >(std::move(next));
+		if(std::atomic_compare_exchange_strong(&current_, &seen, fresh))
+			return;
+		}
+	}
+
+}
+
+#endif
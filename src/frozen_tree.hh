@@ -0,0 +1,717 @@
+/*
+
+	A read-only, compact copy of a tree.hh tree. The nodes are stored in
+	pre-order in contiguous arrays: 32-bit indices for the parent, the
+	next sibling and the end of the subtree of each node, and the data in
+	an array of its own. Walking over it touches memory in order, and
+	takes 12 bytes per node plus the data, against five pointers per
+	node for the tree it was made from. A frozen tree can also be a view
+	on arrays owned by someone else, such as a mapped file (see
+	tree_binary.hh).
+
+   This program is free software: you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef frozen_tree_hh_
+#define frozen_tree_hh_
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "tree.hh"
+
+namespace kptree {
+
+template<class T>
+class frozen_tree {
+	public:
+		typedef T             value_type;
+		typedef std::uint32_t index_type;
+		/// Index used for 'no such node' (the parent of a head node, the sibling after the last).
+		static const index_type none=0xffffffff;
+
+		class pre_order_iterator;
+		class sibling_iterator;
+		typedef pre_order_iterator iterator;
+
+		frozen_tree();
+		/// Copy all nodes of the given tree; throws std::length_error if there are too many
+		/// of them for 32-bit indices.
+		template<class A>
+		explicit frozen_tree(const tree<T, A>&);
+		/// Take over node arrays laid out as returned by the accessors below: 'indices'
+		/// holds the parents, next siblings and subtree ends of all nodes one after the other.
+		frozen_tree(std::vector<index_type>&& indices, std::vector<T>&& values);
+		/// View on 'n' nodes in arrays owned elsewhere, laid out as above. The arrays are
+		/// not copied; 'keep' is held on to for as long as the view is in use.
+		frozen_tree(size_t n, const index_type *indices, const T *values,
+						std::shared_ptr<const void> keep=std::shared_ptr<const void>());
+		frozen_tree(const frozen_tree&);
+		frozen_tree(frozen_tree&&);
+		frozen_tree& operator=(const frozen_tree&);
+		frozen_tree& operator=(frozen_tree&&);
+
+		/// Depth-first iterator, first accessing the node, then its children.
+		class pre_order_iterator {
+			public:
+				typedef T                               value_type;
+				typedef const T*                        pointer;
+				typedef const T&                        reference;
+				typedef size_t                          size_type;
+				typedef ptrdiff_t                       difference_type;
+				typedef std::bidirectional_iterator_tag iterator_category;
+
+				pre_order_iterator();
+				pre_order_iterator(const frozen_tree *, index_type);
+				pre_order_iterator(const sibling_iterator&);
+
+				const T&     operator*() const;
+				const T*     operator->() const;
+				bool         operator==(const pre_order_iterator&) const;
+				bool         operator!=(const pre_order_iterator&) const;
+				pre_order_iterator&  operator++();
+				pre_order_iterator&  operator--();
+				pre_order_iterator   operator++(int);
+				pre_order_iterator   operator--(int);
+				pre_order_iterator&  operator+=(unsigned int);
+				pre_order_iterator&  operator-=(unsigned int);
+
+				/// When called, the next increment skips children of this node.
+				void         skip_children();
+				unsigned int number_of_children() const;
+				sibling_iterator begin() const;
+				sibling_iterator end() const;
+
+				const frozen_tree *tr;
+				index_type         node;
+			private:
+				bool skip_current_children_;
+		};
+
+		/// Iterator which traverses only the nodes which are siblings of each other.
+		class sibling_iterator {
+			public:
+				typedef T                               value_type;
+				typedef const T*                        pointer;
+				typedef const T&                        reference;
+				typedef size_t                          size_type;
+				typedef ptrdiff_t                       difference_type;
+				typedef std::forward_iterator_tag       iterator_category;
+
+				sibling_iterator();
+				sibling_iterator(const frozen_tree *, index_type node, index_type parent);
+				sibling_iterator(const pre_order_iterator&);
+
+				const T&     operator*() const;
+				const T*     operator->() const;
+				bool         operator==(const sibling_iterator&) const;
+				bool         operator!=(const sibling_iterator&) const;
+				sibling_iterator&  operator++();
+				sibling_iterator   operator++(int);
+				sibling_iterator&  operator+=(unsigned int);
+
+				unsigned int number_of_children() const;
+				sibling_iterator begin() const;
+				sibling_iterator end() const;
+
+				const frozen_tree *tr;
+				index_type         node;
+				index_type         parent_;
+		};
+
+		/// Return iterator to the beginning of the tree.
+		pre_order_iterator begin() const;
+		/// Return iterator to the end of the tree.
+		pre_order_iterator end() const;
+		/// Return sibling iterator to the first child of given node.
+		sibling_iterator   begin(const pre_order_iterator&) const;
+		/// Return sibling end iterator for children of given node.
+		sibling_iterator   end(const pre_order_iterator&) const;
+
+		/// Return iterator to the parent of a node; end() for a head node.
+		pre_order_iterator parent(const pre_order_iterator&) const;
+		/// Count the total number of nodes.
+		size_t             size() const;
+		/// Count the number of nodes below and including the one at the given position.
+		size_t             size(const pre_order_iterator&) const;
+		/// Check if the frozen tree is empty.
+		bool               empty() const;
+		/// Compute the depth to the root.
+		int                depth(const pre_order_iterator&) const;
+		/// Count the number of children of node at position.
+		unsigned int       number_of_children(const pre_order_iterator&) const;
+		/// Call f(const T *values, size_t n) for each run of leaves which follow each other in
+		/// pre-order, all leaves together in the order of tree::leaf_iterator. As the values
+		/// of such a run sit next to each other, f gets a plain array, over which a loop can be
+		/// vectorised; the search for the runs reads the subtree ends in order.
+		template<class F>
+		void               for_each_leaf_span(F f) const;
+		/// As above, for the leaves strictly below 'top' (as tree::for_each_leaf_block does).
+		template<class F>
+		void               for_each_leaf_span(const pre_order_iterator& top, F f) const;
+
+		/// Build a mutable tree with the same nodes, replacing the content of 'out'.
+		template<class A>
+		void               thaw(tree<T, A>& out) const;
+		/// As above, returning a tree with the default allocator.
+		tree<T>            thaw() const;
+
+		/// The node arrays themselves, size() entries each, indexed by position in pre-order.
+		/// The first three are consecutive in memory, in this order.
+		const index_type  *parents() const;
+		const index_type  *next_siblings() const;
+		const index_type  *subtree_ends() const;
+		const T           *values() const;
+		/// True if the arrays belong to someone else (see the view constructor).
+		bool               is_view() const;
+
+	private:
+		/// Owned arrays, empty for a view.
+		std::vector<index_type>     index_store_;
+		std::vector<T>              data_store_;
+		std::shared_ptr<const void> keep_;
+		bool                        view_;
+
+		size_t            size_;
+		const index_type *parent_, *next_sibling_, *subtree_end_;
+		const T          *data_;
+
+		/// Point the array pointers at 'index' and 'data', for 'n' nodes.
+		void              point_(size_t n, const index_type *index, const T *data);
+		/// The runs of leaves among nodes from..to-1.
+		template<class F>
+		void              leaf_spans_(index_type from, index_type to, F& f) const;
+};
+
+/// Make a frozen copy of a tree.
+template<class T, class A>
+frozen_tree<T> freeze(const tree<T, A>& tr)
+	{
+	return frozen_tree<T>(tr);
+	}
+
+
+
+template<class T>
+const typename frozen_tree<T>::index_type frozen_tree<T>::none;
+
+template<class T>
+frozen_tree<T>::frozen_tree()
+	: view_(false)
+	{
+	point_(0, 0, 0);
+	}
+
+template<class T>
+template<class A>
+frozen_tree<T>::frozen_tree(const tree<T, A>& tr)
+	: view_(false)
+	{
+	typedef typename A::value_type tree_node;
+
+	size_t n=tr.size();
+	if(n>=none)
+		throw std::length_error("frozen_tree: too many nodes for 32-bit indices");
+	index_store_.resize(3*n);
+	data_store_.reserve(n);
+	index_type *parent=index_store_.data();
+	index_type *next_sibling=parent+n;
+	index_type *subtree_end=next_sibling+n;
+
+	// Walk in pre-order, keeping the path from the head to the current node, so that
+	// a node's subtree ends where the walk first leaves it.
+	std::vector<std::pair<const tree_node *, index_type> > path;
+	index_type i=0;
+	for(typename tree<T, A>::pre_order_iterator it=tr.begin(); it!=tr.end(); ++it, ++i) {
+		while(!path.empty() && path.back().first!=it.node->parent) {
+			subtree_end[path.back().second]=i;
+			path.pop_back();
+			}
+		parent[i]=path.empty()?none:path.back().second;
+		data_store_.push_back(*it);
+		path.push_back(std::make_pair(it.node, i));
+		}
+	while(!path.empty()) {
+		subtree_end[path.back().second]=i;
+		path.pop_back();
+		}
+
+	for(index_type j=0; j<n; ++j) {
+		index_type e=subtree_end[j];
+		next_sibling[j]=(e<n && parent[e]==parent[j])?e:none;
+		}
+	point_(n, index_store_.data(), data_store_.data());
+	}
+
+template<class T>
+frozen_tree<T>::frozen_tree(std::vector<index_type>&& indices, std::vector<T>&& values)
+	: index_store_(std::move(indices)), data_store_(std::move(values)), view_(false)
+	{
+	if(index_store_.size()!=3*data_store_.size())
+		throw std::length_error("frozen_tree: index arrays do not match the number of values");
+	point_(data_store_.size(), index_store_.data(), data_store_.data());
+	}
+
+template<class T>
+frozen_tree<T>::frozen_tree(size_t n, const index_type *indices, const T *values,
+									 std::shared_ptr<const void> keep)
+	: keep_(std::move(keep)), view_(true)
+	{
+	point_(n, indices, values);
+	}
+
+template<class T>
+frozen_tree<T>::frozen_tree(const frozen_tree& other)
+	: index_store_(other.index_store_), data_store_(other.data_store_), keep_(other.keep_), view_(other.view_)
+	{
+	if(view_) point_(other.size_, other.parent_, other.data_);
+	else      point_(other.size_, index_store_.data(), data_store_.data());
+	}
+
+template<class T>
+frozen_tree<T>::frozen_tree(frozen_tree&& other)
+	: index_store_(std::move(other.index_store_)), data_store_(std::move(other.data_store_)),
+	  keep_(std::move(other.keep_)), view_(other.view_)
+	{
+	if(view_) point_(other.size_, other.parent_, other.data_);
+	else      point_(other.size_, index_store_.data(), data_store_.data());
+	other.view_=false;
+	other.point_(0, 0, 0);
+	}
+
+template<class T>
+frozen_tree<T>& frozen_tree<T>::operator=(const frozen_tree& other)
+	{
+	if(this!=&other) {
+		frozen_tree copy(other);
+		*this=std::move(copy);
+		}
+	return *this;
+	}
+
+template<class T>
+frozen_tree<T>& frozen_tree<T>::operator=(frozen_tree&& other)
+	{
+	if(this!=&other) {
+		index_store_=std::move(other.index_store_);
+		data_store_=std::move(other.data_store_);
+		keep_=std::move(other.keep_);
+		view_=other.view_;
+		if(view_) point_(other.size_, other.parent_, other.data_);
+		else      point_(other.size_, index_store_.data(), data_store_.data());
+		other.index_store_.clear();
+		other.data_store_.clear();
+		other.view_=false;
+		other.point_(0, 0, 0);
+		}
+	return *this;
+	}
+
+template<class T>
+void frozen_tree<T>::point_(size_t n, const index_type *index, const T *data)
+	{
+	size_=n;
+	parent_=index;
+	next_sibling_=index+n;
+	subtree_end_=index+2*n;
+	data_=data;
+	}
+
+template<class T>
+typename frozen_tree<T>::pre_order_iterator frozen_tree<T>::begin() const
+	{
+	return pre_order_iterator(this, 0);
+	}
+
+template<class T>
+typename frozen_tree<T>::pre_order_iterator frozen_tree<T>::end() const
+	{
+	return pre_order_iterator(this, index_type(size_));
+	}
+
+template<class T>
+typename frozen_tree<T>::sibling_iterator frozen_tree<T>::begin(const pre_order_iterator& pos) const
+	{
+	return pos.begin();
+	}
+
+template<class T>
+typename frozen_tree<T>::sibling_iterator frozen_tree<T>::end(const pre_order_iterator& pos) const
+	{
+	return pos.end();
+	}
+
+template<class T>
+typename frozen_tree<T>::pre_order_iterator frozen_tree<T>::parent(const pre_order_iterator& pos) const
+	{
+	index_type p=parent_[pos.node];
+	if(p==none) return end();
+	return pre_order_iterator(this, p);
+	}
+
+template<class T>
+size_t frozen_tree<T>::size() const
+	{
+	return size_;
+	}
+
+template<class T>
+size_t frozen_tree<T>::size(const pre_order_iterator& pos) const
+	{
+	return subtree_end_[pos.node]-pos.node;
+	}
+
+template<class T>
+bool frozen_tree<T>::empty() const
+	{
+	return size_==0;
+	}
+
+template<class T>
+int frozen_tree<T>::depth(const pre_order_iterator& pos) const
+	{
+	int ret=0;
+	index_type p=parent_[pos.node];
+	while(p!=none) {
+		++ret;
+		p=parent_[p];
+		}
+	return ret;
+	}
+
+template<class T>
+unsigned int frozen_tree<T>::number_of_children(const pre_order_iterator& pos) const
+	{
+	return pos.number_of_children();
+	}
+
+template<class T>
+template<class A>
+void frozen_tree<T>::thaw(tree<T, A>& out) const
+	{
+	out.clear();
+
+	// Keep the path of freshly made nodes, as in the constructor.
+	std::vector<std::pair<index_type, typename tree<T, A>::iterator> > path;
+	for(index_type i=0; i<size_; ++i) {
+		while(!path.empty() && path.back().first!=parent_[i])
+			path.pop_back();
+		typename tree<T, A>::iterator it;
+		if(path.empty()) it=out.insert(out.end(), data_[i]);
+		else             it=out.append_child(path.back().second, data_[i]);
+		path.push_back(std::make_pair(i, it));
+		}
+	}
+
+template<class T>
+tree<T> frozen_tree<T>::thaw() const
+	{
+	tree<T> ret;
+	thaw(ret);
+	return ret;
+	}
+
+template<class T>
+template<class F>
+void frozen_tree<T>::for_each_leaf_span(F f) const
+	{
+	leaf_spans_(0, index_type(size_), f);
+	}
+
+template<class T>
+template<class F>
+void frozen_tree<T>::for_each_leaf_span(const pre_order_iterator& top, F f) const
+	{
+	leaf_spans_(top.node+1, subtree_end_[top.node], f);
+	}
+
+template<class T>
+template<class F>
+void frozen_tree<T>::leaf_spans_(index_type from, index_type to, F& f) const
+	{
+	// A node is a leaf if its subtree ends right after it.
+	index_type i=from;
+	while(i<to) {
+		while(i<to && subtree_end_[i]!=i+1)
+			++i;
+		index_type run=i;
+		while(i<to && subtree_end_[i]==i+1)
+			++i;
+		if(i>run)
+			f(data_+run, size_t(i-run));
+		}
+	}
+
+template<class T>
+const typename frozen_tree<T>::index_type *frozen_tree<T>::parents() const
+	{
+	return parent_;
+	}
+
+template<class T>
+const typename frozen_tree<T>::index_type *frozen_tree<T>::next_siblings() const
+	{
+	return next_sibling_;
+	}
+
+template<class T>
+const typename frozen_tree<T>::index_type *frozen_tree<T>::subtree_ends() const
+	{
+	return subtree_end_;
+	}
+
+template<class T>
+const T *frozen_tree<T>::values() const
+	{
+	return data_;
+	}
+
+template<class T>
+bool frozen_tree<T>::is_view() const
+	{
+	return view_;
+	}
+
+
+// Pre-order iterator
+
+template<class T>
+frozen_tree<T>::pre_order_iterator::pre_order_iterator()
+	: tr(0), node(none), skip_current_children_(false)
+	{
+	}
+
+template<class T>
+frozen_tree<T>::pre_order_iterator::pre_order_iterator(const frozen_tree *t, index_type n)
+	: tr(t), node(n), skip_current_children_(false)
+	{
+	}
+
+template<class T>
+frozen_tree<T>::pre_order_iterator::pre_order_iterator(const sibling_iterator& other)
+	: tr(other.tr), node(other.node), skip_current_children_(false)
+	{
+	// The end of a sibling range continues where the subtree of the parent ends.
+	if(node==none && tr!=0) {
+		if(other.parent_==none) node=index_type(tr->size_);
+		else                    node=tr->subtree_end_[other.parent_];
+		}
+	}
+
+template<class T>
+const T& frozen_tree<T>::pre_order_iterator::operator*() const
+	{
+	return tr->data_[node];
+	}
+
+template<class T>
+const T* frozen_tree<T>::pre_order_iterator::operator->() const
+	{
+	return &(tr->data_[node]);
+	}
+
+template<class T>
+bool frozen_tree<T>::pre_order_iterator::operator==(const pre_order_iterator& other) const
+	{
+	return node==other.node;
+	}
+
+template<class T>
+bool frozen_tree<T>::pre_order_iterator::operator!=(const pre_order_iterator& other) const
+	{
+	return node!=other.node;
+	}
+
+template<class T>
+typename frozen_tree<T>::pre_order_iterator& frozen_tree<T>::pre_order_iterator::operator++()
+	{
+	if(skip_current_children_) {
+		node=tr->subtree_end_[node];
+		skip_current_children_=false;
+		}
+	else ++node;
+	return *this;
+	}
+
+template<class T>
+typename frozen_tree<T>::pre_order_iterator& frozen_tree<T>::pre_order_iterator::operator--()
+	{
+	--node;
+	return *this;
+	}
+
+template<class T>
+typename frozen_tree<T>::pre_order_iterator frozen_tree<T>::pre_order_iterator::operator++(int)
+	{
+	pre_order_iterator copy = *this;
+	++(*this);
+	return copy;
+	}
+
+template<class T>
+typename frozen_tree<T>::pre_order_iterator frozen_tree<T>::pre_order_iterator::operator--(int)
+	{
+	pre_order_iterator copy = *this;
+	--(*this);
+	return copy;
+	}
+
+template<class T>
+typename frozen_tree<T>::pre_order_iterator& frozen_tree<T>::pre_order_iterator::operator+=(unsigned int num)
+	{
+	while(num>0) {
+		++(*this);
+		--num;
+		}
+	return (*this);
+	}
+
+template<class T>
+typename frozen_tree<T>::pre_order_iterator& frozen_tree<T>::pre_order_iterator::operator-=(unsigned int num)
+	{
+	while(num>0) {
+		--(*this);
+		--num;
+		}
+	return (*this);
+	}
+
+template<class T>
+void frozen_tree<T>::pre_order_iterator::skip_children()
+	{
+	skip_current_children_=true;
+	}
+
+template<class T>
+unsigned int frozen_tree<T>::pre_order_iterator::number_of_children() const
+	{
+	unsigned int ret=0;
+	sibling_iterator sib=begin();
+	while(sib!=end()) {
+		++ret;
+		++sib;
+		}
+	return ret;
+	}
+
+template<class T>
+typename frozen_tree<T>::sibling_iterator frozen_tree<T>::pre_order_iterator::begin() const
+	{
+	// The first child, if any, directly follows its parent.
+	if(tr->subtree_end_[node]==node+1) return end();
+	return sibling_iterator(tr, node+1, node);
+	}
+
+template<class T>
+typename frozen_tree<T>::sibling_iterator frozen_tree<T>::pre_order_iterator::end() const
+	{
+	return sibling_iterator(tr, none, node);
+	}
+
+
+// Sibling iterator
+
+template<class T>
+frozen_tree<T>::sibling_iterator::sibling_iterator()
+	: tr(0), node(none), parent_(none)
+	{
+	}
+
+template<class T>
+frozen_tree<T>::sibling_iterator::sibling_iterator(const frozen_tree *t, index_type n, index_type p)
+	: tr(t), node(n), parent_(p)
+	{
+	}
+
+template<class T>
+frozen_tree<T>::sibling_iterator::sibling_iterator(const pre_order_iterator& other)
+	: tr(other.tr), node(other.node), parent_(none)
+	{
+	if(tr!=0 && node<tr->size_) parent_=tr->parent_[node];
+	else                               node=none;
+	}
+
+template<class T>
+const T& frozen_tree<T>::sibling_iterator::operator*() const
+	{
+	return tr->data_[node];
+	}
+
+template<class T>
+const T* frozen_tree<T>::sibling_iterator::operator->() const
+	{
+	return &(tr->data_[node]);
+	}
+
+template<class T>
+bool frozen_tree<T>::sibling_iterator::operator==(const sibling_iterator& other) const
+	{
+	return node==other.node && (node!=none || parent_==other.parent_);
+	}
+
+template<class T>
+bool frozen_tree<T>::sibling_iterator::operator!=(const sibling_iterator& other) const
+	{
+	return !(*this==other);
+	}
+
+template<class T>
+typename frozen_tree<T>::sibling_iterator& frozen_tree<T>::sibling_iterator::operator++()
+	{
+	node=tr->next_sibling_[node];
+	return *this;
+	}
+
+template<class T>
+typename frozen_tree<T>::sibling_iterator frozen_tree<T>::sibling_iterator::operator++(int)
+	{
+	sibling_iterator copy = *this;
+	++(*this);
+	return copy;
+	}
+
+template<class T>
+typename frozen_tree<T>::sibling_iterator& frozen_tree<T>::sibling_iterator::operator+=(unsigned int num)
+	{
+	while(num>0) {
+		++(*this);
+		--num;
+		}
+	return (*this);
+	}
+
+template<class T>
+unsigned int frozen_tree<T>::sibling_iterator::number_of_children() const
+	{
+	return pre_order_iterator(*this).number_of_children();
+	}
+
+template<class T>
+typename frozen_tree<T>::sibling_iterator frozen_tree<T>::sibling_iterator::begin() const
+	{
+	return pre_order_iterator(*this).begin();
+	}
+
+template<class T>
+typename frozen_tree<T>::sibling_iterator frozen_tree<T>::sibling_iterator::end() const
+	{
+	return pre_order_iterator(*this).end();
+	}
+
+}
+
+#endif
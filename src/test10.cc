@@ -0,0 +1,93 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "tree.hh"
+#include "frozen_tree.hh"
+
+// A frozen tree has the same nodes in the same order as the tree it was
+// made from, with the same parents, children and depths, and thaws back
+// into an identical tree.
+
+template<class Tree>
+void print(const Tree& tr)
+	{
+	typename Tree::pre_order_iterator it=tr.begin();
+	while(it!=tr.end()) {
+		for(int i=0; i<tr.depth(it); ++i)
+			std::cout << "  ";
+		std::cout << (*it) << " (" << tr.number_of_children(it) << ")" << std::endl;
+		++it;
+		}
+	std::cout << "--" << std::endl;
+	}
+
+int main(int, char **)
+	{
+	kptree::frozen_tree<std::string> none;
+	std::cout << "empty: " << none.size() << " " << none.empty() << " " << (none.begin()==none.end()) << std::endl;
+
+	tree<std::string> tr;
+	tree<std::string>::iterator html=tr.set_head("html");
+	tree<std::string>::iterator head=tr.append_child(html, "head");
+	tr.append_child(head, "title");
+	tree<std::string>::iterator body=tr.append_child(html, "body");
+	tr.append_child(tr.append_child(body, "h1"), "text");
+	tr.append_child(body, "p");
+	tr.insert(tr.end(), "second head");
+
+	kptree::frozen_tree<std::string> ft=kptree::freeze(tr);
+	print(ft);
+
+	// Children of body, heads, skipping children, walking back.
+	kptree::frozen_tree<std::string>::iterator fb=ft.begin();
+	fb+=3;
+	kptree::frozen_tree<std::string>::sibling_iterator sib=ft.begin(fb);
+	while(sib!=ft.end(fb)) {
+		std::cout << *sib << " parent " << *ft.parent(sib) << " size " << ft.size(sib) << std::endl;
+		++sib;
+		}
+	kptree::frozen_tree<std::string>::sibling_iterator heads=ft.begin();
+	while(heads!=kptree::frozen_tree<std::string>::sibling_iterator(ft.end()))
+		std::cout << "head: " << *heads++ << std::endl;
+	kptree::frozen_tree<std::string>::iterator it=ft.begin();
+	++it;
+	it.skip_children();
+	++it;
+	std::cout << "after head: " << *it << ", before it: " << *(--it) << std::endl;
+	std::cout << "end of body's children continues at: " << *kptree::frozen_tree<std::string>::iterator(ft.end(fb)) << std::endl;
+
+	tree<std::string> back=ft.thaw();
+	print(back);
+	std::cout << "thawed equal: " << tr.equal(tr.begin(), tr.end(), back.begin()) << std::endl;
+
+	// Random trees, counted nodes on the way back.
+	std::mt19937 gen(11);
+	bool ok=true;
+	for(int round=0; round<20; ++round) {
+		tree<int> rt;
+		std::vector<tree<int>::iterator> nodes;
+		nodes.push_back(rt.set_head(0));
+		for(int i=1; i<500; ++i) {
+			std::uniform_int_distribution<size_t> pick(0, nodes.size()-1);
+			nodes.push_back(rt.append_child(nodes[pick(gen)], i));
+			}
+		kptree::frozen_tree<int> rf(rt);
+		tree<int>::iterator a=rt.begin();
+		kptree::frozen_tree<int>::iterator b=rf.begin();
+		while(a!=rt.end()) {
+			if(*a!=*b || rt.depth(a)!=rf.depth(b) || rt.number_of_children(a)!=rf.number_of_children(b)
+				|| rt.size(a)!=rf.size(b)) ok=false;
+			++a; ++b;
+			}
+		if(b!=rf.end()) ok=false;
+		tree<int, std::allocator<tree_node_counted_<int> > > ct;
+		rf.thaw(ct);
+		ct.debug_verify_consistency();
+		if(ct.size()!=rt.size()) ok=false;
+		tree<int, std::allocator<tree_node_counted_<int> > >::iterator c=ct.begin();
+		for(a=rt.begin(); a!=rt.end() && ok; ++a, ++c)
+			if(*a!=*c || rt.depth(a)!=ct.depth(c)) ok=false;
+		}
+	std::cout << "random trees " << (ok?"ok":"FAILED") << std::endl;
+	}
@@ -0,0 +1,124 @@
+#include <iostream>
+#include <random>
+#include <vector>
+#include "tree.hh"
+
+// is_in_subtree and lowest_common_ancestor give the same answers with the
+// ancestry index (tree_node_indexed_) as a plain walk over the parents, also
+// right after every kind of change to the tree.
+
+typedef tree<int>                                               plain_t;
+typedef tree<int, std::allocator<tree_node_indexed_<int> > >    indexed_t;
+
+template<class Tree>
+std::vector<typename Tree::iterator> all_nodes(const Tree& tr)
+	{
+	std::vector<typename Tree::iterator> ret;
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it)
+		ret.push_back(it);
+	return ret;
+	}
+
+template<class Tree>
+bool is_ancestor(typename Tree::iterator top, typename Tree::iterator it)
+	{
+	for(; it.node!=0; it=Tree::parent(it))
+		if(it==top) return true;
+	return false;
+	}
+
+/// Compare all answers against walks over the parents; returns the number of disagreements.
+template<class Tree>
+int check(const Tree& tr, std::mt19937& gen)
+	{
+	std::vector<typename Tree::iterator> nodes=all_nodes(tr);
+	if(nodes.empty()) return 0;
+	int bad=0;
+	std::uniform_int_distribution<size_t> pick(0, nodes.size()-1);
+	for(int q=0; q<200; ++q) {
+		typename Tree::iterator a=nodes[pick(gen)], b=nodes[pick(gen)];
+		if(tr.is_in_subtree(a, b)!=is_ancestor<Tree>(b, a)) ++bad;
+
+		// The proper ancestors of 'a' and 'b' they have in common; the lowest is the answer.
+		typename Tree::iterator lca(0);
+		for(typename Tree::iterator p=Tree::parent(a); p.node!=0; p=Tree::parent(p))
+			if(p!=a && is_ancestor<Tree>(p, Tree::parent(b))) { lca=p; break; }
+		if(a.node->parent==0 || b.node->parent==0) lca=typename Tree::iterator(0);
+		if(tr.lowest_common_ancestor(a, b)!=lca) ++bad;
+
+		// Range form: pre-order from 'b' up to the node after the subtree of 'b'.
+		typename Tree::iterator e=b;
+		e.skip_children();
+		++e;
+		if(tr.is_in_subtree(a, b, e)!=is_ancestor<Tree>(b, a)) ++bad;
+		}
+	return bad;
+	}
+
+template<class Tree>
+void run(const char *name)
+	{
+	std::mt19937 gen(5);
+	Tree tr;
+	tr.set_head(0);
+	int next=1, bad=0;
+	for(int step=0; step<600; ++step) {
+		std::vector<typename Tree::iterator> nodes=all_nodes(tr);
+		std::uniform_int_distribution<size_t> pick(0, nodes.size()-1);
+		typename Tree::iterator a=nodes[pick(gen)], b=nodes[pick(gen)];
+		bool related=is_ancestor<Tree>(a, b) || is_ancestor<Tree>(b, a);
+		switch(step<150?0:gen()%10) {
+			case 0: case 1: tr.append_child(a, next++); break;
+			case 2: if(a.node->parent) tr.insert(a, next++); break;
+			case 3: if(a.node->parent) tr.insert_after(a, next++); break;
+			case 4: if(a.node->parent && !related) tr.move_after(a, b); break;
+			case 5: if(a.node->parent && !related) tr.move_before(a, b); break;
+			case 6: if(!related) tr.swap(a, b); break;
+			case 7: tr.sort(tr.begin(a), tr.end(a), true); break;
+			case 8: if(a.node->parent) tr.wrap(a, next++); break;
+			case 9: if(a.node->parent && nodes.size()>20) tr.erase(a); break;
+			}
+		bad+=check(tr, gen);
+		}
+	std::cout << name << ": " << tr.size() << " nodes, " << bad << " wrong answers" << std::endl;
+
+	tr.flatten(tr.begin());
+	bad=check(tr, gen);
+	Tree cp(tr);
+	bad+=check(cp, gen);
+	tr.clear();
+	tr.set_head(1);
+	tr.append_child(tr.append_child(tr.begin(), 2), 3);
+	bad+=check(tr, gen);
+	std::cout << name << ": after flatten, copy and clear " << bad << " wrong answers" << std::endl;
+
+	// Siblings erased on either side, then new nodes in their place; each step is
+	// checked so that the index is built before the next change.
+	tr.clear();
+	typename Tree::iterator top=tr.set_head(0);
+	std::vector<typename Tree::iterator> kids;
+	for(int i=1; i<=5; ++i) {
+		kids.push_back(tr.append_child(top, i));
+		tr.append_child(kids.back(), 10*i);
+		}
+	bad=check(tr, gen);
+	tr.erase_right_siblings(kids[2]);
+	bad+=check(tr, gen);
+	tr.append_child(tr.append_child(top, 6), 60);
+	bad+=check(tr, gen);
+	tr.erase_left_siblings(kids[2]);
+	bad+=check(tr, gen);
+	tr.insert(kids[2], 7);
+	tr.append_child(kids[2], 70);
+	bad+=check(tr, gen);
+	tr.erase_children(kids[2]);
+	tr.append_child(kids[2], 80);
+	bad+=check(tr, gen);
+	std::cout << name << ": after erasing siblings " << tr.size() << " nodes, " << bad << " wrong answers" << std::endl;
+	}
+
+int main(int, char **)
+	{
+	run<plain_t>("plain");
+	run<indexed_t>("indexed");
+	}
@@ -0,0 +1,117 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "tree.hh"
+#include "frozen_tree.hh"
+#include "tree_binary.hh"
+
+// Trees written with write_binary come back with the same nodes, whether
+// read from a stream or mapped from a file, and damaged files are refused
+// instead of being walked.
+
+struct point {
+	int   x;
+	float y;
+};
+
+template<class Tree>
+void print(const Tree& tr)
+	{
+	typename Tree::pre_order_iterator it=tr.begin();
+	while(it!=tr.end()) {
+		for(int i=0; i<tr.depth(it); ++i)
+			std::cout << "  ";
+		std::cout << (*it) << " (" << tr.number_of_children(it) << ")" << std::endl;
+		++it;
+		}
+	std::cout << "--" << std::endl;
+	}
+
+template<class F>
+void expect_failure(const char *what, F f)
+	{
+	try {
+		f();
+		std::cout << what << ": accepted" << std::endl;
+		}
+	catch(std::runtime_error& ex) {
+		std::cout << what << ": " << ex.what() << std::endl;
+		}
+	}
+
+int main(int, char **)
+	{
+	tree<int> tr;
+	tree<int>::iterator one=tr.set_head(1);
+	tree<int>::iterator two=tr.append_child(one, 2);
+	tr.append_child(two, 3);
+	tr.append_child(two, 4);
+	tr.append_child(tr.append_child(one, 5), 6);
+	tr.insert(tr.end(), 7);
+	tr.append_child(tr.insert(tr.end(), 8), 9);
+
+	std::stringstream str;
+	kptree::write_binary(str, tr);
+	std::string bytes=str.str();
+	std::cout << "bytes: " << bytes.size() << std::endl;
+
+	kptree::frozen_tree<int> rd=kptree::read_binary<int>(str);
+	print(rd);
+	std::cout << "view: " << rd.is_view() << std::endl;
+
+	{
+	std::ofstream out("test12.bin", std::ios::binary);
+	kptree::write_binary(out, kptree::freeze(tr));
+	}
+	kptree::frozen_tree<int> mp=kptree::map_binary<int>("test12.bin");
+	print(mp);
+	std::cout << "view: " << mp.is_view() << std::endl;
+	kptree::frozen_tree<int> copy=mp;
+	mp=kptree::frozen_tree<int>();
+	tree<int> back=copy.thaw();
+	print(back);
+	std::cout << "equal: " << (back.size()==tr.size() && tr.equal(tr.begin(), tr.end(), back.begin())) << std::endl;
+
+	// Empty trees and structured data.
+	std::stringstream empty;
+	kptree::write_binary(empty, tree<int>());
+	std::cout << "empty: " << kptree::read_binary<int>(empty).size() << std::endl;
+
+	tree<point> pts;
+	tree<point>::iterator p0=pts.set_head(point{1, 0.5f});
+	pts.append_child(p0, point{2, 1.5f});
+	pts.append_child(p0, point{3, 2.5f});
+	std::stringstream pstr;
+	kptree::write_binary(pstr, pts);
+	kptree::frozen_tree<point> pf=kptree::read_binary<point>(pstr);
+	for(kptree::frozen_tree<point>::iterator it=pf.begin(); it!=pf.end(); ++it)
+		std::cout << it->x << " " << it->y << " depth " << pf.depth(it) << std::endl;
+
+	// Damaged files.
+	expect_failure("wrong type", [&]() { std::stringstream s(bytes); kptree::read_binary<double>(s); });
+	expect_failure("truncated", [&]() { std::stringstream s(bytes.substr(0, bytes.size()-1)); kptree::read_binary<int>(s); });
+	expect_failure("header only", [&]() { std::stringstream s(bytes.substr(0, 40)); kptree::read_binary<int>(s); });
+	kptree::binary_header_ huge=kptree::binary_header_for_<int>(0xfffffff0);
+	std::string oversized(reinterpret_cast<const char *>(&huge), sizeof(huge));
+	oversized+=bytes.substr(sizeof(huge));
+	expect_failure("oversized count", [&]() { std::stringstream s(oversized); kptree::read_binary<int>(s); });
+	std::string bad=bytes;
+	bad[0]='K';
+	expect_failure("magic", [&]() { std::stringstream s(bad); kptree::read_binary<int>(s); });
+	bad=bytes;
+	bad[40+4]=5; // parent of node 1
+	expect_failure("parent", [&]() { std::stringstream s(bad); kptree::read_binary<int>(s); });
+	bad=bytes;
+	bad[40+2*9*4+4*4]=8; // subtree end of node 4
+	expect_failure("subtree end", [&]() { std::stringstream s(bad); kptree::read_binary<int>(s); });
+	{
+	std::ofstream out("test12.bin", std::ios::binary);
+	out.write(bytes.data(), bytes.size()-4);
+	}
+	expect_failure("mapped truncated", [&]() { kptree::map_binary<int>("test12.bin"); });
+	expect_failure("missing", [&]() { kptree::map_binary<int>("test12.missing"); });
+	std::remove("test12.bin");
+	}
@@ -0,0 +1,85 @@
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "tree.hh"
+#include "tree_util.hh"
+
+// Bracketed text printed by print_tree_bracketed parses back into the
+// same tree, also for trees far deeper than the stack would allow with
+// a recursive printer or parser, and malformed text is refused.
+
+template<class T>
+std::string printed(const tree<T>& tr)
+	{
+	std::ostringstream str;
+	kptree::print_tree_bracketed(tr, str);
+	return str.str();
+	}
+
+template<class T>
+tree<T> parsed(const std::string& text)
+	{
+	std::istringstream str(text);
+	tree<T> tr;
+	kptree::parse_bracketed(str, tr);
+	return tr;
+	}
+
+template<class T>
+void expect_failure(const std::string& text)
+	{
+	try {
+		parsed<T>(text);
+		std::cout << "'" << text << "': accepted" << std::endl;
+		}
+	catch(std::runtime_error& ex) {
+		std::cout << "'" << text << "': " << ex.what() << std::endl;
+		}
+	}
+
+int main(int, char **)
+	{
+	tree<std::string> tr;
+	tree<std::string>::iterator html=tr.set_head("html");
+	tree<std::string>::iterator head=tr.append_child(html, "head");
+	tr.append_child(head, "title");
+	tree<std::string>::iterator body=tr.append_child(html, "body");
+	tr.append_child(tr.append_child(body, "h1"), "some text");
+	tr.append_child(body, "p");
+	tr.insert(tr.end(), "second head");
+	tr.append_child(tr.insert(tr.end(), "third"), "x");
+
+	std::string text=printed(tr);
+	std::cout << text << std::endl;
+	tree<std::string> back=parsed<std::string>(text);
+	std::cout << printed(back) << std::endl;
+	std::cout << "equal: " << (back.size()==tr.size() && tr.equal(tr.begin(), tr.end(), back.begin())) << std::endl;
+
+	std::cout << "subtree: ";
+	kptree::print_subtree_bracketed(tr, body);
+	std::cout << std::endl;
+
+	// Blanks around labels, newlines inside brackets and blank lines.
+	std::cout << printed(parsed<int>("  1 ( 2,3 (4 ,\n 5) ) \r\n\n-6\n")) << std::endl;
+	std::cout << "empty: " << parsed<int>("").size() << " " << parsed<int>("\n\n").size() << std::endl;
+
+	// A chain of nodes too deep for recursion.
+	tree<int> deep;
+	tree<int>::iterator it=deep.set_head(0);
+	for(int i=1; i<1000000; ++i)
+		it=deep.append_child(it, i);
+	std::string deep_text=printed(deep);
+	tree<int> deep_back=parsed<int>(deep_text);
+	std::cout << "deep: " << deep_text.size() << " " << deep_back.size() << " "
+				 << deep_back.max_depth() << " " << (printed(deep_back)==deep_text) << std::endl;
+
+	expect_failure<int>("1(2");
+	expect_failure<int>("1)");
+	expect_failure<int>("1, 2");
+	expect_failure<int>("1(2)3");
+	expect_failure<int>("1(2)(3)");
+	expect_failure<int>("1(x)");
+	expect_failure<int>("1(99999999999)");
+	expect_failure<unsigned int>("1(-2)");
+	}
@@ -0,0 +1,119 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "tree.hh"
+#include "tree_parallel.hh"
+
+// sort() keeps nodes with equal keys in their original order, moves the
+// children along with their parents, copes with trees deeper than the
+// stack, and parallel_sort gives the same tree as a deep sort.
+
+struct item {
+	int key, seq;
+};
+
+bool by_key(const item& a, const item& b)
+	{
+	return a.key<b.key;
+	}
+
+bool same(const item& a, const item& b)
+	{
+	return a.key==b.key && a.seq==b.seq;
+	}
+
+template<class Tree>
+void build(Tree& tr, int n, int keys)
+	{
+	std::mt19937 gen(5);
+	std::uniform_int_distribution<int> key(0, keys-1);
+	std::vector<typename Tree::iterator> nodes;
+	nodes.push_back(tr.set_head(item{key(gen), 0}));
+	for(int i=1; i<n; ++i) {
+		std::uniform_int_distribution<size_t> pick(0, nodes.size()-1);
+		nodes.push_back(tr.append_child(nodes[pick(gen)], item{key(gen), i}));
+		}
+	}
+
+/// Check that the children of every node are in key order, and in order of 'seq' for
+/// equal keys (which is the order in which they were added).
+template<class Tree>
+bool sorted_stably(const Tree& tr)
+	{
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it) {
+		typename Tree::sibling_iterator ch=tr.begin(it), prev=ch;
+		if(ch==tr.end(it)) continue;
+		for(++ch; ch!=tr.end(it); ++ch, ++prev)
+			if(ch->key<prev->key || (ch->key==prev->key && ch->seq<prev->seq)) return false;
+		}
+	return true;
+	}
+
+void print(const tree<std::string>& tr)
+	{
+	for(tree<std::string>::iterator it=tr.begin(); it!=tr.end(); ++it) {
+		for(int i=0; i<tr.depth(it); ++i)
+			std::cout << "  ";
+		std::cout << *it << std::endl;
+		}
+	std::cout << "--" << std::endl;
+	}
+
+template<class Tree>
+void run(const char *name)
+	{
+	Tree tr;
+	build(tr, 20000, 7);
+	Tree copy(tr);
+	tr.sort(tr.begin(tr.begin()), tr.end(tr.begin()), by_key, true);
+	std::cout << name << " deep sort " << (sorted_stably(tr)?"ok":"FAILED") << " size " << tr.size() << std::endl;
+
+	unsigned int threads[]={ 1, 4 };
+	size_t grains[]={ 0, 1, 100 };
+	bool ok=true;
+	for(size_t t=0; t<2; ++t) {
+		for(size_t g=0; g<3; ++g) {
+			Tree par(copy);
+			kptree::parallel_sort(par, par.begin(), by_key, grains[g], threads[t]);
+			if(!par.equal(par.begin(), par.end(), tr.begin(), same)) ok=false;
+			}
+		}
+	std::cout << name << " parallel sort " << (ok?"ok":"FAILED") << std::endl;
+	}
+
+int main(int, char **)
+	{
+	// Partial ranges, heads, and the children moving along.
+	tree<std::string> tr;
+	tree<std::string>::iterator top=tr.set_head("top");
+	const char *names[]={ "f", "b", "e", "a", "d", "c" };
+	for(int i=0; i<6; ++i)
+		tr.append_child(tr.append_child(top, names[i]), std::string("child of ")+names[i]);
+	tr.insert(tr.end(), "second");
+	tr.insert(tr.end(), "first");
+	tree<std::string>::sibling_iterator from=tr.begin(top), to=tr.begin(top);
+	++from;
+	to+=5;
+	tr.sort(from, to);
+	print(tr);
+	tr.sort(tr.begin(), tr.end(), true);
+	print(tr);
+
+	run<tree<item> >("plain");
+	run<tree<item, std::allocator<tree_node_counted_<item> > > >("counted");
+
+	// A chain too deep for recursion, and sorting with the ancestry index in use.
+	tree<int, std::allocator<tree_node_indexed_<int> > > deep;
+	tree<int, std::allocator<tree_node_indexed_<int> > >::iterator it=deep.set_head(0), mid;
+	for(int i=1; i<1000000; ++i) {
+		it=deep.append_child(it, i);
+		if(i%2==0) deep.append_child(it, -i);
+		if(i==500000) mid=it;
+		}
+	std::cout << "deep " << deep.is_in_subtree(it, mid) << std::endl;
+	deep.sort(deep.begin(), deep.end(), true);
+	kptree::parallel_sort(deep, deep.begin(), std::less<int>(), 0, 4);
+	std::cout << "deep " << deep.size() << " " << deep.max_depth() << " " << *deep.child(deep.begin(), 0)
+				 << " " << deep.is_in_subtree(it, mid) << " " << deep.is_in_subtree(mid, it) << std::endl;
+	}
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "tree.hh"
+
+// The hashed merge gives the same tree as the searching merge on levels of
+// any width, with duplicates on either side, and applies the merge policy
+// to each pair of matched nodes.
+
+typedef std::pair<std::string, int> entry;
+
+struct key_hash {
+	size_t operator()(const entry& e) const { return std::hash<std::string>()(e.first); }
+};
+
+struct key_equal {
+	bool operator()(const entry& a, const entry& b) const { return a.first==b.first; }
+};
+
+void print(const tree<entry>& tr)
+	{
+	for(tree<entry>::iterator it=tr.begin(); it!=tr.end(); ++it) {
+		for(int i=0; i<tr.depth(it); ++i)
+			std::cout << "  ";
+		std::cout << it->first << "=" << it->second << std::endl;
+		}
+	std::cout << "--" << std::endl;
+	}
+
+/// A tree with one head, 'width' children below nodes which are not too deep, and labels
+/// from a small range so that many siblings are equal.
+template<class Tree>
+void build(Tree& tr, std::mt19937& gen, int width, int labels)
+	{
+	std::uniform_int_distribution<int> label(0, labels-1), kids(0, width);
+	std::vector<std::pair<typename Tree::iterator, int> > todo(1, std::make_pair(tr.set_head(0), 0));
+	while(!todo.empty()) {
+		typename Tree::iterator it=todo.back().first;
+		int depth=todo.back().second;
+		todo.pop_back();
+		if(depth==3) continue;
+		int n=std::max(kids(gen), depth==0?1:0); // a leaf head cannot get duplicate siblings
+		for(int i=0; i<n; ++i)
+			todo.push_back(std::make_pair(tr.append_child(it, label(gen)), depth+1));
+		}
+	}
+
+template<class Tree>
+void compare(const char *name)
+	{
+	std::mt19937 gen(11);
+	bool ok=true;
+	int widths[]={ 3, 12, 40 };
+	for(int w=0; w<3; ++w) {
+		for(int round=0; round<20; ++round) {
+			for(int dup=0; dup<2; ++dup) {
+				Tree to, from;
+				build(to, gen, widths[w], widths[w]);
+				build(from, gen, widths[w], widths[w]);
+				Tree searched(to), hashed(to);
+				searched.merge(searched.begin(), from.begin(), dup==1);
+				hashed.merge(hashed.begin(), from.begin(), std::hash<int>(), std::equal_to<int>(),
+								 typename Tree::merge_keep(), dup==1);
+				if(searched.size()!=hashed.size() || !searched.equal(searched.begin(), searched.end(), hashed.begin()))
+					ok=false;
+				}
+			}
+		}
+	std::cout << name << " same as searching merge: " << (ok?"yes":"NO") << std::endl;
+	}
+
+int main(int, char **)
+	{
+	tree<entry> config;
+	tree<entry>::iterator top=config.set_head(entry("config", 0));
+	tree<entry>::iterator net=config.append_child(top, entry("net", 1));
+	config.append_child(net, entry("port", 80));
+	config.append_child(net, entry("host", 1));
+	config.append_child(top, entry("log", 2));
+
+	tree<entry> update;
+	tree<entry>::iterator utop=update.set_head(entry("config", 10));
+	tree<entry>::iterator unet=update.append_child(utop, entry("net", 11));
+	update.append_child(unet, entry("port", 8080));
+	update.append_child(unet, entry("timeout", 30));
+	update.append_child(utop, entry("cache", 12));
+
+	tree<entry> kept(config), overwritten(config), combined(config), doubled(config);
+	kept.merge(kept.begin(), update.begin(), key_hash(), key_equal(), tree<entry>::merge_keep(), false);
+	print(kept);
+	overwritten.merge(overwritten.begin(), update.begin(), key_hash(), key_equal(), tree<entry>::merge_overwrite(), false);
+	print(overwritten);
+	combined.merge(combined.begin(), update.begin(), key_hash(), key_equal(),
+						[](entry& present, const entry& merged) { present.second+=merged.second; }, false);
+	print(combined);
+	doubled.merge(doubled.begin(), update.begin(), key_hash(), key_equal(), tree<entry>::merge_keep(), true);
+	print(doubled);
+
+	// Sibling ranges: merge the children of 'net' into the top level.
+	tree<entry> flat(config);
+	flat.merge(flat.begin(flat.begin()), flat.end(flat.begin()), update.begin(unet), update.end(unet),
+				  key_hash(), key_equal(), tree<entry>::merge_overwrite());
+	print(flat);
+
+	compare<tree<int> >("plain");
+	compare<tree<int, std::allocator<tree_node_counted_<int> > > >("counted");
+	}
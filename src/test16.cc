@@ -0,0 +1,150 @@
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "tree.hh"
+
+// child(), sibling(), index(), number_of_children() and the path functions
+// give the same answers with child arrays (tree_node_random_access_) as by
+// walking the siblings, also right after every kind of change to the tree.
+
+typedef tree<int>                                                    plain_t;
+typedef tree<int, std::allocator<tree_node_random_access_<int> > >   random_t;
+
+template<class Tree>
+std::vector<typename Tree::iterator> all_nodes(const Tree& tr)
+	{
+	std::vector<typename Tree::iterator> ret;
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it)
+		ret.push_back(it);
+	return ret;
+	}
+
+/// Number of the node among its siblings, and the child with a given number, by walking.
+template<class Tree>
+unsigned int walked_index(typename Tree::iterator it)
+	{
+	unsigned int ret=0;
+	while(it.node->prev_sibling!=0 && it.node->prev_sibling->parent==it.node->parent && it.node->parent!=0) {
+		it.node=it.node->prev_sibling;
+		++ret;
+		}
+	return ret;
+	}
+
+template<class Tree>
+typename Tree::iterator walked_child(typename Tree::iterator it, unsigned int num)
+	{
+	typename Tree::iterator ch(it.node->first_child);
+	while(num-- && ch.node!=0) ch.node=ch.node->next_sibling;
+	return ch;
+	}
+
+/// Compare all answers against walks along the siblings; returns the number of disagreements.
+template<class Tree>
+int check(Tree& tr, std::mt19937& gen)
+	{
+	std::vector<typename Tree::iterator> nodes=all_nodes(tr);
+	int bad=0;
+	std::uniform_int_distribution<size_t> pick(0, nodes.size()-1);
+	for(int q=0; q<100; ++q) {
+		typename Tree::iterator a=nodes[pick(gen)], b=nodes[pick(gen)];
+		unsigned int kids=0;
+		for(typename Tree::iterator ch(a.node->first_child); ch.node!=0; ch.node=ch.node->next_sibling) ++kids;
+		if(tr.number_of_children(a)!=kids || a.number_of_children()!=kids) ++bad;
+		for(unsigned int i=0; i<kids; ++i)
+			if(tr.child(a, i).node!=walked_child<Tree>(a, i).node) ++bad;
+		if(a.node->parent!=0) {
+			unsigned int ind=walked_index<Tree>(a);
+			if(tr.index(a)!=ind) ++bad;
+			if(tr.sibling(a, ind)!=typename Tree::sibling_iterator(a)) ++bad;
+			if(tr.sibling(a, 0)!=tr.begin(Tree::parent(a))) ++bad;
+			}
+
+		// Paths from the head, and from 'b' to a node below it.
+		typename Tree::path_t path=tr.path_from_iterator(a, tr.begin());
+		if(tr.iterator_from_path(path, tr.begin())!=a) ++bad;
+		typename Tree::iterator below=b;
+		while(below.node->first_child!=0)
+			below=tr.child(below, gen()%tr.number_of_children(below));
+		path=tr.path_from_iterator(below, b);
+		if(tr.iterator_from_path(path, b)!=below) ++bad;
+		}
+	return bad;
+	}
+
+template<class Tree>
+bool is_ancestor(typename Tree::iterator top, typename Tree::iterator it)
+	{
+	for(; it.node!=0; it=Tree::parent(it))
+		if(it==top) return true;
+	return false;
+	}
+
+template<class Tree>
+void run(const char *name)
+	{
+	std::mt19937 gen(5);
+	Tree tr;
+	tr.set_head(0);
+	int next=1, bad=0;
+	for(int step=0; step<800; ++step) {
+		std::vector<typename Tree::iterator> nodes=all_nodes(tr);
+		std::uniform_int_distribution<size_t> pick(0, nodes.size()-1);
+		typename Tree::iterator a=nodes[pick(gen)], b=nodes[pick(gen)];
+		bool related=is_ancestor<Tree>(a, b) || is_ancestor<Tree>(b, a);
+		switch(step<200?0:gen()%13) {
+			case 0: case 1: tr.append_child(a, next++); break;
+			case 2: if(a.node->parent) tr.insert(a, next++); break;
+			case 3: if(a.node->parent) tr.insert_after(a, next++); break;
+			case 4: if(a.node->parent && !related) tr.move_after(a, b); break;
+			case 5: if(a.node->parent && !related) tr.move_before(a, b); break;
+			case 6: if(!related) tr.swap(a, b); break;
+			case 7: tr.sort(tr.begin(a), tr.end(a), true); break;
+			case 8: if(a.node->parent) tr.wrap(a, next++); break;
+			case 9: if(a.node->parent && nodes.size()>30) tr.erase(a); break;
+			case 10: tr.prepend_child(a, next++); break;
+			case 11: if(a.node->parent && a.node->next_sibling) tr.swap(typename Tree::sibling_iterator(a)); break;
+			case 12: if(a.node->parent && nodes.size()>30) tr.flatten(a); break;
+			}
+		bad+=check(tr, gen);
+		}
+	std::cout << name << ": " << tr.size() << " nodes, " << bad << " wrong answers" << std::endl;
+
+	Tree cp(tr);
+	bad=check(cp, gen);
+	typename Tree::iterator top=tr.begin();
+	tr.erase_children(tr.child(top, 0));
+	tr.replace(tr.child(top, 1), next++);
+	bad+=check(tr, gen);
+	std::cout << name << ": after copy, erase_children and replace " << bad << " wrong answers" << std::endl;
+
+	// Siblings erased on either side, once the child arrays have been built.
+	Tree er;
+	typename Tree::iterator etop=er.set_head(0);
+	std::vector<typename Tree::iterator> kids;
+	for(int i=1; i<=5; ++i)
+		kids.push_back(er.append_child(etop, i));
+	bad=check(er, gen);
+	er.erase_right_siblings(kids[3]);
+	bad+=check(er, gen);
+	er.erase_left_siblings(kids[2]);
+	bad+=check(er, gen);
+	std::cout << name << ": after erasing siblings " << er.number_of_children(etop) << " children, " 
+				 << bad << " wrong answers" << std::endl;
+
+	try {
+		typename Tree::path_t path(1, 0);
+		path.push_back(int(tr.number_of_children(top)));
+		tr.iterator_from_path(path, top);
+		}
+	catch(std::range_error& ex) {
+		std::cout << name << ": " << ex.what() << std::endl;
+		}
+	}
+
+int main(int, char **)
+	{
+	run<plain_t>("plain");
+	run<random_t>("random access");
+	}
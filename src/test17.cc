@@ -0,0 +1,180 @@
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "tree.hh"
+#include "tree_path_cache.hh"
+
+// Paths which keep their steps in place lead to the same nodes as path_t,
+// tree::epoch() moves on with every change of shape but not with changes
+// of data, and the path cache gives the same nodes as walking, also after
+// changes to the tree and when paths get evicted.
+
+typedef tree<int>                                                    plain_t;
+typedef tree<int, std::allocator<tree_node_random_access_<int> > >   random_t;
+
+template<class Tree>
+void build(Tree& tr)
+	{
+	typename Tree::iterator top=tr.set_head(0), it=top;
+	int next=1;
+	for(int i=0; i<3; ++i)
+		tr.append_child(top, next++);
+	// A chain deeper than the paths keep in place, with a sibling on every level.
+	for(int depth=0; depth<40; ++depth) {
+		tr.append_child(it, next++);
+		it=tr.append_child(it, next++);
+		}
+	}
+
+template<class Tree>
+void paths(const char *name)
+	{
+	Tree tr;
+	build(tr);
+	int bad=0;
+	size_t deepest=0;
+	tree_path<> path;
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it) {
+		tr.path_from_iterator(it, tr.begin(), path);
+		typename Tree::path_t plain=tr.path_from_iterator(it, tr.begin());
+		if(path.vector()!=plain || tree_path<>(plain)!=path) ++bad;
+		if(tr.iterator_from_path(path, tr.begin())!=it) ++bad;
+		if(path.size()>deepest) deepest=path.size();
+		tree_path<> copied(path), moved(std::move(copied)), assigned;
+		assigned=moved;
+		if(assigned!=path || assigned.hash()!=path.hash()) ++bad;
+		}
+	std::cout << name << ": paths up to " << deepest << " steps, " << bad << " wrong" << std::endl;
+	}
+
+template<class Tree>
+bool moved_on(const Tree& tr, unsigned long& epoch)
+	{
+	unsigned long now=tr.epoch();
+	bool ret=(now!=epoch);
+	epoch=now;
+	return ret;
+	}
+
+void epochs()
+	{
+	plain_t tr;
+	build(tr);
+	unsigned long epoch=tr.epoch();
+	plain_t::iterator top=tr.begin(), a=tr.child(top, 0), b=tr.child(top, 1);
+
+	*a=100;
+	std::cout << "data change: " << moved_on(tr, epoch) << std::endl;
+	tr.append_child(a, 1);
+	std::cout << "append_child: " << moved_on(tr, epoch) << std::endl;
+	tr.insert(b, 2);
+	std::cout << "insert: " << moved_on(tr, epoch) << std::endl;
+	tr.swap(a, b);
+	std::cout << "swap: " << moved_on(tr, epoch) << std::endl;
+	tr.sort(tr.begin(top), tr.end(top));
+	std::cout << "sort: " << moved_on(tr, epoch) << std::endl;
+	tr.move_after(b, a);
+	std::cout << "move_after: " << moved_on(tr, epoch) << std::endl;
+	tr.erase(a);
+	std::cout << "erase: " << moved_on(tr, epoch) << std::endl;
+	std::cout << "nothing: " << moved_on(tr, epoch) << std::endl;
+	plain_t other;
+	other.set_head(5);
+	tr=other;
+	std::cout << "assignment: " << moved_on(tr, epoch) << std::endl;
+	tr.clear();
+	std::cout << "clear: " << moved_on(tr, epoch) << std::endl;
+
+	// Moving a tree in empties it, which counts as a change of the tree moved from.
+	plain_t from;
+	tr.set_head(0);
+	for(int way=0; way<3; ++way) {
+		from.set_head(way);
+		from.append_child(from.begin(), 10+way);
+		unsigned long from_epoch=from.epoch();
+		kptree::path_cache<int, std::allocator<tree_node_<int> > > pc(from);
+		pc.find(tree_path<>{0, 0});
+		switch(way) {
+			case 0: tr.move_in(tr.begin(), from); break;
+			case 1: tr.move_in_below(tr.begin(), from); break;
+			case 2: tr.move_in_as_nth_child(tr.begin(), 0, from); break;
+			}
+		bool missed=false;
+		try {
+			pc.find(tree_path<>{0, 0});
+			}
+		catch(std::range_error&) {
+			missed=(pc.misses()==2);
+			}
+		std::cout << "moved in, other: " << moved_on(from, from_epoch) << " " << missed << std::endl;
+		}
+	}
+
+template<class A>
+void cache(const char *name)
+	{
+	typedef tree<int, A> Tree;
+	Tree tr;
+	build(tr);
+	kptree::path_cache<int, A> pc(tr, 8);
+	std::vector<tree_path<> > wanted;
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it) {
+		wanted.push_back(tree_path<>());
+		tr.path_from_iterator(it, tr.begin(), wanted.back());
+		}
+
+	int bad=0;
+	for(int round=0; round<3; ++round)
+		for(size_t i=0; i<wanted.size(); i+=11) // 8 paths, all kept
+			if(pc.find(wanted[i])!=tr.iterator_from_path(wanted[i], tr.begin())) ++bad;
+	std::cout << name << ": " << pc.hits() << " hits, " << pc.misses() << " misses, "
+				 << pc.size() << " kept, " << bad << " wrong" << std::endl;
+
+	// Changing the tree lets the same paths lead to other nodes.
+	tr.erase(tr.child(tr.begin(), 0));
+	for(size_t i=0; i<wanted.size(); i+=11) {
+		typename Tree::iterator walked, cached;
+		try {
+			walked=tr.iterator_from_path(wanted[i], tr.begin());
+			}
+		catch(std::range_error&) {
+			}
+		try {
+			cached=pc.find(wanted[i]);
+			}
+		catch(std::range_error&) {
+			}
+		if(walked!=cached) ++bad;
+		}
+	std::cout << name << ": after erase " << pc.hits() << " hits, " << pc.misses() << " misses, "
+				 << bad << " wrong" << std::endl;
+
+	// Going round more paths than fit evicts the least recently used ones.
+	wanted.clear();
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it) {
+		wanted.push_back(tree_path<>());
+		tr.path_from_iterator(it, tr.begin(), wanted.back());
+		}
+	for(int round=0; round<2; ++round)
+		for(size_t i=0; i<9; ++i)
+			if(pc.find(wanted[i])!=tr.iterator_from_path(wanted[i], tr.begin())) ++bad;
+	std::cout << name << ": round of 9 " << pc.hits() << " hits, " << pc.misses() << " misses, "
+				 << pc.size() << " kept, " << bad << " wrong" << std::endl;
+
+	try {
+		pc.find(tree_path<>{0, 99});
+		}
+	catch(std::range_error& ex) {
+		std::cout << name << ": " << ex.what() << std::endl;
+		}
+	}
+
+int main(int, char **)
+	{
+	paths<plain_t>("plain");
+	paths<random_t>("random access");
+	epochs();
+	cache<std::allocator<tree_node_<int> > >("plain");
+	cache<std::allocator<tree_node_random_access_<int> > >("random access");
+	}
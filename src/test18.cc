@@ -0,0 +1,202 @@
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "tree.hh"
+#include "cow_tree.hh"
+
+// A cow_tree holds the same nodes as the tree it was made from, changes to
+// it leave copies made earlier as they were while sharing all nodes which
+// are not on the path to the change, and readers of published snapshots
+// always see a consistent tree while writers carry on.
+
+typedef kptree::cow_tree<int> cow_t;
+
+void build(tree<int>& tr, int n)
+	{
+	std::mt19937 gen(3);
+	std::vector<tree<int>::iterator> nodes;
+	nodes.push_back(tr.set_head(0));
+	for(int i=1; i<n; ++i) {
+		std::uniform_int_distribution<size_t> pick(0, nodes.size()-1);
+		nodes.push_back(tr.append_child(nodes[pick(gen)], i));
+		}
+	}
+
+/// Data and depth of all nodes in pre-order.
+std::vector<std::pair<int, int> > listing(const cow_t& c)
+	{
+	std::vector<std::pair<int, int> > ret;
+	for(cow_t::iterator it=c.begin(); it!=c.end(); ++it)
+		ret.push_back(std::make_pair(*it, it.depth()));
+	return ret;
+	}
+
+std::vector<std::pair<int, int> > listing(const tree<int>& tr)
+	{
+	std::vector<std::pair<int, int> > ret;
+	for(tree<int>::iterator it=tr.begin(); it!=tr.end(); ++it)
+		ret.push_back(std::make_pair(*it, tr.depth(it)));
+	return ret;
+	}
+
+/// Number of nodes which two trees have in common (rather than equal copies of them).
+size_t shared(const cow_t& a, const cow_t& b)
+	{
+	std::set<const int *> in_a;
+	for(cow_t::iterator it=a.begin(); it!=a.end(); ++it)
+		in_a.insert(&*it);
+	size_t ret=0;
+	for(cow_t::iterator it=b.begin(); it!=b.end(); ++it)
+		ret+=in_a.count(&*it);
+	return ret;
+	}
+
+void changes()
+	{
+	tree<int> tr;
+	build(tr, 2000);
+	cow_t c(tr);
+	tree<int> back;
+	c.copy_to(back);
+	std::cout << c.size() << " nodes, same as tree: " << (listing(c)==listing(tr))
+				 << ", copied back: " << (listing(back)==listing(tr)) << std::endl;
+
+	// Paths as given by the iterators lead back to the same nodes.
+	bool ok=true;
+	tree_path<> deepest, path;
+	for(cow_t::iterator it=c.begin(); it!=c.end(); ++it) {
+		it.path(path);
+		if(&c.at(path)!=&*it) ok=false;
+		if(path.size()>deepest.size()) deepest=path;
+		}
+	std::cout << "paths: " << ok << ", deepest " << deepest.size() << " steps" << std::endl;
+
+	cow_t snapshot(c);
+	std::vector<std::pair<int, int> > before=listing(snapshot);
+	c.replace(deepest, -1);
+	std::cout << "replace: " << c.at(deepest) << " against " << snapshot.at(deepest)
+				 << ", copied " << c.size()-shared(c, snapshot) << " nodes" << std::endl;
+	const int *here=&c.at(deepest);
+	c.replace(deepest, -2);
+	std::cout << "replace again: in place " << (&c.at(deepest)==here) << std::endl;
+
+	deepest.pop_back();
+	c.append_child(deepest, -3);
+	c.insert(tree_path<>{0, 0}, -4);
+	tree_path<> second{0, 2};
+	size_t below=0;
+	for(cow_t::iterator it=c.begin(); it!=c.end(); ++it) {
+		it.path(path);
+		if(path.size()>=2 && path[0]==0 && path[1]==2) ++below;
+		}
+	c.erase(second);
+	c.append_child(tree_path<>(), -5);
+	std::cout << "after changes: " << c.size() << " nodes (erased " << below << "), "
+				 << c.at(tree_path<>{1}) << " as second head, snapshot unchanged: "
+				 << (listing(snapshot)==before) << ", " << snapshot.size() << " nodes" << std::endl;
+
+	tree<int> again;
+	c.copy_to(again);
+	std::cout << "copied back: " << (listing(again)==listing(c)) << std::endl;
+
+	const char *bad[]={ "empty", "sibling", "child", "insert" };
+	for(int i=0; i<4; ++i) {
+		try {
+			switch(i) {
+				case 0: c.at(tree_path<>()); break;
+				case 1: c.at(tree_path<>{0, int(c.begin().number_of_children())}); break;
+				case 2: c.erase(tree_path<>{0, 0, 0}); break;
+				case 3: c.insert(tree_path<>{0, int(c.begin().number_of_children())+1}, 0); break;
+				}
+			}
+		catch(std::range_error& ex) {
+			std::cout << bad[i] << ": " << ex.what() << std::endl;
+			}
+		}
+	}
+
+void deep()
+	{
+	// A long chain gets built and taken apart without recursion.
+	tree<int> tr;
+	tree<int>::iterator it=tr.set_head(0);
+	for(int i=1; i<1000000; ++i)
+		it=tr.append_child(it, i);
+	cow_t c(tr);
+	cow_t copy(c);
+	tree_path<> path;
+	for(int i=0; i<1000000; ++i)
+		path.push_back(0);
+	c.replace(path, -1);
+	std::cout << "chain: " << c.size() << " nodes, " << path.size() << " steps, "
+				 << c.at(path) << " against " << copy.at(path) << std::endl;
+	}
+
+void concurrent()
+	{
+	// Writers move amounts between the children of the head, readers check that the
+	// total in every snapshot they take stays the same.
+	cow_t start;
+	start.append_child(tree_path<>(), 0);
+	for(int i=0; i<100; ++i)
+		start.append_child(tree_path<>{0}, 10);
+	kptree::cow_publisher<int> pub(start);
+
+	std::atomic<bool> done(false);
+	std::atomic<int>  wrong(0), snapshots(0);
+	std::vector<std::thread> threads;
+	for(int r=0; r<4; ++r)
+		threads.push_back(std::thread([&]() {
+			while(!done) {
+				cow_t snap=pub.load();
+				int total=0;
+				for(cow_t::iterator it=snap.begin(); it!=snap.end(); ++it)
+					total+=*it;
+				if(total!=1000 || snap.size()!=101) ++wrong;
+				++snapshots;
+				}
+			}));
+
+	// One writer with its own tree, publishing a copy after every change...
+	cow_t mine(start);
+	std::mt19937 gen(7);
+	std::uniform_int_distribution<int> pick(0, 99);
+	for(int round=0; round<2000; ++round) {
+		tree_path<> from{0, pick(gen)}, to{0, pick(gen)};
+		int amount=mine.at(from)/2;
+		mine.replace(from, mine.at(from)-amount);
+		mine.replace(to, mine.at(to)+amount);
+		pub.publish(mine);
+		}
+	// ... and then a few more changing the published version directly.
+	std::vector<std::thread> writers;
+	for(int w=0; w<3; ++w)
+		writers.push_back(std::thread([&, w]() {
+			for(int round=0; round<500; ++round)
+				pub.update([&](cow_t& tr) {
+					tr.replace(tree_path<>{0, w}, tr.at(tree_path<>{0, w})-1);
+					tr.replace(tree_path<>{0, 99-w}, tr.at(tree_path<>{0, 99-w})+1);
+					});
+			}));
+	for(std::thread& t: writers)
+		t.join();
+	done=true;
+	for(std::thread& t: threads)
+		t.join();
+
+	cow_t last=pub.load();
+	std::cout << "readers saw " << wrong << " inconsistent snapshots" << (snapshots>0?"":" (none taken)")
+				 << ", first children " << last.at(tree_path<>{0, 0})-mine.at(tree_path<>{0, 0})
+				 << " " << last.at(tree_path<>{0, 99})-mine.at(tree_path<>{0, 99}) << std::endl;
+	}
+
+int main(int, char **)
+	{
+	changes();
+	deep();
+	concurrent();
+	}
@@ -0,0 +1,100 @@
+#include <iostream>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "tree.hh"
+#include "tree_concurrent.hh"
+
+// Threads adding nodes at the same time through concurrent_appender, below
+// parents of their own, below one shared parent and by moving in trees of
+// their own, give a tree with all links in order, all nodes present, and
+// the nodes added by one thread below one parent in the order it added them.
+
+const int threads=8, per_thread=5000;
+
+/// Number of broken links (parents, siblings, first and last children) in the tree.
+template<class Tree>
+int broken(const Tree& tr)
+	{
+	int ret=0;
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it) {
+		auto n=it.node;
+		if(n->first_child!=0 && n->first_child->prev_sibling!=0) ++ret;
+		if(n->last_child!=0 && n->last_child->next_sibling!=0) ++ret;
+		if((n->first_child==0)!=(n->last_child==0)) ++ret;
+		for(auto ch=n->first_child; ch!=0; ch=ch->next_sibling) {
+			if(ch->parent!=n) ++ret;
+			if(ch->next_sibling!=0 && ch->next_sibling->prev_sibling!=ch) ++ret;
+			if(ch->next_sibling==0 && ch!=n->last_child) ++ret;
+			}
+		}
+	return ret;
+	}
+
+/// Values are thread*1000000+count; returns the number of children of 'parent' added by
+/// one thread which came out of order.
+template<class Tree>
+int out_of_order(const Tree& tr, typename Tree::iterator parent)
+	{
+	std::vector<int> last(threads, -1);
+	int ret=0;
+	for(typename Tree::sibling_iterator ch=tr.begin(parent); ch!=tr.end(parent); ++ch) {
+		int t=*ch/1000000, c=*ch%1000000;
+		if(c<=last[t]) ++ret;
+		last[t]=c;
+		}
+	return ret;
+	}
+
+template<class A>
+void run(const char *name)
+	{
+	typedef tree<int, A> Tree;
+	Tree tr;
+	typename Tree::iterator top=tr.set_head(-1), shared=tr.append_child(top, -2);
+	std::vector<typename Tree::iterator> own;
+	for(int t=0; t<threads; ++t)
+		own.push_back(tr.append_child(top, -3));
+
+	unsigned long epoch=tr.epoch(); // so that the first addition has to move it on
+	kptree::concurrent_appender<int, A> app(tr);
+	std::vector<std::thread> workers;
+	for(int t=0; t<threads; ++t)
+		workers.push_back(std::thread([&, t]() {
+			typename Tree::iterator mine=own[t], below=own[t];
+			for(int i=0; i<per_thread; ++i) {
+				int value=t*1000000+i;
+				app.append_child(shared, value);
+				if(i%100==0) below=app.append_child(mine, value);
+				else         app.append_child(below, value);
+				if(i%10==0)  app.insert(shared, value);
+				}
+			// A subtree built on the side, moved in below the shared parent in one go (which
+			// needs an allocator which can be used by all threads at once).
+			if(std::is_empty<A>::value) {
+				Tree side(tr.get_allocator());
+				typename Tree::iterator head=side.set_head(t*1000000+per_thread);
+				for(int i=0; i<100; ++i)
+					side.append_child(head, i);
+				app.move_in_below(shared, side);
+				}
+			else
+				app.append_child(shared, t*1000000+per_thread);
+			app.emplace_child(shared, t*1000000+per_thread+1);
+			}));
+	for(std::thread& w: workers)
+		w.join();
+
+	size_t expected=2+threads+threads*(2*per_thread+per_thread/10+(std::is_empty<A>::value?101:1)+1);
+	std::cout << name << ": " << tr.size() << " nodes (expected " << expected << "), "
+				 << tr.number_of_children(shared) << " below the shared one, "
+				 << broken(tr) << " broken links, " << out_of_order(tr, shared) << " out of order, "
+				 << "epoch moved on: " << (tr.epoch()!=epoch) << std::endl;
+	}
+
+int main(int, char **)
+	{
+	run<std::allocator<tree_node_<int> > >("plain");
+	run<std::allocator<tree_node_random_access_<int> > >("random access");
+	run<tree_node_pool_allocator<tree_node_<int> > >("pool");
+	}
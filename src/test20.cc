@@ -0,0 +1,132 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include "tree.hh"
+#include "tree_parallel.hh"
+
+// Moving in a range of trees at once gives the same tree as moving them in
+// one by one, also for empty trees in the range and with cached counts,
+// and parallel_build gives the trees its factory makes, in order.
+
+template<class Tree>
+Tree small(int label, int kids)
+	{
+	Tree tr;
+	typename Tree::iterator top=tr.set_head(label);
+	for(int i=0; i<kids; ++i)
+		tr.append_child(top, label*100+i);
+	if(kids==2) // a tree with two heads
+		tr.insert_after(top, label+1000);
+	return tr;
+	}
+
+template<class Tree>
+std::vector<Tree> several()
+	{
+	std::vector<Tree> ret;
+	ret.push_back(small<Tree>(1, 3));
+	ret.push_back(Tree());
+	ret.push_back(small<Tree>(2, 2));
+	ret.push_back(small<Tree>(3, 0));
+	ret.push_back(Tree());
+	return ret;
+	}
+
+template<class Tree>
+void print(const Tree& tr)
+	{
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it)
+		std::cout << *it << "(" << tr.size(it) << ") ";
+	std::cout << std::endl;
+	}
+
+template<class Tree>
+void splice(const char *name)
+	{
+	bool same=true;
+	for(size_t n=0; n<=4; ++n) {
+		Tree batch=small<Tree>(9, 3), single(batch);
+		std::vector<Tree> trees=several<Tree>(), copies=several<Tree>();
+		typename Tree::iterator top=batch.begin();
+		typename Tree::iterator first=(n==4)?batch.move_in_below(top, trees.begin(), trees.end())
+		                                    :batch.move_in_as_nth_child(top, n, trees.begin(), trees.end());
+		typename Tree::iterator pos=single.begin();
+		for(size_t t=0, at=n; t<copies.size(); ++t) {
+			size_t heads=0;
+			for(typename Tree::sibling_iterator h=copies[t].begin(); h!=copies[t].end(); ++h)
+				++heads;
+			if(n==4) single.move_in_below(pos, copies[t]);
+			else     single.move_in_as_nth_child(pos, at, copies[t]);
+			at+=heads;
+			}
+		if(!batch.equal(batch.begin(), batch.end(), single.begin()) || batch.size()!=single.size()
+			|| *first!=1 || batch.size(batch.begin())!=batch.size())
+			same=false;
+		for(size_t t=0; t<trees.size(); ++t)
+			if(!trees[t].empty()) same=false;
+		for(unsigned int k=0; k<batch.number_of_children(top); ++k)
+			if(*batch.child(top, k)!=*single.child(pos, k) || batch.index(batch.child(top, k))!=k) same=false;
+		if(n==1) print(batch);
+		}
+	std::cout << name << " same as one by one: " << (same?"yes":"NO") << std::endl;
+
+	Tree tr=small<Tree>(9, 1);
+	std::vector<Tree> none(3);
+	std::cout << name << " nothing to move in: " << (tr.move_in_below(tr.begin(), none.begin(), none.end())==tr.begin())
+				 << ", " << tr.size() << " nodes" << std::endl;
+	try {
+		std::vector<Tree> trees=several<Tree>();
+		tr.move_in_as_nth_child(tr.begin(), 3, trees.begin(), trees.end());
+		}
+	catch(std::range_error& ex) {
+		std::cout << name << ": " << ex.what() << std::endl;
+		}
+	}
+
+void build()
+	{
+	typedef tree<int> tree_t;
+	auto factory=[](size_t i) {
+		tree_t tr;
+		tree_t::iterator top=tr.set_head(int(i));
+		for(size_t c=0; c<i%5; ++c)
+			tr.append_child(top, int(10*i+c));
+		return tr;
+		};
+	std::vector<tree_t> built=kptree::parallel_build(1000, factory, 4);
+	bool ok=(built.size()==1000);
+	for(size_t i=0; i<built.size(); ++i) {
+		tree_t expected=factory(i);
+		if(!built[i].equal(built[i].begin(), built[i].end(), expected.begin()) || built[i].size()!=expected.size())
+			ok=false;
+		}
+	std::cout << "parallel_build: " << (ok?"as made":"WRONG") << std::endl;
+
+	tree_t tr;
+	tree_t::iterator top=tr.set_head(-1);
+	tree_t::iterator first=kptree::parallel_build(tr, top, 1000, factory);
+	size_t expected=1;
+	for(size_t i=0; i<1000; ++i)
+		expected+=1+i%5;
+	std::cout << "parallel_build below: " << tr.size() << " nodes (expected " << expected << "), "
+				 << tr.number_of_children(top) << " children, first " << *first
+				 << ", last " << *tr.child(top, 999) << std::endl;
+
+	try {
+		kptree::parallel_build(100, [](size_t i) {
+			if(i==42) throw std::runtime_error("no tree for 42");
+			return tree_t();
+			});
+		}
+	catch(std::runtime_error& ex) {
+		std::cout << "parallel_build: " << ex.what() << std::endl;
+		}
+	}
+
+int main(int, char **)
+	{
+	splice<tree<int> >("plain");
+	splice<tree<int, std::allocator<tree_node_counted_<int> > > >("counted");
+	splice<tree<int, std::allocator<tree_node_random_access_<int> > > >("random access");
+	build();
+	}
@@ -0,0 +1,80 @@
+#include <functional>
+#include <iostream>
+#include <thread>
+#include "tree.hh"
+
+// Compiled with KPTREE_STATS: the counts kept by tree_stats match the node
+// allocations, iterator steps and sibling walks done, calls to sort, merge
+// and copying are counted once each (also when they recurse), and the counts
+// of threads which have finished are kept.
+
+typedef tree<int> tree_t;
+
+/// Difference of a counter since 'before'.
+unsigned long long since(const tree_stats& before, tree_stats::counter c)
+	{
+	return tree_t::stats()[c]-before[c];
+	}
+
+void show(const tree_stats& before, tree_stats::counter c)
+	{
+	std::cout << tree_stats::name(c) << " " << since(before, c) << std::endl;
+	}
+
+int main(int, char **)
+	{
+	std::cout << "enabled " << tree_stats::enabled << std::endl;
+	tree_stats before=tree_t::stats();
+	{
+	tree_t tr;
+	tree_t::iterator top=tr.set_head(0);
+	for(int i=1; i<=9; ++i)
+		tr.append_child(top, 10-i);
+	show(before, tree_stats::allocations);       // 10 nodes plus head and feet
+
+	before=tree_t::stats();
+	for(tree_t::iterator it=tr.begin(); it!=tr.end(); ++it) {}
+	for(tree_t::post_order_iterator it=tr.begin_post(); it!=tr.end_post(); ++it) {}
+	for(tree_t::sibling_iterator it=tr.begin(top); it!=tr.end(top); ++it) {}
+	for(tree_t::leaf_iterator it=tr.begin_leaf(); it!=tr.end_leaf(); ++it) {}
+	show(before, tree_stats::pre_order_steps);
+	show(before, tree_stats::post_order_steps);
+	show(before, tree_stats::sibling_steps);
+	show(before, tree_stats::leaf_steps);
+
+	before=tree_t::stats();
+	tr.number_of_children(top);                  // 8 steps from the first child
+	tr.child(top, 5);                            // 5
+	tr.index(tr.child(top, 3));                  // 3, plus 3 for child()
+	show(before, tree_stats::sibling_walk_steps);
+
+	before=tree_t::stats();
+	tr.sort(tr.begin(), tr.end(), true);
+	tree_t other(tr);
+	tr.merge(tr.begin(), other.begin(), false);
+	show(before, tree_stats::sorts);
+	show(before, tree_stats::copies);
+	show(before, tree_stats::merges);
+	std::cout << "timed " << (since(before, tree_stats::sort_ns)>0) << " " << (since(before, tree_stats::copy_ns)>0)
+				 << " " << (since(before, tree_stats::merge_ns)>0) << std::endl;
+	before=tree_t::stats();
+	}
+	show(before, tree_stats::frees);             // both trees, heads and feet included
+
+	// Counts of a finished thread stay in.
+	before=tree_t::stats();
+	std::thread t([]() {
+		tree_t tr;
+		tr.set_head(1);
+		});
+	t.join();
+	show(before, tree_stats::allocations);
+	show(before, tree_stats::frees);
+
+	tree_stats::reset();
+	tree_stats now=tree_t::stats();
+	unsigned long long total=0;
+	for(int c=0; c<tree_stats::counters; ++c)
+		total+=now[tree_stats::counter(c)];
+	std::cout << "after reset " << total << std::endl;
+	}
@@ -0,0 +1,142 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "tree.hh"
+#include "tree_view.hh"
+
+// A subtree_view walks the nodes of a range of siblings in place, in the
+// same order as the tree subtree() returns, at the end of the siblings and
+// at the top of the tree too. Deferred subtrees and inserts read the
+// source until written to, then give what subtree() and insert_subtree()
+// give, and refuse to go on once the source has changed shape.
+
+typedef tree<std::string>                 tree_t;
+typedef kptree::subtree_view<std::string> view_t;
+
+tree_t example()
+	{
+	tree_t tr;
+	tree_t::iterator a=tr.set_head("a");
+	tree_t::iterator b=tr.append_child(a, "b");
+	tr.append_child(b, "b1");
+	tree_t::iterator b2=tr.append_child(b, "b2");
+	tr.append_child(b2, "b21");
+	tree_t::iterator c=tr.append_child(a, "c");
+	tr.append_child(c, "c1");
+	tr.append_child(a, "d");
+	tree_t::iterator e=tr.insert_after(a, "e");
+	tr.append_child(e, "e1");
+	return tr;
+	}
+
+void print(const view_t& v)
+	{
+	for(view_t::iterator it=v.begin(); it!=v.end(); ++it)
+		std::cout << *it << "/" << v.depth(it) << " ";
+	std::cout << "| ";
+	for(view_t::post_order_iterator it=v.begin_post(); it!=v.end_post(); ++it)
+		std::cout << *it << " ";
+	std::cout << "| " << v.size() << " nodes" << std::endl;
+	}
+
+/// Whether the view has the nodes of the tree subtree() makes, in the same order.
+bool same(const view_t& v, const tree_t& copy)
+	{
+	tree_t::iterator c=copy.begin();
+	for(view_t::iterator it=v.begin(); it!=v.end(); ++it, ++c)
+		if(c==copy.end() || *it!=*c || v.depth(it)!=copy.depth(c)) return false;
+	if(c!=copy.end()) return false;
+	tree_t::post_order_iterator p=copy.begin_post();
+	for(view_t::post_order_iterator it=v.begin_post(); it!=v.end_post(); ++it, ++p)
+		if(p==copy.end_post() || *it!=*p) return false;
+	return p==copy.end_post() && v.size()==copy.size();
+	}
+
+void views()
+	{
+	tree_t tr=example();
+	tree_t::iterator a=tr.begin(), b=tr.child(a, 0), c=tr.child(a, 1), d=tr.child(a, 2);
+
+	view_t middle(tr, b, d), last(tr, c, tr.end(a)), one(tr, b), top(tr, tr.begin(), tr.end());
+	print(middle);
+	print(last);
+	print(one);
+	print(top);
+	std::cout << "in place: " << (&*middle.begin()==&*b) << std::endl;
+	std::cout << "as subtree(): " << same(middle, tr.subtree(b, d)) << same(last, tr.subtree(c, tr.end(a)))
+				 << same(top, tr.subtree(tr.begin(), tr.end())) << same(one, one.copy()) << std::endl;
+
+	view_t none(tr, c, c), leafless(tr, tr.begin(d), tr.end(d));
+	std::cout << "empty: " << none.empty() << leafless.empty() << " " << none.size()
+				 << (none.begin()==none.end()) << (leafless.begin_post()==leafless.end_post()) << std::endl;
+	}
+
+void deferred()
+	{
+	tree_t tr=example();
+	tree_t::iterator a=tr.begin(), b=tr.child(a, 0), d=tr.child(a, 2);
+
+	kptree::deferred_subtree<std::string> ext=kptree::defer_subtree(tr, b, d);
+	print(ext.view());
+	*tr.child(b, 0)="B1"; // values show through until the copy is made
+	std::cout << "reads the source: " << *++ext.view().begin() << ", written " << ext.written() << std::endl;
+	tree_t& copy=ext.write();
+	*copy.begin()="changed";
+	std::cout << "written " << ext.written() << ", source " << *b << ", copy " << *ext.view().begin()
+				 << ", same as subtree() " << (copy.size()==tr.subtree(b, d).size()) << std::endl;
+
+	kptree::deferred_subtree<std::string> stale=kptree::defer_subtree(tr, b, d);
+	tr.erase(tr.child(b, 0));
+	try {
+		stale.view();
+		}
+	catch(std::logic_error& ex) {
+		std::cout << ex.what() << std::endl;
+		}
+	std::cout << "written copy stays: " << ext.view().size() << std::endl;
+
+	// Deferred insert, from another tree and from the tree itself.
+	tree_t dest, eager;
+	dest.set_head("x");
+	eager.set_head("x");
+	tree_t src=example();
+	tree_t::iterator sub=src.child(src.begin(), 0);
+	kptree::deferred_insert<std::string> ins=kptree::defer_insert_subtree(dest, dest.begin(), src, sub);
+	print(ins.view());
+	std::cout << "dest before write: " << dest.size() << " nodes" << std::endl;
+	tree_t::iterator at=ins.write();
+	eager.insert_subtree(eager.begin(), sub);
+	std::cout << "dest after write: " << dest.size() << " nodes, at " << *at << ", same as insert_subtree() "
+				 << dest.equal(dest.begin(), dest.end(), eager.begin()) << ", again " << (ins.write()==at) << std::endl;
+	print(ins.view());
+
+	kptree::deferred_insert<std::string> self=kptree::defer_insert_subtree(src, src.child(src.begin(), 2), src, sub);
+	tree_t::iterator copied=self.write();
+	std::cout << "into itself: " << src.size() << " nodes, " << *copied << " at child "
+				 << src.index(copied) << std::endl;
+
+	kptree::deferred_insert<std::string> dropped=kptree::defer_insert_subtree(dest, dest.begin(), src, sub);
+	src.erase(src.begin(sub));
+	try {
+		dropped.write();
+		}
+	catch(std::logic_error& ex) {
+		std::cout << ex.what() << std::endl;
+		}
+
+	// The position it goes to is in the destination, so changes there count too.
+	kptree::deferred_insert<std::string> moved=kptree::defer_insert_subtree(dest, dest.begin(), src, src.begin());
+	dest.erase(dest.begin());
+	try {
+		moved.write();
+		}
+	catch(std::logic_error& ex) {
+		std::cout << ex.what() << std::endl;
+		}
+	}
+
+int main(int, char **)
+	{
+	views();
+	deferred();
+	}
@@ -0,0 +1,124 @@
+#include <iostream>
+#include <string>
+#include "tree.hh"
+#include "tree_hash.hh"
+
+// Equal subtrees get equal hashes, wherever they are, and subtrees which
+// differ in values or in shape different ones; comparisons, searches and
+// the duplicates found agree with equal_subtree, also when all hashes
+// collide, and the hashes kept are dropped when the tree changes shape.
+
+typedef tree<std::string> tree_t;
+
+/// A bit of an expression tree: (a+b)*(a+b)+f(a+b, a), then ((a+b)) and a(b).
+tree_t expression()
+	{
+	tree_t tr;
+	tree_t::iterator plus=tr.set_head("+");
+	tree_t::iterator times=tr.append_child(plus, "*");
+	for(int i=0; i<2; ++i) {
+		tree_t::iterator sum=tr.append_child(times, "+");
+		tr.append_child(sum, "a");
+		tr.append_child(sum, "b");
+		}
+	tree_t::iterator f=tr.append_child(plus, "f");
+	tree_t::iterator sum=tr.append_child(f, "+");
+	tr.append_child(sum, "a");
+	tr.append_child(sum, "b");
+	tr.append_child(f, "a");
+	tree_t::iterator paren=tr.insert_after(plus, "()");
+	sum=tr.append_child(paren, "+");
+	tr.append_child(sum, "a");
+	tr.append_child(sum, "b");
+	tree_t::iterator a=tr.insert_after(paren, "a");
+	tr.append_child(a, "b");
+	return tr;
+	}
+
+/// A hash under which everything collides.
+struct same_hash {
+	size_t operator()(const std::string&) const { return 1; }
+	};
+
+std::string show(const tree_t& tr, tree_t::iterator it)
+	{
+	std::string ret=*it;
+	if(tr.number_of_children(it)>0) {
+		ret+="(";
+		for(tree_t::sibling_iterator ch=tr.begin(it); ch!=tr.end(it); ++ch)
+			ret+=(ch==tr.begin(it)?"":",")+show(tr, ch);
+		ret+=")";
+		}
+	return ret;
+	}
+
+template<class Hash>
+void duplicates(const tree_t& tr, size_t min_nodes)
+	{
+	std::vector<std::vector<tree_t::iterator> > groups=kptree::find_duplicate_subtrees(tr, min_nodes, Hash());
+	for(size_t g=0; g<groups.size(); ++g) {
+		std::cout << "  " << show(tr, groups[g][0]) << " x" << groups[g].size() << " at";
+		for(size_t i=0; i<groups[g].size(); ++i)
+			std::cout << " " << tr.depth(groups[g][i]) << "/" << tr.index(groups[g][i]);
+		std::cout << std::endl;
+		}
+	}
+
+int main(int, char **)
+	{
+	tree_t tr=expression();
+	tree_t::iterator plus=tr.begin(), times=tr.child(plus, 0), f=tr.child(plus, 1);
+	tree_t::iterator paren=tr.next_sibling(plus), a=tr.next_sibling(paren);
+
+	// Hashes, against equal_subtree for all pairs of nodes.
+	kptree::subtree_hash<std::string> hashes(tr);
+	size_t all=hashes(plus);
+	std::cout << "hashed " << hashes.size() << " nodes" << std::endl;
+	int disagree=0, same=0, pairs=0;
+	for(tree_t::iterator one=tr.begin(); one!=tr.end(); ++one)
+		for(tree_t::iterator two=tr.begin(); two!=tr.end(); ++two) {
+			bool eq=tr.equal_subtree(one, two);
+			if(hashes.equal(one, two)!=eq) ++disagree;
+			if(eq!=(hashes(one)==hashes(two))) ++disagree;
+			if(eq && one!=two) ++same;
+			++pairs;
+			}
+	std::cout << pairs << " pairs, " << same << " equal, " << disagree << " disagreeing" << std::endl;
+	tree_t copy=tr.subtree(f, tr.end(plus));
+	std::cout << "uncached: " << (kptree::hash_subtree(tr, plus)==all) << ", other tree: "
+				 << (kptree::hash_subtree(tr, tr.child(times, 0))==kptree::hash_subtree(copy, copy.child(copy.begin(), 0)))
+				 << ", a(b) against +(a,b) and ()(+(a,b)): " << (hashes(a)!=hashes(tr.child(times, 0)))
+				 << (hashes(paren)!=hashes(tr.child(times, 0))) << std::endl;
+
+	// Searching, for one subtree and for a range of siblings.
+	tree_t pattern;
+	tree_t::iterator p=pattern.set_head("+");
+	pattern.append_child(p, "a");
+	pattern.append_child(p, "b");
+	tree_t::iterator found=hashes.find(p, tr.begin(), tr.end());
+	std::cout << "found " << show(tr, found) << " below " << *tr.parent(found) << ", from f on below "
+				 << *tr.parent(hashes.find(p, f, tr.end())) << std::endl;
+	pattern.append_child(p, "c");
+	std::cout << "not found " << show(pattern, p) << ": " << (hashes.find(p, tr.begin(), tr.end())==tr.end()) << std::endl;
+	pattern.erase(pattern.child(p, 2));
+	pattern.insert_after(p, "a");
+	found=tr.find_subtree(pattern.begin(), pattern.end(), tr.begin(), tr.end());
+	std::cout << "siblings found below " << *tr.parent(found) << " at " << tr.index(found)
+				 << ", own children: " << (tr.find_subtree(tr.begin(times), tr.end(times), tr.begin(), tr.end())==tr.child(times, 0))
+				 << ", not before them: " << (tr.find_subtree(tr.begin(times), tr.end(times), tr.begin(), times)==times)
+				 << ", empty: " << (tr.find_subtree(pattern.end(), pattern.end(), tr.begin(), tr.end())==tr.end())
+				 << std::endl;
+
+	// Changing the shape drops what was known.
+	tr.append_child(tr.child(times, 1), "c");
+	std::cout << "after a change " << (hashes.equal(tr.child(times, 0), tr.child(times, 1))) << ", "
+				 << hashes.size() << " nodes hashed" << std::endl;
+	tr.erase(tr.child(tr.child(times, 1), 2));
+
+	std::cout << "duplicates:" << std::endl;
+	duplicates<std::hash<std::string> >(tr, 2);
+	std::cout << "duplicates, all single nodes too:" << std::endl;
+	duplicates<std::hash<std::string> >(tr, 1);
+	std::cout << "duplicates, hashes colliding:" << std::endl;
+	duplicates<same_hash>(tr, 2);
+	}
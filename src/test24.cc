@@ -0,0 +1,105 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "tree.hh"
+#include "tree_dag.hh"
+
+// A dag_tree stores each distinct subtree once, counting the places which
+// refer to it, iterates and expands to the tree it was made from, shares
+// subtrees with trees added later, and stays right when all hashes
+// collide.
+
+typedef tree<std::string> tree_t;
+
+/// A configuration with 'hosts' entries which all have the same settings,
+/// except for their names, and a few which have one setting changed.
+tree_t config(int hosts)
+	{
+	tree_t tr;
+	tree_t::iterator top=tr.set_head("hosts");
+	for(int h=0; h<hosts; ++h) {
+		tree_t::iterator host=tr.append_child(top, "host");
+		tr.append_child(tr.append_child(host, "name"), "host"+std::to_string(h));
+		tree_t::iterator net=tr.append_child(host, "network");
+		tr.append_child(tr.append_child(net, "mtu"), h%10==9?"9000":"1500");
+		tr.append_child(tr.append_child(net, "dns"), "10.0.0.1");
+		tree_t::iterator disks=tr.append_child(host, "disks");
+		for(int d=0; d<3; ++d) {
+			tree_t::iterator disk=tr.append_child(disks, "disk");
+			tr.append_child(tr.append_child(disk, "size"), "100G");
+			tr.append_child(tr.append_child(disk, "type"), "ssd");
+			}
+		}
+	tr.insert_after(top, "version");
+	return tr;
+	}
+
+struct same_hash {
+	size_t operator()(const std::string&) const { return 1; }
+	};
+
+template<class Dag>
+bool same(const Dag& dag, const tree_t& tr)
+	{
+	typename Dag::iterator d=dag.begin();
+	for(tree_t::iterator it=tr.begin(); it!=tr.end(); ++it, ++d)
+		if(d==dag.end() || *d!=*it || dag.depth(d)!=tr.depth(it) || dag.number_of_children(d)!=tr.number_of_children(it)
+			|| dag.size(d)!=tr.size(it)) return false;
+	tree_t expanded=dag.expand();
+	return d==dag.end() && dag.size()==tr.size()
+		&& expanded.size()==tr.size() && tr.equal(tr.begin(), tr.end(), expanded.begin());
+	}
+
+int main(int, char **)
+	{
+	tree_t tr=config(100);
+	kptree::dag_tree<std::string> dag(tr);
+	std::cout << tr.size() << " nodes, " << dag.stored() << " stored, same: " << same(dag, tr) << std::endl;
+	std::cout << "at least 5 times smaller: " << (5*dag.memory()<tr.size()*sizeof(tree_node_<std::string>)) << std::endl;
+
+	// The settings of the disks are shared by all disks, the disks by all hosts.
+	kptree::dag_tree<std::string>::iterator it=dag.begin();
+	while(*it!="disks") ++it;
+	kptree::dag_tree<std::string>::sibling_iterator disk=dag.begin(it);
+	std::cout << "disks referred to " << dag.references(it) << " times, a disk "
+				 << dag.references(disk) << " times, children:";
+	for(kptree::dag_tree<std::string>::sibling_iterator ch=dag.begin(disk); ch!=dag.end(disk); ++ch)
+		std::cout << " " << *ch;
+	std::cout << std::endl;
+
+	std::cout << "heads:";
+	for(kptree::dag_tree<std::string>::sibling_iterator h=dag.begin_heads(); h!=dag.end_heads(); ++h)
+		std::cout << " " << *h << "(" << dag.size(h) << ")";
+	std::cout << std::endl;
+
+	size_t top_level=0;
+	for(it=dag.begin(); it!=dag.end(); ++it) {
+		++top_level;
+		it.skip_children();
+		}
+	std::cout << "skipping children: " << top_level << " nodes" << std::endl;
+
+	// Adding more shares what is there already.
+	size_t before=dag.stored();
+	tree_t more=config(120);
+	dag.add(more);
+	tree_t both(tr);
+	for(tree_t::sibling_iterator h=more.begin(); h!=more.end(); ++h)
+		both.insert_subtree(both.end(), h);
+	std::cout << "added " << more.size() << " nodes, " << dag.stored()-before << " stored, same: "
+				 << same(dag, both) << std::endl;
+
+	dag.release_index();
+	try {
+		dag.add(tr);
+		}
+	catch(std::logic_error& ex) {
+		std::cout << ex.what() << std::endl;
+		}
+
+	kptree::dag_tree<std::string, same_hash> colliding(tr);
+	std::cout << "colliding: " << colliding.stored() << " stored, same: " << same(colliding, tr) << std::endl;
+
+	kptree::dag_tree<std::string> none;
+	std::cout << "empty: " << none.empty() << (none.begin()==none.end()) << none.size() << none.expand().size() << std::endl;
+	}
@@ -0,0 +1,176 @@
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tree.hh"
+
+// Compact nodes keep their links in a fraction of the space of pointers,
+// and a tree built from them goes through the same random changes as one
+// built from plain nodes with the same result; nodes move between trees,
+// and those freed by threads which have ended are handed out again.
+
+typedef tree_node_compact_<std::string>                            node_t;
+typedef tree<std::string, tree_node_compact_allocator<node_t> >    compact_t;
+typedef tree<std::string>                                          plain_t;
+typedef tree_node_compact_pool_<tree_node_compact_<int> >          int_pool;
+typedef tree<int, tree_node_compact_allocator<tree_node_compact_<int> > > compact_int_t;
+
+template<class Tree>
+std::string show(const Tree& tr)
+	{
+	std::string ret;
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it)
+		ret+=std::to_string(tr.depth(it))+*it+" ";
+	return ret;
+	}
+
+/// Whether both trees have the same nodes at the same depths, also when walked
+/// backwards, in post-order and along the leaves.
+bool same(const compact_t& one, const plain_t& two)
+	{
+	if(show(one)!=show(two) || one.size()!=two.size()) return false;
+	compact_t::post_order_iterator p1=one.end_post();
+	plain_t::post_order_iterator   p2=two.end_post();
+	while(p1!=one.begin_post()) {
+		--p1; --p2;
+		if(*p1!=*p2) return false;
+		}
+	compact_t::leaf_iterator l1=one.begin_leaf();
+	plain_t::leaf_iterator   l2=two.begin_leaf();
+	for(; l1!=one.end_leaf(); ++l1, ++l2)
+		if(l2==two.end_leaf() || *l1!=*l2) return false;
+	return l2==two.end_leaf();
+	}
+
+template<class Tree>
+typename Tree::iterator nth(const Tree& tr, size_t n)
+	{
+	typename Tree::iterator it=tr.begin();
+	while(n-->0) ++it;
+	return it;
+	}
+
+/// Change both trees in the same way, picking changes and places with 'gen'.
+template<class Tree>
+void change(Tree& tr, std::mt19937& gen, int step)
+	{
+	std::string val=std::to_string(step);
+	if(tr.empty()) {
+		tr.set_head(val);
+		return;
+		}
+	typename Tree::iterator at=nth(tr, gen()%tr.size());
+	switch(gen()%12) {
+		case 0: tr.append_child(at, val); break;
+		case 1: tr.prepend_child(at, val); break;
+		case 2: tr.insert(at, val); break;
+		case 3: tr.insert_after(at, val); break;
+		case 4: if(tr.size()>10) tr.erase(at); break;
+		case 5: {
+			typename Tree::iterator to=nth(tr, gen()%tr.size());
+			if(!tr.is_in_subtree(to, at) && !tr.is_in_subtree(at, to)) tr.move_after(to, at);
+			break;
+			}
+		case 6: tr.sort(tr.begin(at), tr.end(at)); break;
+		case 7: tr.flatten(at); break;
+		case 8: if(tr.number_of_children(at)>0) tr.reparent(tr.insert_after(at, val), at); break;
+		case 9: if(tr.size()>100) tr.erase_children(at); break;
+		case 10: if(tr.size()>100) tr.erase_left_siblings(at); break;
+		case 11: if(tr.size()>100) tr.erase_right_siblings(at); break;
+		}
+	}
+
+/// Builds a tree when the thread ends.
+struct ending {
+	ending(std::atomic<bool>& done) : done_(done) {}
+	~ending()
+		{
+		compact_int_t tr;
+		tr.append_child(tr.set_head(1), 2);
+		done_=(tr.size()==2);
+		}
+	std::atomic<bool>& done_;
+};
+
+int main(int, char **)
+	{
+	std::cout << "links of a compact node: " << sizeof(tree_node_compact_<char>)-4
+				 << " bytes, at most half of a plain one: "
+				 << (2*sizeof(tree_node_compact_<int>)<=sizeof(tree_node_<int>) || sizeof(void *)==4) << std::endl;
+
+	compact_t compact;
+	plain_t   plain;
+	std::mt19937 gen1(3), gen2(3);
+	bool agree=true;
+	for(int step=0; step<3000; ++step) {
+		change(compact, gen1, step);
+		change(plain, gen2, step);
+		if(step%100==0) agree=agree && same(compact, plain);
+		}
+	std::cout << "after 3000 changes " << compact.size() << " nodes, same: " << (agree && same(compact, plain)) << std::endl;
+
+	// Copies, and nodes moving from one tree into another.
+	compact_t copy(compact), other;
+	other.set_head("other");
+	plain_t plain_copy(plain), plain_other;
+	plain_other.set_head("other");
+	compact_t::iterator parent=compact.begin();
+	plain_t::iterator   plain_parent=plain.begin();
+	while(compact.number_of_children(parent)==0) {
+		++parent;
+		++plain_parent;
+		}
+	compact_t::iterator from=compact.child(parent, 0);
+	plain_t::iterator   plain_from=plain.child(plain_parent, 0);
+	compact_t moved=compact.move_out(from);
+	plain_t   plain_moved=plain.move_out(plain_from);
+	other.move_in_below(other.begin(), moved);
+	plain_other.move_in_below(plain_other.begin(), plain_moved);
+	std::cout << "copy: " << same(copy, plain_copy) << ", moved: " << same(compact, plain) << same(other, plain_other) << std::endl;
+
+	// Nodes which threads leave behind are handed out again, so that building as many
+	// nodes again takes no new chunks. The threads keep their trees until all are built,
+	// so that each takes a chunk of its own; the tree in 'keep' holds on to the pool.
+	compact_int_t *keep=new compact_int_t;
+	keep->set_head(0);
+	std::vector<std::thread> threads;
+	std::atomic<int> built(0);
+	for(int t=0; t<4; ++t)
+		threads.push_back(std::thread([&built]() {
+			compact_int_t tr;
+			compact_int_t::iterator top=tr.set_head(0);
+			for(int i=0; i<50000; ++i)
+				tr.append_child(top, i);
+			++built;
+			while(built<4) 
+				std::this_thread::yield();
+			}));
+	for(size_t t=0; t<threads.size(); ++t)
+		threads[t].join();
+	unsigned int chunks=int_pool::chunks();
+	compact_int_t *tr=new compact_int_t;
+	compact_int_t::iterator top=tr->set_head(0);
+	for(int i=0; i<200000; ++i)
+		tr->append_child(top, i);
+	long sum=0;
+	for(compact_int_t::iterator it=tr->begin(); it!=tr->end(); ++it)
+		sum+=*it;
+	std::cout << "chunks after the threads: " << chunks << ", after as many nodes again: " << int_pool::chunks()
+				 << ", sum " << sum << std::endl;
+
+	// Once the last node is gone, so are the chunks; nodes taken after that, also by a
+	// thread which is ending, come from new ones.
+	delete tr;
+	delete keep;
+	chunks=int_pool::chunks();
+	std::atomic<bool> at_end(false);
+	std::thread([&at_end]() {
+		static thread_local ending last(at_end); // destroyed after the pool gave back this thread's nodes
+		compact_int_t tr;
+		tr.set_head(1);
+		}).join();
+	std::cout << "chunks once all nodes are gone: " << chunks << ", nodes taken by an ending thread: " << at_end 
+				 << ", chunks left: " << int_pool::chunks() << std::endl;
+	}
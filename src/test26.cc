@@ -0,0 +1,120 @@
+#include <iostream>
+#include <random>
+#include <vector>
+#include "tree.hh"
+#include "frozen_tree.hh"
+
+// The blocks of leaves handed out by tree::for_each_leaf_block, and the
+// spans of frozen_tree::for_each_leaf_span, hold the same leaves in the
+// same order as leaf_iterator, for whole trees and below a node, with all
+// blocks full but the last and spans which cannot be joined; the data in
+// the blocks can be changed.
+
+typedef tree<int> tree_t;
+
+/// A tree of 'n' nodes, each placed below a random earlier node, with some heads.
+tree_t random_tree(int n, unsigned int seed)
+	{
+	std::mt19937 gen(seed);
+	tree_t tr;
+	std::vector<tree_t::iterator> nodes;
+	for(int i=0; i<n; ++i) {
+		if(nodes.empty() || gen()%50==0) nodes.push_back(tr.insert(tr.end(), i));
+		else                             nodes.push_back(tr.append_child(nodes[gen()%nodes.size()], i));
+		}
+	return tr;
+	}
+
+std::vector<int> by_iterator(tree_t::leaf_iterator it, tree_t::leaf_iterator end)
+	{
+	std::vector<int> ret;
+	for(; it!=end; ++it)
+		ret.push_back(*it);
+	return ret;
+	}
+
+/// Collects the leaves it is given, and checks that every block but the last is full.
+struct collect {
+	collect(std::vector<int>& l, bool& f) : leaves(l), full(f), last(tree_t::leaf_block_size) {}
+	void operator()(int * const *data, size_t n)
+		{
+		if(last!=tree_t::leaf_block_size) full=false;
+		for(size_t i=0; i<n; ++i)
+			leaves.push_back(*data[i]);
+		last=n;
+		}
+	std::vector<int>& leaves;
+	bool&             full;
+	size_t            last;
+};
+
+/// Collects the leaves in spans, and checks that no span starts where the one before ends.
+struct collect_spans {
+	collect_spans(std::vector<int>& l, bool& s) : leaves(l), separate(s), end(0) {}
+	void operator()(const int *values, size_t n)
+		{
+		if(values==end || n==0) separate=false;
+		leaves.insert(leaves.end(), values, values+n);
+		end=values+n;
+		}
+	std::vector<int>& leaves;
+	bool&             separate;
+	const int        *end;
+};
+
+int main(int, char **)
+	{
+	int sizes[]={ 1, 2, 10, 64, 65, 1000, 20000 };
+	for(int s=0; s<7; ++s) {
+		tree_t tr=random_tree(sizes[s], unsigned(s));
+		kptree::frozen_tree<int> frozen(tr);
+		std::vector<int> expected=by_iterator(tr.begin_leaf(), tr.end_leaf()), blocks, spans;
+		bool full=true, separate=true;
+		tr.for_each_leaf_block(collect(blocks, full));
+		frozen.for_each_leaf_span(collect_spans(spans, separate));
+		std::cout << sizes[s] << " nodes, " << expected.size() << " leaves, blocks: " << (blocks==expected)
+					 << full << ", spans: " << (spans==expected) << separate;
+
+		// Below each head, and below the nodes on the way down to the last leaf.
+		bool below=true;
+		std::vector<tree_t::iterator> tops;
+		for(tree_t::sibling_iterator h=tr.begin(); h!=tr.end(); ++h)
+			tops.push_back(h);
+		for(tree_t::iterator it=tops.back(); tr.number_of_children(it)>0; it=tr.child(it, tr.number_of_children(it)-1))
+			tops.push_back(it);
+		for(size_t t=0; t<tops.size(); ++t) {
+			std::vector<int> sub=by_iterator(tr.begin_leaf(tops[t]), tr.end_leaf(tops[t]));
+			blocks.clear();
+			spans.clear();
+			tr.for_each_leaf_block(tops[t], collect(blocks, full));
+			kptree::frozen_tree<int>::iterator ftop=frozen.begin();
+			for(tree_t::iterator it=tr.begin(); it!=tops[t]; ++it)
+				++ftop;
+			frozen.for_each_leaf_span(ftop, collect_spans(spans, separate));
+			if(blocks!=sub || spans!=sub) below=false;
+			}
+		std::cout << ", below " << tops.size() << " nodes: " << below << full << separate << std::endl;
+		}
+
+	// Summing, and changing the data through the blocks.
+	tree_t tr=random_tree(5000, 9);
+	long sum=0, sum_blocks=0, sum_spans=0;
+	for(tree_t::leaf_iterator it=tr.begin_leaf(); it!=tr.end_leaf(); ++it)
+		sum+=*it;
+	tr.for_each_leaf_block([&sum_blocks](int * const *data, size_t n) {
+		for(size_t i=0; i<n; ++i) {
+			sum_blocks+=*data[i];
+			*data[i]=-*data[i];
+			}
+		});
+	kptree::frozen_tree<int>(tr).for_each_leaf_span([&sum_spans](const int *values, size_t n) {
+		for(size_t i=0; i<n; ++i) sum_spans-=values[i];
+		});
+	std::cout << "sums " << sum << " " << sum_blocks << " " << sum_spans << std::endl;
+
+	tree_t none;
+	size_t calls=0;
+	none.for_each_leaf_block([&calls](int * const *, size_t) { ++calls; });
+	kptree::frozen_tree<int>(none).for_each_leaf_span([&calls](const int *, size_t) { ++calls; });
+	std::cout << "empty tree: " << calls << " calls" << std::endl;
+	}
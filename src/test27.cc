@@ -0,0 +1,168 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include "tree.hh"
+
+// Nodes which keep their depth and the max_depth() below them give the same
+// depth(), depth(it, root) and max_depth() as plain nodes, for which these
+// walk the tree, through random changes which move single nodes and whole
+// subtrees to other levels, between trees and in copies.
+
+typedef tree<int, std::allocator<tree_node_depth_<int> > > kept_t;
+typedef tree<int>                                          plain_t;
+
+template<class Tree>
+typename Tree::iterator nth(const Tree& tr, size_t n)
+	{
+	typename Tree::iterator it=tr.begin();
+	while(n-->0) ++it;
+	return it;
+	}
+
+/// Depths and maximal depths of all nodes, walking up from every node.
+std::string walked(const kept_t& tr)
+	{
+	std::string ret;
+	for(kept_t::iterator it=tr.begin(); it!=tr.end(); ++it) {
+		int depth=0, maxd=0;
+		for(kept_t::iterator up=tr.parent(it); tr.is_valid(up); up=tr.parent(up))
+			++depth;
+		kept_t::iterator end=it;
+		end.skip_children();
+		++end;
+		for(kept_t::iterator below=it; below!=end; ++below) {
+			int d=0;
+			for(kept_t::iterator up=below; up!=it; up=tr.parent(up))
+				++d;
+			maxd=std::max(maxd, d);
+			}
+		ret+=std::to_string(*it)+":"+std::to_string(depth)+"/"+std::to_string(maxd)+" ";
+		}
+	return ret;
+	}
+
+template<class Tree>
+std::string kept(const Tree& tr)
+	{
+	std::string ret;
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it)
+		ret+=std::to_string(*it)+":"+std::to_string(tr.depth(it))+"/"+std::to_string(tr.max_depth(it))+" ";
+	return ret;
+	}
+
+/// Whether depth(it, root) agrees for a few roots, for the nodes below them and for
+/// all others, for which the walk up ends at the top.
+template<class Tree>
+bool relative(const Tree& tr, const plain_t& plain)
+	{
+	for(size_t r=0; r<tr.size(); r+=7) {
+		typename Tree::iterator root=nth(tr, r);
+		plain_t::iterator proot=nth(plain, r);
+		typename Tree::iterator it=tr.begin();
+		plain_t::iterator pit=plain.begin();
+		for(; it!=tr.end(); ++it, ++pit)
+			if(tr.depth(it, root)!=plain.depth(pit, proot)) return false;
+		}
+	return true;
+	}
+
+/// Change both trees in the same way, picking changes and places with 'gen'.
+template<class Tree>
+void change(Tree& tr, std::mt19937& gen, int step)
+	{
+	if(tr.empty()) {
+		tr.set_head(step);
+		return;
+		}
+	typename Tree::iterator at=nth(tr, gen()%tr.size());
+	typename Tree::iterator to=nth(tr, gen()%tr.size());
+	bool apart=!tr.is_in_subtree(to, at) && !tr.is_in_subtree(at, to);
+	switch(gen()%19) {
+		case 0: tr.append_child(at, step); break;
+		case 1: tr.prepend_child(at, step); break;
+		case 2: tr.insert(at, step); break;
+		case 3: tr.insert_after(at, step); break;
+		case 4: if(tr.size()>20 || gen()%2==0) tr.erase(at); break;
+		case 5: if(apart) tr.move_after(to, at); break;
+		case 6: if(apart) tr.move_before(to, at); break;
+		case 7: if(apart) tr.move_ontop(to, at); break;
+		case 8: tr.flatten(at); break;
+		case 9: if(tr.number_of_children(at)>0 && !tr.is_in_subtree(to, at)) tr.reparent(tr.append_child(to, step), at); break;
+		case 10: tr.wrap(at, step); break;
+		case 11: if(apart) tr.swap(at, to); break;
+		case 12: if(!tr.is_in_subtree(to, at)) tr.replace(to, at); break;
+		case 13: if(apart && tr.size()<200) tr.insert_subtree(to, at); break;
+		case 14: 
+			if(tr.depth(at)>0 && !tr.is_in_subtree(to, at)) {
+				Tree moved=tr.move_out(at);
+				tr.move_in_below(to, moved);
+				}
+			break;
+		case 15: tr.append_child(at, step); tr.prepend_child(tr.append_child(at, step), step); break;
+		case 16: if(tr.size()>100) tr.erase_children(at); break;
+		case 17: if(tr.size()>100) tr.erase_left_siblings(at); break;
+		case 18: if(tr.size()>100) tr.erase_right_siblings(at); break;
+		}
+	}
+
+int main(int, char **)
+	{
+	bool agree=true, rel=true;
+	for(unsigned int seed=0; seed<3; ++seed) {
+		kept_t  tr;
+		plain_t plain;
+		std::mt19937 gen1(seed), gen2(seed);
+		for(int step=0; step<2000; ++step) {
+			change(tr, gen1, step);
+			change(plain, gen2, step);
+			if(step%50==0) {
+				// Only some of the changes get looked at, so that heights go unknown for
+				// longer and along more than one change.
+				agree=agree && kept(tr)==kept(plain) && kept(tr)==walked(tr);
+				rel=rel && relative(tr, plain);
+				}
+			}
+		agree=agree && kept(tr)==kept(plain) && kept(tr)==walked(tr) && tr.max_depth()==plain.max_depth();
+		std::cout << "seed " << seed << ": " << tr.size() << " nodes, max_depth " << tr.max_depth()
+					 << ", same: " << agree << ", relative: " << (rel && relative(tr, plain)) << std::endl;
+
+		// Copies, and subtrees taken out from below some node, start at depth 0.
+		size_t n=0;
+		while(tr.depth(nth(tr, n))==0 || tr.number_of_children(nth(tr, n))==0) ++n;
+		kept_t::iterator from=nth(tr, n);
+		plain_t::iterator plain_from=nth(plain, n);
+		kept_t copy(tr), sub=tr.subtree(tr.begin(from), tr.end(from));
+		plain_t plain_sub=plain.subtree(plain.begin(plain_from), plain.end(plain_from));
+		std::cout << "copy: " << (kept(copy)==kept(plain) && kept(copy)==walked(copy))
+					 << ", subtree: " << (kept(sub)==kept(plain_sub) && kept(sub)==walked(sub)) << std::endl;
+		}
+
+	// A long chain, moved up one level at a time from the bottom.
+	kept_t chain;
+	kept_t::iterator it=chain.set_head(0);
+	for(int i=1; i<1000; ++i)
+		it=chain.append_child(it, i);
+	std::cout << "chain: " << chain.max_depth() << " " << chain.depth(it);
+	chain.move_after(chain.begin(), it);
+	chain.flatten(chain.begin());
+	std::cout << ", after moving and flattening: " << chain.max_depth() << " " << chain.depth(it) 
+				 << " " << chain.depth(nth(chain, 500)) << std::endl;
+
+	// Heights once the only deep subtree is erased together with its siblings.
+	kept_t er;
+	kept_t::iterator top=er.set_head(0);
+	kept_t::iterator first=er.append_child(top, 1);
+	er.append_child(er.append_child(er.append_child(top, 2), 20), 200);
+	er.append_child(top, 3);
+	std::cout << "erased siblings: " << er.max_depth(top);
+	er.erase_right_siblings(first);
+	std::cout << " " << er.max_depth(top) << " " << er.max_depth();
+	er.append_child(er.append_child(first, 10), 100);
+	er.insert_after(first, 4);
+	std::cout << ", " << er.max_depth(top);
+	er.erase_left_siblings(er.child(top, 1));
+	std::cout << " " << er.max_depth(top) << std::endl;
+
+	kept_t none;
+	std::cout << "empty tree: " << none.max_depth() << std::endl;
+	}
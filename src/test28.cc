@@ -0,0 +1,146 @@
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include "tree.hh"
+
+// Changes made inside a batch() scope leave subtree sizes and depths alone
+// until the scope ends; afterwards the trees agree with trees which had
+// them kept up to date all along, with nested scopes, subtrees moved out in
+// the middle, and scopes rolled back by an exception.
+
+typedef tree<int, std::allocator<tree_node_counted_<int> > > counted_t;
+typedef tree<int, std::allocator<tree_node_depth_<int> > >   depth_t;
+
+template<class Tree>
+typename Tree::iterator nth(const Tree& tr, size_t n)
+	{
+	typename Tree::iterator it=tr.begin();
+	while(n-->0) ++it;
+	return it;
+	}
+
+template<class Tree>
+std::string shape(const Tree& tr)
+	{
+	std::string ret;
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it)
+		ret+=std::to_string(*it)+":"+std::to_string(tr.size(it))+"/"+std::to_string(tr.number_of_children(it))
+			+"/"+std::to_string(tr.depth(it))+"/"+std::to_string(tr.max_depth(it))+" ";
+	return ret;
+	}
+
+/// One random change, with places and kind picked by 'gen'.
+template<class Tree>
+void change(Tree& tr, std::mt19937& gen, int step)
+	{
+	if(tr.empty()) {
+		tr.set_head(step);
+		return;
+		}
+	typename Tree::iterator at=nth(tr, gen()%tr.size());
+	typename Tree::iterator to=nth(tr, gen()%tr.size());
+	bool apart=!tr.is_in_subtree(to, at) && !tr.is_in_subtree(at, to);
+	switch(gen()%13) {
+		case 0: tr.append_child(at, step); break;
+		case 1: tr.insert(at, step); break;
+		case 2: if(tr.size()>20) tr.erase(at); break;
+		case 3: if(apart) tr.move_after(to, at); break;
+		case 4: if(apart) tr.move_ontop(to, at); break;
+		case 5: tr.flatten(at); break;
+		case 6: tr.wrap(at, step); break;
+		case 7: if(apart) tr.swap(at, to); break;
+		case 8:
+			if(!Tree::is_head(at) && !tr.is_in_subtree(to, at)) {
+				Tree moved=tr.move_out(at);
+				moved.debug_verify_consistency();
+				tr.move_in_below(to, moved);
+				}
+			break;
+		case 9: tr.prepend_child(tr.append_child(at, step), step); break;
+		case 10: if(tr.size()>100) tr.erase_children(at); break;
+		case 11: if(tr.size()>100) tr.erase_left_siblings(at); break;
+		case 12: if(tr.size()>100) tr.erase_right_siblings(at); break;
+		}
+	}
+
+/// Apply 'ops' changes to a tree in batches of 'per_batch', and to a plain tree one by one.
+template<class Tree>
+bool batched(unsigned int seed, int ops, int per_batch)
+	{
+	Tree       tr;
+	tree<int>  plain;
+	std::mt19937 gen1(seed), gen2(seed);
+	for(int step=0; step<ops; ) {
+		typename Tree::batch_scope b=tr.batch();
+		for(int i=0; i<per_batch && step<ops; ++i, ++step)
+			change(tr, gen1, step);
+		b.commit();
+		tr.debug_verify_consistency();
+		}
+	for(int step=0; step<ops; ++step)
+		change(plain, gen2, step);
+	return shape(tr)==shape(plain);
+	}
+
+int main(int, char **)
+	{
+	for(unsigned int seed=0; seed<3; ++seed)
+		std::cout << "seed " << seed << ": counted " << batched<counted_t>(seed, 1000, 100)
+					 << ", depth " << batched<depth_t>(seed, 1000, 100)
+					 << ", one batch " << batched<depth_t>(seed, 1000, 1000) << std::endl;
+
+	// Nested scopes: only the outermost one brings the tree up to date.
+	counted_t tr;
+	counted_t::iterator top=tr.set_head(0);
+	{
+	counted_t::batch_scope outer=tr.batch();
+	for(int i=1; i<5; ++i) tr.append_child(top, i);
+	{
+	counted_t::batch_scope inner=tr.batch();
+	tr.append_child(tr.begin(top), 5);
+	inner.commit();
+	}
+	std::cout << "inside: " << tr.size() << " " << tr.size(top) << " " << tr.number_of_children(top) << std::endl;
+	}
+	std::cout << "after: " << tr.size() << " " << tr.size(top) << " " << tr.number_of_children(top) << std::endl;
+
+	// Common ancestors asked for inside a scope, after the depths went stale.
+	depth_t lt;
+	depth_t::iterator lt_top=lt.set_head(0);
+	depth_t::iterator deep=lt.append_child(lt.append_child(lt.append_child(lt_top, 1), 2), 3);
+	depth_t::iterator shallow=lt.append_child(lt_top, 4);
+	{
+	depth_t::batch_scope b=lt.batch();
+	for(int i=0; i<3; ++i) 
+		lt.wrap(lt.child(lt_top, 0), 10+i);
+	deep=lt.append_child(deep, 5);
+	std::cout << "common ancestor: " << *lt.lowest_common_ancestor(deep, shallow) << " "
+				 << *lt.lowest_common_ancestor(deep, lt.parent(deep)) << std::endl;
+	b.commit();
+	}
+
+	// A scope left by an exception, with and without rollback.
+	depth_t dt;
+	depth_t::iterator head=dt.set_head(0);
+	dt.append_child(dt.append_child(head, 1), 2);
+	std::string before=shape(dt);
+	try {
+		depth_t::batch_scope b=dt.batch(true);
+		dt.wrap(dt.begin(), 3);
+		dt.flatten(dt.begin());
+		throw std::runtime_error("failed");
+		}
+	catch(std::exception&) {
+		}
+	std::cout << "rolled back: " << (shape(dt)==before) << " " << shape(dt) << std::endl;
+	try {
+		depth_t::batch_scope b=dt.batch();
+		dt.wrap(dt.begin(), 3);
+		throw std::runtime_error("failed");
+		}
+	catch(std::exception&) {
+		}
+	dt.debug_verify_consistency();
+	std::cout << "kept: " << shape(dt) << std::endl;
+	}
@@ -0,0 +1,122 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include "tree.hh"
+#include "tree_diff.hh"
+
+// Patches made by kptree::diff turn one tree into the other, for trees
+// which differ by a few random changes or completely, and for empty trees;
+// the size of the patch follows the number of changes.
+
+typedef tree<int> tree_t;
+
+std::string show(const kptree::tree_patch<int>& patch)
+	{
+	const char *names[]={"insert", "erase", "replace", "move"};
+	std::string ret;
+	for(const kptree::tree_edit<int>& e: patch) {
+		ret+=names[e.kind];
+		ret+=" ";
+		if(e.kind==kptree::tree_edit<int>::move) {
+			for(int p: e.from) ret+=std::to_string(p)+".";
+			ret+=" to ";
+			}
+		for(int p: e.path) ret+=std::to_string(p)+".";
+		if(e.kind==kptree::tree_edit<int>::replace)
+			ret+=" = "+std::to_string(e.value);
+		if(e.kind==kptree::tree_edit<int>::insert)
+			ret+=" ("+std::to_string(e.subtree.size())+" nodes)";
+		ret+="; ";
+		}
+	return ret;
+	}
+
+tree_t::iterator nth(const tree_t& tr, size_t n)
+	{
+	tree_t::iterator it=tr.begin();
+	while(n-->0) ++it;
+	return it;
+	}
+
+void random_tree(tree_t& tr, std::mt19937& gen, size_t n)
+	{
+	tr.set_head(0);
+	for(size_t i=1; i<n; ++i)
+		tr.append_child(nth(tr, gen()%tr.size()), int(gen()%20));
+	}
+
+void change(tree_t& tr, std::mt19937& gen, int step)
+	{
+	tree_t::iterator at=nth(tr, gen()%tr.size());
+	tree_t::iterator to=nth(tr, gen()%tr.size());
+	bool apart=!tr.is_in_subtree(to, at) && !tr.is_in_subtree(at, to);
+	switch(gen()%10) {
+		case 0: tr.append_child(at, 100+step); break;
+		case 1: tr.insert(at, 100+step); break;
+		case 2: if(tr.size()>10) tr.erase(at); break;
+		case 3: *at=100+step; break;
+		case 4: if(apart) tr.move_after(to, at); break;
+		case 5: if(at.node->next_sibling!=0 && at.node->next_sibling!=tr.feet) tr.swap(tree_t::sibling_iterator(at)); break;
+		case 6: tr.flatten(at); break;
+		case 7: if(tr.size()>10) tr.erase_children(at); break;
+		case 8: if(tr.size()>10) tr.erase_left_siblings(at); break;
+		case 9: if(tr.size()>10) tr.erase_right_siblings(at); break;
+		}
+	}
+
+bool patched(const tree_t& a, const tree_t& b, size_t& edits)
+	{
+	kptree::tree_patch<int> patch=kptree::diff(a, b);
+	edits=patch.size();
+	tree_t c(a);
+	kptree::apply_patch(c, patch);
+	c.debug_verify_consistency();
+	return c.size()==b.size() && (b.empty() || c.equal(c.begin(), c.end(), b.begin()));
+	}
+
+int main(int, char **)
+	{
+	// Small cases, with the patches in full.
+	tree_t a, b;
+	tree_t::iterator top=a.set_head(1);
+	for(int i=2; i<7; ++i) a.append_child(top, i);
+	a.append_child(a.child(top, 2), 10);
+	b=a;
+	std::cout << "equal: " << show(kptree::diff(a, b)) << std::endl;
+	*b.child(b.begin(), 1)=20;
+	std::cout << "value: " << show(kptree::diff(a, b)) << std::endl;
+	b.move_after(b.child(b.begin(), 4), b.child(b.begin(), 0));
+	std::cout << "moved: " << show(kptree::diff(a, b)) << std::endl;
+	b.append_child(b.append_child(b.child(b.begin(), 1), 30), 31);
+	b.erase(b.child(b.begin(), 3));
+	b.insert(b.begin(), 0);
+	size_t edits;
+	bool ok=patched(a, b, edits);
+	std::cout << "more: " << show(kptree::diff(a, b)) << ok << std::endl;
+	tree_t none;
+	std::cout << "from empty: " << show(kptree::diff(none, a)) << patched(none, a, edits) << std::endl;
+	std::cout << "to empty: " << show(kptree::diff(a, none)) << patched(a, none, edits) << std::endl;
+	tree_t reversed;
+	for(int i=0; i<6; ++i) reversed.insert(reversed.begin(), i);
+	tree_t sorted(reversed);
+	sorted.sort(sorted.begin(), sorted.end());
+	std::cout << "reversed: " << show(kptree::diff(reversed, sorted)) << patched(reversed, sorted, edits) << std::endl;
+
+	// Random trees with a growing number of random changes.
+	for(unsigned int seed=0; seed<4; ++seed) {
+		std::mt19937 gen(seed);
+		tree_t orig;
+		random_tree(orig, gen, 500);
+		std::cout << "seed " << seed << ":";
+		for(int changes: {1, 5, 25, 125}) {
+			tree_t changed(orig);
+			for(int step=0; step<changes; ++step)
+				change(changed, gen, step);
+			bool ok=patched(orig, changed, edits);
+			std::cout << " " << changes << " changes " << ok << " " << (edits<=size_t(4*changes)) << ",";
+			}
+		tree_t other;
+		random_tree(other, gen, 300);
+		std::cout << " other tree " << patched(orig, other, edits) << std::endl;
+		}
+	}
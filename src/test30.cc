@@ -0,0 +1,153 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "tree.hh"
+
+// Ranges from begin_fixed to end_fixed hold the nodes at the given depth
+// below a node (or its siblings, for depth 0), walking forward and back,
+// for plain nodes and for indexed nodes which step through the lists of
+// the ancestry index; also after the tree changed halfway through a range,
+// and for next_at_same_depth.
+
+typedef tree<int>                                            plain_t;
+typedef tree<int, std::allocator<tree_node_indexed_<int> > > indexed_t;
+
+template<class Tree>
+void random_tree(Tree& tr, std::mt19937& gen, size_t n)
+	{
+	std::vector<typename Tree::iterator> nodes;
+	nodes.push_back(tr.set_head(0));
+	if(n>3) nodes.push_back(tr.insert_after(tr.begin(), 1));
+	while(nodes.size()<n) {
+		// Mostly below the last few nodes, for deep and sparse trees.
+		size_t at=(gen()%4==0)?gen()%nodes.size():nodes.size()-1-gen()%std::min<size_t>(nodes.size(), 3);
+		nodes.push_back(tr.append_child(nodes[at], int(nodes.size())));
+		}
+	}
+
+/// Values of the nodes at depth dp below pos, or of pos and its siblings if dp==0.
+template<class Tree>
+std::string expected(const Tree& tr, typename Tree::iterator pos, unsigned int dp, bool walk_back)
+	{
+	std::string ret;
+	if(dp==0) {
+		typename Tree::sibling_iterator it=pos;
+		if(walk_back)
+			while(tr.index(it)>0) --it;
+		for(; tr.is_valid(it); ++it)
+			ret+=std::to_string(*it)+" ";
+		return ret;
+		}
+	typename Tree::iterator it=pos, end=pos;
+	end.skip_children();
+	++end;
+	for(; it!=end; ++it)
+		if(tr.depth(it, pos)==int(dp))
+			ret+=std::to_string(*it)+" ";
+	return ret;
+	}
+
+template<class Tree>
+std::string forward(const Tree& tr, typename Tree::iterator pos, unsigned int dp, bool walk_back)
+	{
+	std::string ret;
+	for(typename Tree::fixed_depth_iterator it=tr.begin_fixed(pos, dp, walk_back); it!=tr.end_fixed(pos, dp); ++it)
+		ret+=std::to_string(*it)+" ";
+	return ret;
+	}
+
+template<class Tree>
+std::string backward(const Tree& tr, typename Tree::iterator pos, unsigned int dp)
+	{
+	std::vector<int> vals;
+	typename Tree::fixed_depth_iterator it=tr.begin_fixed(pos, dp), last=it;
+	if(it==tr.end_fixed(pos, dp)) return "";
+	for(; it!=tr.end_fixed(pos, dp); ++it)
+		last=it;
+	for(it=last; it.node!=0; --it)
+		vals.insert(vals.begin(), *it);
+	std::string ret;
+	for(int v: vals)
+		ret+=std::to_string(v)+" ";
+	return ret;
+	}
+
+template<class Tree>
+bool check(const Tree& tr)
+	{
+	bool ok=true;
+	int maxd=tr.max_depth();
+	for(typename Tree::iterator pos=tr.begin(); pos!=tr.end(); ++pos)
+		for(int dp=0; dp<=maxd-tr.depth(pos)+1; ++dp) {
+			std::string exp=expected(tr, pos, dp, true);
+			ok=ok && forward(tr, pos, dp, true)==exp && backward(tr, pos, dp)==exp;
+			if(dp==0)
+				ok=ok && forward(tr, pos, dp, false)==expected(tr, pos, dp, false);
+			}
+	return ok;
+	}
+
+/// Whether next_at_same_depth gives the next node at that depth in the whole tree.
+template<class Tree>
+bool next_same(const Tree& tr)
+	{
+	std::vector<std::vector<typename Tree::iterator> > levels(tr.max_depth()+1);
+	for(typename Tree::iterator it=tr.begin(); it!=tr.end(); ++it)
+		levels[tr.depth(it)].push_back(it);
+	for(size_t d=0; d<levels.size(); ++d)
+		for(size_t i=0; i+1<levels[d].size(); ++i)
+			if(tr.next_at_same_depth(levels[d][i])!=levels[d][i+1])
+				return false;
+	return true;
+	}
+
+int main(int, char **)
+	{
+	for(unsigned int seed=0; seed<4; ++seed) {
+		std::mt19937 gen1(seed), gen2(seed);
+		plain_t   plain;
+		indexed_t indexed;
+		random_tree(plain, gen1, 200);
+		random_tree(indexed, gen2, 200);
+		std::cout << "seed " << seed << ": max_depth " << plain.max_depth() << ", plain " << check(plain)
+					 << ", indexed " << check(indexed) << ", next " << next_same(plain) << " " << next_same(indexed)
+					 << std::endl;
+		}
+
+	// Changes halfway through a range: the rest of it is found by walking the tree.
+	indexed_t tr;
+	indexed_t::iterator top=tr.set_head(0);
+	for(int i=1; i<=4; ++i)
+		tr.append_child(tr.append_child(top, i), 10*i);
+	indexed_t::fixed_depth_iterator it=tr.begin_fixed(top, 2);
+	std::cout << "changed: " << *it;
+	++it;
+	std::cout << " " << *it;
+	tr.append_child(tr.child(top, 3), 41);
+	tr.append_child(tr.child(top, 0), 11);
+	for(++it; it!=tr.end_fixed(top, 2); ++it)
+		std::cout << " " << *it;
+	std::cout << std::endl;
+
+	// An empty range, and the level of a node at the top.
+	std::cout << "empty: " << (tr.begin_fixed(top, 3)==tr.end_fixed(top, 3))
+				 << ", top level: " << forward(tr, top, 0, true) << std::endl;
+
+	// Ranges started once siblings are gone hold only the nodes that are left.
+	indexed_t er;
+	indexed_t::iterator etop=er.set_head(0);
+	std::vector<indexed_t::iterator> kids;
+	for(int i=1; i<=5; ++i)
+		kids.push_back(er.append_child(etop, i));
+	er.append_child(kids[2], 30);
+	std::cout << "erased: " << forward(er, etop, 1, true) << "/ ";
+	er.erase_right_siblings(kids[3]);
+	std::cout << forward(er, etop, 1, true) << "/ ";
+	er.erase_left_siblings(kids[1]);
+	std::cout << forward(er, etop, 1, true) << forward(er, etop, 2, true) << "/ ";
+	er.erase_children(kids[2]);
+	std::cout << forward(er, etop, 1, true) << (er.begin_fixed(etop, 2)==er.end_fixed(etop, 2)) << " / ";
+	er.erase_right_siblings(kids[1]);
+	std::cout << forward(er, etop, 1, true) << backward(er, etop, 1) << std::endl;
+	}
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tree.hh"
+#include "tree_coro.hh"
+
+// The coroutine generators give the nodes in the same order as the tree's
+// iterators, for whole trees and subtrees; prefetch and async_visit get the
+// results of fetches which run on other threads, in traversal order or as
+// they come in, with no more of them running at a time than asked for, and
+// pass on the exception of a fetch which fails.
+
+typedef tree<int> tree_t;
+
+template<class Gen>
+std::vector<int> values(Gen gen)
+	{
+	std::vector<int> ret;
+	for(auto& it: gen)
+		ret.push_back(*it);
+	return ret;
+	}
+
+/// Values from a walk over the whole tree with the iterator It, of all nodes or only
+/// of those below 'top'.
+template<class It>
+std::vector<int> values(const tree_t& tr, It it, It end, tree_t::iterator top=tree_t::iterator())
+	{
+	std::vector<int> ret;
+	for(; it!=end; ++it)
+		if(top.node==0 || tr.is_in_subtree(it, top))
+			ret.push_back(*it);
+	return ret;
+	}
+
+std::string show(const std::vector<int>& vals)
+	{
+	std::string ret;
+	for(int v: vals)
+		ret+=std::to_string(v)+" ";
+	return ret;
+	}
+
+std::atomic<int> running(0), most_running(0);
+
+/// Stands in for a lookup of the data a node refers to: takes a while, longer
+/// for some nodes than for others, and fails for negative values.
+std::future<int> fetch(tree_t::iterator it)
+	{
+	int val=*it;
+	return std::async(std::launch::async, [val]() {
+		int now=++running;
+		int most=most_running;
+		while(now>most && !most_running.compare_exchange_weak(most, now))
+			;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1+(val%4==0?3:0)));
+		--running;
+		if(val<0) throw std::runtime_error("no data");
+		return 10*val;
+		});
+	}
+
+int main(int, char **)
+	{
+	// A small tree in full, then a random one against the iterators.
+	tree_t small;
+	tree_t::iterator one=small.set_head(1);
+	tree_t::iterator two=small.append_child(one, 2);
+	small.append_child(two, 4);
+	small.append_child(two, 5);
+	small.append_child(small.append_child(one, 3), 6);
+	small.insert_after(one, 7);
+	std::cout << "pre: " << show(values(kptree::pre_order(small))) << std::endl
+				 << "post: " << show(values(kptree::post_order(small))) << std::endl
+				 << "breadth: " << show(values(kptree::breadth_first(small))) << std::endl
+				 << "leaves: " << show(values(kptree::leaves(small))) << std::endl
+				 << "subtrees: " << show(values(kptree::pre_order(small, two))) << "/ " 
+				 << show(values(kptree::post_order(small, two))) << "/ " 
+				 << show(values(kptree::breadth_first(small, one))) << "/ " 
+				 << show(values(kptree::leaves(small, one))) << std::endl;
+
+	std::vector<int> pruned;
+	for(auto& it: kptree::pre_order(small)) {
+		pruned.push_back(*it);
+		if(*it==2) it.skip_children();
+		}
+	std::cout << "pruned: " << show(pruned) << std::endl;
+
+	tree_t tr;
+	std::mt19937 gen(1);
+	tree_t::iterator top=tr.set_head(0);
+	tr.insert_after(top, 1);
+	for(int i=2; i<200; ++i) {
+		tree_t::iterator at=tr.begin();
+		for(unsigned int n=gen()%tr.size(); n>0; --n) ++at;
+		tr.append_child(at, i);
+		}
+	bool whole=values(kptree::pre_order(tr))==values(tr, tr.begin(), tr.end())
+		&& values(kptree::post_order(tr))==values(tr, tr.begin_post(), tr.end_post())
+		&& values(kptree::breadth_first(tr))==values(tr, tr.begin_breadth_first(), tr.end_breadth_first())
+		&& values(kptree::leaves(tr))==values(tr, tr.begin_leaf(), tr.end_leaf());
+	bool below=true;
+	for(tree_t::iterator sub=tr.begin(); sub!=tr.end(); ++sub)
+		below=below && values(kptree::pre_order(tr, sub))==values(tr, tr.begin(), tr.end(), sub)
+			&& values(kptree::post_order(tr, sub))==values(tr, tr.begin_post(), tr.end_post(), sub)
+			&& values(kptree::breadth_first(tr, sub))==values(tr, tree_t::breadth_first_queued_iterator(sub), tr.end_breadth_first())
+			&& values(kptree::leaves(tr, sub))==values(tr, tr.begin_leaf(sub), tr.end_leaf(sub), sub);
+	std::cout << "random tree: whole " << whole << ", subtrees " << below << std::endl;
+
+	// Fetches in flight while walking.
+	std::vector<int> expected, got;
+	for(tree_t::post_order_iterator it=tr.begin_post(); it!=tr.end_post(); ++it)
+		expected.push_back(10*(*it));
+	bool paired=true;
+	for(auto& done: kptree::prefetch(kptree::post_order(tr), 8, fetch)) {
+		got.push_back(done.second);
+		paired=paired && done.second==10*(*done.first);
+		}
+	std::cout << "ordered: " << (got==expected) << " " << paired 
+				 << ", at most 8 running: " << (most_running<=8) << " " << (most_running>1) << std::endl;
+
+	got.clear();
+	most_running=0;
+	kptree::async_visit(kptree::post_order(tr), 4, fetch, [&](tree_t::post_order_iterator it, int val) {
+		got.push_back(val);
+		paired=paired && val==10*(*it);
+		}, false);
+	std::sort(got.begin(), got.end());
+	std::sort(expected.begin(), expected.end());
+	std::cout << "unordered: " << (got==expected) << " " << paired 
+				 << ", at most 4 running: " << (most_running<=4) << std::endl;
+
+	got.clear();
+	most_running=0;
+	kptree::async_visit(kptree::leaves(tr, top), 1, fetch, [&](tree_t::leaf_iterator, int val) {
+		got.push_back(val);
+		});
+	std::cout << "one at a time: " << (got.size()==values(kptree::leaves(tr, top)).size()) << " " << most_running << std::endl;
+
+	*tr.child(top, 0)=-1;
+	got.clear();
+	try {
+		kptree::async_visit(kptree::pre_order(tr), 8, fetch, [&](tree_t::iterator, int val) {
+			got.push_back(val);
+			});
+		std::cout << "failed fetch: no exception" << std::endl;
+		}
+	catch(std::runtime_error& ex) {
+		std::cout << "failed fetch: " << ex.what() << " after " << got.size() << std::endl;
+		}
+	}
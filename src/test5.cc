@@ -0,0 +1,86 @@
+
+#include <iostream>
+#include <string>
+#include "tree.hh"
+
+// Trees using the pool allocator: nodes come out of shared chunks, are
+// recycled on erase, and are dropped in one go on clear() when possible.
+
+typedef tree_node_pool_allocator<tree_node_<int> >         int_pool;
+typedef tree_node_pool_allocator<tree_node_<std::string> > string_pool;
+
+template<class Tree>
+void print(const Tree& tr)
+	{
+	typename Tree::pre_order_iterator it=tr.begin();
+	while(it!=tr.end()) {
+		for(int i=0; i<tr.depth(it); ++i)
+			std::cout << "  ";
+		std::cout << (*it) << std::endl;
+		++it;
+		}
+	std::cout << "--" << std::endl;
+	}
+
+int main(int, char **)
+	{
+	int_pool pool(16);
+	{
+	tree<int, int_pool> tr(pool);
+	tree<int, int_pool>::iterator top=tr.set_head(1);
+	for(int i=0; i<10; ++i) {
+		tree<int, int_pool>::iterator ch=tr.append_child(top, 10+i);
+		for(int j=0; j<5; ++j)
+			tr.append_child(ch, 100*(i+1)+j);
+		}
+	std::cout << tr.size() << " nodes, " << pool.nodes_in_use() << " in use, capacity " << pool.capacity() << std::endl;
+
+	// Erased nodes go back on the free list and get reused.
+	tr.erase_children(tr.begin());
+	std::cout << pool.nodes_in_use() << " in use" << std::endl;
+	tr.append_child(tr.begin(), 2);
+	tr.append_child(tr.begin(), 3);
+	std::cout << pool.nodes_in_use() << " in use, capacity " << pool.capacity() << std::endl;
+
+	// Moving nodes between trees sharing one pool.
+	tree<int, int_pool> other(pool);
+	other.set_head(4);
+	other.append_child(other.begin(), 5);
+	tr.move_in_below(tr.begin(), other);
+	print(tr);
+	tree<int, int_pool> out=tr.move_out(tr.child(tr.begin(), 2));
+	print(out);
+
+	// The pool is shared, so clear() has to take the slow path.
+	tr.clear();
+	std::cout << tr.empty() << " " << pool.nodes_in_use() << " in use" << std::endl;
+	}
+	std::cout << pool.nodes_in_use() << " in use" << std::endl;
+
+	// A tree owning its pool drops all chunks at once on clear().
+	tree<int, int_pool> own;
+	own.set_head(0);
+	for(int i=1; i<5000; ++i)
+		own.append_child(own.begin(), i);
+	std::cout << own.get_allocator().capacity() << std::endl;
+	own.clear();
+	std::cout << own.empty() << " " << own.size() << " " << own.get_allocator().capacity() << std::endl;
+	own.set_head(7);
+	own.append_child(own.begin(), 8);
+	print(own);
+	tree<int, int_pool> moved(std::move(own));
+	print(moved);
+	tree<int, int_pool> assigned;
+	assigned.set_head(9);
+	assigned=std::move(moved);
+	print(assigned);
+
+	// Non-trivial payloads are destroyed one by one.
+	tree<std::string, string_pool> str;
+	str.set_head("head");
+	str.append_child(str.begin(), "one");
+	str.append_child(str.begin(), "two");
+	tree<std::string, string_pool> strcopy(str);
+	str.clear();
+	print(strcopy);
+	}
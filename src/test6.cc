@@ -0,0 +1,88 @@
+
+#include <iostream>
+#include <string>
+#include "tree.hh"
+
+// Trees with counted nodes: size() and number_of_children() come from
+// counts cached in the nodes, which every mutating member keeps up to date.
+// debug_verify_consistency() recounts everything and asserts on mismatch.
+
+typedef tree<std::string, std::allocator<tree_node_counted_<std::string> > > ctree;
+
+void report(const ctree& tr, const char *what)
+	{
+	tr.debug_verify_consistency();
+	std::cout << what << ": " << tr.size();
+	if(!tr.empty())
+		std::cout << " " << tr.number_of_children(tr.begin()) << " " << tr.number_of_siblings(tr.begin());
+	std::cout << std::endl;
+	}
+
+int main(int, char **)
+	{
+	ctree tr;
+	ctree::iterator top=tr.set_head("top");
+	ctree::iterator a=tr.append_child(top, "a");
+	ctree::iterator b=tr.append_child(top, "b");
+	ctree::iterator c=tr.prepend_child(top, "c");
+	tr.append_child(a, "a1");
+	tr.append_child(a, "a2");
+	tr.insert(b, "before b");
+	tr.insert_after(b, "after b");
+	report(tr, "built");
+	std::cout << tr.size(a) << " " << tr.number_of_children(a) << " " << a.number_of_children() << std::endl;
+
+	tr.insert_subtree(c, a);
+	report(tr, "insert_subtree");
+	tr.append_child(b, a);
+	report(tr, "append_child subtree");
+	std::cout << tr.size(b) << std::endl;
+
+	tr.flatten(b);
+	report(tr, "flatten");
+	tr.reparent(c, tr.begin(top), c);
+	report(tr, "reparent");
+	std::cout << tr.size(c) << " " << tr.number_of_children(c) << std::endl;
+	tr.wrap(c, "wrap");
+	report(tr, "wrap");
+
+	tr.move_after(b, a);
+	report(tr, "move_after");
+	tr.move_before(tr.child(c, 0), b);
+	report(tr, "move_before");
+	tr.move_before(c.end(), ctree::sibling_iterator(a));
+	report(tr, "move_before end");
+	std::cout << tr.size(c) << " " << tr.number_of_children(c) << std::endl;
+	tr.move_ontop(tr.child(c, 0), tr.child(c, 1));
+	report(tr, "move_ontop");
+
+	tr.swap(tr.child(top, 1), tr.child(c, 0));
+	report(tr, "swap");
+
+	ctree out=tr.move_out(c);
+	report(tr, "move_out");
+	report(out, "moved out");
+	tr.move_in_below(top, out);
+	report(tr, "move_in_below");
+	ctree other("other");
+	other.append_child(other.begin(), "x");
+	tr.move_in(tr.child(top, 0), other);
+	report(tr, "move_in");
+
+	ctree copy(tr);
+	report(copy, "copy");
+	copy.sort(copy.begin(copy.begin()), copy.end(copy.begin()), true);
+	copy.merge(copy.begin(), copy.end(), tr.begin(), tr.end(), true);
+	report(copy, "merge");
+
+	tr.erase_right_siblings(tr.child(top, 1));
+	report(tr, "erase_right_siblings");
+	tr.erase_left_siblings(tr.child(top, 1));
+	report(tr, "erase_left_siblings");
+	tr.erase(tr.child(top, 0));
+	report(tr, "erase");
+	tr.erase_children(top);
+	report(tr, "erase_children");
+	tr.clear();
+	report(tr, "clear");
+	}
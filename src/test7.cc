@@ -0,0 +1,79 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "tree.hh"
+
+// Payloads handed over as rvalues are moved into their node, and the emplace
+// members build them in place, so neither makes a copy.
+
+class payload {
+	public:
+		payload() {}
+		payload(const std::string& n, int k) : name(n), values(k, k) { ++constructed; }
+		payload(const payload& o) : name(o.name), values(o.values)    { ++copied; }
+		payload(payload&& o) : name(std::move(o.name)), values(std::move(o.values)) { ++moved; }
+		payload& operator=(const payload& o) { name=o.name; values=o.values; ++copied; return *this; }
+		payload& operator=(payload&& o)      { name=std::move(o.name); values=std::move(o.values); ++moved; return *this; }
+
+		std::string      name;
+		std::vector<int> values;
+
+		static int constructed, copied, moved;
+		static void report(const char *what)
+			{
+			std::cout << what << ": " << constructed << " constructed, " << copied << " copied, " 
+						 << moved << " moved" << std::endl;
+			constructed=copied=moved=0;
+			}
+};
+
+int payload::constructed=0;
+int payload::copied=0;
+int payload::moved=0;
+
+template<class Tree>
+void print(const Tree& tr)
+	{
+	typename Tree::pre_order_iterator it=tr.begin();
+	while(it!=tr.end()) {
+		for(int i=0; i<tr.depth(it); ++i)
+			std::cout << "  ";
+		std::cout << it->name << " " << it->values.size() << std::endl;
+		++it;
+		}
+	std::cout << "--" << std::endl;
+	}
+
+template<class Tree>
+void run()
+	{
+	Tree tr;
+	typename Tree::iterator top=tr.set_head(payload("top", 1));
+	tr.append_child(top, payload("a", 2));
+	tr.prepend_child(top, payload("b", 3));
+	typename Tree::iterator c=tr.insert(tr.child(top, 1), payload("c", 4));
+	tr.insert_after(c, payload("d", 5));
+	typename Tree::sibling_iterator e=tr.insert(typename Tree::sibling_iterator(top.end()), payload("e", 6));
+	payload::report("rvalue");
+
+	tr.emplace_child(e, "f", 7);
+	tr.emplace_before(tr.begin(e), "g", 8);
+	tr.emplace_after(c, "h", 9);
+	tr.emplace_before(typename Tree::sibling_iterator(e.end()), "i", 10);
+	payload::report("emplace");
+
+	print(tr);
+	tr.debug_verify_consistency();
+
+	Tree tr2;
+	tr2.emplace_head("head", 2);
+	tr2.emplace_child(tr2.begin(), "child", 3);
+	payload::report("emplace_head");
+	print(tr2);
+	}
+
+int main(int, char **)
+	{
+	run<tree<payload> >();
+	run<tree<payload, std::allocator<tree_node_counted_<payload> > > >();
+	}
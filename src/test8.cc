@@ -0,0 +1,71 @@
+#include <iostream>
+#include <random>
+#include <vector>
+#include "tree.hh"
+
+// The level-order iterator visits nodes in the same order as the queued
+// breadth-first iterator, on whole trees as well as on subtrees.
+
+typedef tree<int> tree_t;
+
+template<class Iter>
+std::vector<int> walk(Iter it, Iter end)
+	{
+	std::vector<int> ret;
+	while(it!=end) {
+		ret.push_back(*it);
+		it++;
+		}
+	return ret;
+	}
+
+void print(const std::vector<int>& v)
+	{
+	for(size_t i=0; i<v.size(); ++i)
+		std::cout << v[i] << " ";
+	std::cout << std::endl;
+	}
+
+int main(int, char **)
+	{
+	tree_t tr;
+	std::cout << "empty: " << walk(tr.begin_level_order(), tr.end_level_order()).size() << std::endl;
+
+	// Levels with gaps: only some nodes on each level have children.
+	tree_t::iterator top=tr.set_head(0);
+	tree_t::iterator a=tr.append_child(top, 1);
+	tree_t::iterator b=tr.append_child(top, 2);
+	tree_t::iterator c=tr.append_child(top, 3);
+	tr.append_child(a, 4);
+	tree_t::iterator e=tr.append_child(c, 5);
+	tree_t::iterator f=tr.append_child(c, 6);
+	tr.append_child(e, 7);
+	tr.append_child(tr.append_child(f, 8), 9);
+	(void)b;
+	print(walk(tr.begin_level_order(), tr.end_level_order()));
+	print(walk(tr.begin_breadth_first(), tr.end_breadth_first()));
+	print(walk(tree_t::level_order_iterator(c), tree_t::level_order_iterator()));
+	print(walk(tree_t::level_order_iterator(a), tree_t::level_order_iterator()));
+
+	// A second head is not part of the walk, as for the queued iterator.
+	tr.insert(tr.end(), 10);
+	print(walk(tr.begin_level_order(), tr.end_level_order()));
+
+	std::mt19937 gen(7);
+	int mismatches=0;
+	for(int round=0; round<50; ++round) {
+		tree_t rt;
+		std::vector<tree_t::iterator> nodes;
+		nodes.push_back(rt.set_head(0));
+		for(int i=1; i<200; ++i) {
+			std::uniform_int_distribution<size_t> pick(0, nodes.size()-1);
+			nodes.push_back(rt.append_child(nodes[pick(gen)], i));
+			}
+		for(size_t i=0; i<nodes.size(); i+=17) {
+			if(walk(tree_t::level_order_iterator(nodes[i]), tree_t::level_order_iterator())
+				!=walk(tree_t::breadth_first_queued_iterator(nodes[i]), tree_t::breadth_first_queued_iterator()))
+				++mismatches;
+			}
+		}
+	std::cout << "random trees: " << mismatches << " mismatches" << std::endl;
+	}
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "tree.hh"
+#include "tree_parallel.hh"
+
+// The parallel traversals visit every node below the top exactly once, for
+// any grain size and number of threads, and pass exceptions on to the caller.
+
+template<class Tree>
+void build(Tree& tr, int n)
+	{
+	std::mt19937 gen(3);
+	std::vector<typename Tree::iterator> nodes;
+	nodes.push_back(tr.set_head(0));
+	for(int i=1; i<n; ++i) {
+		std::uniform_int_distribution<size_t> pick(0, nodes.size()-1);
+		nodes.push_back(tr.append_child(nodes[pick(gen)], i));
+		}
+	}
+
+template<class Tree>
+long serial_sum(typename Tree::iterator top)
+	{
+	long sum=0;
+	typename Tree::iterator it=top, eit=top;
+	eit.skip_children();
+	++eit;
+	while(it!=eit) {
+		sum+=*it;
+		++it;
+		}
+	return sum;
+	}
+
+template<class Tree>
+void run(const char *name)
+	{
+	Tree tr;
+	build(tr, 10000);
+	typename Tree::iterator sub=tr.child(tr.begin(), 0);
+
+	bool ok=true;
+	size_t grains[]={ 0, 1, 50, 100000 };
+	unsigned int threads[]={ 1, 3, 8 };
+	for(size_t g=0; g<4; ++g) {
+		for(size_t t=0; t<3; ++t) {
+			long sum=kptree::parallel_reduce(tr, tr.begin(), 0L, [](long a, long b) { return a+b; }, grains[g], threads[t]);
+			if(sum!=serial_sum<Tree>(tr.begin())) ok=false;
+			sum=kptree::parallel_reduce(tr, sub, 0L, [](long a, long b) { return a+b; }, grains[g], threads[t]);
+			if(sum!=serial_sum<Tree>(sub)) ok=false;
+
+			// Every node incremented exactly once.
+			kptree::parallel_for_each(tr, tr.begin(), [](int& x) { x+=1; }, grains[g], threads[t]);
+			long count=kptree::parallel_transform_reduce(tr, tr.begin(), 0L, [](long a, long b) { return a+b; },
+																		[](int) { return 1L; }, grains[g], threads[t]);
+			if(count!=long(tr.size())) ok=false;
+			kptree::parallel_for_each(tr, tr.begin(), [](int& x) { x-=1; }, grains[g], threads[t]);
+			}
+		}
+	std::cout << name << " sum " << serial_sum<Tree>(tr.begin()) << (ok?" ok":" FAILED") << std::endl;
+
+	// A leaf on its own, and an init value which is not neutral.
+	typename Tree::iterator leaf=tr.begin();
+	while(leaf.number_of_children()>0) leaf=tr.child(leaf, 0);
+	std::cout << name << " leaf " << kptree::parallel_reduce(tr, leaf, 1000L, [](long a, long b) { return a+b; }) 
+				 << " (" << *leaf << ")" << std::endl;
+
+	try {
+		kptree::parallel_for_each(tr, tr.begin(), [](int& x) { if(x==5000) throw std::runtime_error("node 5000"); }, 10, 4);
+		}
+	catch(std::exception& ex) {
+		std::cout << name << " caught " << ex.what() << std::endl;
+		}
+	}
+
+int main(int, char **)
+	{
+	run<tree<int> >("plain");
+	run<tree<int, std::allocator<tree_node_counted_<int> > > >("counted");
+	}
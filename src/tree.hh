@@ -30,12 +30,38 @@
 #include <memory>
 #include <stdexcept>
 #include <iterator>
-#include <set>
 #include <queue>
 #include <algorithm>
 #include <cstddef>
+#include <vector>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+#include <cstdlib>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+#ifdef KPTREE_STATS
+#include <chrono>
+#endif
 
 
+/// Hint to the processor that the memory at 'p' will be read soon; p may be null. Does
+/// nothing on compilers which offer no way to say so.
+#if defined(__GNUC__)
+#define KPTREE_PREFETCH_(p)            __builtin_prefetch(p)
+#else
+#define KPTREE_PREFETCH_(p)            ((void)0)
+#endif
+
+/// Tag selecting the node constructors which build the data in place from the
+/// constructor arguments that follow it, as used by the emplace members of tree.
+struct tree_node_in_place_ {};
+
 /// A node in the tree, combining links to other nodes as well as the actual data.
 template<class T>
 class tree_node_ { // size: 5*4=20 bytes (on 32 bit arch), can be reduced by 8.
@@ -43,6 +69,8 @@ class tree_node_ { // size: 5*4=20 bytes (on 32 bit arch), can be reduced by 8.
 		tree_node_();
 		tree_node_(const T&);
 		tree_node_(T&&);
+		template<class... Args>
+		tree_node_(tree_node_in_place_, Args&&...);
 
 		tree_node_<T> *parent;
 	   tree_node_<T> *first_child, *last_child;
@@ -64,14 +92,1253 @@ tree_node_<T>::tree_node_(const T& val)
 
 template<class T>
 tree_node_<T>::tree_node_(T&& val)
-	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(val)
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(std::move(val))
+	{
+	}
+
+template<class T>
+template<class... Args>
+tree_node_<T>::tree_node_(tree_node_in_place_, Args&&... args)
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(std::forward<Args>(args)...)
+	{
+	}
+
+/// A node which in addition keeps track of its number of children and of the number of
+/// nodes in the subtree below it (itself included), so that size() and number_of_children()
+/// do not have to walk the tree. Every mutating member of tree keeps these up to date, at
+/// the cost of a walk up to the root. Select it through the allocator, e.g.
+/// tree<T, std::allocator<tree_node_counted_<T> > >.
+template<class T>
+class tree_node_counted_ {
+	public:
+		tree_node_counted_();
+		tree_node_counted_(const T&);
+		tree_node_counted_(T&&);
+		template<class... Args>
+		tree_node_counted_(tree_node_in_place_, Args&&...);
+
+		tree_node_counted_<T> *parent;
+	   tree_node_counted_<T> *first_child, *last_child;
+		tree_node_counted_<T> *prev_sibling, *next_sibling;
+		T data;
+
+		size_t       subtree_size;
+		unsigned int children;
+}; 
+
+template<class T>
+tree_node_counted_<T>::tree_node_counted_()
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), 
+	  subtree_size(1), children(0)
+	{
+	}
+
+template<class T>
+tree_node_counted_<T>::tree_node_counted_(const T& val)
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(val), 
+	  subtree_size(1), children(0)
+	{
+	}
+
+template<class T>
+tree_node_counted_<T>::tree_node_counted_(T&& val)
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(std::move(val)), 
+	  subtree_size(1), children(0)
+	{
+	}
+
+template<class T>
+template<class... Args>
+tree_node_counted_<T>::tree_node_counted_(tree_node_in_place_, Args&&... args)
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(std::forward<Args>(args)...), 
+	  subtree_size(1), children(0)
+	{
+	}
+
+/// A node which in addition can hold its position in a pre-order numbering of the tree,
+/// and the number just past its subtree. With this node type, tree builds an ancestry 
+/// index on the first call to is_in_subtree or lowest_common_ancestor after a change, 
+/// and answers those in O(1) and O(log n). Because building happens inside const members,
+/// concurrent queries on a freshly changed tree need one query to run on its own first.
+/// Select it through the allocator, e.g. tree<T, std::allocator<tree_node_indexed_<T> > >.
+template<class T>
+class tree_node_indexed_ {
+	public:
+		tree_node_indexed_();
+		tree_node_indexed_(const T&);
+		tree_node_indexed_(T&&);
+		template<class... Args>
+		tree_node_indexed_(tree_node_in_place_, Args&&...);
+
+		tree_node_indexed_<T> *parent;
+	   tree_node_indexed_<T> *first_child, *last_child;
+		tree_node_indexed_<T> *prev_sibling, *next_sibling;
+		T data;
+
+		size_t order, order_end;
+}; 
+
+template<class T>
+tree_node_indexed_<T>::tree_node_indexed_()
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), 
+	  order(0), order_end(0)
+	{
+	}
+
+template<class T>
+tree_node_indexed_<T>::tree_node_indexed_(const T& val)
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(val), 
+	  order(0), order_end(0)
+	{
+	}
+
+template<class T>
+tree_node_indexed_<T>::tree_node_indexed_(T&& val)
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(std::move(val)), 
+	  order(0), order_end(0)
+	{
+	}
+
+template<class T>
+template<class... Args>
+tree_node_indexed_<T>::tree_node_indexed_(tree_node_in_place_, Args&&... args)
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(std::forward<Args>(args)...), 
+	  order(0), order_end(0)
+	{
+	}
+
+/// Array of child pointers kept by tree_node_random_access_, with room for a few of them
+/// in place so that nodes with small fanout need no separate allocation.
+template<class Node, unsigned int N=4>
+class tree_node_child_array_ {
+	public:
+		tree_node_child_array_() : data_(inline_), size_(0), capacity_(N) {}
+		~tree_node_child_array_() { if(data_!=inline_) delete [] data_; }
+		tree_node_child_array_(const tree_node_child_array_&)=delete;
+		tree_node_child_array_& operator=(const tree_node_child_array_&)=delete;
+
+		unsigned int size() const                  { return size_; }
+		Node        *operator[](unsigned int i) const { return data_[i]; }
+		void         clear()                       { size_=0; }
+		void         push_back(Node *n)
+			{
+			if(size_==capacity_) {
+				Node **grown=new Node*[2*capacity_];
+				std::copy(data_, data_+size_, grown);
+				if(data_!=inline_) delete [] data_;
+				data_=grown;
+				capacity_*=2;
+				}
+			data_[size_++]=n;
+			}
+
+	private:
+		Node       **data_;
+		unsigned int size_, capacity_;
+		Node        *inline_[N];
+};
+
+/// A node which in addition keeps an array of pointers to its children, and its own
+/// position among its siblings, so that child(), sibling(), index(), number_of_children()
+/// and the steps of iterator_from_path() and path_from_iterator() take constant time 
+/// instead of a walk along the siblings. Changes to a list of children only mark the array
+/// of the parent as out of date; it gets rebuilt on the next such call. As for the ancestry
+/// index, concurrent calls on a freshly changed tree need one call to run on its own first.
+/// Select it through the allocator, e.g. tree<T, std::allocator<tree_node_random_access_<T> > >.
+template<class T>
+class tree_node_random_access_ {
+	public:
+		tree_node_random_access_();
+		tree_node_random_access_(const T&);
+		tree_node_random_access_(T&&);
+		template<class... Args>
+		tree_node_random_access_(tree_node_in_place_, Args&&...);
+
+		tree_node_random_access_<T> *parent;
+	   tree_node_random_access_<T> *first_child, *last_child;
+		tree_node_random_access_<T> *prev_sibling, *next_sibling;
+		T data;
+
+		tree_node_child_array_<tree_node_random_access_<T> > child_array;
+		unsigned int position;
+		bool         child_array_valid;
+}; 
+
+template<class T>
+tree_node_random_access_<T>::tree_node_random_access_()
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), 
+	  position(0), child_array_valid(false)
+	{
+	}
+
+template<class T>
+tree_node_random_access_<T>::tree_node_random_access_(const T& val)
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(val), 
+	  position(0), child_array_valid(false)
+	{
+	}
+
+template<class T>
+tree_node_random_access_<T>::tree_node_random_access_(T&& val)
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(std::move(val)), 
+	  position(0), child_array_valid(false)
+	{
+	}
+
+template<class T>
+template<class... Args>
+tree_node_random_access_<T>::tree_node_random_access_(tree_node_in_place_, Args&&... args)
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(std::forward<Args>(args)...), 
+	  position(0), child_array_valid(false)
+	{
+	}
+
+/// A node which in addition keeps its depth, and the max_depth() of the subtree below it,
+/// so that depth() takes constant time instead of a walk up to the root, and max_depth()
+/// only looks at the parts of the tree which changed since it was last asked. Mutating 
+/// members of tree set the depths of the nodes they put in a new place, which for a 
+/// subtree moved to another level takes a walk over that subtree; they mark the maximal 
+/// depths of the ancestors of a change unknown, stopping at the first ancestor for which 
+/// it already is. As for the ancestry index, concurrent calls to max_depth() on a freshly
+/// changed tree need one call to run on its own first. Select it through the allocator,
+/// e.g. tree<T, std::allocator<tree_node_depth_<T> > >.
+template<class T>
+class tree_node_depth_ {
+	public:
+		tree_node_depth_();
+		tree_node_depth_(const T&);
+		tree_node_depth_(T&&);
+		template<class... Args>
+		tree_node_depth_(tree_node_in_place_, Args&&...);
+
+		tree_node_depth_<T> *parent;
+	   tree_node_depth_<T> *first_child, *last_child;
+		tree_node_depth_<T> *prev_sibling, *next_sibling;
+		T data;
+
+		int  depth;
+		int  height;       // max_depth() of the subtree, if height_known
+		bool height_known;
+}; 
+
+template<class T>
+tree_node_depth_<T>::tree_node_depth_()
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), 
+	  depth(0), height(0), height_known(true)
+	{
+	}
+
+template<class T>
+tree_node_depth_<T>::tree_node_depth_(const T& val)
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(val), 
+	  depth(0), height(0), height_known(true)
+	{
+	}
+
+template<class T>
+tree_node_depth_<T>::tree_node_depth_(T&& val)
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(std::move(val)), 
+	  depth(0), height(0), height_known(true)
+	{
+	}
+
+template<class T>
+template<class... Args>
+tree_node_depth_<T>::tree_node_depth_(tree_node_in_place_, Args&&... args)
+	: parent(0), first_child(0), last_child(0), prev_sibling(0), next_sibling(0), data(std::forward<Args>(args)...), 
+	  depth(0), height(0), height_known(true)
+	{
+	}
+
+/// The nodes of one compact node type (see tree_node_compact_), for the whole program.
+/// They come in chunks of 2^16 nodes, each chunk starting at an address which is a
+/// multiple of its (power of two) alignment and holding its own number in front of its
+/// first node. A node is known by a 32-bit index, the number of its chunk times 2^16 plus
+/// its position in the chunk: the node is found from the index through the table of
+/// chunks, the index from the node through the number at the start of its chunk. Index 0
+/// is never handed out and stands for no node. Every thread takes nodes from a chunk and
+/// a free list of its own; what is left of those when it ends goes to a list shared by
+/// all threads, and is handed out again from there, also to threads which are ending.
+/// Once the last node has been given back, all chunks are freed; the threads notice
+/// from the generation of the pool that what they hold is gone.
+template<class Node>
+class tree_node_compact_pool_ {
+	public:
+		static const unsigned int chunk_bits=16;
+		static const uint32_t     max_chunks=(uint32_t(1)<<(32-chunk_bits))-1;
+
+		static Node     *node(uint32_t index)
+			{
+			return reinterpret_cast<Node *>(chunk_[index>>chunk_bits]+first_offset_()
+													  +size_t(index&(chunk_nodes_-1))*sizeof(Node));
+			}
+		static uint32_t  index(const Node *n)
+			{
+			uintptr_t at=reinterpret_cast<uintptr_t>(n), start=at&~uintptr_t(chunk_align_()-1);
+			uint32_t  number=*reinterpret_cast<const uint32_t *>(start);
+			return (number<<chunk_bits) | uint32_t((at-start-first_offset_())/sizeof(Node));
+			}
+		/// Room for one node, not constructed. Throws std::bad_alloc once all indices are used.
+		static Node     *allocate();
+		static void      deallocate(Node *);
+		/// Number of chunks held at the moment.
+		static uint32_t  chunks();
+
+	private:
+		static const size_t chunk_nodes_=size_t(1)<<chunk_bits;
+		static constexpr size_t first_offset_()
+			{
+			return (sizeof(uint32_t)+alignof(Node)-1)/alignof(Node)*alignof(Node);
+			}
+		static constexpr size_t chunk_bytes_()
+			{
+			return first_offset_()+chunk_nodes_*sizeof(Node);
+			}
+		static constexpr size_t chunk_align_(size_t a=1)
+			{
+			return a>=chunk_bytes_()?a:chunk_align_(2*a);
+			}
+		/// A free node holds the index of the next one in its first bytes.
+		static uint32_t& next_free_(uint32_t index) { return *reinterpret_cast<uint32_t *>(node(index)); }
+
+		/// Nodes next..end-1 of the chunk in use by a thread, and its free list, as of the
+		/// given generation of the pool.
+		struct local_ {
+			uint32_t      next, end, free;
+			unsigned long generation;
+			bool          registered, leaving;
+		};
+		/// Gives back what the thread holds when it ends.
+		struct leaver_ {
+			~leaver_();
+		};
+		static void     current_(local_&);
+		static void     refill_(local_&);
+		static void     register_(local_&);
+		static uint32_t new_chunk_();
+		static void     release_();
+
+		static char                *chunk_[max_chunks];
+		static uint32_t             chunks_, shared_free_;
+		static std::mutex           mutex_;
+		static thread_local local_  local_state_;
+		/// Nodes handed out and not given back; a large negative number while release_()
+		/// frees the chunks.
+		static std::atomic<int64_t>       live_;
+		static std::atomic<unsigned long> generation_;
+		static const int64_t              releasing_=int64_t(1)<<62;
+};
+
+template<class Node>
+char *tree_node_compact_pool_<Node>::chunk_[tree_node_compact_pool_<Node>::max_chunks];
+template<class Node>
+uint32_t tree_node_compact_pool_<Node>::chunks_=0;
+template<class Node>
+uint32_t tree_node_compact_pool_<Node>::shared_free_=0;
+template<class Node>
+std::mutex tree_node_compact_pool_<Node>::mutex_;
+template<class Node>
+thread_local typename tree_node_compact_pool_<Node>::local_ tree_node_compact_pool_<Node>::local_state_;
+template<class Node>
+std::atomic<int64_t> tree_node_compact_pool_<Node>::live_(0);
+template<class Node>
+std::atomic<unsigned long> tree_node_compact_pool_<Node>::generation_(0);
+
+template<class Node>
+Node *tree_node_compact_pool_<Node>::allocate()
+	{
+	if(live_.fetch_add(1)<0) { // chunks are being freed, wait until that is over
+		std::lock_guard<std::mutex> lock(mutex_);
+		}
+	local_& l=local_state_;
+	uint32_t ret;
+	try {
+		current_(l);
+		if(l.leaving) { // the thread is ending, take from the shared list
+			std::lock_guard<std::mutex> lock(mutex_);
+			if(shared_free_==0) {
+				uint32_t first=new_chunk_(), end=((first>>chunk_bits)+1)<<chunk_bits;
+				for(uint32_t i=first; i!=end; ++i) {
+					next_free_(i)=shared_free_;
+					shared_free_=i;
+					}
+				}
+			ret=shared_free_;
+			shared_free_=next_free_(ret);
+			return node(ret);
+			}
+		if(l.free==0 && l.next==l.end)
+			refill_(l);
+		}
+	catch(...) {
+		live_.fetch_sub(1);
+		throw;
+		}
+	if(l.free!=0) {
+		ret=l.free;
+		l.free=next_free_(ret);
+		}
+	else ret=l.next++;
+	return node(ret);
+	}
+
+template<class Node>
+void tree_node_compact_pool_<Node>::deallocate(Node *n)
+	{
+	uint32_t i=index(n);
+	local_& l=local_state_;
+	current_(l);
+	if(l.leaving) { // the thread is ending, its free list has been given back
+		std::lock_guard<std::mutex> lock(mutex_);
+		next_free_(i)=shared_free_;
+		shared_free_=i;
+		}
+	else {
+		if(!l.registered)
+			register_(l);
+		next_free_(i)=l.free;
+		l.free=i;
+		}
+	if(live_.fetch_sub(1)==1)
+		release_();
+	}
+
+template<class Node>
+uint32_t tree_node_compact_pool_<Node>::chunks()
+	{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return chunks_;
+	}
+
+template<class Node>
+void tree_node_compact_pool_<Node>::current_(local_& l)
+	{
+	unsigned long now=generation_.load();
+	if(l.generation!=now) { // the chunks these were in have been freed
+		l.next=l.end=l.free=0;
+		l.generation=now;
+		}
+	}
+
+template<class Node>
+void tree_node_compact_pool_<Node>::refill_(local_& l)
+	{
+	if(!l.registered)
+		register_(l);
+	std::lock_guard<std::mutex> lock(mutex_);
+	if(shared_free_!=0) {
+		l.free=shared_free_;
+		shared_free_=0;
+		return;
+		}
+	l.next=new_chunk_();
+	l.end=((l.next>>chunk_bits)+1)<<chunk_bits;
+	}
+
+template<class Node>
+uint32_t tree_node_compact_pool_<Node>::new_chunk_()
+	{
+	if(chunks_==max_chunks)
+		throw std::bad_alloc();
+	// Aligned to the power of two above its size, so that the start of a chunk follows
+	// from the address of any node in it.
+	void *start=0;
+#if defined(_WIN32)
+	start=_aligned_malloc(chunk_bytes_(), chunk_align_());
+#else
+	if(posix_memalign(&start, chunk_align_(), chunk_bytes_())!=0)
+		start=0;
+#endif
+	if(start==0)
+		throw std::bad_alloc();
+	*static_cast<uint32_t *>(start)=chunks_;
+	chunk_[chunks_]=static_cast<char *>(start);
+	uint32_t first=chunks_<<chunk_bits;
+	++chunks_;
+	return first==0?1:first;
+	}
+
+template<class Node>
+void tree_node_compact_pool_<Node>::release_()
+	{
+	std::lock_guard<std::mutex> lock(mutex_);
+	int64_t none=0;
+	if(!live_.compare_exchange_strong(none, -releasing_)) // nodes were taken in the meantime
+		return;
+	for(uint32_t c=0; c<chunks_; ++c) {
+#if defined(_WIN32)
+		_aligned_free(chunk_[c]);
+#else
+		free(chunk_[c]);
+#endif
+		chunk_[c]=0;
+		}
+	chunks_=0;
+	shared_free_=0;
+	++generation_;
+	live_.fetch_add(releasing_);
+	}
+
+template<class Node>
+void tree_node_compact_pool_<Node>::register_(local_& l)
+	{
+	static thread_local leaver_ leaver;
+	(void)leaver;
+	l.registered=true;
+	}
+
+template<class Node>
+tree_node_compact_pool_<Node>::leaver_::~leaver_()
+	{
+	local_& l=local_state_;
+	std::lock_guard<std::mutex> lock(mutex_);
+	if(l.generation==generation_.load()) {
+		while(l.free!=0) {
+			uint32_t i=l.free;
+			l.free=next_free_(i);
+			next_free_(i)=shared_free_;
+			shared_free_=i;
+			}
+		for(; l.next!=l.end; ++l.next) {
+			next_free_(l.next)=shared_free_;
+			shared_free_=l.next;
+			}
+		}
+	l.leaving=true;
+	}
+
+/// Link from one compact node to another, kept as the 32-bit index of the node in its 
+/// pool (see tree_node_compact_pool_) instead of as a pointer. It reads and assigns like 
+/// a pointer, so all code written for tree_node_ works unchanged on nodes built from it.
+template<class Node>
+class tree_node_compact_link_ {
+	public:
+		tree_node_compact_link_() : index_(0) {}
+
+		tree_node_compact_link_& operator=(Node *n)
+			{
+			index_=(n==0)?0:tree_node_compact_pool_<Node>::index(n);
+			return *this;
+			}
+		operator Node *() const  { return index_==0?0:tree_node_compact_pool_<Node>::node(index_); }
+		Node *operator->() const { return tree_node_compact_pool_<Node>::node(index_); }
+
+	private:
+		uint32_t index_;
+};
+
+template<class Node>
+class tree_node_compact_allocator;
+
+/// A node with the links of tree_node_ kept as 32-bit indices into a pool of nodes, so 
+/// that its links take 20 bytes instead of 40 on 64-bit machines. The iterators and all
+/// members of tree work as they do with tree_node_, but every step from one node to 
+/// another takes a lookup in the table of chunks on top of the load of the node (a 
+/// second, though nearly always cached, dependent load), and every link set takes a 
+/// load of the number at the start of the chunk of the node linked to and a division 
+/// by the node size. Nodes come out of one pool for the whole program, through 
+/// tree_node_compact_allocator, which has to be used with them, as in 
+/// tree<T, tree_node_compact_allocator<tree_node_compact_<T> > >.
+/// All five links of tree_node_ are kept. Leaving out last_child and prev_sibling would
+/// save another 8 bytes, but tree reads both directly throughout, often halfway through
+/// relinking nodes, and appending, erasing and stepping back over siblings would take
+/// time linear in the number of siblings; so that has deliberately not been done.
+template<class T>
+class tree_node_compact_ {
+	public:
+		tree_node_compact_();
+		tree_node_compact_(const T&);
+		tree_node_compact_(T&&);
+		template<class... Args>
+		tree_node_compact_(tree_node_in_place_, Args&&...);
+
+		tree_node_compact_link_<tree_node_compact_<T> > parent;
+	   tree_node_compact_link_<tree_node_compact_<T> > first_child, last_child;
+		tree_node_compact_link_<tree_node_compact_<T> > prev_sibling, next_sibling;
+		T data;
+}; 
+
+template<class T>
+tree_node_compact_<T>::tree_node_compact_()
+	{
+	}
+
+template<class T>
+tree_node_compact_<T>::tree_node_compact_(const T& val)
+	: data(val)
+	{
+	}
+
+template<class T>
+tree_node_compact_<T>::tree_node_compact_(T&& val)
+	: data(std::move(val))
+	{
+	}
+
+template<class T>
+template<class... Args>
+tree_node_compact_<T>::tree_node_compact_(tree_node_in_place_, Args&&... args)
+	: data(std::forward<Args>(args)...)
+	{
+	}
+
+/// Describes what a node type keeps on top of its links. The plain tree_node_ stores 
+/// nothing else, so all bookkeeping done by tree reduces to no-ops for it. Node types 
+/// which cache information specialise tree_node_traits_ and override members of this base.
+template<class Node>
+struct tree_node_traits_base_ {
+	static const bool counted=false;
+	static size_t       subtree_size(const Node *)            { return 0; }
+	static unsigned int children(const Node *)                { return 0; }
+	static void         add_counts(Node *, ptrdiff_t, int)    {}
+	static const bool indexed=false;
+	static size_t       order(const Node *)                   { return 0; }
+	static size_t       order_end(const Node *)               { return 0; }
+	static void         set_order(Node *, size_t)             {}
+	static void         set_order_end(Node *, size_t)         {}
+	static const bool random_access=false;
+	static void         children_stale(Node *)                {}
+	static Node        *nth_child(Node *, unsigned int)       { return 0; }
+	static unsigned int child_count(Node *)                   { return 0; }
+	static unsigned int position(Node *)                      { return 0; }
+	static const bool depth_kept=false;
+	static int          depth(const Node *)                   { return 0; }
+	static void         set_depth(Node *, int)                {}
+	static bool         height_known(const Node *)            { return false; }
+	static int          height(const Node *)                  { return 0; }
+	static void         set_height(Node *, int)               {}
+	static void         forget_height(Node *)                 {}
+	/// Whether nodes of this type can come from allocator Alloc.
+	template<class Alloc>
+	static constexpr bool allocator_fits()                    { return true; }
+};
+
+template<class Node>
+struct tree_node_traits_ : public tree_node_traits_base_<Node> {
+};
+
+template<class T>
+struct tree_node_traits_<tree_node_counted_<T> > : public tree_node_traits_base_<tree_node_counted_<T> > {
+	static const bool counted=true;
+	static size_t       subtree_size(const tree_node_counted_<T> *n) { return n->subtree_size; }
+	static unsigned int children(const tree_node_counted_<T> *n)     { return n->children; }
+	static void         add_counts(tree_node_counted_<T> *n, ptrdiff_t size, int children)
+		{
+		n->subtree_size+=size;
+		n->children+=children;
+		}
+};
+
+template<class T>
+struct tree_node_traits_<tree_node_indexed_<T> > : public tree_node_traits_base_<tree_node_indexed_<T> > {
+	static const bool indexed=true;
+	static size_t       order(const tree_node_indexed_<T> *n)         { return n->order; }
+	static size_t       order_end(const tree_node_indexed_<T> *n)     { return n->order_end; }
+	static void         set_order(tree_node_indexed_<T> *n, size_t i)     { n->order=i; }
+	static void         set_order_end(tree_node_indexed_<T> *n, size_t i) { n->order_end=i; }
+};
+
+template<class T>
+struct tree_node_traits_<tree_node_random_access_<T> > : public tree_node_traits_base_<tree_node_random_access_<T> > {
+	typedef tree_node_random_access_<T> node;
+	static const bool random_access=true;
+	static void         children_stale(node *n)                 { n->child_array_valid=false; }
+	/// The child with the given number, or 0 if there are not that many.
+	static node        *nth_child(node *n, unsigned int num)
+		{
+		children_built(n);
+		return num<n->child_array.size()?n->child_array[num]:0;
+		}
+	static unsigned int child_count(node *n)
+		{
+		children_built(n);
+		return n->child_array.size();
+		}
+	/// Position among the siblings, for nodes which have a parent.
+	static unsigned int position(node *n)
+		{
+		children_built(n->parent);
+		return n->position;
+		}
+	static void         children_built(node *n)
+		{
+		if(n->child_array_valid) return;
+		n->child_array.clear();
+		for(node *ch=n->first_child; ch!=0; ch=ch->next_sibling) {
+			ch->position=n->child_array.size();
+			n->child_array.push_back(ch);
+			}
+		n->child_array_valid=true;
+		}
+};
+
+template<class T>
+struct tree_node_traits_<tree_node_depth_<T> > : public tree_node_traits_base_<tree_node_depth_<T> > {
+	typedef tree_node_depth_<T> node;
+	static const bool depth_kept=true;
+	static int          depth(const node *n)                  { return n->depth; }
+	static void         set_depth(node *n, int d)             { n->depth=d; }
+	static bool         height_known(const node *n)           { return n->height_known; }
+	static int          height(const node *n)                 { return n->height; }
+	static void         set_height(node *n, int h)            { n->height=h; n->height_known=true; }
+	static void         forget_height(node *n)                { n->height_known=false; }
+};
+
+template<class T>
+struct tree_node_traits_<tree_node_compact_<T> > : public tree_node_traits_base_<tree_node_compact_<T> > {
+	template<class Alloc>
+	static constexpr bool allocator_fits()
+		{
+		return std::is_same<Alloc, tree_node_compact_allocator<tree_node_compact_<T> > >::value;
+		}
+};
+
+/// Node allocator which carves nodes out of large chunks instead of going to the heap
+/// for every single node; freed nodes are kept on a free list and handed out again.
+/// Copies of the allocator share the same pool, so trees which exchange nodes (move
+/// constructor, move_out, move_in and friends) should be built from copies of one
+/// allocator. When a tree is the only user of its pool and the node data is trivially
+/// destructible, clear() and the destructor drop the whole pool in one go instead of
+/// visiting every node.
+template<class Node>
+class tree_node_pool_allocator {
+	public:
+		typedef Node              value_type;
+		typedef Node*             pointer;
+		typedef const Node*       const_pointer;
+		typedef Node&             reference;
+		typedef const Node&       const_reference;
+		typedef size_t            size_type;
+		typedef ptrdiff_t         difference_type;
+		template<class U> struct rebind { typedef tree_node_pool_allocator<U> other; };
+
+		explicit tree_node_pool_allocator(size_type nodes_per_chunk=1024);
+
+		pointer   allocate(size_type n, const void *hint=0);
+		void      deallocate(pointer p, size_type n);
+		template<class U, class... Args>
+		void      construct(U *p, Args&&... args);
+		template<class U>
+		void      destroy(U *p);
+
+		/// Make sure the next 'n' nodes come out of a single chunk (rather than from the
+		/// free list), so that nodes which are allocated together sit next to each other.
+		void      reserve(size_type n);
+		/// Give all chunks back to the system without running any destructors. This is
+		/// only done (and 'true' returned) if no other allocator shares the pool.
+		bool      release();
+		/// Number of nodes currently handed out.
+		size_type nodes_in_use() const;
+		/// Number of nodes which fit in the chunks obtained so far.
+		size_type capacity() const;
+
+		bool      operator==(const tree_node_pool_allocator&) const;
+		bool      operator!=(const tree_node_pool_allocator&) const;
+
+	private:
+		union slot_ {
+			slot_ *next_free;
+			typename std::aligned_storage<sizeof(Node), alignof(Node)>::type storage;
+		};
+		struct pool_ {
+			pool_(size_type);
+			~pool_();
+			void free_chunks();
+			void new_chunk(size_type);
+
+			size_type            chunk_size;
+			std::vector<slot_ *> chunks;
+			slot_               *free_list;
+			size_type            last_chunk_size, used_in_last_chunk, reserved;
+			size_type            in_use, total;
+		};
+		std::shared_ptr<pool_> pool;
+};
+
+template<class Node>
+tree_node_pool_allocator<Node>::pool_::pool_(size_type cs)
+	: chunk_size(cs>0?cs:1), free_list(0), last_chunk_size(0), used_in_last_chunk(0), reserved(0), 
+	  in_use(0), total(0)
+	{
+	}
+
+template<class Node>
+tree_node_pool_allocator<Node>::pool_::~pool_()
+	{
+	free_chunks();
+	}
+
+template<class Node>
+void tree_node_pool_allocator<Node>::pool_::free_chunks()
+	{
+	for(size_t i=0; i<chunks.size(); ++i)
+		::operator delete(chunks[i]);
+	chunks.clear();
+	free_list=0;
+	last_chunk_size=0;
+	used_in_last_chunk=0;
+	reserved=0;
+	in_use=0;
+	total=0;
+	}
+
+template<class Node>
+void tree_node_pool_allocator<Node>::pool_::new_chunk(size_type n)
 	{
+	chunks.push_back(static_cast<slot_ *>(::operator new(n*sizeof(slot_))));
+	last_chunk_size=n;
+	used_in_last_chunk=0;
+	total+=n;
 	}
 
+template<class Node>
+tree_node_pool_allocator<Node>::tree_node_pool_allocator(size_type nodes_per_chunk)
+	: pool(std::make_shared<pool_>(nodes_per_chunk))
+	{
+	}
+
+template<class Node>
+typename tree_node_pool_allocator<Node>::pointer tree_node_pool_allocator<Node>::allocate(size_type n, const void *)
+	{
+	if(n!=1) // only single nodes come out of the pool
+		return static_cast<pointer>(::operator new(n*sizeof(Node)));
+
+	slot_ *ret;
+	if(pool->free_list && pool->reserved==0) {
+		ret=pool->free_list;
+		pool->free_list=ret->next_free;
+		}
+	else {
+		if(pool->used_in_last_chunk==pool->last_chunk_size) 
+			pool->new_chunk(pool->chunk_size);
+		if(pool->reserved>0)
+			--pool->reserved;
+		ret=pool->chunks.back()+pool->used_in_last_chunk;
+		++pool->used_in_last_chunk;
+		}
+	++pool->in_use;
+	return reinterpret_cast<pointer>(ret);
+	}
+
+template<class Node>
+void tree_node_pool_allocator<Node>::deallocate(pointer p, size_type n)
+	{
+	if(n!=1) {
+		::operator delete(p);
+		return;
+		}
+	slot_ *slot=reinterpret_cast<slot_ *>(p);
+	slot->next_free=pool->free_list;
+	pool->free_list=slot;
+	--pool->in_use;
+	}
+
+template<class Node>
+template<class U, class... Args>
+void tree_node_pool_allocator<Node>::construct(U *p, Args&&... args)
+	{
+	::new(static_cast<void *>(p)) U(std::forward<Args>(args)...);
+	}
+
+template<class Node>
+template<class U>
+void tree_node_pool_allocator<Node>::destroy(U *p)
+	{
+	p->~U();
+	}
+
+template<class Node>
+void tree_node_pool_allocator<Node>::reserve(size_type n)
+	{
+	if(pool->last_chunk_size-pool->used_in_last_chunk < n) 
+		pool->new_chunk(std::max(n, pool->chunk_size));
+	pool->reserved=n;
+	}
+
+template<class Node>
+bool tree_node_pool_allocator<Node>::release()
+	{
+	if(pool.use_count()!=1) return false;
+	pool->free_chunks();
+	return true;
+	}
+
+template<class Node>
+typename tree_node_pool_allocator<Node>::size_type tree_node_pool_allocator<Node>::nodes_in_use() const
+	{
+	return pool->in_use;
+	}
+
+template<class Node>
+typename tree_node_pool_allocator<Node>::size_type tree_node_pool_allocator<Node>::capacity() const
+	{
+	return pool->total;
+	}
+
+template<class Node>
+bool tree_node_pool_allocator<Node>::operator==(const tree_node_pool_allocator& other) const
+	{
+	return pool==other.pool;
+	}
+
+template<class Node>
+bool tree_node_pool_allocator<Node>::operator!=(const tree_node_pool_allocator& other) const
+	{
+	return pool!=other.pool;
+	}
+
+/// Allocator for tree_node_compact_, the only one these nodes work with: it hands out 
+/// nodes from the pool which the whole program shares (see tree_node_compact_pool_), so 
+/// all allocators are equal and nodes move freely between trees. Memory taken by the
+/// pool stays with it until the program ends.
+template<class Node>
+class tree_node_compact_allocator {
+	public:
+		typedef Node              value_type;
+		typedef Node*             pointer;
+		typedef const Node*       const_pointer;
+		typedef Node&             reference;
+		typedef const Node&       const_reference;
+		typedef size_t            size_type;
+		typedef ptrdiff_t         difference_type;
+		template<class U> struct rebind { typedef tree_node_compact_allocator<U> other; };
+
+		tree_node_compact_allocator() {}
+		template<class U>
+		tree_node_compact_allocator(const tree_node_compact_allocator<U>&) {}
+
+		pointer   allocate(size_type n, const void * =0)
+			{
+			if(n!=1) return static_cast<pointer>(::operator new(n*sizeof(Node)));
+			return tree_node_compact_pool_<Node>::allocate();
+			}
+		void      deallocate(pointer p, size_type n)
+			{
+			if(n!=1) ::operator delete(p);
+			else     tree_node_compact_pool_<Node>::deallocate(p);
+			}
+		template<class U, class... Args>
+		void      construct(U *p, Args&&... args) { ::new(static_cast<void *>(p)) U(std::forward<Args>(args)...); }
+		template<class U>
+		void      destroy(U *p)                   { p->~U(); }
+
+		bool      operator==(const tree_node_compact_allocator&) const { return true; }
+		bool      operator!=(const tree_node_compact_allocator&) const { return false; }
+};
+
+/// A path as taken by iterator_from_path() and given by path_from_iterator(), like
+/// tree::path_t, but keeping up to N steps in place so that paths to nodes which are not
+/// too deep need no allocation. Comparable and hashable, to serve as a key (see
+/// kptree::path_cache in tree_path_cache.hh).
+template<unsigned int N=16>
+class tree_path {
+	public:
+		tree_path() : data_(inline_), size_(0), capacity_(N) {}
+		tree_path(std::initializer_list<int>);
+		explicit tree_path(const std::vector<int>&);
+		tree_path(const tree_path&);
+		tree_path(tree_path&&);
+		~tree_path() { if(data_!=inline_) delete [] data_; }
+		tree_path& operator=(const tree_path&);
+		tree_path& operator=(tree_path&&);
+
+		size_t       size() const               { return size_; }
+		bool         empty() const              { return size_==0; }
+		int          operator[](size_t i) const { return data_[i]; }
+		int&         operator[](size_t i)       { return data_[i]; }
+		const int   *begin() const              { return data_; }
+		const int   *end() const                { return data_+size_; }
+		int         *begin()                    { return data_; }
+		int         *end()                      { return data_+size_; }
+		void         clear()                    { size_=0; }
+		void         pop_back()                 { --size_; }
+		void         push_back(int);
+		/// Copy into a tree::path_t.
+		std::vector<int> vector() const         { return std::vector<int>(begin(), end()); }
+
+		bool         operator==(const tree_path&) const;
+		bool         operator!=(const tree_path& other) const { return !(*this==other); }
+		size_t       hash() const;
+		struct hasher {
+			size_t operator()(const tree_path& p) const { return p.hash(); }
+		};
+
+	private:
+		int         *data_;
+		unsigned int size_, capacity_;
+		int          inline_[N];
+};
+
+template<unsigned int N>
+tree_path<N>::tree_path(std::initializer_list<int> l)
+	: tree_path()
+	{
+	for(int step: l)
+		push_back(step);
+	}
+
+template<unsigned int N>
+tree_path<N>::tree_path(const std::vector<int>& v)
+	: tree_path()
+	{
+	for(int step: v)
+		push_back(step);
+	}
+
+template<unsigned int N>
+tree_path<N>::tree_path(const tree_path& other)
+	: tree_path()
+	{
+	*this=other;
+	}
+
+template<unsigned int N>
+tree_path<N>::tree_path(tree_path&& other)
+	: tree_path()
+	{
+	*this=std::move(other);
+	}
+
+template<unsigned int N>
+tree_path<N>& tree_path<N>::operator=(const tree_path& other)
+	{
+	if(this==&other) return *this;
+	if(other.size_>capacity_) {
+		if(data_!=inline_) delete [] data_;
+		data_=new int[other.size_];
+		capacity_=other.size_;
+		}
+	std::copy(other.begin(), other.end(), data_);
+	size_=other.size_;
+	return *this;
+	}
+
+template<unsigned int N>
+tree_path<N>& tree_path<N>::operator=(tree_path&& other)
+	{
+	if(this==&other) return *this;
+	if(other.data_==other.inline_) 
+		return *this=other;
+	// Take over the steps on the heap, leaving 'other' empty.
+	if(data_!=inline_) delete [] data_;
+	data_=other.data_;
+	size_=other.size_;
+	capacity_=other.capacity_;
+	other.data_=other.inline_;
+	other.size_=0;
+	other.capacity_=N;
+	return *this;
+	}
+
+template<unsigned int N>
+void tree_path<N>::push_back(int step)
+	{
+	if(size_==capacity_) {
+		int *grown=new int[2*capacity_];
+		std::copy(data_, data_+size_, grown);
+		if(data_!=inline_) delete [] data_;
+		data_=grown;
+		capacity_*=2;
+		}
+	data_[size_++]=step;
+	}
+
+template<unsigned int N>
+bool tree_path<N>::operator==(const tree_path& other) const
+	{
+	return size_==other.size_ && std::equal(begin(), end(), other.begin());
+	}
+
+template<unsigned int N>
+size_t tree_path<N>::hash() const
+	{
+	// FNV-1a over the steps; paths are short and mostly consist of small numbers.
+	size_t h=static_cast<size_t>(14695981039346656037ULL);
+	for(unsigned int i=0; i<size_; ++i) {
+		h^=static_cast<size_t>(static_cast<unsigned int>(data_[i]));
+		h*=static_cast<size_t>(1099511628211ULL);
+		}
+	return h;
+	}
+
+/// Counts of what trees have been doing, summed over all trees and threads since the
+/// start of the program (or the last reset()). They are only kept when compiling with
+/// KPTREE_STATS defined; otherwise all counts stay zero and the counting compiles away.
+/// Each thread counts on its own, so that counting does not slow down parallel use.
+class tree_stats {
+	public:
+		enum counter {
+			allocations, frees,      // nodes, head and feet included
+			bulk_releases,           // whole trees dropped at once by a pool allocator
+			pre_order_steps, post_order_steps, breadth_first_steps, level_order_steps, 
+			fixed_depth_steps, sibling_steps, leaf_steps,       // iterator increments
+			sibling_walk_steps,      // siblings passed in number_of_children(), index() and child()
+			sorts, merges, copies,   // calls (outermost ones only, for recursive merges)
+			sort_ns, merge_ns, copy_ns,   // time spent in those calls
+			counters
+		};
+
+		tree_stats();
+
+		unsigned long long operator[](counter c) const { return values_[c]; }
+		/// Name of the counter, e.g. "pre_order_steps", for export.
+		static const char *name(counter);
+
+#ifdef KPTREE_STATS
+		static const bool enabled=true;
+#else
+		static const bool enabled=false;
+#endif
+		/// The counts of all threads, including finished ones. Counts which other threads
+		/// are changing at the same time may or may not be included.
+		static tree_stats current();
+		/// Set all counts back to zero.
+		static void       reset();
+		/// Add to a count of the calling thread.
+		static void       add(counter, unsigned long long);
+
+	private:
+		unsigned long long values_[counters];
+};
+
+inline tree_stats::tree_stats()
+	{
+	std::fill(values_, values_+counters, 0ULL);
+	}
+
+inline const char *tree_stats::name(counter c)
+	{
+	static const char *names[counters]={
+		"allocations", "frees", "bulk_releases", 
+		"pre_order_steps", "post_order_steps", "breadth_first_steps", "level_order_steps",
+		"fixed_depth_steps", "sibling_steps", "leaf_steps", "sibling_walk_steps",
+		"sorts", "merges", "copies", "sort_ns", "merge_ns", "copy_ns" };
+	return names[c];
+	}
+
+#ifdef KPTREE_STATS
+
+/// Counts of one thread. Only that thread changes them, but current() reads them from
+/// other threads, hence the (relaxed, so plain loads and stores) atomics.
+struct tree_stats_local_ {
+	tree_stats_local_();
+	~tree_stats_local_();
+	std::atomic<unsigned long long> values[tree_stats::counters];
+	int                             nesting[tree_stats::counters]; // of timed calls
+};
+
+/// All threads which count, plus the counts of the ones which have finished.
+struct tree_stats_registry_ {
+	tree_stats_registry_() { std::fill(retired, retired+tree_stats::counters, 0ULL); }
+	std::mutex                        mutex;
+	std::vector<tree_stats_local_ *>  live;
+	unsigned long long                retired[tree_stats::counters];
+
+	static tree_stats_registry_& instance() { static tree_stats_registry_ r; return r; }
+};
+
+inline tree_stats_local_& tree_stats_local_instance_()
+	{
+	static thread_local tree_stats_local_ local;
+	return local;
+	}
+
+inline tree_stats_local_::tree_stats_local_()
+	{
+	for(int c=0; c<tree_stats::counters; ++c) {
+		values[c].store(0, std::memory_order_relaxed);
+		nesting[c]=0;
+		}
+	tree_stats_registry_& reg=tree_stats_registry_::instance();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	reg.live.push_back(this);
+	}
+
+inline tree_stats_local_::~tree_stats_local_()
+	{
+	tree_stats_registry_& reg=tree_stats_registry_::instance();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	for(int c=0; c<tree_stats::counters; ++c)
+		reg.retired[c]+=values[c].load(std::memory_order_relaxed);
+	reg.live.erase(std::find(reg.live.begin(), reg.live.end(), this));
+	}
+
+inline void tree_stats::add(counter c, unsigned long long n)
+	{
+	std::atomic<unsigned long long>& v=tree_stats_local_instance_().values[c];
+	v.store(v.load(std::memory_order_relaxed)+n, std::memory_order_relaxed);
+	}
+
+inline tree_stats tree_stats::current()
+	{
+	tree_stats ret;
+	tree_stats_registry_& reg=tree_stats_registry_::instance();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	for(int c=0; c<counters; ++c) {
+		ret.values_[c]=reg.retired[c];
+		for(tree_stats_local_ *local: reg.live)
+			ret.values_[c]+=local->values[c].load(std::memory_order_relaxed);
+		}
+	return ret;
+	}
+
+inline void tree_stats::reset()
+	{
+	tree_stats_registry_& reg=tree_stats_registry_::instance();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	for(int c=0; c<counters; ++c) {
+		reg.retired[c]=0;
+		for(tree_stats_local_ *local: reg.live)
+			local->values[c].store(0, std::memory_order_relaxed);
+		}
+	}
+
+/// Counts a call and the time it takes, unless it is made from within another call of the
+/// same kind on the same thread.
+class tree_stats_timer_ {
+	public:
+		tree_stats_timer_(tree_stats::counter calls, tree_stats::counter ns)
+			: calls_(calls), ns_(ns), outermost_(tree_stats_local_instance_().nesting[ns]++==0)
+			{
+			if(outermost_) start_=std::chrono::steady_clock::now();
+			}
+		~tree_stats_timer_()
+			{
+			if(--tree_stats_local_instance_().nesting[ns_]!=0) return;
+			std::chrono::steady_clock::duration spent=std::chrono::steady_clock::now()-start_;
+			tree_stats::add(calls_, 1);
+			tree_stats::add(ns_, std::chrono::duration_cast<std::chrono::nanoseconds>(spent).count());
+			}
+	private:
+		tree_stats::counter                   calls_, ns_;
+		bool                                  outermost_;
+		std::chrono::steady_clock::time_point start_;
+};
+
+#define KPTREE_STAT_ADD_(c, n)         tree_stats::add(tree_stats::c, n)
+#define KPTREE_STAT_TIME_(calls, ns)   tree_stats_timer_ kptree_stats_timer_(tree_stats::calls, tree_stats::ns)
+
+#else
+
+inline tree_stats tree_stats::current() { return tree_stats(); }
+inline void       tree_stats::reset()    {}
+inline void       tree_stats::add(counter, unsigned long long) {}
+
+#define KPTREE_STAT_ADD_(c, n)         ((void)0)
+#define KPTREE_STAT_TIME_(calls, ns)   ((void)0)
+
+#endif
+
 template <class T, class tree_node_allocator = std::allocator<tree_node_<T> > >
 class tree {
 	protected:
-		typedef tree_node_<T> tree_node;
+		typedef typename tree_node_allocator::value_type tree_node;
+		typedef tree_node_traits_<tree_node>             node_traits;
+		typedef std::allocator_traits<tree_node_allocator> alloc_traits_;
+		static_assert(node_traits::template allocator_fits<tree_node_allocator>(), 
+						  "tree: these nodes cannot come from this allocator");
+	private:
+		struct ancestry_index_;
 	public:
 		/// Value of the data stored at a node.
 		typedef T value_type;
@@ -83,6 +1350,7 @@ class tree {
       class leaf_iterator;
 
 		tree();                                         // empty constructor
+		explicit tree(const tree_node_allocator&);      // empty constructor using the given allocator
 		tree(const T&);                                 // constructor setting given element as head
 		tree(const iterator_base&);
 		tree(const tree<T, tree_node_allocator>&);      // copy constructor
@@ -183,11 +1451,38 @@ class tree {
 				std::queue<tree_node *> traversal_queue;
 		};
 
+		/// Breadth-first iterator which keeps no queue: each step walks over to the next node at
+		/// the same depth (up to the common ancestor and down again), and at the end of a level 
+		/// it continues with the first node one level down. Copying is as cheap as for the 
+		/// other iterators. Fast when nodes have many children or form long chains; when most
+		/// sibling ranges are short, the walks between them make breadth_first_queued_iterator
+		/// the better choice.
+		class level_order_iterator : public iterator_base {
+			public:
+				level_order_iterator();
+				level_order_iterator(tree_node *);
+				level_order_iterator(const iterator_base&);
+
+				bool    operator==(const level_order_iterator&) const;
+				bool    operator!=(const level_order_iterator&) const;
+				level_order_iterator&  operator++();
+				level_order_iterator   operator++(int);
+				level_order_iterator&  operator+=(unsigned int);
+
+			private:
+				void       set_next_level_();
+
+				tree_node *level_last;             // last node on the current level
+				tree_node *next_first, *next_last; // first and last node seen so far on the level below
+		};
+
 		/// The default iterator types throughout the tree class.
 		typedef pre_order_iterator            iterator;
 		typedef breadth_first_queued_iterator breadth_first_iterator;
 
-		/// Iterator which traverses only the nodes at a given depth from the root.
+		/// Iterator which traverses only the nodes at a given depth from the root. Iterators
+		/// made by begin_fixed stay within the range they were made for and end up equal
+		/// to end_fixed; others go on through the whole tree and end up pointing at 0.
 		class fixed_depth_iterator : public iterator_base {
 			public:
 				fixed_depth_iterator();
@@ -206,6 +1501,18 @@ class tree {
 				fixed_depth_iterator&  operator-=(unsigned int);
 
 				tree_node *top_node;
+			private:
+				friend class tree;
+				/// Whether the ancestry index this iterator walks is still the one it was made with.
+				bool  indexed_() const;
+
+				unsigned int           depth_;  // levels below top_node, if that is set
+				/// With tree_node_indexed_ nodes, the ancestry index lists the nodes at each depth,
+				/// and the iterator walks positions begin_ to end_ in the list of its depth, as
+				/// long as the index is not rebuilt (see built_); after that it walks the tree.
+				const ancestry_index_ *index_;
+				unsigned long          built_;
+				size_t                 level_, begin_, at_, end_;
 		};
 
 		/// Iterator which traverses only the nodes which are siblings of each other.
@@ -218,6 +1525,11 @@ class tree {
 
 				bool    operator==(const sibling_iterator&) const;
 				bool    operator!=(const sibling_iterator&) const;
+				/// Comparisons with the default iterator, such as 'it!=tr.end()', without going
+				/// through a conversion; with C++20's rewritten comparisons these would otherwise
+				/// be ambiguous.
+				bool    operator==(const pre_order_iterator&) const;
+				bool    operator!=(const pre_order_iterator&) const;
 				sibling_iterator&  operator++();
 				sibling_iterator&  operator--();
 				sibling_iterator   operator++(int);
@@ -262,14 +1574,23 @@ class tree {
 		post_order_iterator  end_post() const;
 		/// Return fixed-depth iterator to the first node at a given depth from the given iterator.
 		/// If 'walk_back=true', a depth=0 iterator will be taken from the beginning of the sibling
-		/// range, not the current node.
+		/// range, not the current node. The range holds the nodes at that depth below the given
+		/// one, or for depth 0 the node and its siblings, and is empty (begin equal to end) if
+		/// there are none. With tree_node_indexed_ nodes, the iterator steps through a list of
+		/// the nodes at its depth kept with the ancestry index, so walking the range takes time
+		/// in proportion to the number of nodes in it, not to the size of the subtree. Other
+		/// nodes keep no such lists, so there the steps walk the subtree down to that depth.
 		fixed_depth_iterator begin_fixed(const iterator_base&, unsigned int, bool walk_back=true) const;
-		/// Return fixed-depth end iterator.
+		/// Return fixed-depth end iterator for the range of begin_fixed with the same arguments.
 		fixed_depth_iterator end_fixed(const iterator_base&, unsigned int) const;
 		/// Return breadth-first iterator to the first node at a given depth.
 		breadth_first_queued_iterator begin_breadth_first() const;
 		/// Return breadth-first end iterator.
 		breadth_first_queued_iterator end_breadth_first() const;
+		/// Return level-order iterator to the first node (head) of the tree.
+		level_order_iterator begin_level_order() const;
+		/// Return level-order end iterator.
+		level_order_iterator end_level_order() const;
 		/// Return sibling iterator to the first child of given node.
 		static sibling_iterator     begin(const iterator_base&);
 		/// Return sibling end iterator for children of given node.
@@ -282,6 +1603,18 @@ class tree {
       leaf_iterator   begin_leaf(const iterator_base& top) const;
       /// Return leaf end iterator for the subtree at the given node.
       leaf_iterator   end_leaf(const iterator_base& top) const;
+		/// Largest number of leaves for_each_leaf_block hands out in one call.
+		static const size_t leaf_block_size=64;
+		/// Call f(T * const *data, size_t n) with the data of all leaves, in the order of
+		/// leaf_iterator, up to leaf_block_size of them at a time, so that the work on the data
+		/// can run as a tight loop over an array. While it collects the leaves, the walk tells
+		/// the processor about the nodes it may visit next, so that fetching them overlaps
+		/// with the work on the current one.
+		template<class F>
+		void            for_each_leaf_block(F f) const;
+		/// As above, for the leaves from begin_leaf(top) to end_leaf(top).
+		template<class F>
+		void            for_each_leaf_block(const iterator_base& top, F f) const;
 
 		typedef std::vector<int> path_t;
 		/// Return a path (to be taken from the 'top' node) corresponding to a node in the tree.
@@ -290,6 +1623,12 @@ class tree {
 		path_t          path_from_iterator(const iterator_base& iter, const iterator_base& top) const;
 		/// Return an iterator given a path from the 'top' node.
 		iterator        iterator_from_path(const path_t&, const iterator_base& top) const;
+		/// As above, for paths which keep their steps in place (tree_path); the first one
+		/// fills 'path' instead of returning a new one, so that it can be reused.
+		template<unsigned int N>
+		void            path_from_iterator(const iterator_base& iter, const iterator_base& top, tree_path<N>& path) const;
+		template<unsigned int N>
+		iterator        iterator_from_path(const tree_path<N>&, const iterator_base& top) const;
 				
 		/// Return iterator to the parent of a node.
 		template<typename	iter> static iter parent(iter);
@@ -297,7 +1636,8 @@ class tree {
 		template<typename iter> static iter previous_sibling(iter);
 		/// Return iterator to the next sibling of a node.
 		template<typename iter> static iter next_sibling(iter);
-		/// Return iterator to the next node at a given depth.
+		/// Return iterator to the next node at a given depth (with tree_node_indexed_ nodes found
+		/// through the ancestry index instead of a walk through the tree).
 		template<typename iter> iter next_at_same_depth(iter) const;
 
 		/// Erase all nodes of the tree.
@@ -326,20 +1666,31 @@ class tree {
 		template<typename iter> iter append_children(iter position, sibling_iterator from, sibling_iterator to);
 		template<typename iter> iter prepend_children(iter position, sibling_iterator from, sibling_iterator to);
 
+		/// Construct a node in place from the arguments and make it the last child of position.
+		template<typename iter, typename... Args> iter emplace_child(iter position, Args&&... args);
+
 		/// Short-hand to insert topmost node in otherwise empty tree.
 		pre_order_iterator set_head(const T& x);
 		pre_order_iterator set_head(T&& x);
+		/// Construct the topmost node of an otherwise empty tree in place from the arguments.
+		template<typename... Args> pre_order_iterator emplace_head(Args&&... args);
 		/// Insert node as previous sibling of node pointed to by position.
 		template<typename iter> iter insert(iter position, const T& x);
 		template<typename iter> iter insert(iter position, T&& x);
 		/// Specialisation of previous member.
 		sibling_iterator insert(sibling_iterator position, const T& x);
+		/// Construct a node in place from the arguments as previous sibling of position.
+		template<typename iter, typename... Args> iter emplace_before(iter position, Args&&... args);
+		/// Specialisation of previous member.
+		template<typename... Args> sibling_iterator emplace_before(sibling_iterator position, Args&&... args);
 		/// Insert node (with children) pointed to by subtree as previous sibling of node pointed to by position.
 		/// Does not change the subtree itself (use move_in or move_in_below for that).
 		template<typename iter> iter insert_subtree(iter position, const iterator_base& subtree);
 		/// Insert node as next sibling of node pointed to by position.
 		template<typename iter> iter insert_after(iter position, const T& x);
 		template<typename iter> iter insert_after(iter position, T&& x);
+		/// Construct a node in place from the arguments as next sibling of position.
+		template<typename iter, typename... Args> iter emplace_after(iter position, Args&&... args);
 		/// Insert node (with children) pointed to by subtree as next sibling of node pointed to by position.
 		template<typename iter> iter insert_subtree_after(iter position, const iterator_base& subtree);
 
@@ -380,13 +1731,39 @@ class tree {
 		template<typename iter> iter move_in_below(iter, tree&);
 		/// As above, but now make the tree the nth child of the indicated node (if possible).
 		template<typename iter> iter move_in_as_nth_child(iter, size_t, tree&);
+		/// As the two above, moving in all trees in the range [first, last) one after the other
+		/// in one go (using the same allocator as this tree), leaving them empty. Returns
+		/// iterator to the first node moved in, or to the indicated node if there were none.
+		template<typename iter, class TreeIter> iter move_in_below(iter, TreeIter first, TreeIter last);
+		template<typename iter, class TreeIter> iter move_in_as_nth_child(iter, size_t, TreeIter first, TreeIter last);
 
 		/// Merge with other tree, creating new branches and leaves only if they are not already present.
 		void     merge(sibling_iterator, sibling_iterator, sibling_iterator, sibling_iterator, 
 							bool duplicate_leaves=false);
 		/// As above, but using two trees with a single top node at the 'to' and 'from' positions.
 		void     merge(iterator to, iterator from, bool duplicate_leaves);
-		/// Sort (std::sort only moves values of nodes, this one moves children as well).
+		/// Merge policies, saying what to do with the data of a node when a node with equal data
+		/// is merged in: leave it alone or assign the new data. Any other function object taking
+		/// (T& present, const T& merged) can be used to combine the two.
+		struct merge_keep {
+			void operator()(T&, const T&) const {}
+		};
+		struct merge_overwrite {
+			void operator()(T& present, const T& merged) const { present=merged; }
+		};
+		/// As the first merge, but finding matching siblings with one lookup in a hash table
+		/// per level (using the given hash and equality on node data) instead of a search
+		/// through all siblings, and applying 'policy' to every matched pair of nodes. The
+		/// matched node stays in the hash table while 'policy' runs, so the policy must leave
+		/// the part of the data which 'hash' and 'equal' look at unchanged.
+		template<class Hash, class Equal, class Policy>
+		void     merge(sibling_iterator, sibling_iterator, sibling_iterator, sibling_iterator, 
+							Hash, Equal, Policy, bool duplicate_leaves=false);
+		/// As above, using two trees with a single top node at the 'to' and 'from' positions.
+		template<class Hash, class Equal, class Policy>
+		void     merge(iterator to, iterator from, Hash, Equal, Policy, bool duplicate_leaves);
+		/// Sort (std::sort only moves values of nodes, this one moves children as well). The
+		/// sort is stable; with 'deep' the children of each node are sorted as well.
 		void     sort(sibling_iterator from, sibling_iterator to, bool deep=false);
 		template<class StrictWeakOrdering>
 		void     sort(sibling_iterator from, sibling_iterator to, StrictWeakOrdering comp, bool deep=false);
@@ -399,6 +1776,14 @@ class tree {
 		bool     equal_subtree(const iter& one, const iter& two) const;
 		template<typename iter, class BinaryPredicate>
 		bool     equal_subtree(const iter& one, const iter& two, BinaryPredicate) const;
+		/// Find the first node in the range from..to (in pre-order) at which the siblings
+		/// subfrom..subto occur, children included, that is, for which the node and the
+		/// siblings after it are equal to them in the sense of equal_subtree. Returns 'to'
+		/// if there is no such node, or if the range subfrom..subto is empty.
+		iterator find_subtree(sibling_iterator subfrom, sibling_iterator subto, iterator from, iterator to) const;
+		template<class BinaryPredicate>
+		iterator find_subtree(sibling_iterator subfrom, sibling_iterator subto, iterator from, iterator to,
+									 BinaryPredicate) const;
 		/// Extract a new tree formed by the range of siblings plus all their children.
 		tree     subtree(sibling_iterator from, sibling_iterator to) const;
 		void     subtree(tree&, sibling_iterator from, sibling_iterator to) const;
@@ -414,12 +1799,54 @@ class tree {
 		size_t   size(const iterator_base&) const;
 		/// Check if tree is empty.
 		bool     empty() const;
-		/// Compute the depth to the root or to a fixed other iterator.
+		/// Return a copy of the allocator used for the nodes of this tree.
+		tree_node_allocator get_allocator() const;
+		/// Counts of node allocations, iterator steps, sibling walks and the time spent in
+		/// sort, merge and copying, over all trees (see tree_stats; only kept with KPTREE_STATS).
+		static tree_stats   stats();
+		/// Number which changes whenever nodes get added, removed or moved (but not when only
+		/// their data changes), so that anything derived from the shape of the tree, like
+		/// the node at a given path, is still valid as long as it returns the same value.
+		/// Like the ancestry index, concurrent calls on a freshly changed tree need one call
+		/// to run on its own first.
+		unsigned long epoch() const;
+		/// Scope, opened with batch(), in which changes to the tree leave the data the nodes
+		/// keep about their surroundings alone (subtree sizes of tree_node_counted_, depths
+		/// and maximal depths of tree_node_depth_), instead of walking up to the root or down
+		/// a moved subtree for every change. When the outermost scope ends, all of it is
+		/// brought up to date in a single walk over the tree. Until then size() and max_depth()
+		/// walk the tree, number_of_children() stays right, but depth() and the subtree sizes
+		/// in debug_verify_consistency() are not to be trusted. Scopes may be nested; the tree
+		/// should not be moved or assigned to while one is open.
+		class batch_scope {
+			public:
+				batch_scope(batch_scope&&);
+				~batch_scope();
+				/// End the scope, keeping all changes. Without a call to commit(), a scope opened
+				/// with 'rollback' puts the tree back the way it was when it was opened (for
+				/// instance when an exception leaves the scope); all other scopes keep the changes.
+				void commit();
+			private:
+				friend class tree;
+				batch_scope(tree&, bool rollback);
+				void end_();
+
+				tree                  *tree_;
+				std::unique_ptr<tree>  saved_;
+		};
+		/// Open a batch_scope. With 'rollback' the tree is copied first, so that the changes
+		/// can be undone; iterators into the tree are invalid after that happened.
+		batch_scope   batch(bool rollback=false);
+		/// Compute the depth to the root or to a fixed other iterator, walking up from the
+		/// first iterator until it meets the other one or the top. With nodes which keep 
+		/// their depth (tree_node_depth_) the first takes constant time.
 		static int depth(const iterator_base&);
 		static int depth(const iterator_base&, const iterator_base&);
 		/// Determine the maximal depth of the tree. An empty tree has max_depth=-1.
 		int      max_depth() const;
-		/// Determine the maximal depth of the tree with top node at the given position.
+		/// Determine the maximal depth of the tree with top node at the given position. With
+		/// tree_node_depth_ nodes only the parts of the subtree changed since the last call
+		/// are looked at.
 		int      max_depth(const iterator_base&) const;
 		/// Count the number of children of node at position.
 		static unsigned int number_of_children(const iterator_base&);
@@ -435,14 +1862,17 @@ class tree {
 		/// Determine whether the iterator is one of the 'head' nodes at the top level, i.e. has no parent.
 		static   bool is_head(const iterator_base&);
 		/// Find the lowest common ancestor of two nodes, that is, the deepest node such that
-		/// both nodes are descendants of it.
+		/// both nodes are descendants of it. Returns an iterator to 0 if there is none (nodes
+		/// in different head subtrees, or one of them a head).
 		iterator lowest_common_ancestor(const iterator_base&, const iterator_base &) const;
 
 		/// Determine the index of a node in the range of siblings to which it belongs.
 		unsigned int index(sibling_iterator it) const;
-		/// Inverse of 'index': return the n-th child of the node at position.
+		/// Inverse of 'index': return the n-th child of the node at position, which has to
+		/// have more than n children.
 		static sibling_iterator child(const iterator_base& position, unsigned int);
-		/// Return iterator to the sibling indicated by index
+		/// Return iterator to the sibling indicated by index, which has to be below the
+		/// number of nodes in the range of siblings.
 		sibling_iterator sibling(const iterator_base& position, unsigned int) const;  				
 		
 		/// For debugging only: verify internal consistency by inspecting all pointers in the tree
@@ -462,8 +1892,112 @@ class tree {
 	private:
 		tree_node_allocator alloc_;
 		void head_initialise_();
+		/// Drop all nodes (head and feet included) in one go, if the allocator supports it
+		/// and no destructors need to run. Returns false if nothing was done.
+		bool release_nodes_();
+		template<class Alloc>
+		static bool release_all_(Alloc&)                          { return false; }
+		template<class Node>
+		static bool release_all_(tree_node_pool_allocator<Node>& a) { return a.release(); }
+		/// Room for one node (not constructed), and giving it back.
+		tree_node *allocate_node_();
+		void       deallocate_node_(tree_node *);
+		/// Tell the allocator that 'n' nodes are about to be allocated, if it wants to know.
+		void reserve_nodes_(size_t n);
+		template<class Alloc>
+		static void reserve_(Alloc&, size_t)                                 {}
+		template<class Node>
+		static void reserve_(tree_node_pool_allocator<Node>& a, size_t n)    { a.reserve(n); }
+		/// Copy the given node and everything below it in a single pre-order pass. The copy
+		/// is not linked into the tree yet (its parent and sibling pointers are null). Each
+		/// node is allocated and constructed on its own, also for trivially copyable data:
+		/// nodes get freed one at a time, so there is no block to copy the data into at once.
+		tree_node *clone_subtree_(const tree_node *);
+		/// Add a copy of the data as last child of 'parent' while cloning (no counts updated).
+		tree_node *clone_append_(tree_node *parent, const T&);
+		/// Allocate an unlinked node with its data built in place from the arguments.
+		template<class... Args>
+		tree_node *new_node_(Args&&...);
+		/// Free all nodes below the given one, without touching any counts.
+		void erase_children_(tree_node *);
+		/// Free the given node, all nodes to its right and all their children.
+		void erase_siblings_(tree_node *);
+		/// Stable sort of the siblings from 'first' to 'last' (inclusive), relinking them
+		/// in their new order; 'scratch' is used as buffer. Returns the new first node.
+		template<class StrictWeakOrdering>
+		tree_node *sort_siblings_(tree_node *first, tree_node *last, StrictWeakOrdering& comp,
+										  std::vector<tree_node *>& scratch);
+		/// Link the heads of all trees in [first, last) in as children of 'parent', right after
+		/// 'prev' (or in front of all children if that is null); returns the first of them, or
+		/// null if the trees are all empty.
+		template<class TreeIter>
+		tree_node *move_in_after_(tree_node *parent, tree_node *prev, TreeIter first, TreeIter last);
+		/// Add the data of the leaves strictly below 'top' to 'block', which holds 'n' of them
+		/// already, handing it to f whenever it is full. Returns the number left in 'block'.
+		template<class F>
+		size_t     leaf_blocks_(tree_node *top, T **block, size_t n, F& f) const;
+		/// Bookkeeping after a change of structure: mark any ancestry index and the child array
+		/// of 'pos' stale, and update cached counts (if the node type has them): 'pos' gets
+		/// 'children' extra children, and it as well as all its ancestors get 'size' extra
+		/// nodes below them.
+		void counts_(tree_node *pos, ptrdiff_t size, int children);
+		/// For nodes which keep their depth: give the siblings 'first' to 'last' (inclusive),
+		/// and everything below them, the depth of the place they are in now.
+		void        depths_(tree_node *first, tree_node *last);
+		/// For nodes which keep their depth: the max_depth() below 'top', working out the 
+		/// unknown ones on the way.
+		static int  height_(tree_node *top);
+
+		/// Pre-order numbering of all nodes (stored in the nodes themselves) plus, per
+		/// number, the node and its depth, with a table of the shallowest node in runs of
+		/// blocks of numbers, and the numbers of the nodes at each depth (for fixed-depth
+		/// iterators). Only used with node types which can store their number.
+		struct ancestry_index_ {
+			ancestry_index_() : valid(false), builds(0) {}
+			std::vector<tree_node *>          nodes;
+			std::vector<unsigned int>         depths;
+			std::vector<std::vector<size_t> > shallowest; // [k][b]: over blocks b..b+2^k-1
+			std::vector<std::vector<size_t> > levels;     // [d]: numbers at depth d, in order
+			bool                              valid;
+			unsigned long                     builds;     // number of times it was (re)built
+		};
+		static const size_t ancestry_block_=32;
+		mutable std::unique_ptr<ancestry_index_> ancestry_;
+		/// Mark the ancestry index as out of date and move on to a new epoch().
+		void structure_changed_();
+		unsigned long        epoch_=0;
+		mutable bool         epoch_seen_=false; // epoch_ only needs to change once someone saw it
+		/// Number of open batch_scopes, and whether the structure changed since the first one.
+		unsigned int         batch_depth_=0;
+		bool                 batch_dirty_=false;
+		/// Set the subtree sizes, depths and maximal depths of all nodes (for node types which
+		/// keep them) in one walk, after a batch_scope.
+		void     repair_();
+		/// The walks behind path_from_iterator() and iterator_from_path(), for either kind of path.
+		template<class Path>
+		void     path_from_iterator_(const iterator_base& iter, const iterator_base& top, Path&) const;
+		template<class Path>
+		iterator iterator_from_path_(const Path&, const iterator_base& top) const;
+		/// Return the ancestry index, (re)building it first if needed.
+		const ancestry_index_& ancestry_index_built_() const;
+		/// Number of the shallowest node with number in [from, to].
+		static size_t shallowest_(const ancestry_index_&, size_t from, size_t to);
 		void copy_(const tree<T, tree_node_allocator>& other);
 
+		/// Hash and equality of nodes through their data, for the merge index.
+		template<class Hash>
+		struct hash_nodes_ {
+			hash_nodes_(const Hash& h) : hash(h) {}
+			size_t operator()(const tree_node *n) const { return hash(n->data); }
+			Hash hash;
+		};
+		template<class Equal>
+		struct equal_nodes_ {
+			equal_nodes_(const Equal& e) : equal(e) {}
+			bool operator()(const tree_node *a, const tree_node *b) const { return equal(a->data, b->data); }
+			Equal equal;
+		};
+
       /// Comparator class for two nodes of a tree (used for sorting and searching).
 		template<class StrictWeakOrdering>
 		class compare_nodes {
@@ -527,6 +2061,13 @@ tree<T, tree_node_allocator>::tree()
 	head_initialise_();
 	}
 
+template <class T, class tree_node_allocator>
+tree<T, tree_node_allocator>::tree(const tree_node_allocator& alloc) 
+	: alloc_(alloc)
+	{
+	head_initialise_();
+	}
+
 template <class T, class tree_node_allocator>
 tree<T, tree_node_allocator>::tree(const T& x) 
 	{
@@ -536,11 +2077,13 @@ tree<T, tree_node_allocator>::tree(const T& x)
 
 template <class T, class tree_node_allocator>
 tree<T, tree_node_allocator>::tree(tree<T, tree_node_allocator>&& x) 
+	: alloc_(x.alloc_) // the nodes we take over stay with the allocator of x
 	{
 	head_initialise_();
+	x.structure_changed_();
 	if(x.head->next_sibling!=x.feet) { // move tree if non-empty only
 		head->next_sibling=x.head->next_sibling;
-		feet->prev_sibling=x.head->prev_sibling;
+		feet->prev_sibling=x.feet->prev_sibling;
 		x.head->next_sibling->prev_sibling=head;
 		x.feet->prev_sibling->next_sibling=feet;
 		x.head->next_sibling=x.feet;
@@ -559,20 +2102,45 @@ tree<T, tree_node_allocator>::tree(const iterator_base& other)
 template <class T, class tree_node_allocator>
 tree<T, tree_node_allocator>::~tree()
 	{
+	if(release_nodes_()) return;
+
 	clear();
-	alloc_.destroy(head);
-	alloc_.destroy(feet);
-	alloc_.deallocate(head,1);
-	alloc_.deallocate(feet,1);
+	alloc_traits_::destroy(alloc_, head);
+	alloc_traits_::destroy(alloc_, feet);
+	deallocate_node_(head);
+	deallocate_node_(feet);
+	}
+
+template <class T, class tree_node_allocator>
+bool tree<T, tree_node_allocator>::release_nodes_()
+	{
+	if(!std::is_trivially_destructible<tree_node>::value) return false;
+	if(!release_all_(alloc_)) return false;
+	KPTREE_STAT_ADD_(bulk_releases, 1);
+	return true;
+	}
+
+template <class T, class tree_node_allocator>
+typename tree<T, tree_node_allocator>::tree_node *tree<T, tree_node_allocator>::allocate_node_()
+	{
+	KPTREE_STAT_ADD_(allocations, 1);
+	return alloc_traits_::allocate(alloc_, 1);
+	}
+
+template <class T, class tree_node_allocator>
+void tree<T, tree_node_allocator>::deallocate_node_(tree_node *n)
+	{
+	KPTREE_STAT_ADD_(frees, 1);
+	alloc_traits_::deallocate(alloc_, n, 1);
 	}
 
 template <class T, class tree_node_allocator>
 void tree<T, tree_node_allocator>::head_initialise_() 
    { 
-   head = alloc_.allocate(1,0); // MSVC does not have default second argument 
-	feet = alloc_.allocate(1,0);
-	alloc_.construct(head, tree_node_<T>());
-	alloc_.construct(feet, tree_node_<T>());
+   head = allocate_node_();
+	feet = allocate_node_();
+	alloc_traits_::construct(alloc_, head);
+	alloc_traits_::construct(alloc_, feet);
 
    head->parent=0;
    head->first_child=0;
@@ -600,9 +2168,22 @@ tree<T,tree_node_allocator>& tree<T, tree_node_allocator>::operator=(tree<T, tre
 	{
 	if(this != &x) {
 		clear(); // clear any existing data.
-		
+		x.structure_changed_();
+		if(alloc_!=x.alloc_) {
+			// The nodes of x have to be freed by the allocator they came from, so
+			// take that one over (with fresh head and feet).
+			alloc_traits_::destroy(alloc_, head);
+			alloc_traits_::destroy(alloc_, feet);
+			deallocate_node_(head);
+			deallocate_node_(feet);
+			alloc_=x.alloc_;
+			head_initialise_();
+			}
+		if(x.head->next_sibling==x.feet) // nothing to move
+			return *this;
+
 		head->next_sibling=x.head->next_sibling;
-		feet->prev_sibling=x.head->prev_sibling;
+		feet->prev_sibling=x.feet->prev_sibling;
 		x.head->next_sibling->prev_sibling=head;
 		x.feet->prev_sibling->next_sibling=feet;
 		x.head->next_sibling=x.feet;
@@ -621,30 +2202,123 @@ tree<T, tree_node_allocator>::tree(const tree<T, tree_node_allocator>& other)
 template <class T, class tree_node_allocator>
 void tree<T, tree_node_allocator>::copy_(const tree<T, tree_node_allocator>& other) 
 	{
+	KPTREE_STAT_TIME_(copies, copy_ns);
 	clear();
-	pre_order_iterator it=other.begin(), to=begin();
-	while(it!=other.end()) {
-		to=insert(to, (*it));
-		it.skip_children();
-		++it;
+	if(node_traits::counted) // only then is the size known without a walk
+		reserve_nodes_(other.size());
+	for(tree_node *from=other.head->next_sibling; from!=other.feet; from=from->next_sibling) {
+		tree_node *tmp=clone_subtree_(from);
+		tmp->prev_sibling=feet->prev_sibling;
+		tmp->next_sibling=feet;
+		feet->prev_sibling->next_sibling=tmp;
+		feet->prev_sibling=tmp;
 		}
-	to=begin();
-	it=other.begin();
-	while(it!=other.end()) {
-		to=replace(to, it);
-		to.skip_children();
-		it.skip_children();
-		++to;
-		++it;
+	}
+
+template <class T, class tree_node_allocator>
+typename tree<T, tree_node_allocator>::tree_node *tree<T, tree_node_allocator>::clone_subtree_(const tree_node *from) 
+	{
+	tree_node *top=allocate_node_();
+	try {
+		alloc_traits_::construct(alloc_, top, from->data);
+		}
+	catch(...) {
+		deallocate_node_(top);
+		throw;
+		}
+
+	// Walk the original in pre-order, with 'dst' always pointing at the copy of 'src'.
+	// The parent pointers of the copy lead back up, so no stack is needed. Once we 
+	// leave a node for good, its counts are complete and get added to its parent.
+	const tree_node *src=from;
+	tree_node       *dst=top;
+	try {
+		for(;;) {
+			if(src->first_child!=0) {
+				src=src->first_child;
+				dst=clone_append_(dst, src->data);
+				continue;
+				}
+			while(src!=from && src->next_sibling==0) {
+				node_traits::add_counts(dst->parent, node_traits::subtree_size(dst), 1);
+				src=src->parent;
+				dst=dst->parent;
+				}
+			if(src==from) 
+				break;
+			node_traits::add_counts(dst->parent, node_traits::subtree_size(dst), 1);
+			src=src->next_sibling;
+			dst=clone_append_(dst->parent, src->data);
+			}
+		}
+	catch(...) {
+		erase_children_(top);
+		alloc_traits_::destroy(alloc_, top);
+		deallocate_node_(top);
+		throw;
+		}
+	return top;
+	}
+
+template <class T, class tree_node_allocator>
+typename tree<T, tree_node_allocator>::tree_node *tree<T, tree_node_allocator>::clone_append_(tree_node *parent, const T& x) 
+	{
+	tree_node *tmp=allocate_node_();
+	try {
+		alloc_traits_::construct(alloc_, tmp, x);
 		}
+	catch(...) {
+		deallocate_node_(tmp);
+		throw;
+		}
+	tmp->parent=parent;
+	tmp->prev_sibling=parent->last_child;
+	if(parent->last_child!=0) parent->last_child->next_sibling=tmp;
+	else                      parent->first_child=tmp;
+	parent->last_child=tmp;
+	node_traits::set_depth(tmp, node_traits::depth(parent)+1);
+	node_traits::forget_height(parent);
+	return tmp;
+	}
+
+template <class T, class tree_node_allocator>
+template <class... Args>
+typename tree<T, tree_node_allocator>::tree_node *tree<T, tree_node_allocator>::new_node_(Args&&... args) 
+	{
+	tree_node *tmp=allocate_node_();
+	try {
+		alloc_traits_::construct(alloc_, tmp, tree_node_in_place_(), std::forward<Args>(args)...);
+		}
+	catch(...) {
+		deallocate_node_(tmp);
+		throw;
+		}
+	return tmp;
+	}
+
+template <class T, class tree_node_allocator>
+void tree<T, tree_node_allocator>::reserve_nodes_(size_t n) 
+	{
+	reserve_(alloc_, n);
 	}
 
 template <class T, class tree_node_allocator>
 void tree<T, tree_node_allocator>::clear()
 	{
-	if(head)
-		while(head->next_sibling!=feet)
-			erase(pre_order_iterator(head->next_sibling));
+	structure_changed_();
+	if(head) {
+		if(head->next_sibling==feet) return;
+		// Bulk release of all nodes; note that this also renews head and feet,
+		// so any end() iterators obtained earlier are invalidated.
+		if(release_nodes_()) {
+			head_initialise_();
+			return;
+			}
+		feet->prev_sibling->next_sibling=0;
+		erase_siblings_(head->next_sibling);
+		head->next_sibling=feet;
+		feet->prev_sibling=head;
+		}
 	}
 
 template<class T, class tree_node_allocator> 
@@ -653,20 +2327,36 @@ void tree<T, tree_node_allocator>::erase_children(const iterator_base& it)
 //	std::cout << "erase_children " << it.node << std::endl;
 	if(it.node==0) return;
 
-	tree_node *cur=it.node->first_child;
-	tree_node *prev=0;
+	counts_(it.node, 1-ptrdiff_t(node_traits::subtree_size(it.node)), -int(node_traits::children(it.node)));
+	erase_children_(it.node);
+//	std::cout << "exit" << std::endl;
+	}
+
+template<class T, class tree_node_allocator> 
+void tree<T, tree_node_allocator>::erase_children_(tree_node *node)
+	{
+	erase_siblings_(node->first_child);
+	node->first_child=0;
+	node->last_child=0;
+	}
 
+template<class T, class tree_node_allocator> 
+void tree<T, tree_node_allocator>::erase_siblings_(tree_node *cur)
+	{
+	// Instead of descending into the children of a node, splice its list of 
+	// children in front of its next sibling before freeing it. This visits 
+	// every node once and needs no stack, whatever the shape of the tree.
 	while(cur!=0) {
-		prev=cur;
-		cur=cur->next_sibling;
-		erase_children(pre_order_iterator(prev));
-//		kp::destructor(&prev->data);
-		alloc_.destroy(prev);
-		alloc_.deallocate(prev,1);
-		}
-	it.node->first_child=0;
-	it.node->last_child=0;
-//	std::cout << "exit" << std::endl;
+		tree_node *next=cur->next_sibling;
+		if(cur->first_child!=0) {
+			cur->last_child->next_sibling=next;
+			next=cur->first_child;
+			}
+//		kp::destructor(&cur->data);
+		alloc_traits_::destroy(alloc_, cur);
+		deallocate_node_(cur);
+		cur=next;
+		}
 	}
 
 template<class T, class tree_node_allocator> 
@@ -674,20 +2364,29 @@ void tree<T, tree_node_allocator>::erase_right_siblings(const iterator_base& it)
 	{
 	if(it.node==0) return;
 
-	tree_node *cur=it.node->next_sibling;
-	tree_node *prev=0;
+	// Siblings at the head level are closed off by the feet, not by a null pointer.
+	tree_node *stop=(it.node->parent==0)?feet:0;
+	tree_node *first=it.node->next_sibling;
+	if(first==stop) return;
+
+	// Sizes only matter to counted nodes, but the change has to be recorded for all.
+	ptrdiff_t removed_size=0;
+	int       removed_children=0;
+	if(node_traits::counted)
+		for(tree_node *cur=first; cur!=stop; cur=cur->next_sibling) {
+			removed_size+=node_traits::subtree_size(cur);
+			++removed_children;
+			}
+	counts_(it.node->parent, -removed_size, -removed_children);
 
-	while(cur!=0) {
-		prev=cur;
-		cur=cur->next_sibling;
-		erase_children(pre_order_iterator(prev));
-//		kp::destructor(&prev->data);
-		alloc_.destroy(prev);
-		alloc_.deallocate(prev,1);
-		}
-	it.node->next_sibling=0;
-	if(it.node->parent!=0)
+	if(stop) {
+		feet->prev_sibling->next_sibling=0;
+		feet->prev_sibling=it.node;
+		}
+	else
 		it.node->parent->last_child=it.node;
+	it.node->next_sibling=stop;
+	erase_siblings_(first);
 	}
 
 template<class T, class tree_node_allocator> 
@@ -695,20 +2394,30 @@ void tree<T, tree_node_allocator>::erase_left_siblings(const iterator_base& it)
 	{
 	if(it.node==0) return;
 
-	tree_node *cur=it.node->prev_sibling;
-	tree_node *prev=0;
+	// Siblings at the head level are closed off by the head, not by a null pointer.
+	tree_node *stop=(it.node->parent==0)?head:0;
+	tree_node *last=it.node->prev_sibling;
+	if(last==stop) return;
+
+	tree_node *first;
+	if(stop) first=head->next_sibling;
+	else     first=it.node->parent->first_child;
+
+	// Sizes only matter to counted nodes, but the change has to be recorded for all.
+	ptrdiff_t removed_size=0;
+	int       removed_children=0;
+	if(node_traits::counted)
+		for(tree_node *cur=first; cur!=it.node; cur=cur->next_sibling) {
+			removed_size+=node_traits::subtree_size(cur);
+			++removed_children;
+			}
+	counts_(it.node->parent, -removed_size, -removed_children);
 
-	while(cur!=0) {
-		prev=cur;
-		cur=cur->prev_sibling;
-		erase_children(pre_order_iterator(prev));
-//		kp::destructor(&prev->data);
-		alloc_.destroy(prev);
-		alloc_.deallocate(prev,1);
-		}
-	it.node->prev_sibling=0;
-	if(it.node->parent!=0)
-		it.node->parent->first_child=it.node;
+	if(stop) head->next_sibling=it.node;
+	else     it.node->parent->first_child=it.node;
+	it.node->prev_sibling=stop;
+	last->next_sibling=0;
+	erase_siblings_(first);
 	}
 
 template<class T, class tree_node_allocator> 
@@ -720,7 +2429,8 @@ iter tree<T, tree_node_allocator>::erase(iter it)
 	iter ret=it;
 	ret.skip_children();
 	++ret;
-	erase_children(it);
+	counts_(cur->parent, -ptrdiff_t(node_traits::subtree_size(cur)), -1);
+	erase_children_(cur);
 	if(cur->prev_sibling==0) {
 		cur->parent->first_child=cur->next_sibling;
 		}
@@ -735,8 +2445,8 @@ iter tree<T, tree_node_allocator>::erase(iter it)
 		}
 
 //	kp::destructor(&cur->data);
-	alloc_.destroy(cur);
-   alloc_.deallocate(cur,1);
+	alloc_traits_::destroy(alloc_, cur);
+   deallocate_node_(cur);
 	return ret;
 	}
 
@@ -764,6 +2474,19 @@ typename tree<T, tree_node_allocator>::breadth_first_queued_iterator tree<T, tre
 	return breadth_first_queued_iterator();
 	}
 
+template <class T, class tree_node_allocator>
+typename tree<T, tree_node_allocator>::level_order_iterator tree<T, tree_node_allocator>::begin_level_order() const
+	{
+	if(head->next_sibling==feet) return level_order_iterator();
+	return level_order_iterator(head->next_sibling);
+	}
+
+template <class T, class tree_node_allocator>
+typename tree<T, tree_node_allocator>::level_order_iterator tree<T, tree_node_allocator>::end_level_order() const
+	{
+	return level_order_iterator();
+	}
+
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::post_order_iterator tree<T, tree_node_allocator>::begin_post() const
 	{
@@ -784,34 +2507,53 @@ typename tree<T, tree_node_allocator>::post_order_iterator tree<T, tree_node_all
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::fixed_depth_iterator tree<T, tree_node_allocator>::begin_fixed(const iterator_base& pos, unsigned int dp, bool walk_back) const
 	{
-	typename tree<T, tree_node_allocator>::fixed_depth_iterator ret;
-	ret.top_node=pos.node;
+	fixed_depth_iterator ret=end_fixed(pos, dp);
+
+	if(node_traits::indexed) {
+		// The nodes in the range have consecutive places in the list of their depth: those
+		// numbered within the subtree of pos, or for dp==0 within that of its parent.
+		const ancestry_index_& idx=ancestry_index_built_();
+		size_t num=node_traits::order(pos.node), from=num, to=node_traits::order_end(pos.node);
+		if(dp==0) {
+			if(walk_back) from=(pos.node->parent==0)?0:node_traits::order(pos.node->parent);
+			to=(pos.node->parent==0)?idx.nodes.size():node_traits::order_end(pos.node->parent);
+			}
+		size_t level=idx.depths[num]+dp;
+		if(level>=idx.levels.size()) return ret;
+		const std::vector<size_t>& l=idx.levels[level];
+		ret.begin_=std::lower_bound(l.begin(), l.end(), from)-l.begin();
+		ret.end_=std::lower_bound(l.begin()+ret.begin_, l.end(), to)-l.begin();
+		if(ret.begin_==ret.end_) return ret;
+		ret.index_=&idx;
+		ret.built_=idx.builds;
+		ret.level_=level;
+		ret.at_=ret.begin_;
+		ret.node=idx.nodes[l[ret.at_]];
+		return ret;
+		}
 
 	tree_node *tmp=pos.node;
 	unsigned int curdepth=0;
-	while(curdepth<dp) { // go down one level
-		while(tmp->first_child==0) {
-			if(tmp->next_sibling==0) {
-				// try to walk up and then right again
-				do {
-					if(tmp==ret.top_node)
-					   throw std::range_error("tree: begin_fixed out of range");
-					tmp=tmp->parent;
-               if(tmp==0) 
-					   throw std::range_error("tree: begin_fixed out of range");
-               --curdepth;
-				   } while(tmp->next_sibling==0);
-				}
-			tmp=tmp->next_sibling;
+	while(curdepth<dp) { 
+		if(tmp->first_child!=0) { // go down one level
+			tmp=tmp->first_child;
+			++curdepth;
+			continue;
 			}
-		tmp=tmp->first_child;
-		++curdepth;
+		// try to walk right, going up as needed but staying below pos
+		while(curdepth>0 && tmp->next_sibling==0) {
+			tmp=tmp->parent;
+			--curdepth;
+			}
+		if(curdepth==0) 
+			return ret; // nothing at this depth
+		tmp=tmp->next_sibling;
 		}
 
 	// Now walk back to the first sibling in this range.
-	if(walk_back)
-	while(tmp->prev_sibling!=0)
-		tmp=tmp->prev_sibling;	
+	if(walk_back && dp==0)
+		while(tmp->prev_sibling!=0 && tmp->prev_sibling!=head)
+			tmp=tmp->prev_sibling;	
 	
 	ret.node=tmp;
 	return ret;
@@ -820,19 +2562,11 @@ typename tree<T, tree_node_allocator>::fixed_depth_iterator tree<T, tree_node_al
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::fixed_depth_iterator tree<T, tree_node_allocator>::end_fixed(const iterator_base& pos, unsigned int dp) const
 	{
-	assert(1==0); // FIXME: not correct yet: use is_valid() as a temporary workaround 
-	tree_node *tmp=pos.node;
-	unsigned int curdepth=1;
-	while(curdepth<dp) { // go down one level
-		while(tmp->first_child==0) {
-			tmp=tmp->next_sibling;
-			if(tmp==0)
-				throw std::range_error("tree: end_fixed out of range");
-			}
-		tmp=tmp->first_child;
-		++curdepth;
-		}
-	return tmp;
+	fixed_depth_iterator ret;
+	ret.node=0;
+	ret.top_node=pos.node;
+	ret.depth_=dp;
+	return ret;
 	}
 
 template <class T, class tree_node_allocator>
@@ -842,7 +2576,7 @@ typename tree<T, tree_node_allocator>::sibling_iterator tree<T, tree_node_alloca
 	if(pos.node->first_child==0) {
 		return end(pos);
 		}
-	return pos.node->first_child;
+	return sibling_iterator(pos.node->first_child);
 	}
 
 template <class T, class tree_node_allocator>
@@ -874,12 +2608,33 @@ template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::path_t tree<T, tree_node_allocator>::path_from_iterator(const iterator_base& iter, const iterator_base& top) const
 	{
 	path_t path;
+	path_from_iterator_(iter, top, path);
+	return path;
+	}
+
+template <class T, class tree_node_allocator>
+template <unsigned int N>
+void tree<T, tree_node_allocator>::path_from_iterator(const iterator_base& iter, const iterator_base& top, tree_path<N>& path) const
+	{
+	path.clear();
+	path_from_iterator_(iter, top, path);
+	}
+
+template <class T, class tree_node_allocator>
+template <class Path>
+void tree<T, tree_node_allocator>::path_from_iterator_(const iterator_base& iter, const iterator_base& top, Path& path) const
+	{
 	tree_node *walk=iter.node;
 		
 	do {
 		if(path.size()>0)
 			walk=walk->parent;
 		int num=0;
+		if(node_traits::random_access && walk->parent!=0 && walk->parent!=top.node->parent) {
+			// 'top' is not among these siblings, so all the ones before 'walk' count.
+			num=node_traits::position(walk);
+			walk=walk->parent->first_child;
+			}
 		while(walk!=top.node && walk->prev_sibling!=0 && walk->prev_sibling!=head) {
 			++num;
 			walk=walk->prev_sibling;
@@ -889,16 +2644,37 @@ typename tree<T, tree_node_allocator>::path_t tree<T, tree_node_allocator>::path
 	while(walk->parent!=0 && walk!=top.node);
 
 	std::reverse(path.begin(), path.end());
-	return path;
 	}
 
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::iterator tree<T, tree_node_allocator>::iterator_from_path(const path_t& path, const iterator_base& top) const
+	{
+	return iterator_from_path_(path, top);
+	}
+
+template <class T, class tree_node_allocator>
+template <unsigned int N>
+typename tree<T, tree_node_allocator>::iterator tree<T, tree_node_allocator>::iterator_from_path(const tree_path<N>& path, const iterator_base& top) const
+	{
+	return iterator_from_path_(path, top);
+	}
+
+template <class T, class tree_node_allocator>
+template <class Path>
+typename tree<T, tree_node_allocator>::iterator tree<T, tree_node_allocator>::iterator_from_path_(const Path& path, const iterator_base& top) const
 	{
 	iterator it=top;
 	tree_node *walk=it.node;
 
 	for(size_t step=0; step<path.size(); ++step) {
+		if(step>0 && node_traits::random_access) {
+			if(walk->first_child==0)
+				throw std::range_error("tree::iterator_from_path: no more nodes at step "+std::to_string(step));
+			walk=node_traits::nth_child(walk, path[step]);
+			if(walk==0)
+				throw std::range_error("tree::iterator_from_path: out of siblings at step "+std::to_string(step));
+			continue;
+			}
 		if(step>0)
 			walk=walk->first_child;
 		if(walk==0)
@@ -929,6 +2705,70 @@ typename tree<T, tree_node_allocator>::leaf_iterator tree<T, tree_node_allocator
    return leaf_iterator(top.node, top.node);
    }
 
+template <class T, class tree_node_allocator>
+const size_t tree<T, tree_node_allocator>::leaf_block_size;
+
+template <class T, class tree_node_allocator>
+template <class F>
+void tree<T, tree_node_allocator>::for_each_leaf_block(F f) const
+	{
+	T     *block[leaf_block_size];
+	size_t n=0;
+	for(tree_node *top=head->next_sibling; top!=feet; top=top->next_sibling) {
+		if(top->first_child==0) {
+			block[n++]=&top->data;
+			if(n==leaf_block_size) {
+				f(static_cast<T * const *>(block), n);
+				n=0;
+				}
+			}
+		else n=leaf_blocks_(top, block, n, f);
+		}
+	if(n>0)
+		f(static_cast<T * const *>(block), n);
+	}
+
+template <class T, class tree_node_allocator>
+template <class F>
+void tree<T, tree_node_allocator>::for_each_leaf_block(const iterator_base& top, F f) const
+	{
+	assert(top.node!=0);
+	T     *block[leaf_block_size];
+	size_t n=leaf_blocks_(top.node, block, 0, f);
+	if(n>0)
+		f(static_cast<T * const *>(block), n);
+	}
+
+template <class T, class tree_node_allocator>
+template <class F>
+size_t tree<T, tree_node_allocator>::leaf_blocks_(tree_node *top, T **block, size_t n, F& f) const
+	{
+	tree_node *cur=top->first_child;
+	if(cur==0) return n;
+	while(true) {
+		// The next node is either the first child or, once the subtree is done, the next
+		// sibling; both links are at hand now, so ask for both nodes.
+		tree_node *child=cur->first_child, *next=cur->next_sibling;
+		KPTREE_PREFETCH_(child);
+		KPTREE_PREFETCH_(next);
+		if(child!=0) {
+			cur=child;
+			continue;
+			}
+		block[n++]=&cur->data;
+		if(n==leaf_block_size) {
+			f(static_cast<T * const *>(block), n);
+			n=0;
+			}
+		while(next==0) {
+			cur=cur->parent;
+			if(cur==top) return n;
+			next=cur->next_sibling;
+			}
+		cur=next;
+		}
+	}
+
 template <class T, class tree_node_allocator>
 template <typename iter>
 iter tree<T, tree_node_allocator>::parent(iter position) 
@@ -961,6 +2801,17 @@ template <class T, class tree_node_allocator>
 template <typename iter>
 iter tree<T, tree_node_allocator>::next_at_same_depth(iter position) const
 	{
+	if(node_traits::indexed) {
+		// The next number in the list of the depth of this node.
+		const ancestry_index_& idx=ancestry_index_built_();
+		size_t num=node_traits::order(position.node);
+		const std::vector<size_t>& l=idx.levels[idx.depths[num]];
+		typename std::vector<size_t>::const_iterator next=std::upper_bound(l.begin(), l.end(), num);
+		iter ret(position);
+		ret.node=(next==l.end())?0:idx.nodes[*next];
+		return ret;
+		}
+
 	// We make use of a temporary fixed_depth iterator to implement this.
 
 	typename tree<T, tree_node_allocator>::fixed_depth_iterator tmp(position.node);
@@ -1010,8 +2861,8 @@ iter tree<T, tree_node_allocator>::append_child(iter position)
 	assert(position.node!=feet);
 	assert(position.node);
 
-	tree_node *tmp=alloc_.allocate(1,0);
-	alloc_.construct(tmp, tree_node_<T>());
+	tree_node *tmp=allocate_node_();
+	alloc_traits_::construct(alloc_, tmp);
 //	kp::constructor(&tmp->data);
 	tmp->first_child=0;
 	tmp->last_child=0;
@@ -1026,6 +2877,8 @@ iter tree<T, tree_node_allocator>::append_child(iter position)
 	tmp->prev_sibling=position.node->last_child;
 	position.node->last_child=tmp;
 	tmp->next_sibling=0;
+	counts_(position.node, 1, 1);
+	depths_(tmp, tmp);
 	return tmp;
  	}
 
@@ -1037,8 +2890,8 @@ iter tree<T, tree_node_allocator>::prepend_child(iter position)
 	assert(position.node!=feet);
 	assert(position.node);
 
-	tree_node *tmp=alloc_.allocate(1,0);
-	alloc_.construct(tmp, tree_node_<T>());
+	tree_node *tmp=allocate_node_();
+	alloc_traits_::construct(alloc_, tmp);
 //	kp::constructor(&tmp->data);
 	tmp->first_child=0;
 	tmp->last_child=0;
@@ -1051,8 +2904,10 @@ iter tree<T, tree_node_allocator>::prepend_child(iter position)
 		position.node->last_child=tmp;
 		}
 	tmp->next_sibling=position.node->first_child;
-	position.node->prev_child=tmp;
+	position.node->first_child=tmp;
 	tmp->prev_sibling=0;
+	counts_(position.node, 1, 1);
+	depths_(tmp, tmp);
 	return tmp;
  	}
 
@@ -1068,8 +2923,8 @@ iter tree<T, tree_node_allocator>::append_child(iter position, const T& x)
 	assert(position.node!=feet);
 	assert(position.node);
 
-	tree_node* tmp = alloc_.allocate(1,0);
-	alloc_.construct(tmp, x);
+	tree_node* tmp = allocate_node_();
+	alloc_traits_::construct(alloc_, tmp, x);
 //	kp::constructor(&tmp->data, x);
 	tmp->first_child=0;
 	tmp->last_child=0;
@@ -1084,20 +2939,27 @@ iter tree<T, tree_node_allocator>::append_child(iter position, const T& x)
 	tmp->prev_sibling=position.node->last_child;
 	position.node->last_child=tmp;
 	tmp->next_sibling=0;
+	counts_(position.node, 1, 1);
+	depths_(tmp, tmp);
 	return tmp;
 	}
 
 template <class T, class tree_node_allocator>
 template <class iter>
 iter tree<T, tree_node_allocator>::append_child(iter position, T&& x)
+	{
+	return emplace_child(position, std::move(x));
+	}
+
+template <class T, class tree_node_allocator>
+template <class iter, class... Args>
+iter tree<T, tree_node_allocator>::emplace_child(iter position, Args&&... args)
 	{
 	assert(position.node!=head);
 	assert(position.node!=feet);
 	assert(position.node);
 
-	tree_node* tmp = alloc_.allocate(1,0);
-	alloc_.construct(tmp); // Here is where the move semantics kick in
-	std::swap(tmp->data, x);
+	tree_node* tmp = new_node_(std::forward<Args>(args)...);
 
 	tmp->first_child=0;
 	tmp->last_child=0;
@@ -1112,6 +2974,8 @@ iter tree<T, tree_node_allocator>::append_child(iter position, T&& x)
 	tmp->prev_sibling=position.node->last_child;
 	position.node->last_child=tmp;
 	tmp->next_sibling=0;
+	counts_(position.node, 1, 1);
+	depths_(tmp, tmp);
 	return tmp;
 	}
 
@@ -1123,8 +2987,8 @@ iter tree<T, tree_node_allocator>::prepend_child(iter position, const T& x)
 	assert(position.node!=feet);
 	assert(position.node);
 
-	tree_node* tmp = alloc_.allocate(1,0);
-	alloc_.construct(tmp, x);
+	tree_node* tmp = allocate_node_();
+	alloc_traits_::construct(alloc_, tmp, x);
 //	kp::constructor(&tmp->data, x);
 	tmp->first_child=0;
 	tmp->last_child=0;
@@ -1139,6 +3003,8 @@ iter tree<T, tree_node_allocator>::prepend_child(iter position, const T& x)
 	tmp->next_sibling=position.node->first_child;
 	position.node->first_child=tmp;
 	tmp->prev_sibling=0;
+	counts_(position.node, 1, 1);
+	depths_(tmp, tmp);
 	return tmp;
 	}
 
@@ -1150,9 +3016,8 @@ iter tree<T, tree_node_allocator>::prepend_child(iter position, T&& x)
 	assert(position.node!=feet);
 	assert(position.node);
 
-	tree_node* tmp = alloc_.allocate(1,0);
-	alloc_.construct(tmp);
-	std::swap(tmp->data, x);
+	tree_node* tmp = allocate_node_();
+	alloc_traits_::construct(alloc_, tmp, std::move(x));
 
 	tmp->first_child=0;
 	tmp->last_child=0;
@@ -1167,6 +3032,8 @@ iter tree<T, tree_node_allocator>::prepend_child(iter position, T&& x)
 	tmp->next_sibling=position.node->first_child;
 	position.node->first_child=tmp;
 	tmp->prev_sibling=0;
+	counts_(position.node, 1, 1);
+	depths_(tmp, tmp);
 	return tmp;
 	}
 
@@ -1240,9 +3107,16 @@ typename tree<T, tree_node_allocator>::pre_order_iterator tree<T, tree_node_allo
 
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::pre_order_iterator tree<T, tree_node_allocator>::set_head(T&& x)
+	{
+	return emplace_head(std::move(x));
+	}
+
+template <class T, class tree_node_allocator>
+template <class... Args>
+typename tree<T, tree_node_allocator>::pre_order_iterator tree<T, tree_node_allocator>::emplace_head(Args&&... args)
 	{
 	assert(head->next_sibling==feet);
-	return insert(iterator(feet), x);
+	return emplace_before(iterator(feet), std::forward<Args>(args)...);
 	}
 
 template <class T, class tree_node_allocator>
@@ -1255,8 +3129,8 @@ iter tree<T, tree_node_allocator>::insert(iter position, const T& x)
 		}
 	assert(position.node!=head); // Cannot insert before head.
 
-	tree_node* tmp = alloc_.allocate(1,0);
-	alloc_.construct(tmp, x);
+	tree_node* tmp = allocate_node_();
+	alloc_traits_::construct(alloc_, tmp, x);
 //	kp::constructor(&tmp->data, x);
 	tmp->first_child=0;
 	tmp->last_child=0;
@@ -1272,20 +3146,29 @@ iter tree<T, tree_node_allocator>::insert(iter position, const T& x)
 		}
 	else
 		tmp->prev_sibling->next_sibling=tmp;
+	counts_(tmp->parent, 1, 1);
+	depths_(tmp, tmp);
 	return tmp;
 	}
 
 template <class T, class tree_node_allocator>
 template <class iter>
 iter tree<T, tree_node_allocator>::insert(iter position, T&& x)
+	{
+	return emplace_before(position, std::move(x));
+	}
+
+template <class T, class tree_node_allocator>
+template <class iter, class... Args>
+iter tree<T, tree_node_allocator>::emplace_before(iter position, Args&&... args)
 	{
 	if(position.node==0) {
 		position.node=feet; // Backward compatibility: when calling insert on a null node,
 		                    // insert before the feet.
 		}
-	tree_node* tmp = alloc_.allocate(1,0);
-	alloc_.construct(tmp);
-	std::swap(tmp->data, x); // Move semantics
+	assert(position.node!=head); // Cannot insert before head.
+
+	tree_node* tmp = new_node_(std::forward<Args>(args)...);
 	tmp->first_child=0;
 	tmp->last_child=0;
 
@@ -1300,14 +3183,16 @@ iter tree<T, tree_node_allocator>::insert(iter position, T&& x)
 		}
 	else
 		tmp->prev_sibling->next_sibling=tmp;
+	counts_(tmp->parent, 1, 1);
+	depths_(tmp, tmp);
 	return tmp;
 	}
 
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::sibling_iterator tree<T, tree_node_allocator>::insert(sibling_iterator position, const T& x)
 	{
-	tree_node* tmp = alloc_.allocate(1,0);
-	alloc_.construct(tmp, x);
+	tree_node* tmp = allocate_node_();
+	alloc_traits_::construct(alloc_, tmp, x);
 //	kp::constructor(&tmp->data, x);
 	tmp->first_child=0;
 	tmp->last_child=0;
@@ -1330,6 +3215,39 @@ typename tree<T, tree_node_allocator>::sibling_iterator tree<T, tree_node_alloca
 		}
 	else
 		tmp->prev_sibling->next_sibling=tmp;
+	counts_(tmp->parent, 1, 1);
+	depths_(tmp, tmp);
+	return tmp;
+	}
+
+template <class T, class tree_node_allocator>
+template <class... Args>
+typename tree<T, tree_node_allocator>::sibling_iterator tree<T, tree_node_allocator>::emplace_before(sibling_iterator position, Args&&... args)
+	{
+	tree_node* tmp = new_node_(std::forward<Args>(args)...);
+	tmp->first_child=0;
+	tmp->last_child=0;
+
+	tmp->next_sibling=position.node;
+	if(position.node==0) { // iterator points to end of a subtree
+		tmp->parent=position.parent_;
+		tmp->prev_sibling=position.range_last();
+		tmp->parent->last_child=tmp;
+		}
+	else {
+		tmp->parent=position.node->parent;
+		tmp->prev_sibling=position.node->prev_sibling;
+		position.node->prev_sibling=tmp;
+		}
+
+	if(tmp->prev_sibling==0) {
+		if(tmp->parent) // when inserting nodes at the head, there is no parent
+			tmp->parent->first_child=tmp;
+		}
+	else
+		tmp->prev_sibling->next_sibling=tmp;
+	counts_(tmp->parent, 1, 1);
+	depths_(tmp, tmp);
 	return tmp;
 	}
 
@@ -1337,8 +3255,8 @@ template <class T, class tree_node_allocator>
 template <class iter>
 iter tree<T, tree_node_allocator>::insert_after(iter position, const T& x)
 	{
-	tree_node* tmp = alloc_.allocate(1,0);
-	alloc_.construct(tmp, x);
+	tree_node* tmp = allocate_node_();
+	alloc_traits_::construct(alloc_, tmp, x);
 //	kp::constructor(&tmp->data, x);
 	tmp->first_child=0;
 	tmp->last_child=0;
@@ -1355,6 +3273,8 @@ iter tree<T, tree_node_allocator>::insert_after(iter position, const T& x)
 	else {
 		tmp->next_sibling->prev_sibling=tmp;
 		}
+	counts_(tmp->parent, 1, 1);
+	depths_(tmp, tmp);
 	return tmp;
 	}
 
@@ -1362,10 +3282,14 @@ template <class T, class tree_node_allocator>
 template <class iter>
 iter tree<T, tree_node_allocator>::insert_after(iter position, T&& x)
 	{
-	tree_node* tmp = alloc_.allocate(1,0);
-	alloc_.construct(tmp);
-	std::swap(tmp->data, x); // move semantics
-//	kp::constructor(&tmp->data, x);
+	return emplace_after(position, std::move(x));
+	}
+
+template <class T, class tree_node_allocator>
+template <class iter, class... Args>
+iter tree<T, tree_node_allocator>::emplace_after(iter position, Args&&... args)
+	{
+	tree_node* tmp = new_node_(std::forward<Args>(args)...);
 	tmp->first_child=0;
 	tmp->last_child=0;
 
@@ -1381,6 +3305,8 @@ iter tree<T, tree_node_allocator>::insert_after(iter position, T&& x)
 	else {
 		tmp->next_sibling->prev_sibling=tmp;
 		}
+	counts_(tmp->parent, 1, 1);
+	depths_(tmp, tmp);
 	return tmp;
 	}
 
@@ -1431,19 +3357,13 @@ template <class iter>
 iter tree<T, tree_node_allocator>::replace(iter position, const iterator_base& from)
 	{
 	assert(position.node!=head);
-	tree_node *current_from=from.node;
-	tree_node *start_from=from.node;
-	tree_node *current_to  =position.node;
-
-	// replace the node at position with head of the replacement tree at from
-//	std::cout << "warning!" << position.node << std::endl;
-	erase_children(position);	
-//	std::cout << "no warning!" << std::endl;
-	tree_node* tmp = alloc_.allocate(1,0);
-	alloc_.construct(tmp, (*from));
-//	kp::constructor(&tmp->data, (*from));
-	tmp->first_child=0;
-	tmp->last_child=0;
+	tree_node *current_to=position.node;
+
+	// copy the replacement subtree first, then put it in the place of the node at position
+	if(node_traits::counted)
+		reserve_nodes_(node_traits::subtree_size(from.node));
+	tree_node *tmp=clone_subtree_(from.node);
+
 	if(current_to->prev_sibling==0) {
 		if(current_to->parent!=0)
 			current_to->parent->first_child=tmp;
@@ -1461,37 +3381,15 @@ iter tree<T, tree_node_allocator>::replace(iter position, const iterator_base& f
 		}
 	tmp->next_sibling=current_to->next_sibling;
 	tmp->parent=current_to->parent;
-//	kp::destructor(&current_to->data);
-	alloc_.destroy(current_to);
-	alloc_.deallocate(current_to,1);
-	current_to=tmp;
-	
-	// only at this stage can we fix 'last'
-	tree_node *last=from.node->next_sibling;
+	counts_(tmp->parent, ptrdiff_t(node_traits::subtree_size(tmp))-ptrdiff_t(node_traits::subtree_size(current_to)), 0);
+	depths_(tmp, tmp);
 
-	pre_order_iterator toit=tmp;
-	// copy all children
-	do {
-		assert(current_from!=0);
-		if(current_from->first_child != 0) {
-			current_from=current_from->first_child;
-			toit=append_child(toit, current_from->data);
-			}
-		else {
-			while(current_from->next_sibling==0 && current_from!=start_from) {
-				current_from=current_from->parent;
-				toit=parent(toit);
-				assert(current_from!=0);
-				}
-			current_from=current_from->next_sibling;
-			if(current_from!=last) {
-				toit=append_child(parent(toit), current_from->data);
-				}
-			}
-		}
-	while(current_from!=last);
+	erase_children_(current_to);
+//	kp::destructor(&current_to->data);
+	alloc_traits_::destroy(alloc_, current_to);
+	deallocate_node_(current_to);
 
-	return current_to;
+	return tmp;
 	}
 
 template <class T, class tree_node_allocator>
@@ -1546,7 +3444,13 @@ iter tree<T, tree_node_allocator>::flatten(iter position)
 	if(position.node->first_child==0)
 		return position;
 
-	tree_node *tmp=position.node->first_child;
+	ptrdiff_t moved_size=ptrdiff_t(node_traits::subtree_size(position.node))-1;
+	int       moved_children=node_traits::children(position.node);
+	counts_(position.node, -moved_size, -moved_children);
+	counts_(position.node->parent, moved_size, moved_children);
+
+	tree_node *first=position.node->first_child, *last=position.node->last_child;
+	tree_node *tmp=first;
 	while(tmp) {
 		tmp->parent=position.node->parent;
 		tmp=tmp->next_sibling;
@@ -1562,6 +3466,7 @@ iter tree<T, tree_node_allocator>::flatten(iter position)
 	position.node->next_sibling->prev_sibling=position.node;
 	position.node->first_child=0;
 	position.node->last_child=0;
+	depths_(first, last);
 
 	return position;
 	}
@@ -1578,9 +3483,15 @@ iter tree<T, tree_node_allocator>::reparent(iter position, sibling_iterator begi
 	
 	if(begin==end) return begin;
 	// determine last node
+	ptrdiff_t moved_size=node_traits::subtree_size(first);
+	int       moved_children=1;
 	while((++begin)!=end) {
 		last=last->next_sibling;
+		moved_size+=node_traits::subtree_size(last);
+		++moved_children;
 		}
+	counts_(first->parent, -moved_size, -moved_children);
+	counts_(position.node, moved_size, moved_children);
 	// move subtree
 	if(first->prev_sibling==0) {
 		first->parent->first_child=last->next_sibling;
@@ -1612,6 +3523,7 @@ iter tree<T, tree_node_allocator>::reparent(iter position, sibling_iterator begi
 		if(pos==last) break;
 		pos=pos->next_sibling;
 		}
+	depths_(first, last);
 
 	return first;
 	}
@@ -1620,7 +3532,7 @@ template <class T, class tree_node_allocator>
 template <typename iter> iter tree<T, tree_node_allocator>::reparent(iter position, iter from)
 	{
 	if(from.node->first_child==0) return position;
-	return reparent(position, from.node->first_child, end(from));
+	return reparent(position, sibling_iterator(from.node->first_child), end(from));
 	}
 
 template <class T, class tree_node_allocator>
@@ -1656,6 +3568,9 @@ template <typename iter> iter tree<T, tree_node_allocator>::move_after(iter targ
 		if(dst->next_sibling==src) // already in the right spot
 			return source;
 
+	counts_(src->parent, -ptrdiff_t(node_traits::subtree_size(src)), -1);
+	counts_(dst->parent, node_traits::subtree_size(src), 1);
+
    // take src out of the tree
    if(src->prev_sibling!=0) src->prev_sibling->next_sibling=src->next_sibling;
    else                     src->parent->first_child=src->next_sibling;
@@ -1669,6 +3584,7 @@ template <typename iter> iter tree<T, tree_node_allocator>::move_after(iter targ
    dst->next_sibling=src;
    src->prev_sibling=dst;
    src->parent=dst->parent;
+   depths_(src, src);
    return src;
    }
 
@@ -1685,6 +3601,9 @@ template <typename iter> iter tree<T, tree_node_allocator>::move_before(iter tar
 		if(dst->prev_sibling==src) // already in the right spot
 			return source;
 
+	counts_(src->parent, -ptrdiff_t(node_traits::subtree_size(src)), -1);
+	counts_(dst->parent, node_traits::subtree_size(src), 1);
+
    // take src out of the tree
    if(src->prev_sibling!=0) src->prev_sibling->next_sibling=src->next_sibling;
    else                     src->parent->first_child=src->next_sibling;
@@ -1698,6 +3617,7 @@ template <typename iter> iter tree<T, tree_node_allocator>::move_before(iter tar
    dst->prev_sibling=src;
    src->next_sibling=dst;
    src->parent=dst->parent;
+   depths_(src, src);
    return src;
    }
 
@@ -1721,6 +3641,10 @@ typename tree<T, tree_node_allocator>::sibling_iterator tree<T, tree_node_alloca
 		if(dst_prev_sibling==src) // already in the right spot
 			return source;
 
+	tree_node *dst_parent=dst?dst->parent:target.parent_;
+	counts_(src->parent, -ptrdiff_t(node_traits::subtree_size(src)), -1);
+	counts_(dst_parent, node_traits::subtree_size(src), 1);
+
 	// take src out of the tree
 	if(src->prev_sibling!=0) src->prev_sibling->next_sibling=src->next_sibling;
 	else                     src->parent->first_child=src->next_sibling;
@@ -1731,11 +3655,11 @@ typename tree<T, tree_node_allocator>::sibling_iterator tree<T, tree_node_alloca
 	if(dst_prev_sibling!=0) dst_prev_sibling->next_sibling=src;
 	else                    target.parent_->first_child=src;
 	src->prev_sibling=dst_prev_sibling;
-	if(dst) {
-		dst->prev_sibling=src;
-		src->parent=dst->parent;
-		}
+	if(dst) dst->prev_sibling=src;
+	else    target.parent_->last_child=src;
+	src->parent=dst_parent;
 	src->next_sibling=dst;
+	depths_(src, src);
 	return src;
 	}
 
@@ -1757,10 +3681,16 @@ template <typename iter> iter tree<T, tree_node_allocator>::move_ontop(iter targ
 	tree_node *b_prev_sibling=dst->prev_sibling;
 	tree_node *b_next_sibling=dst->next_sibling;
 	tree_node *b_parent=dst->parent;
+	// if source and target are neighbours, source itself will not be there to connect to
+	if(b_prev_sibling==src) b_prev_sibling=src->prev_sibling;
+	if(b_next_sibling==src) b_next_sibling=src->next_sibling;
 
 	// remove target
 	erase(target);
 
+	counts_(src->parent, -ptrdiff_t(node_traits::subtree_size(src)), -1);
+	counts_(b_parent, node_traits::subtree_size(src), 1);
+
 	// take src out of the tree
 	if(src->prev_sibling!=0) src->prev_sibling->next_sibling=src->next_sibling;
 	else {
@@ -1787,6 +3717,7 @@ template <typename iter> iter tree<T, tree_node_allocator>::move_ontop(iter targ
 	src->prev_sibling=b_prev_sibling;
 	src->next_sibling=b_next_sibling;
 	src->parent=b_parent;
+	depths_(src, src);
 	return src;
 	}
 
@@ -1794,23 +3725,32 @@ template <typename iter> iter tree<T, tree_node_allocator>::move_ontop(iter targ
 template <class T, class tree_node_allocator>
 tree<T, tree_node_allocator> tree<T, tree_node_allocator>::move_out(iterator source)
 	{
-	tree ret;
+	tree ret(alloc_);
 
-	// Move source node into the 'ret' tree.
-	ret.head->next_sibling = source.node;
-	ret.feet->prev_sibling = source.node;
-	source.node->parent=0;
+	counts_(source.node->parent, -ptrdiff_t(node_traits::subtree_size(source.node)), -1);
 
 	// Close the links in the current tree.
 	if(source.node->prev_sibling!=0) 
 		source.node->prev_sibling->next_sibling = source.node->next_sibling;
+	else
+		source.node->parent->first_child = source.node->next_sibling;
 
 	if(source.node->next_sibling!=0) 
 		source.node->next_sibling->prev_sibling = source.node->prev_sibling;
+	else
+		source.node->parent->last_child = source.node->prev_sibling;
+
+	// Move source node into the 'ret' tree.
+	ret.head->next_sibling = source.node;
+	ret.feet->prev_sibling = source.node;
+	source.node->parent=0;
 
 	// Fix source prev/next links.
 	source.node->prev_sibling = ret.head;
 	source.node->next_sibling = ret.feet;
+	depths_(source.node, source.node);
+	if(batch_depth_>0) // the subtree leaves the batch, so has to be right now
+		ret.repair_();
 
 	return ret; // A good compiler will move this, not copy.
 	}
@@ -1826,23 +3766,31 @@ template<typename iter> iter tree<T, tree_node_allocator>::move_in(iter loc, tre
 	sibling_iterator prev(loc);
 	--prev;
 	
-	prev.node->next_sibling = other_first_head;
+	if(prev.node!=0) prev.node->next_sibling = other_first_head;
+	else             loc.node->parent->first_child = other_first_head;
 	loc.node->prev_sibling  = other_last_head;
 	other_first_head->prev_sibling = prev.node;
 	other_last_head->next_sibling  = loc.node;
 
 	// Adjust parent pointers.
 	tree_node *walk=other_first_head;
+	ptrdiff_t moved_size=0;
+	int       moved_children=0;
 	while(true) {
 		walk->parent=loc.node->parent;
+		moved_size+=node_traits::subtree_size(walk);
+		++moved_children;
 		if(walk==other_last_head)
 			break;
 		walk=walk->next_sibling;
 		}
+	counts_(loc.node->parent, moved_size, moved_children);
+	depths_(other_first_head, other_last_head);
 
-	// Close other tree.
+	// Close other tree; its nodes are gone, so are paths, caches and indices built on it.
 	other.head->next_sibling=other.feet;
 	other.feet->prev_sibling=other.head;
+	other.structure_changed_();
 
 	return other_first_head;
 	}
@@ -1852,8 +3800,7 @@ template<typename iter> iter tree<T, tree_node_allocator>::move_in_below(iter lo
 	{
 	if(other.head->next_sibling==other.feet) return loc; // other tree is empty
 
-	auto n = other.number_of_children(loc);
-	return move_in_as_nth_child(loc, n, other);
+	return move_in_below(loc, &other, &other+1);
 	}
 
 template <class T, class tree_node_allocator>
@@ -1861,57 +3808,83 @@ template<typename iter> iter tree<T, tree_node_allocator>::move_in_as_nth_child(
 	{
 	if(other.head->next_sibling==other.feet) return loc; // other tree is empty
 
-	tree_node *other_first_head = other.head->next_sibling;
-	tree_node *other_last_head  = other.feet->prev_sibling;
+	return move_in_as_nth_child(loc, n, &other, &other+1);
+	}
 
-	if(n==0) {
-		if(loc.node->first_child==0) {
-			loc.node->first_child=other_first_head;
-			loc.node->last_child=other_last_head;
-			other_last_head->next_sibling=0;
-			other_first_head->prev_sibling=0;
-			} 
-		else {
-			loc.node->first_child->prev_sibling=other_last_head;
-			other_last_head->next_sibling=loc.node->first_child;
-			loc.node->first_child=other_first_head;
-			other_first_head->prev_sibling=0;
-			}
-		}
-	else {
+template <class T, class tree_node_allocator>
+template<typename iter, class TreeIter> iter tree<T, tree_node_allocator>::move_in_below(iter loc, TreeIter first, TreeIter last)
+	{
+	tree_node *moved=move_in_after_(loc.node, loc.node->last_child, first, last);
+	return moved?iter(moved):loc;
+	}
+
+template <class T, class tree_node_allocator>
+template<typename iter, class TreeIter> iter tree<T, tree_node_allocator>::move_in_as_nth_child(iter loc, size_t n, TreeIter first, TreeIter last)
+	{
+	tree_node *prev=0;
+	if(n>0) {
 		--n;
-		tree_node *walk = loc.node->first_child;
+		prev = loc.node->first_child;
 		while(true) {
-			if(walk==0)
+			if(prev==0)
 				throw std::range_error("tree: move_in_as_nth_child position out of range");
 			if(n==0) 
 				break;
 			--n;
-			walk = walk->next_sibling;
+			prev = prev->next_sibling;
 			}
-		if(walk->next_sibling==0) 
-			loc.node->last_child=other_last_head;
-		else 
-			walk->next_sibling->prev_sibling=other_last_head;
-		other_last_head->next_sibling=walk->next_sibling;
-		walk->next_sibling=other_first_head;
-		other_first_head->prev_sibling=walk;
 		}
+	tree_node *moved=move_in_after_(loc.node, prev, first, last);
+	return moved?iter(moved):loc;
+	}
 
-	// Adjust parent pointers.
-	tree_node *walk=other_first_head;
-	while(true) {
-		walk->parent=loc.node;
-		if(walk==other_last_head)
-			break;
-		walk=walk->next_sibling;
+template <class T, class tree_node_allocator>
+template <class TreeIter>
+typename tree<T, tree_node_allocator>::tree_node *tree<T, tree_node_allocator>::move_in_after_(tree_node *parent, tree_node *prev,
+																													  TreeIter first, TreeIter last)
+	{
+	tree_node *next = (prev==0)?parent->first_child:prev->next_sibling;
+	tree_node *ret  = 0;
+	ptrdiff_t moved_size=0;
+	int       moved_children=0;
+
+	for(; first!=last; ++first) {
+		tree& other=*first;
+		if(other.head->next_sibling==other.feet) continue; // other tree is empty
+
+		tree_node *other_first_head = other.head->next_sibling;
+		tree_node *other_last_head  = other.feet->prev_sibling;
+		if(prev==0) parent->first_child=other_first_head;
+		else        prev->next_sibling=other_first_head;
+		other_first_head->prev_sibling=prev;
+		if(ret==0) ret=other_first_head;
+
+		// Adjust parent pointers.
+		tree_node *walk=other_first_head;
+		while(true) {
+			walk->parent=parent;
+			moved_size+=node_traits::subtree_size(walk);
+			++moved_children;
+			if(walk==other_last_head)
+				break;
+			walk=walk->next_sibling;
+			}
+		prev=other_last_head;
+
+		// Close other tree, as in move_in.
+		other.head->next_sibling=other.feet;
+		other.feet->prev_sibling=other.head;
+		other.structure_changed_();
 		}
+	if(ret==0) return 0;
 
-	// Close other tree.
-	other.head->next_sibling=other.feet;
-	other.feet->prev_sibling=other.head;
+	prev->next_sibling=next;
+	if(next==0) parent->last_child=prev;
+	else        next->prev_sibling=prev;
+	counts_(parent, moved_size, moved_children);
+	depths_(ret, prev);
 
-	return other_first_head;
+	return ret;
 	}
 
 
@@ -1920,6 +3893,7 @@ void tree<T, tree_node_allocator>::merge(sibling_iterator to1,   sibling_iterato
 														sibling_iterator from1, sibling_iterator from2,
 														bool duplicate_leaves)
 	{
+	KPTREE_STAT_TIME_(merges, merge_ns);
 	sibling_iterator fnd;
 	while(from1!=from2) {
 		if((fnd=std::find(to1, to2, (*from1))) != to2) { // element found
@@ -1927,19 +3901,101 @@ void tree<T, tree_node_allocator>::merge(sibling_iterator to1,   sibling_iterato
 				if(duplicate_leaves)
 					append_child(parent(to1), (*from1));
 				}
-			else { // descend further
-				merge(fnd.begin(), fnd.end(), from1.begin(), from1.end(), duplicate_leaves);
+			else { // descend further
+				merge(fnd.begin(), fnd.end(), from1.begin(), from1.end(), duplicate_leaves);
+				}
+			}
+		else { // element missing
+			insert_subtree(to2, from1);
+			}
+		++from1;
+		}
+	}
+
+template <class T, class tree_node_allocator>
+void tree<T, tree_node_allocator>::merge(iterator to, iterator from, bool duplicate_leaves)
+	{
+	sibling_iterator to1(to);
+	sibling_iterator to2=to1;
+	++to2;
+	sibling_iterator from1(from);
+	sibling_iterator from2=from1;
+	++from2;
+
+	merge(to1, to2, from1, from2, duplicate_leaves);
+	}
+
+template <class T, class tree_node_allocator>
+template <class Hash, class Equal, class Policy>
+void tree<T, tree_node_allocator>::merge(sibling_iterator to1,   sibling_iterator to2,
+														sibling_iterator from1, sibling_iterator from2,
+														Hash hash, Equal equal, Policy policy, bool duplicate_leaves)
+	{
+	KPTREE_STAT_TIME_(merges, merge_ns);
+	typedef std::unordered_set<tree_node *, hash_nodes_<Hash>, equal_nodes_<Equal> > index_t;
+	// Levels matched so far but not yet merged, as (present, merged) parent nodes; the
+	// first level is the one given. Each level is merged completely before the levels
+	// found in it, in the order they were found, as the recursive merge would.
+	std::vector<std::pair<tree_node *, tree_node *> > pending;
+	bool first=true;
+	while(first || !pending.empty()) {
+		if(!first) {
+			sibling_iterator to(pending.back().first);
+			sibling_iterator from(pending.back().second);
+			pending.pop_back();
+			to1=begin(to);
+			to2=end(to);
+			from1=begin(from);
+			from2=end(from);
+			}
+		first=false;
+
+		// Short levels are searched; anything longer gets an index.
+		size_t count=0;
+		for(sibling_iterator it=to1; it!=to2 && count<=8; ++it) ++count;
+		for(sibling_iterator it=from1; it!=from2 && count<=8; ++it) ++count;
+		bool use_index=(count>8);
+		index_t index(0, hash_nodes_<Hash>(hash), equal_nodes_<Equal>(equal));
+		if(use_index)
+			for(sibling_iterator it=to1; it!=to2; ++it)
+				index.insert(it.node); // keeps the first of equal siblings
+
+		size_t found=pending.size();
+		for(; from1!=from2; ++from1) {
+			tree_node *fnd=0;
+			if(use_index) {
+				typename index_t::iterator ii=index.find(from1.node);
+				if(ii!=index.end()) fnd=*ii;
+				}
+			else {
+				for(sibling_iterator it=to1; it!=to2; ++it)
+					if(equal(*it, *from1)) { fnd=it.node; break; }
+				}
+
+			if(fnd!=0) { // element found
+				// Leaves the hashed part alone (see the declaration), so 'fnd' stays findable.
+				policy(fnd->data, *from1);
+				if(from1.begin()==from1.end()) { // full depth reached
+					if(duplicate_leaves)
+						append_child(parent(to1), (*from1));
+					}
+				else pending.push_back(std::make_pair(fnd, from1.node));
+				}
+			else { // element missing
+				// Inserted in front of 'to2', so found by later siblings as in the searching
+				// merge; except when the level was empty, and 'to1' is the end as well.
+				iterator ins=insert_subtree(to2, from1);
+				if(use_index && to1!=to2) index.insert(ins.node);
 				}
 			}
-		else { // element missing
-			insert_subtree(to2, from1);
-			}
-		++from1;
+		std::reverse(pending.begin()+found, pending.end());
 		}
 	}
 
 template <class T, class tree_node_allocator>
-void tree<T, tree_node_allocator>::merge(iterator to, iterator from, bool duplicate_leaves)
+template <class Hash, class Equal, class Policy>
+void tree<T, tree_node_allocator>::merge(iterator to, iterator from, Hash hash, Equal equal, Policy policy,
+													  bool duplicate_leaves)
 	{
 	sibling_iterator to1(to);
 	sibling_iterator to2=to1;
@@ -1948,7 +4004,7 @@ void tree<T, tree_node_allocator>::merge(iterator to, iterator from, bool duplic
 	sibling_iterator from2=from1;
 	++from2;
 
-	merge(to1, to2, from1, from2, duplicate_leaves);
+	merge(to1, to2, from1, from2, hash, equal, policy, duplicate_leaves);
 	}
 
 
@@ -1964,59 +4020,73 @@ template <class StrictWeakOrdering>
 void tree<T, tree_node_allocator>::sort(sibling_iterator from, sibling_iterator to, 
 													 StrictWeakOrdering comp, bool deep)
 	{
+	KPTREE_STAT_TIME_(sorts, sort_ns);
 	if(from==to) return;
-	// make list of sorted nodes
-	// CHECK: if multiset stores equivalent nodes in the order in which they
-	// are inserted, then this routine should be called 'stable_sort'.
-	std::multiset<tree_node *, compare_nodes<StrictWeakOrdering> > nodes(comp);
-	sibling_iterator it=from, it2=to;
-	while(it != to) {
-		nodes.insert(it.node);
-		++it;
-		}
-	// reassemble
-	--it2;
-
-	// prev and next are the nodes before and after the sorted range
-	tree_node *prev=from.node->prev_sibling;
-	tree_node *next=it2.node->next_sibling;
-	typename std::multiset<tree_node *, compare_nodes<StrictWeakOrdering> >::iterator nit=nodes.begin(), eit=nodes.end();
-	if(prev==0) {
-		if((*nit)->parent!=0) // to catch "sorting the head" situations, when there is no parent
-			(*nit)->parent->first_child=(*nit);
+	structure_changed_();
+	compare_nodes<StrictWeakOrdering> cmp(comp);
+	std::vector<tree_node *> scratch;
+
+	sibling_iterator last=to;
+	--last;
+	tree_node *stop=last.node->next_sibling;
+	tree_node *first=sort_siblings_(from.node, last.node, cmp, scratch);
+	if(!deep) return;
+
+	// Sort the children of the nodes in the range, and so on downwards, keeping a list
+	// of nodes whose children still need sorting rather than recursing.
+	std::vector<tree_node *> pending;
+	for(tree_node *n=first; n!=stop; n=n->next_sibling)
+		if(n->first_child!=0) pending.push_back(n);
+	while(!pending.empty()) {
+		tree_node *n=pending.back();
+		pending.pop_back();
+		tree_node *ch=sort_siblings_(n->first_child, n->last_child, cmp, scratch);
+		for(; ch!=0; ch=ch->next_sibling)
+			if(ch->first_child!=0) pending.push_back(ch);
 		}
-	else prev->next_sibling=(*nit);
+	}
 
-	--eit;
-	while(nit!=eit) {
-		(*nit)->prev_sibling=prev;
-		if(prev)
-			prev->next_sibling=(*nit);
-		prev=(*nit);
-		++nit;
+template <class T, class tree_node_allocator>
+template <class StrictWeakOrdering>
+typename tree<T, tree_node_allocator>::tree_node *tree<T, tree_node_allocator>::sort_siblings_(
+	tree_node *first, tree_node *last, StrictWeakOrdering& comp, std::vector<tree_node *>& scratch)
+	{
+	if(first==last) return first;
+	scratch.clear();
+	for(tree_node *n=first; ; n=n->next_sibling) {
+		scratch.push_back(n);
+		if(n==last) break;
 		}
-	// prev now points to the last-but-one node in the sorted range
-	if(prev)
-		prev->next_sibling=(*eit);
-
-	// eit points to the last node in the sorted range.
-	(*eit)->next_sibling=next;
-   (*eit)->prev_sibling=prev; // missed in the loop above
-	if(next==0) {
-		if((*eit)->parent!=0) // to catch "sorting the head" situations, when there is no parent
-			(*eit)->parent->last_child=(*eit);
+	// std::stable_sort allocates a buffer on every call, which dominates for the short
+	// child lists of most nodes; an insertion sort (stable as well) does without.
+	if(scratch.size()<=16) {
+		for(size_t i=1; i<scratch.size(); ++i) {
+			tree_node *n=scratch[i];
+			size_t j=i;
+			for(; j>0 && comp(n, scratch[j-1]); --j)
+				scratch[j]=scratch[j-1];
+			scratch[j]=n;
+			}
 		}
-	else next->prev_sibling=(*eit);
+	else std::stable_sort(scratch.begin(), scratch.end(), comp);
 
-	if(deep) {	// sort the children of each node too
-		sibling_iterator bcs(*nodes.begin());
-		sibling_iterator ecs(*eit);
-		++ecs;
-		while(bcs!=ecs) {
-			sort(begin(bcs), end(bcs), comp, deep);
-			++bcs;
-			}
+	// prev and next are the nodes before and after the sorted range
+	tree_node *prev=first->prev_sibling;
+	tree_node *next=last->next_sibling;
+	tree_node *parent=first->parent;
+	if(node_traits::random_access && parent!=0)
+		node_traits::children_stale(parent);
+	for(size_t i=0; i<scratch.size(); ++i) {
+		tree_node *n=scratch[i];
+		n->prev_sibling=prev;
+		if(prev) prev->next_sibling=n;
+		else if(parent!=0) parent->first_child=n; // no parent when sorting the heads
+		prev=n;
 		}
+	prev->next_sibling=next;
+	if(next) next->prev_sibling=prev;
+	else if(parent!=0) parent->last_child=prev;
+	return scratch.front();
 	}
 
 template <class T, class tree_node_allocator>
@@ -2068,11 +4138,8 @@ bool tree<T, tree_node_allocator>::equal_subtree(const iter& one_, const iter& t
 template <class T, class tree_node_allocator>
 tree<T, tree_node_allocator> tree<T, tree_node_allocator>::subtree(sibling_iterator from, sibling_iterator to) const
 	{
-	assert(from!=to); // if from==to, the range is empty, hence no tree to return.
-
 	tree tmp;
-	tmp.set_head(value_type());
-	tmp.replace(tmp.begin(), tmp.end(), from, to);
+	subtree(tmp, from, to);
 	return tmp;
 	}
 
@@ -2080,15 +4147,33 @@ template <class T, class tree_node_allocator>
 void tree<T, tree_node_allocator>::subtree(tree& tmp, sibling_iterator from, sibling_iterator to) const
 	{
 	assert(from!=to); // if from==to, the range is empty, hence no tree to return.
+	assert(tmp.head->next_sibling==tmp.feet);
 
-	tmp.set_head(value_type());
-	tmp.replace(tmp.begin(), tmp.end(), from, to);
+	if(node_traits::counted) {
+		size_t n=0;
+		for(sibling_iterator it=from; it!=to; ++it)
+			n+=node_traits::subtree_size(it.node);
+		tmp.reserve_nodes_(n);
+		}
+	while(from!=to) {
+		tree_node *cp=tmp.clone_subtree_(from.node);
+		cp->prev_sibling=tmp.feet->prev_sibling;
+		cp->next_sibling=tmp.feet;
+		tmp.feet->prev_sibling->next_sibling=cp;
+		tmp.feet->prev_sibling=cp;
+		++from;
+		}
 	}
 
 template <class T, class tree_node_allocator>
 size_t tree<T, tree_node_allocator>::size() const
 	{
 	size_t i=0;
+	if(node_traits::counted && batch_depth_==0) {
+		for(tree_node *it=head->next_sibling; it!=feet; it=it->next_sibling)
+			i+=node_traits::subtree_size(it);
+		return i;
+		}
 	pre_order_iterator it=begin(), eit=end();
 	while(it!=eit) {
 		++i;
@@ -2100,6 +4185,9 @@ size_t tree<T, tree_node_allocator>::size() const
 template <class T, class tree_node_allocator>
 size_t tree<T, tree_node_allocator>::size(const iterator_base& top) const
 	{
+	if(node_traits::counted && batch_depth_==0)
+		return node_traits::subtree_size(top.node);
+
 	size_t i=0;
 	pre_order_iterator it=top, eit=top;
 	eit.skip_children();
@@ -2118,11 +4206,19 @@ bool tree<T, tree_node_allocator>::empty() const
 	return (it==eit);
 	}
 
+template <class T, class tree_node_allocator>
+tree_node_allocator tree<T, tree_node_allocator>::get_allocator() const
+	{
+	return alloc_;
+	}
+
 template <class T, class tree_node_allocator>
 int tree<T, tree_node_allocator>::depth(const iterator_base& it) 
 	{
 	tree_node* pos=it.node;
 	assert(pos!=0);
+	if(node_traits::depth_kept) 
+		return node_traits::depth(pos);
 	int ret=0;
 	while(pos->parent!=0) {
 		pos=pos->parent;
@@ -2136,6 +4232,8 @@ int tree<T, tree_node_allocator>::depth(const iterator_base& it, const iterator_
 	{
 	tree_node* pos=it.node;
 	assert(pos!=0);
+	// Stored depths (tree_node_depth_) only give the answer once 'root' is known to be an
+	// ancestor, which takes the same walk; so all nodes walk.
 	int ret=0;
 	while(pos->parent!=0 && pos!=root.node) {
 		pos=pos->parent;
@@ -2161,6 +4259,8 @@ int tree<T, tree_node_allocator>::max_depth(const iterator_base& pos) const
 	tree_node *tmp=pos.node;
 
 	if(tmp==0 || tmp==head || tmp==feet) return -1;
+	if(node_traits::depth_kept && batch_depth_==0)
+		return height_(tmp);
 
 	int curdepth=0, maxdepth=0;
 	while(true) { // try to walk the bottom of the tree
@@ -2170,7 +4270,7 @@ int tree<T, tree_node_allocator>::max_depth(const iterator_base& pos) const
 				// try to walk up and then right again
 				do {
 					tmp=tmp->parent;
-               if(tmp==0) return maxdepth;
+               if(tmp==0 || tmp==pos.node) return maxdepth;
                --curdepth;
 					}
 				while(tmp->next_sibling==0);
@@ -2187,6 +4287,11 @@ int tree<T, tree_node_allocator>::max_depth(const iterator_base& pos) const
 template <class T, class tree_node_allocator>
 unsigned int tree<T, tree_node_allocator>::number_of_children(const iterator_base& it) 
 	{
+	if(node_traits::counted)
+		return node_traits::children(it.node);
+	if(node_traits::random_access)
+		return node_traits::child_count(it.node);
+
 	tree_node *pos=it.node->first_child;
 	if(pos==0) return 0;
 	
@@ -2197,6 +4302,7 @@ unsigned int tree<T, tree_node_allocator>::number_of_children(const iterator_bas
 //		  }
 	while((pos=pos->next_sibling))
 		++ret;
+	KPTREE_STAT_ADD_(sibling_walk_steps, ret-1);
 	return ret;
 	}
 
@@ -2204,6 +4310,9 @@ template <class T, class tree_node_allocator>
 unsigned int tree<T, tree_node_allocator>::number_of_siblings(const iterator_base& it) const
 	{
 	tree_node *pos=it.node;
+	if(node_traits::counted && pos->parent!=0)
+		return node_traits::children(pos->parent)-1;
+
 	unsigned int ret=0;
 	// count forward
 	while(pos->next_sibling && 
@@ -2227,7 +4336,10 @@ unsigned int tree<T, tree_node_allocator>::number_of_siblings(const iterator_bas
 template <class T, class tree_node_allocator>
 void tree<T, tree_node_allocator>::swap(sibling_iterator it)
 	{
+	structure_changed_();
 	tree_node *nxt=it.node->next_sibling;
+	if(node_traits::random_access && it.node->parent!=0)
+		node_traits::children_stale(it.node->parent);
 	if(nxt) {
 		if(it.node->prev_sibling)
 			it.node->prev_sibling->next_sibling=nxt;
@@ -2248,6 +4360,7 @@ void tree<T, tree_node_allocator>::swap(sibling_iterator it)
 template <class T, class tree_node_allocator>
 void tree<T, tree_node_allocator>::swap(iterator one, iterator two)
 	{
+	structure_changed_();
 	// if one and two are adjacent siblings, use the sibling swap
 	if(one.node->next_sibling==two.node) swap(one);
 	else if(two.node->next_sibling==one.node) swap(two);
@@ -2258,6 +4371,17 @@ void tree<T, tree_node_allocator>::swap(iterator one, iterator two)
 		tree_node *pre2=two.node->prev_sibling;
 		tree_node *par1=one.node->parent;
 		tree_node *par2=two.node->parent;
+		if(node_traits::random_access) {
+			if(par1) node_traits::children_stale(par1);
+			if(par2) node_traits::children_stale(par2);
+			}
+
+		if(par1!=par2) {
+			ptrdiff_t size1=node_traits::subtree_size(one.node);
+			ptrdiff_t size2=node_traits::subtree_size(two.node);
+			counts_(par1, size2-size1, 0);
+			counts_(par2, size1-size2, 0);
+			}
 
 		// reconnect
 		one.node->parent=par2;
@@ -2275,37 +4399,63 @@ void tree<T, tree_node_allocator>::swap(iterator one, iterator two)
 		two.node->prev_sibling=pre1;
 		if(pre1) pre1->next_sibling=two.node;
 		else     par1->first_child=two.node;
+		depths_(one.node, one.node);
+		depths_(two.node, two.node);
 		}
 	}
 
-// template <class BinaryPredicate>
-// tree<T, tree_node_allocator>::iterator tree<T, tree_node_allocator>::find_subtree(
-// 	sibling_iterator subfrom, sibling_iterator subto, iterator from, iterator to, 
-// 	BinaryPredicate fun) const
-// 	{
-// 	assert(1==0); // this routine is not finished yet.
-// 	while(from!=to) {
-// 		if(fun(*subfrom, *from)) {
-// 			
-// 			}
-// 		}
-// 	return to;
-// 	}
+template <class T, class tree_node_allocator>
+typename tree<T, tree_node_allocator>::iterator tree<T, tree_node_allocator>::find_subtree(
+	sibling_iterator subfrom, sibling_iterator subto, iterator from, iterator to) const
+	{
+	std::equal_to<T> comp;
+	return find_subtree(subfrom, subto, from, to, comp);
+	}
+
+template <class T, class tree_node_allocator>
+template <class BinaryPredicate>
+typename tree<T, tree_node_allocator>::iterator tree<T, tree_node_allocator>::find_subtree(
+	sibling_iterator subfrom, sibling_iterator subto, iterator from, iterator to, 
+	BinaryPredicate fun) const
+	{
+	if(subfrom==subto) return to;
+	while(from!=to) {
+		sibling_iterator sub=subfrom, here=from;
+		while(sub!=subto && here.node!=0 && here.node!=feet && equal_subtree(sub, here, fun)) {
+			++sub;
+			++here;
+			}
+		if(sub==subto) return from;
+		++from;
+		}
+	return to;
+	}
 
 template <class T, class tree_node_allocator>
 bool tree<T, tree_node_allocator>::is_in_subtree(const iterator_base& it, const iterator_base& top) const
    {
-	sibling_iterator first=top;
-	sibling_iterator last=first;
-	++last;
-	return is_in_subtree(it, first, last);
+	if(node_traits::indexed && is_valid(it) && is_valid(top)) {
+		ancestry_index_built_();
+		return node_traits::order(top.node)<=node_traits::order(it.node) 
+			&& node_traits::order(it.node)<node_traits::order_end(top.node);
+		}
+	for(tree_node *walk=it.node; walk!=0; walk=walk->parent)
+		if(walk==top.node) return true;
+	return false;
 	}
 
 template <class T, class tree_node_allocator>
 bool tree<T, tree_node_allocator>::is_in_subtree(const iterator_base& it, const iterator_base& begin, 
 																 const iterator_base& end) const
 	{
-	// FIXME: this should be optimised.
+	if(node_traits::indexed && is_valid(begin)) {
+		if(!is_valid(it)) return false;
+		const ancestry_index_& idx=ancestry_index_built_();
+		size_t first=node_traits::order(begin.node);
+		size_t last=is_valid(end)?node_traits::order(end.node):idx.nodes.size();
+		if(last<first) last=idx.nodes.size(); // the walk below would run to the end
+		return first<=node_traits::order(it.node) && node_traits::order(it.node)<last;
+		}
 	pre_order_iterator tmp=begin;
 	while(tmp!=end) {
 		if(tmp==it) return true;
@@ -2332,31 +4482,45 @@ template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::iterator tree<T, tree_node_allocator>::lowest_common_ancestor(
 	const iterator_base& one, const iterator_base& two) const
 	{
-	std::set<iterator, iterator_base_less> parents;
-
-	// Walk up from 'one' storing all parents.
-	iterator walk=one;
-	do {
-		walk=parent(walk);
-		parents.insert(walk);
+	// The answer is the lowest node which is an ancestor of (or equal to) both parents.
+	tree_node *a=one.node->parent;
+	tree_node *b=two.node->parent;
+	if(a==0 || b==0) return iterator(0);
+
+	if(node_traits::indexed) {
+		const ancestry_index_& idx=ancestry_index_built_();
+		if(node_traits::order(a)>node_traits::order(b)) std::swap(a,b);
+		if(node_traits::order(b)<node_traits::order_end(a)) return iterator(a);
+		// The shallowest node after 'a', up to 'b', is a child of the ancestor we want.
+		return iterator(idx.nodes[shallowest_(idx, node_traits::order(a)+1, node_traits::order(b))]->parent);
 		}
-	while( is_valid(parent(walk)) );
 
-	// Walk up from 'two' until we encounter a node in parents.
-	walk=two;
-	do {
-		walk=parent(walk);
-		if(parents.find(walk) != parents.end()) break;
+	// Level the two with their depths; those kept in the nodes are stale inside a batch,
+	// so count the steps up to the top then.
+	int da=0, db=0;
+	if(node_traits::depth_kept && batch_depth_==0) {
+		da=node_traits::depth(a);
+		db=node_traits::depth(b);
 		}
-	while( is_valid(parent(walk)) );
-
-	return walk;
+	else {
+		for(tree_node *n=a; n->parent!=0; n=n->parent) ++da;
+		for(tree_node *n=b; n->parent!=0; n=n->parent) ++db;
+		}
+	for(; da>db; --da) a=a->parent;
+	for(; db>da; --db) b=b->parent;
+	while(a!=b) {
+		a=a->parent;
+		b=b->parent;
+		}
+	return iterator(a);
 	}
 
 template <class T, class tree_node_allocator>
 unsigned int tree<T, tree_node_allocator>::index(sibling_iterator it) const
 	{
 	unsigned int ind=0;
+	if(node_traits::random_access && it.node->parent!=0)
+		return node_traits::position(it.node);
 	if(it.node->parent==0) {
 		while(it.node->prev_sibling!=head) {
 			it.node=it.node->prev_sibling;
@@ -2369,6 +4533,7 @@ unsigned int tree<T, tree_node_allocator>::index(sibling_iterator it) const
 			++ind;
 			}
 		}
+	KPTREE_STAT_ADD_(sibling_walk_steps, ind);
 	return ind;
 	}
 
@@ -2383,6 +4548,10 @@ typename tree<T, tree_node_allocator>::sibling_iterator tree<T, tree_node_alloca
          --num;
          }
       }
+   else if(node_traits::random_access) {
+      assert(num<node_traits::child_count(it.node->parent));
+      tmp=node_traits::nth_child(it.node->parent, num);
+      }
    else {
       tmp=it.node->parent->first_child;
       while(num) {
@@ -2410,13 +4579,311 @@ void tree<T, tree_node_allocator>::debug_verify_consistency() const
 			else
 				assert(it.node->next_sibling->prev_sibling==it.node);
 			}
+		if(node_traits::counted) {
+			size_t       subtree_size=1;
+			unsigned int children=0;
+			for(tree_node *ch=it.node->first_child; ch!=0; ch=ch->next_sibling) {
+				subtree_size+=node_traits::subtree_size(ch);
+				++children;
+				}
+			assert(batch_depth_>0 || node_traits::subtree_size(it.node)==subtree_size);
+			assert(node_traits::children(it.node)==children);
+			}
+		if(node_traits::depth_kept && batch_depth_==0) 
+			assert(node_traits::depth(it.node)==(it.node->parent==0?0:node_traits::depth(it.node->parent)+1));
 		++it;
 		}
 	}
 
+template <class T, class tree_node_allocator>
+void tree<T, tree_node_allocator>::counts_(tree_node *pos, ptrdiff_t size, int children)
+	{
+	structure_changed_();
+	if(node_traits::random_access && pos!=0)
+		node_traits::children_stale(pos);
+	if(batch_depth_>0) {
+		// Child counts are cheap to keep; the rest waits for the end of the batch.
+		batch_dirty_=true;
+		if(node_traits::counted && pos!=0)
+			node_traits::add_counts(pos, 0, children);
+		return;
+		}
+	if(node_traits::depth_kept) {
+		// Once a node's height is unknown, so are those of all nodes above it.
+		for(tree_node *n=pos; n!=0 && node_traits::height_known(n); n=n->parent)
+			node_traits::forget_height(n);
+		}
+	if(!node_traits::counted || pos==0) return;
+
+	node_traits::add_counts(pos, size, children);
+	while((pos=pos->parent)!=0)
+		node_traits::add_counts(pos, size, 0);
+	}
+
+template <class T, class tree_node_allocator>
+void tree<T, tree_node_allocator>::depths_(tree_node *first, tree_node *last)
+	{
+	if(!node_traits::depth_kept || batch_depth_>0) return;
+	for(tree_node *top=first; ; top=top->next_sibling) {
+		int shift=(top->parent==0?0:node_traits::depth(top->parent)+1)-node_traits::depth(top);
+		if(shift!=0) { // the depths below are right relative to 'top', so shift them all
+			tree_node *n=top;
+			while(true) {
+				node_traits::set_depth(n, node_traits::depth(n)+shift);
+				if(n->first_child!=0) {
+					n=n->first_child;
+					continue;
+					}
+				while(n!=top && n->next_sibling==0)
+					n=n->parent;
+				if(n==top) break;
+				n=n->next_sibling;
+				}
+			}
+		if(top==last) break;
+		}
+	}
+
+template <class T, class tree_node_allocator>
+int tree<T, tree_node_allocator>::height_(tree_node *top)
+	{
+	if(node_traits::height_known(top)) return node_traits::height(top);
+	// Post-order over the nodes whose height is unknown; below all others it is known.
+	tree_node *n=top, *ch=top->first_child;
+	while(true) {
+		while(ch!=0 && node_traits::height_known(ch))
+			ch=ch->next_sibling;
+		if(ch!=0) {
+			n=ch;
+			ch=n->first_child;
+			continue;
+			}
+		int h=0;
+		for(ch=n->first_child; ch!=0; ch=ch->next_sibling)
+			h=std::max(h, node_traits::height(ch)+1);
+		node_traits::set_height(n, h);
+		if(n==top) return h;
+		ch=n->next_sibling;
+		n=n->parent;
+		}
+	}
+
+template <class T, class tree_node_allocator>
+void tree<T, tree_node_allocator>::structure_changed_()
+	{
+	// Only written when still valid, so that concurrent structural changes to different
+	// parts of the tree (tree_parallel.hh) merely read it once it is stale.
+	if(node_traits::indexed && ancestry_ && ancestry_->valid)
+		ancestry_->valid=false;
+	if(epoch_seen_) {
+		++epoch_;
+		epoch_seen_=false;
+		}
+	}
+
+template <class T, class tree_node_allocator>
+void tree<T, tree_node_allocator>::repair_()
+	{
+	if(!node_traits::counted && !node_traits::depth_kept) return;
+	// Depths get set on the way down, counts and heights once the walk leaves a node
+	// for good, when those of its children are known.
+	for(tree_node *top=head->next_sibling; top!=feet; top=top->next_sibling) {
+		tree_node *n=top;
+		node_traits::set_depth(n, 0);
+		while(true) {
+			if(n->first_child!=0) {
+				n=n->first_child;
+				node_traits::set_depth(n, node_traits::depth(n->parent)+1);
+				continue;
+				}
+			while(true) {
+				size_t       size=1;
+				unsigned int children=0;
+				int          height=0;
+				for(tree_node *ch=n->first_child; ch!=0; ch=ch->next_sibling) {
+					size+=node_traits::subtree_size(ch);
+					++children;
+					height=std::max(height, node_traits::height(ch)+1);
+					}
+				node_traits::add_counts(n, ptrdiff_t(size)-ptrdiff_t(node_traits::subtree_size(n)), 
+												int(children)-int(node_traits::children(n)));
+				node_traits::set_height(n, height);
+				if(n==top || n->next_sibling!=0) break;
+				n=n->parent;
+				}
+			if(n==top) break;
+			n=n->next_sibling;
+			node_traits::set_depth(n, node_traits::depth(n->parent)+1);
+			}
+		}
+	}
+
+template <class T, class tree_node_allocator>
+typename tree<T, tree_node_allocator>::batch_scope tree<T, tree_node_allocator>::batch(bool rollback)
+	{
+	return batch_scope(*this, rollback);
+	}
+
+template <class T, class tree_node_allocator>
+tree<T, tree_node_allocator>::batch_scope::batch_scope(tree& tr, bool rollback)
+	: tree_(&tr)
+	{
+	if(rollback) {
+		saved_.reset(new tree(tr.alloc_));
+		*saved_=tr;
+		}
+	if(tree_->batch_depth_++==0)
+		tree_->batch_dirty_=false;
+	}
+
+template <class T, class tree_node_allocator>
+tree<T, tree_node_allocator>::batch_scope::batch_scope(batch_scope&& other)
+	: tree_(other.tree_), saved_(std::move(other.saved_))
+	{
+	other.tree_=0;
+	}
+
+template <class T, class tree_node_allocator>
+tree<T, tree_node_allocator>::batch_scope::~batch_scope()
+	{
+	if(tree_==0) return;
+	if(saved_) {
+		// Not committed: throw away the changes. Copies are made with all node data up
+		// to date, so nothing is left to repair.
+		*tree_=std::move(*saved_);
+		saved_.reset();
+		tree_->batch_dirty_=false;
+		}
+	end_();
+	}
+
+template <class T, class tree_node_allocator>
+void tree<T, tree_node_allocator>::batch_scope::commit()
+	{
+	assert(tree_!=0);
+	saved_.reset();
+	end_();
+	}
+
+template <class T, class tree_node_allocator>
+void tree<T, tree_node_allocator>::batch_scope::end_()
+	{
+	if(--tree_->batch_depth_==0 && tree_->batch_dirty_) {
+		tree_->repair_();
+		tree_->batch_dirty_=false;
+		}
+	tree_=0;
+	}
+
+template <class T, class tree_node_allocator>
+tree_stats tree<T, tree_node_allocator>::stats()
+	{
+	return tree_stats::current();
+	}
+
+template <class T, class tree_node_allocator>
+unsigned long tree<T, tree_node_allocator>::epoch() const
+	{
+	if(!epoch_seen_)
+		epoch_seen_=true;
+	return epoch_;
+	}
+
+template <class T, class tree_node_allocator>
+const typename tree<T, tree_node_allocator>::ancestry_index_& tree<T, tree_node_allocator>::ancestry_index_built_() const
+	{
+	if(!ancestry_) 
+		ancestry_.reset(new ancestry_index_());
+	ancestry_index_& idx=*ancestry_;
+	if(idx.valid) return idx;
+
+	// Number the nodes in pre-order; a node's subtree ends where the walk leaves it.
+	idx.nodes.clear();
+	idx.depths.clear();
+	for(size_t l=0; l<idx.levels.size(); ++l)
+		idx.levels[l].clear();
+	tree_node    *n=head->next_sibling;
+	unsigned int  d=0;
+	while(n!=feet) {
+		node_traits::set_order(n, idx.nodes.size());
+		if(d==idx.levels.size())
+			idx.levels.push_back(std::vector<size_t>());
+		idx.levels[d].push_back(idx.nodes.size());
+		idx.nodes.push_back(n);
+		idx.depths.push_back(d);
+		if(n->first_child) {
+			n=n->first_child;
+			++d;
+			continue;
+			}
+		for(;;) {
+			node_traits::set_order_end(n, idx.nodes.size());
+			if(n->next_sibling) {
+				n=n->next_sibling;
+				break;
+				}
+			n=n->parent;
+			--d;
+			}
+		}
+
+	// Shallowest node per block, then per run of 2^k blocks.
+	size_t blocks=(idx.nodes.size()+ancestry_block_-1)/ancestry_block_;
+	idx.shallowest.assign(1, std::vector<size_t>(blocks));
+	for(size_t b=0; b<blocks; ++b) {
+		size_t best=b*ancestry_block_;
+		size_t last=std::min(best+ancestry_block_, idx.nodes.size());
+		for(size_t i=best+1; i<last; ++i)
+			if(idx.depths[i]<idx.depths[best]) best=i;
+		idx.shallowest[0][b]=best;
+		}
+	for(size_t k=1; (size_t(1)<<k)<=blocks; ++k) {
+		const std::vector<size_t>& prev=idx.shallowest[k-1];
+		std::vector<size_t> cur(blocks-(size_t(1)<<k)+1);
+		for(size_t b=0; b<cur.size(); ++b) {
+			size_t one=prev[b], two=prev[b+(size_t(1)<<(k-1))];
+			cur[b]=(idx.depths[two]<idx.depths[one])?two:one;
+			}
+		idx.shallowest.push_back(cur);
+		}
+
+	while(!idx.levels.empty() && idx.levels.back().empty())
+		idx.levels.pop_back();
+	++idx.builds;
+	idx.valid=true;
+	return idx;
+	}
+
+template <class T, class tree_node_allocator>
+size_t tree<T, tree_node_allocator>::shallowest_(const ancestry_index_& idx, size_t from, size_t to) 
+	{
+	size_t best=from;
+	size_t bfrom=from/ancestry_block_, bto=to/ancestry_block_;
+	size_t scan_to=(bfrom==bto)?to:(bfrom+1)*ancestry_block_-1;
+	for(size_t i=from+1; i<=scan_to; ++i)
+		if(idx.depths[i]<idx.depths[best]) best=i;
+	if(bfrom!=bto) {
+		for(size_t i=bto*ancestry_block_; i<=to; ++i)
+			if(idx.depths[i]<idx.depths[best]) best=i;
+		if(bto>bfrom+1) { // whole blocks in between, covered by two overlapping runs
+			size_t num=bto-bfrom-1, k=0;
+			while((size_t(2)<<k)<=num) ++k;
+			size_t one=idx.shallowest[k][bfrom+1], two=idx.shallowest[k][bto-(size_t(1)<<k)];
+			if(idx.depths[one]<idx.depths[best]) best=one;
+			if(idx.depths[two]<idx.depths[best]) best=two;
+			}
+		}
+	return best;
+	}
+
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::sibling_iterator tree<T, tree_node_allocator>::child(const iterator_base& it, unsigned int num) 
 	{
+	if(node_traits::random_access) {
+		assert(num<node_traits::child_count(it.node));
+		return node_traits::nth_child(it.node, num);
+		}
+	KPTREE_STAT_ADD_(sibling_walk_steps, num);
 	tree_node *tmp=it.node->first_child;
 	while(num--) {
 		assert(tmp!=0);
@@ -2496,6 +4963,18 @@ bool tree<T, tree_node_allocator>::sibling_iterator::operator==(const sibling_it
 	else return false;
 	}
 
+template <class T, class tree_node_allocator>
+bool tree<T, tree_node_allocator>::sibling_iterator::operator!=(const pre_order_iterator& other) const
+	{
+	return other.node!=this->node;
+	}
+
+template <class T, class tree_node_allocator>
+bool tree<T, tree_node_allocator>::sibling_iterator::operator==(const pre_order_iterator& other) const
+	{
+	return other.node==this->node;
+	}
+
 template <class T, class tree_node_allocator>
 bool tree<T, tree_node_allocator>::leaf_iterator::operator!=(const leaf_iterator& other) const
    {
@@ -2544,6 +5023,11 @@ void tree<T, tree_node_allocator>::iterator_base::skip_children(bool skip)
 template <class T, class tree_node_allocator>
 unsigned int tree<T, tree_node_allocator>::iterator_base::number_of_children() const
 	{
+	if(node_traits::counted)
+		return node_traits::children(node);
+	if(node_traits::random_access)
+		return node_traits::child_count(node);
+
 	tree_node *pos=node->first_child;
 	if(pos==0) return 0;
 	
@@ -2594,6 +5078,7 @@ tree<T, tree_node_allocator>::pre_order_iterator::pre_order_iterator(const sibli
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::pre_order_iterator& tree<T, tree_node_allocator>::pre_order_iterator::operator++()
 	{
+	KPTREE_STAT_ADD_(pre_order_steps, 1);
 	assert(this->node!=0);
 	if(!this->skip_current_children_ && this->node->first_child != 0) {
 		this->node=this->node->first_child;
@@ -2710,6 +5195,7 @@ tree<T, tree_node_allocator>::post_order_iterator::post_order_iterator(const sib
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::post_order_iterator& tree<T, tree_node_allocator>::post_order_iterator::operator++()
 	{
+	KPTREE_STAT_ADD_(post_order_steps, 1);
 	assert(this->node!=0);
 	if(this->node->next_sibling==0) {
 		this->node=this->node->parent;
@@ -2829,6 +5315,7 @@ bool tree<T, tree_node_allocator>::breadth_first_queued_iterator::operator==(con
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::breadth_first_queued_iterator& tree<T, tree_node_allocator>::breadth_first_queued_iterator::operator++()
 	{
+	KPTREE_STAT_ADD_(breadth_first_steps, 1);
 	assert(this->node!=0);
 
 	// Add child nodes and pop current node
@@ -2865,35 +5352,135 @@ typename tree<T, tree_node_allocator>::breadth_first_queued_iterator& tree<T, tr
 
 
 
+// Level-order iterator
+
+template <class T, class tree_node_allocator>
+tree<T, tree_node_allocator>::level_order_iterator::level_order_iterator()
+	: iterator_base(), level_last(0), next_first(0), next_last(0)
+	{
+	}
+
+template <class T, class tree_node_allocator>
+tree<T, tree_node_allocator>::level_order_iterator::level_order_iterator(tree_node *tn)
+	: iterator_base(tn), level_last(tn), next_first(0), next_last(0)
+	{
+	set_next_level_();
+	}
+
+template <class T, class tree_node_allocator>
+tree<T, tree_node_allocator>::level_order_iterator::level_order_iterator(const iterator_base& other)
+	: iterator_base(other.node), level_last(other.node), next_first(0), next_last(0)
+	{
+	set_next_level_();
+	}
+
+template <class T, class tree_node_allocator>
+void tree<T, tree_node_allocator>::level_order_iterator::set_next_level_()
+	{
+	if(this->node==0 || this->node->first_child==0) return;
+	if(next_first==0)
+		next_first=this->node->first_child;
+	next_last=this->node->last_child;
+	}
+
+template <class T, class tree_node_allocator>
+bool tree<T, tree_node_allocator>::level_order_iterator::operator!=(const level_order_iterator& other) const
+	{
+	if(other.node!=this->node) return true;
+	else return false;
+	}
+
+template <class T, class tree_node_allocator>
+bool tree<T, tree_node_allocator>::level_order_iterator::operator==(const level_order_iterator& other) const
+	{
+	if(other.node==this->node) return true;
+	else return false;
+	}
+
+template <class T, class tree_node_allocator>
+typename tree<T, tree_node_allocator>::level_order_iterator& tree<T, tree_node_allocator>::level_order_iterator::operator++()
+	{
+	KPTREE_STAT_ADD_(level_order_steps, 1);
+	assert(this->node!=0);
+
+	if(this->node==level_last) { // continue one level down
+		this->node=next_first;
+		level_last=next_last;
+		next_first=0;
+		next_last=0;
+		set_next_level_();
+		return (*this);
+		}
+
+	// Walk right, and up when there is nothing to the right, then down again to the
+	// same depth. There is a node further on this level, so this always ends below
+	// the top of the walk.
+	int relative_depth=0;
+	for(;;) {
+		while(this->node->next_sibling==0) {
+			this->node=this->node->parent;
+			--relative_depth;
+			}
+		this->node=this->node->next_sibling;
+		while(relative_depth<0 && this->node->first_child!=0) {
+			this->node=this->node->first_child;
+			++relative_depth;
+			}
+		if(relative_depth==0) break;
+		}
+	set_next_level_();
+	return (*this);
+	}
+
+template <class T, class tree_node_allocator>
+typename tree<T, tree_node_allocator>::level_order_iterator tree<T, tree_node_allocator>::level_order_iterator::operator++(int)
+	{
+	level_order_iterator copy = *this;
+	++(*this);
+	return copy;
+	}
+
+template <class T, class tree_node_allocator>
+typename tree<T, tree_node_allocator>::level_order_iterator& tree<T, tree_node_allocator>::level_order_iterator::operator+=(unsigned int num)
+	{
+	while(num>0) {
+		++(*this);
+		--num;
+		}
+	return (*this);
+	}
+
+
 // Fixed depth iterator
 
 template <class T, class tree_node_allocator>
 tree<T, tree_node_allocator>::fixed_depth_iterator::fixed_depth_iterator()
-	: iterator_base()
+	: iterator_base(), top_node(0), depth_(0), index_(0), built_(0), level_(0), begin_(0), at_(0), end_(0)
 	{
 	}
 
 template <class T, class tree_node_allocator>
 tree<T, tree_node_allocator>::fixed_depth_iterator::fixed_depth_iterator(tree_node *tn)
-	: iterator_base(tn), top_node(0)
+	: iterator_base(tn), top_node(0), depth_(0), index_(0), built_(0), level_(0), begin_(0), at_(0), end_(0)
 	{
 	}
 
 template <class T, class tree_node_allocator>
 tree<T, tree_node_allocator>::fixed_depth_iterator::fixed_depth_iterator(const iterator_base& other)
-	: iterator_base(other.node), top_node(0)
+	: iterator_base(other.node), top_node(0), depth_(0), index_(0), built_(0), level_(0), begin_(0), at_(0), end_(0)
 	{
 	}
 
 template <class T, class tree_node_allocator>
 tree<T, tree_node_allocator>::fixed_depth_iterator::fixed_depth_iterator(const sibling_iterator& other)
-	: iterator_base(other.node), top_node(0)
+	: iterator_base(other.node), top_node(0), depth_(0), index_(0), built_(0), level_(0), begin_(0), at_(0), end_(0)
 	{
 	}
 
 template <class T, class tree_node_allocator>
 tree<T, tree_node_allocator>::fixed_depth_iterator::fixed_depth_iterator(const fixed_depth_iterator& other)
-	: iterator_base(other.node), top_node(other.top_node)
+	: iterator_base(other.node), top_node(other.top_node), depth_(other.depth_), index_(other.index_), 
+	  built_(other.built_), level_(other.level_), begin_(other.begin_), at_(other.at_), end_(other.end_)
 	{
 	}
 
@@ -2914,19 +5501,48 @@ bool tree<T, tree_node_allocator>::fixed_depth_iterator::operator!=(const fixed_
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::fixed_depth_iterator& tree<T, tree_node_allocator>::fixed_depth_iterator::operator++()
 	{
+	KPTREE_STAT_ADD_(fixed_depth_steps, 1);
 	assert(this->node!=0);
 
+	if(indexed_()) {
+		this->node=(++at_<end_)?index_->nodes[index_->levels[level_][at_]]:0;
+		return *this;
+		}
+	if(this->top_node!=0) {
+		// Walk on in pre-order, going neither below the depth of this node nor above that
+		// of top_node; at the latter, only siblings count if that is the depth we walk.
+		tree_node *n=this->node;
+		unsigned int d=depth_;
+		for(;;) {
+			while(d>0 && n->next_sibling==0) {
+				n=n->parent;
+				--d;
+				}
+			if(d==0) {
+				tree_node *next=n->next_sibling;
+				bool       feet=(next!=0 && next->parent==0 && next->next_sibling==0);
+				this->node=(depth_==0 && next!=0 && !feet)?next:0;
+				return *this;
+				}
+			n=n->next_sibling;
+			while(d<depth_ && n->first_child!=0) {
+				n=n->first_child;
+				++d;
+				}
+			if(d==depth_) {
+				this->node=n;
+				return *this;
+				}
+			}
+		}
+
 	if(this->node->next_sibling) {
 		this->node=this->node->next_sibling;
 		}
-	else { 
+	else { // made from a node rather than by begin_fixed: on through the whole tree
 		int relative_depth=0;
 	   upper:
 		do {
-			if(this->node==this->top_node) {
-				this->node=0; // FIXME: return a proper fixed_depth end iterator once implemented
-				return *this;
-				}
 			this->node=this->node->parent;
 			if(this->node==0) return *this;
 			--relative_depth;
@@ -2956,17 +5572,44 @@ typename tree<T, tree_node_allocator>::fixed_depth_iterator& tree<T, tree_node_a
 	{
 	assert(this->node!=0);
 
+	if(indexed_()) {
+		this->node=(at_>begin_)?index_->nodes[index_->levels[level_][--at_]]:0;
+		return *this;
+		}
+	if(this->top_node!=0) {
+		// As operator++, mirrored.
+		tree_node *n=this->node;
+		unsigned int d=depth_;
+		for(;;) {
+			while(d>0 && n->prev_sibling==0) {
+				n=n->parent;
+				--d;
+				}
+			if(d==0) {
+				tree_node *prev=n->prev_sibling;
+				bool       head=(prev!=0 && prev->parent==0 && prev->prev_sibling==0);
+				this->node=(depth_==0 && prev!=0 && !head)?prev:0;
+				return *this;
+				}
+			n=n->prev_sibling;
+			while(d<depth_ && n->last_child!=0) {
+				n=n->last_child;
+				++d;
+				}
+			if(d==depth_) {
+				this->node=n;
+				return *this;
+				}
+			}
+		}
+
 	if(this->node->prev_sibling) {
 		this->node=this->node->prev_sibling;
 		}
-	else { 
+	else { // as operator++
 		int relative_depth=0;
 	   upper:
 		do {
-			if(this->node==this->top_node) {
-				this->node=0;
-				return *this;
-				}
 			this->node=this->node->parent;
 			if(this->node==0) return *this;
 			--relative_depth;
@@ -3013,6 +5656,12 @@ typename tree<T, tree_node_allocator>::fixed_depth_iterator& tree<T, tree_node_a
 //	return *this;
 	}
 
+template <class T, class tree_node_allocator>
+bool tree<T, tree_node_allocator>::fixed_depth_iterator::indexed_() const
+	{
+	return index_!=0 && index_->valid && index_->builds==built_;
+	}
+
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::fixed_depth_iterator tree<T, tree_node_allocator>::fixed_depth_iterator::operator++(int)
 	{
@@ -3091,6 +5740,7 @@ void tree<T, tree_node_allocator>::sibling_iterator::set_parent_()
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::sibling_iterator& tree<T, tree_node_allocator>::sibling_iterator::operator++()
 	{
+	KPTREE_STAT_ADD_(sibling_steps, 1);
 	if(this->node)
 		this->node=this->node->next_sibling;
 	return *this;
@@ -3192,6 +5842,7 @@ tree<T, tree_node_allocator>::leaf_iterator::leaf_iterator(const sibling_iterato
 template <class T, class tree_node_allocator>
 typename tree<T, tree_node_allocator>::leaf_iterator& tree<T, tree_node_allocator>::leaf_iterator::operator++()
    {
+	KPTREE_STAT_ADD_(leaf_steps, 1);
 	assert(this->node!=0);
 	if(this->node->first_child!=0) { // current node is no longer leaf (children got added)
 		 while(this->node->first_child) 
@@ -0,0 +1,268 @@
+/*
+
+	Binary files for trees with trivially copyable data. A file holds
+	the frozen layout of frozen_tree.hh as it is in memory: a short
+	header, the parent, next sibling and subtree end index of every node
+	in pre-order, and then the data of all nodes. Reading it back needs no
+	parsing; on POSIX systems map_binary maps the file and serves
+	traversal straight from the mapped pages.
+
+	Files are written in the byte order and layout of the machine that
+	writes them, and are refused elsewhere.
+
+   This program is free software: you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef tree_binary_hh_
+#define tree_binary_hh_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "tree.hh"
+#include "frozen_tree.hh"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define KPTREE_BINARY_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace kptree {
+
+/// Write a frozen tree to a stream opened in binary mode. Throws std::runtime_error if
+/// the stream fails.
+template<class T>
+void write_binary(std::ostream&, const frozen_tree<T>&);
+
+/// As above, freezing the tree first.
+template<class T, class A>
+void write_binary(std::ostream&, const tree<T, A>&);
+
+/// Read a tree written by write_binary into memory. Throws std::runtime_error if the
+/// stream does not hold a valid file for this type.
+template<class T>
+frozen_tree<T> read_binary(std::istream&);
+
+/// Read a tree written by write_binary from a file. Where mmap is available the result
+/// is a view on the mapped file, which stays mapped for as long as the tree or any copy
+/// of it lives. The node indices are checked before use unless 'verify' is false, which
+/// leaves the pages of the data untouched until they are visited.
+template<class T>
+frozen_tree<T> map_binary(const std::string& filename, bool verify=true);
+
+
+
+/// Fixed part at the start of each file.
+struct binary_header_ {
+	char          magic[8];
+	std::uint32_t version;
+	std::uint32_t byte_order;
+	std::uint32_t index_size;
+	std::uint32_t value_size;
+	std::uint64_t nodes;
+	std::uint64_t values_offset;
+};
+
+static const char          binary_magic_[8]={'k','p','t','r','e','e','\0','\n'};
+static const std::uint32_t binary_version_=1;
+static const std::uint32_t binary_byte_order_=0x01020304;
+
+/// The data section starts at a multiple of this.
+static const std::uint64_t binary_align_=16;
+
+template<class T>
+binary_header_ binary_header_for_(std::uint64_t n)
+	{
+	static_assert(std::is_trivially_copyable<T>::value, "tree_binary: data must be trivially copyable");
+	static_assert(alignof(T)<=binary_align_, "tree_binary: data alignment too large");
+
+	binary_header_ hdr;
+	std::memset(&hdr, 0, sizeof(hdr));
+	std::memcpy(hdr.magic, binary_magic_, sizeof(hdr.magic));
+	hdr.version=binary_version_;
+	hdr.byte_order=binary_byte_order_;
+	hdr.index_size=sizeof(typename frozen_tree<T>::index_type);
+	hdr.value_size=sizeof(T);
+	hdr.nodes=n;
+	std::uint64_t end=sizeof(binary_header_)+3*n*hdr.index_size;
+	hdr.values_offset=(end+binary_align_-1)/binary_align_*binary_align_;
+	return hdr;
+	}
+
+/// Check that a header read from a file describes 'size' bytes (if known) holding a tree
+/// of T, and return the number of nodes.
+template<class T>
+std::uint64_t binary_check_header_(const binary_header_& hdr, bool size_known, std::uint64_t size)
+	{
+	if(std::memcmp(hdr.magic, binary_magic_, sizeof(hdr.magic))!=0)
+		throw std::runtime_error("tree_binary: not a tree file");
+	if(hdr.version!=binary_version_)
+		throw std::runtime_error("tree_binary: unsupported version");
+	if(hdr.byte_order!=binary_byte_order_)
+		throw std::runtime_error("tree_binary: file has a different byte order");
+	if(hdr.index_size!=sizeof(typename frozen_tree<T>::index_type) || hdr.value_size!=sizeof(T))
+		throw std::runtime_error("tree_binary: file holds data of a different size");
+	if(hdr.nodes>=frozen_tree<T>::none)
+		throw std::runtime_error("tree_binary: too many nodes");
+	if(hdr.values_offset!=binary_header_for_<T>(hdr.nodes).values_offset)
+		throw std::runtime_error("tree_binary: corrupt header");
+	if(size_known && size<hdr.values_offset+hdr.nodes*sizeof(T))
+		throw std::runtime_error("tree_binary: file is truncated");
+	return hdr.nodes;
+	}
+
+/// Check that the index arrays describe a tree in pre-order: the parent of each node is
+/// the nearest one whose subtree contains it, and subtrees nest.
+template<class T>
+void binary_check_indices_(std::uint64_t n, const typename frozen_tree<T>::index_type *idx)
+	{
+	typedef typename frozen_tree<T>::index_type index_type;
+	const index_type none=frozen_tree<T>::none;
+	const index_type *parent=idx, *next_sibling=idx+n, *subtree_end=idx+2*n;
+
+	std::vector<index_type> open;
+	for(index_type i=0; i<n; ++i) {
+		while(!open.empty() && subtree_end[open.back()]<=i)
+			open.pop_back();
+		index_type p=open.empty()?none:open.back();
+		index_type e=subtree_end[i];
+		bool ok=(parent[i]==p && e>i && e<=(p==none?n:subtree_end[p]));
+		if(next_sibling[i]!=none) ok=ok && next_sibling[i]==e && e<n && parent[e]==p;
+		else                      ok=ok && (e==n || parent[e]!=p);
+		if(!ok)
+			throw std::runtime_error("tree_binary: corrupt node indices");
+		open.push_back(i);
+		}
+	}
+
+/// Read 'count' objects into 'out', growing it by at most a megabyte at a time, so that
+/// a count which the stream does not hold fails when the data runs out instead of
+/// asking for all the room up front.
+template<class U>
+void binary_read_(std::istream& str, std::vector<U>& out, std::uint64_t count)
+	{
+	const std::uint64_t block=(std::uint64_t(1)<<20)/sizeof(U)+1;
+	out.clear();
+	while(out.size()<count) {
+		size_t at=out.size(), now=size_t(std::min<std::uint64_t>(count-at, block));
+		out.resize(at+now);
+		if(!str.read(reinterpret_cast<char *>(out.data()+at), now*sizeof(U)))
+			throw std::runtime_error("tree_binary: file is truncated");
+		}
+	}
+
+template<class T>
+void write_binary(std::ostream& str, const frozen_tree<T>& ft)
+	{
+	typedef typename frozen_tree<T>::index_type index_type;
+
+	binary_header_ hdr=binary_header_for_<T>(ft.size());
+	std::uint64_t index_bytes=3*ft.size()*sizeof(index_type);
+	char pad[binary_align_]={0};
+
+	str.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+	if(ft.size()>0) {
+		str.write(reinterpret_cast<const char *>(ft.parents()), index_bytes);
+		str.write(pad, hdr.values_offset-sizeof(hdr)-index_bytes);
+		str.write(reinterpret_cast<const char *>(ft.values()), ft.size()*sizeof(T));
+		}
+	else str.write(pad, hdr.values_offset-sizeof(hdr));
+	if(!str)
+		throw std::runtime_error("tree_binary: write failed");
+	}
+
+template<class T, class A>
+void write_binary(std::ostream& str, const tree<T, A>& tr)
+	{
+	write_binary(str, frozen_tree<T>(tr));
+	}
+
+template<class T>
+frozen_tree<T> read_binary(std::istream& str)
+	{
+	typedef typename frozen_tree<T>::index_type index_type;
+
+	binary_header_ hdr;
+	if(!str.read(reinterpret_cast<char *>(&hdr), sizeof(hdr)))
+		throw std::runtime_error("tree_binary: file is truncated");
+	std::uint64_t n=binary_check_header_<T>(hdr, false, 0);
+
+	// The node count comes from the file, so the arrays only grow with the data read.
+	std::vector<index_type> indices;
+	std::vector<T>          values;
+	std::uint64_t index_bytes=3*n*sizeof(index_type);
+	char pad[binary_align_];
+	binary_read_(str, indices, 3*n);
+	str.read(pad, hdr.values_offset-sizeof(hdr)-index_bytes);
+	binary_read_(str, values, n);
+	if(!str)
+		throw std::runtime_error("tree_binary: file is truncated");
+	binary_check_indices_<T>(n, indices.data());
+
+	return frozen_tree<T>(std::move(indices), std::move(values));
+	}
+
+template<class T>
+frozen_tree<T> map_binary(const std::string& filename, bool verify)
+	{
+	typedef typename frozen_tree<T>::index_type index_type;
+
+#ifdef KPTREE_BINARY_MMAP
+	int fd=::open(filename.c_str(), O_RDONLY);
+	if(fd<0)
+		throw std::runtime_error("tree_binary: cannot open "+filename);
+	struct stat st;
+	if(::fstat(fd, &st)!=0 || std::uint64_t(st.st_size)<sizeof(binary_header_)) {
+		::close(fd);
+		throw std::runtime_error("tree_binary: file is truncated");
+		}
+	size_t len=st.st_size;
+	void *addr=::mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(addr==MAP_FAILED)
+		throw std::runtime_error("tree_binary: cannot map "+filename);
+	std::shared_ptr<const void> keep(addr, [len](const void *p) { ::munmap(const_cast<void *>(p), len); });
+
+	const char *base=static_cast<const char *>(addr);
+	binary_header_ hdr;
+	std::memcpy(&hdr, base, sizeof(hdr));
+	std::uint64_t n=binary_check_header_<T>(hdr, true, len);
+	const index_type *indices=reinterpret_cast<const index_type *>(base+sizeof(hdr));
+	if(verify)
+		binary_check_indices_<T>(n, indices);
+
+	return frozen_tree<T>(n, indices, reinterpret_cast<const T *>(base+hdr.values_offset), keep);
+#else
+	std::ifstream str(filename.c_str(), std::ios::binary);
+	if(!str)
+		throw std::runtime_error("tree_binary: cannot open "+filename);
+	(void)verify;
+	return read_binary<T>(str);
+#endif
+	}
+
+}
+
+#endif
@@ -0,0 +1,161 @@
+/*
+
+	Concurrent building of a tree.hh tree: several threads adding nodes
+	to one tree at the same time, each below parents of its own or all
+	below the same ones.
+
+	The functions here need to be compiled with thread support (-pthread
+	with gcc and clang).
+
+   This program is free software: you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef tree_concurrent_hh_
+#define tree_concurrent_hh_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include "tree.hh"
+
+namespace kptree {
+
+/// Adds nodes to a tree from any number of threads at once. Adding below a node only
+/// changes that node and the last of its children, so the changes below different
+/// parents go ahead side by side, while those below the same parent take turns through
+/// a lock picked by the parent (from a fixed table, so unrelated parents occasionally
+/// share one). Children added below one parent by one thread keep their order, but end
+/// up interleaved with those added by other threads.
+///
+/// Meanwhile the tree must not be used in any other way, except for reading the data of
+/// nodes nobody adds to. Iterators returned by one thread can be handed to others (with
+/// the usual synchronisation) to add below. The fastest way to add many nodes is for each
+/// thread to build a tree of its own and move it in with move_in_below, which takes the
+/// lock once for the whole lot; such trees must use copies of the allocator of the main
+/// tree, which is then used by all threads at once.
+///
+/// The allocator has to be safe to use from several threads; stateless ones (such as
+/// std::allocator) are taken to be, while with allocators holding state (such as
+/// tree_node_pool_allocator) all additions take one and the same lock. Node types with
+/// cached subtree sizes (tree_node_counted_) or cached heights (tree_node_depth_) are not
+/// supported, as every addition changes all ancestors, which those below other parents
+/// share.
+template<class T, class A=std::allocator<tree_node_<T> > >
+class concurrent_appender {
+	public:
+		typedef tree<T, A>                   tree_type;
+		typedef typename tree_type::iterator iterator;
+
+		static_assert(!tree_node_traits_<typename A::value_type>::counted,
+						  "concurrent_appender cannot keep subtree sizes up to date");
+		static_assert(!tree_node_traits_<typename A::value_type>::depth_kept,
+						  "concurrent_appender cannot keep subtree heights up to date");
+
+		explicit concurrent_appender(tree_type& tr);
+
+		/// As the tree functions of the same name.
+		iterator append_child(iterator parent, const T& x);
+		iterator append_child(iterator parent, T&& x);
+		template<class... Args>
+		iterator emplace_child(iterator parent, Args&&... args);
+		iterator insert(iterator position, const T& x);
+		/// Move all nodes of 'other' in as the last children of 'parent', leaving 'other' empty.
+		iterator move_in_below(iterator parent, tree_type& other);
+
+	private:
+		/// Run f, which changes the children of 'parent', under the lock for 'parent'. The
+		/// very first change runs on its own, which settles the bookkeeping of the tree as a
+		/// whole (ancestry index, epoch), so that later changes only read it.
+		template<class F>
+		iterator locked_(const void *parent, F f);
+
+		struct alignas(64) stripe_ {
+			std::mutex mutex;
+		};
+		static const size_t stripes_=64;
+
+		tree_type&        tree_;
+		std::atomic<bool> settled_;
+		std::mutex        settle_;
+		stripe_           locks_[stripes_];
+};
+
+
+
+template<class T, class A>
+concurrent_appender<T, A>::concurrent_appender(tree_type& tr)
+	: tree_(tr), settled_(false)
+	{
+	}
+
+template<class T, class A>
+template<class F>
+typename concurrent_appender<T, A>::iterator concurrent_appender<T, A>::locked_(const void *parent, F f)
+	{
+	if(!settled_.load(std::memory_order_acquire)) {
+		std::lock_guard<std::mutex> guard(settle_);
+		if(!settled_.load(std::memory_order_relaxed)) {
+			iterator ret=f();
+			settled_.store(true, std::memory_order_release);
+			return ret;
+			}
+		}
+	size_t stripe=0;
+	if(std::is_empty<A>::value) {
+		std::uintptr_t p=reinterpret_cast<std::uintptr_t>(parent);
+		stripe=((p>>6)^(p>>12))%stripes_;
+		}
+	std::lock_guard<std::mutex> guard(locks_[stripe].mutex);
+	return f();
+	}
+
+template<class T, class A>
+typename concurrent_appender<T, A>::iterator concurrent_appender<T, A>::append_child(iterator parent, const T& x)
+	{
+	return locked_(parent.node, [&]() { return tree_.append_child(parent, x); });
+	}
+
+template<class T, class A>
+typename concurrent_appender<T, A>::iterator concurrent_appender<T, A>::append_child(iterator parent, T&& x)
+	{
+	return locked_(parent.node, [&]() { return tree_.append_child(parent, std::move(x)); });
+	}
+
+template<class T, class A>
+template<class... Args>
+typename concurrent_appender<T, A>::iterator concurrent_appender<T, A>::emplace_child(iterator parent, Args&&... args)
+	{
+	return locked_(parent.node, [&]() { return tree_.emplace_child(parent, std::forward<Args>(args)...); });
+	}
+
+template<class T, class A>
+typename concurrent_appender<T, A>::iterator concurrent_appender<T, A>::insert(iterator position, const T& x)
+	{
+	// Heads have no parent; they all share the lock for 'no parent'.
+	return locked_(position.node->parent, [&]() { return tree_.insert(position, x); });
+	}
+
+template<class T, class A>
+typename concurrent_appender<T, A>::iterator concurrent_appender<T, A>::move_in_below(iterator parent, tree_type& other)
+	{
+	if(other.empty()) return parent; // nothing changes, so this does not settle anything
+	return locked_(parent.node, [&]() { return tree_.move_in_below(parent, other); });
+	}
+
+}
+
+#endif
@@ -0,0 +1,271 @@
+/*
+
+	Coroutine generators over the traversal orders of the templated
+	tree.hh class, and a visitor for trees whose node payloads have to
+	be fetched before they can be used (handles to remote data, files):
+	it keeps a number of fetches in flight while walking the tree, so
+	that the waiting for them overlaps.
+
+	Needs C++20 (-std=c++20 with gcc and clang); fetches which run on
+	threads, such as those started with std::async, also need -pthread.
+
+   This program is free software: you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef tree_coro_hh_
+#define tree_coro_hh_
+
+#if __cplusplus < 202002L || !defined(__cpp_impl_coroutine)
+#error "tree_coro.hh needs a compiler with C++20 coroutines"
+#endif
+
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "tree.hh"
+
+namespace kptree {
+
+/// A sequence of values produced one at a time by a coroutine which co_yields them,
+/// to be walked over once. The coroutine only runs while the sequence is being walked,
+/// and stops where it is when the generator goes away. The values are handed out by
+/// reference, so changes made to them are seen by the coroutine when it continues.
+
+template<class V>
+class generator {
+	public:
+		struct promise_type {
+			V                 *current=nullptr;
+			std::exception_ptr error;
+
+			generator           get_return_object()   { return generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+			std::suspend_always initial_suspend()     noexcept { return {}; }
+			std::suspend_always final_suspend()       noexcept { return {}; }
+			std::suspend_always yield_value(V& val)   noexcept { current=std::addressof(val); return {}; }
+			std::suspend_always yield_value(V&& val)  noexcept { current=std::addressof(val); return {}; }
+			void                return_void()         {}
+			void                unhandled_exception() { error=std::current_exception(); }
+		};
+
+		class iterator {
+			public:
+				typedef std::input_iterator_tag iterator_category;
+				typedef V                       value_type;
+				typedef std::ptrdiff_t          difference_type;
+				typedef V*                      pointer;
+				typedef V&                      reference;
+
+				iterator() = default;
+
+				V&        operator*() const  { return *coro_.promise().current; }
+				V*        operator->() const { return coro_.promise().current; }
+				iterator& operator++()       { generator::resume_(coro_); return *this; }
+				void      operator++(int)    { ++(*this); }
+				bool      operator==(std::default_sentinel_t) const { return !coro_ || coro_.done(); }
+			private:
+				friend class generator;
+				explicit iterator(std::coroutine_handle<promise_type> coro) : coro_(coro) {}
+				std::coroutine_handle<promise_type> coro_;
+		};
+
+		generator(generator&& other) noexcept : coro_(std::exchange(other.coro_, nullptr)) {}
+		generator& operator=(generator&& other) noexcept
+			{
+			if(this!=&other) {
+				if(coro_) coro_.destroy();
+				coro_=std::exchange(other.coro_, nullptr);
+				}
+			return *this;
+			}
+		~generator()
+			{
+			if(coro_) coro_.destroy();
+			}
+
+		/// Runs the coroutine up to its first value; call only once.
+		iterator                begin() { resume_(coro_); return iterator(coro_); }
+		std::default_sentinel_t end()   { return {}; }
+
+	private:
+		explicit generator(std::coroutine_handle<promise_type> coro) : coro_(coro) {}
+
+		static void resume_(std::coroutine_handle<promise_type> coro)
+			{
+			coro.resume();
+			if(coro.done() && coro.promise().error)
+				std::rethrow_exception(coro.promise().error);
+			}
+
+		std::coroutine_handle<promise_type> coro_;
+};
+
+// The traversals below yield the tree's own iterators, so the nodes can be used and
+// changed through them as usual; the tree itself should not be changed while a
+// traversal is under way.
+
+/// Nodes of the subtree at 'top' in pre-order. Calling skip_children() on a yielded
+/// iterator leaves out the nodes below it.
+template<class T, class A>
+generator<typename tree<T, A>::pre_order_iterator> pre_order(const tree<T, A>& tr, typename tree<T, A>::iterator top)
+	{
+	typename tree<T, A>::pre_order_iterator it=top, end=top;
+	if(!tr.is_valid(top)) co_return;
+	end.skip_children();
+	++end;
+	for(; it!=end; ++it)
+		co_yield it;
+	}
+
+/// All nodes of the tree in pre-order, see above.
+template<class T, class A>
+generator<typename tree<T, A>::pre_order_iterator> pre_order(const tree<T, A>& tr)
+	{
+	for(typename tree<T, A>::pre_order_iterator it=tr.begin(); it!=tr.end(); ++it)
+		co_yield it;
+	}
+
+/// Nodes of the subtree at 'top' in post-order, ending with 'top'.
+template<class T, class A>
+generator<typename tree<T, A>::post_order_iterator> post_order(const tree<T, A>& tr, typename tree<T, A>::iterator top)
+	{
+	if(!tr.is_valid(top)) co_return;
+	typename tree<T, A>::post_order_iterator it=top, last=top;
+	it.descend_all();
+	for(; it!=last; ++it)
+		co_yield it;
+	co_yield it;
+	}
+
+/// All nodes of the tree in post-order.
+template<class T, class A>
+generator<typename tree<T, A>::post_order_iterator> post_order(const tree<T, A>& tr)
+	{
+	for(typename tree<T, A>::post_order_iterator it=tr.begin_post(); it!=tr.end_post(); ++it)
+		co_yield it;
+	}
+
+/// Nodes of the subtree at 'top' level by level, with a queue of the nodes whose
+/// children are still to come.
+template<class T, class A>
+generator<typename tree<T, A>::iterator> breadth_first(const tree<T, A>& tr, typename tree<T, A>::iterator top)
+	{
+	typedef typename tree<T, A>::iterator         iterator;
+	typedef typename tree<T, A>::sibling_iterator sibling_iterator;
+	if(!tr.is_valid(top)) co_return;
+	iterator it=top;
+	co_yield it;
+	std::deque<iterator> parents(1, top);
+	while(!parents.empty()) {
+		iterator parent=parents.front();
+		parents.pop_front();
+		for(sibling_iterator child=tr.begin(parent); child!=tr.end(parent); ++child) {
+			it=child;
+			if(child.node->first_child!=0)
+				parents.push_back(it);
+			co_yield it;
+			}
+		}
+	}
+
+/// All nodes of the tree level by level, with the tree's level_order_iterator.
+template<class T, class A>
+generator<typename tree<T, A>::level_order_iterator> breadth_first(const tree<T, A>& tr)
+	{
+	for(typename tree<T, A>::level_order_iterator it=tr.begin_level_order(); it!=tr.end_level_order(); ++it)
+		co_yield it;
+	}
+
+/// Leaves of the subtree at 'top' from left to right, as from begin_leaf(top) to end_leaf(top).
+template<class T, class A>
+generator<typename tree<T, A>::leaf_iterator> leaves(const tree<T, A>& tr, typename tree<T, A>::iterator top)
+	{
+	if(!tr.is_valid(top)) co_return;
+	for(typename tree<T, A>::leaf_iterator it=tr.begin_leaf(top); it!=tr.end_leaf(top); ++it)
+		co_yield it;
+	}
+
+/// All leaves of the tree from left to right.
+template<class T, class A>
+generator<typename tree<T, A>::leaf_iterator> leaves(const tree<T, A>& tr)
+	{
+	for(typename tree<T, A>::leaf_iterator it=tr.begin_leaf(); it!=tr.end_leaf(); ++it)
+		co_yield it;
+	}
+
+template<class It, class Fetch>
+using fetched_t = std::decay_t<decltype(std::declval<Fetch&>()(std::declval<It&>()).get())>;
+
+/// Walk over 'nodes' (one of the generators above, or any other range of iterators)
+/// and call fetch(it) for each node; fetch starts the work of getting what the node
+/// refers to and returns a future for it (std::future, std::shared_future, or anything
+/// else with get() and wait_for()). Up to 'in_flight' of these are kept outstanding
+/// while the walk goes on ahead. Yields the iterators paired with the results, in the
+/// order of the walk if 'ordered' is true, and otherwise in the order in which they
+/// become ready, waiting for the oldest one when none is. A fetch which fails throws
+/// from the walk over the results.
+
+template<class Range, class Fetch,
+			class It     = std::decay_t<decltype(*std::begin(std::declval<Range&>()))>,
+			class Result = fetched_t<It, Fetch> >
+generator<std::pair<It, Result> > prefetch(Range nodes, std::size_t in_flight, Fetch fetch, bool ordered=true)
+	{
+	typedef decltype(fetch(std::declval<It&>())) future_type;
+	std::deque<std::pair<It, future_type> > pending;
+	if(in_flight==0) in_flight=1;
+
+	auto walk=std::begin(nodes);
+	auto stop=std::end(nodes);
+	for(;;) {
+		while(pending.size()<in_flight && walk!=stop) {
+			It it=*walk;
+			pending.emplace_back(it, fetch(it));
+			++walk;
+			}
+		if(pending.empty()) break;
+
+		auto ready=pending.begin();
+		if(!ordered)
+			for(auto p=pending.begin(); p!=pending.end(); ++p)
+				if(p->second.wait_for(std::chrono::seconds(0))==std::future_status::ready) {
+					ready=p;
+					break;
+					}
+		std::pair<It, Result> done(ready->first, ready->second.get());
+		pending.erase(ready);
+		co_yield done;
+		}
+	}
+
+/// Call visit(it, result) for every node of 'nodes' with the result of its fetch, keeping
+/// up to 'in_flight' fetches outstanding; see prefetch() above for the arguments.
+/// All calls to 'visit' come from the calling thread.
+
+template<class Range, class Fetch, class Visit>
+void async_visit(Range nodes, std::size_t in_flight, Fetch fetch, Visit visit, bool ordered=true)
+	{
+	for(auto& done: prefetch(std::move(nodes), in_flight, std::move(fetch), ordered))
+		visit(done.first, done.second);
+	}
+
+}
+
+#endif
@@ -0,0 +1,550 @@
+/*
+
+	A read-only tree which stores each distinct subtree only once: equal
+	subtrees (in the sense of tree::equal_subtree) are found while adding
+	them, by hashing bottom-up as in tree_hash.hh, and share a single
+	node, so that the tree is kept as a directed acyclic graph. Nodes
+	have their children as a run of 32-bit indices in one array, and
+	count the number of places which refer to them. Iterating goes over
+	the tree as it would be with all shared subtrees written out, and
+	expand() builds that tree.
+
+   This program is free software: you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef tree_dag_hh_
+#define tree_dag_hh_
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "tree.hh"
+#include "tree_hash.hh"
+
+namespace kptree {
+
+/// Equal values are recognised with 'Equal', and 'Hash' has to give them equal hashes.
+/// Adding subtrees invalidates all iterators.
+template<class T, class Hash=std::hash<T>, class Equal=std::equal_to<T> >
+class dag_tree {
+	public:
+		typedef T             value_type;
+		typedef std::uint32_t index_type;
+
+		class pre_order_iterator;
+		class sibling_iterator;
+		typedef pre_order_iterator iterator;
+
+		explicit dag_tree(Hash hash=Hash(), Equal equal=Equal());
+		/// Store all nodes of the given tree; throws std::length_error if there are too many
+		/// distinct ones for 32-bit indices.
+		template<class A>
+		explicit dag_tree(const tree<T, A>&, Hash hash=Hash(), Equal equal=Equal());
+
+		/// Depth-first iterator, first accessing the node, then its children. It keeps the
+		/// path to the node, as a shared node is reached from more than one parent.
+		class pre_order_iterator {
+			public:
+				typedef T                               value_type;
+				typedef const T*                        pointer;
+				typedef const T&                        reference;
+				typedef size_t                          size_type;
+				typedef ptrdiff_t                       difference_type;
+				typedef std::forward_iterator_tag       iterator_category;
+
+				pre_order_iterator();
+
+				const T&     operator*() const;
+				const T*     operator->() const;
+				bool         operator==(const pre_order_iterator&) const;
+				bool         operator!=(const pre_order_iterator&) const;
+				pre_order_iterator&  operator++();
+				pre_order_iterator   operator++(int);
+
+				/// When called, the next increment skips children of this node.
+				void         skip_children();
+				/// The stored node this position shows.
+				index_type   node() const;
+
+				const dag_tree *tr;
+			private:
+				friend class dag_tree;
+				/// Per level, the position in the run of siblings and the end of that run.
+				std::vector<std::pair<const index_type *, const index_type *> > path_;
+				bool skip_current_children_;
+		};
+
+		/// Iterator which traverses only the nodes which are siblings of each other.
+		class sibling_iterator {
+			public:
+				typedef T                               value_type;
+				typedef const T*                        pointer;
+				typedef const T&                        reference;
+				typedef size_t                          size_type;
+				typedef ptrdiff_t                       difference_type;
+				typedef std::forward_iterator_tag       iterator_category;
+
+				sibling_iterator();
+				sibling_iterator(const dag_tree *, const index_type *);
+				sibling_iterator(const pre_order_iterator&);
+
+				const T&     operator*() const;
+				const T*     operator->() const;
+				bool         operator==(const sibling_iterator&) const;
+				bool         operator!=(const sibling_iterator&) const;
+				sibling_iterator&  operator++();
+				sibling_iterator   operator++(int);
+
+				index_type   node() const;
+
+				const dag_tree   *tr;
+				const index_type *pos;
+		};
+
+		/// Return iterator to the beginning of the tree.
+		pre_order_iterator begin() const;
+		/// Return iterator to the end of the tree.
+		pre_order_iterator end() const;
+		/// Return sibling iterators to the first head and past the last one.
+		sibling_iterator   begin_heads() const;
+		sibling_iterator   end_heads() const;
+		/// Return sibling iterator to the first child of given node.
+		template<class Iter>
+		sibling_iterator   begin(const Iter&) const;
+		/// Return sibling end iterator for children of given node.
+		template<class Iter>
+		sibling_iterator   end(const Iter&) const;
+
+		/// Add the subtree at 'top' of 'tr' as a new head after the existing ones, sharing
+		/// the subtrees already stored; returns the new head.
+		template<class A>
+		sibling_iterator   add(const tree<T, A>& tr, const typename tree<T, A>::iterator_base& top);
+		/// Add all heads of 'tr' in the same way.
+		template<class A>
+		void               add(const tree<T, A>& tr);
+
+		/// Count the total number of nodes, as in the tree written out.
+		size_t             size() const;
+		/// Count the number of nodes below and including the one at the given position.
+		template<class Iter>
+		size_t             size(const Iter&) const;
+		/// Check if the tree is empty.
+		bool               empty() const;
+		/// Compute the depth to the root.
+		int                depth(const pre_order_iterator&) const;
+		/// Count the number of children of node at position.
+		template<class Iter>
+		unsigned int       number_of_children(const Iter&) const;
+		/// Number of places (parents and heads) referring to the node at position.
+		template<class Iter>
+		unsigned int       references(const Iter&) const;
+
+		/// Number of nodes actually stored, that is, of distinct subtrees.
+		size_t             stored() const;
+		/// Bytes taken by the nodes and children, not counting the index used to find
+		/// equal subtrees when adding; release_index() frees that, after which add()
+		/// throws std::logic_error.
+		size_t             memory() const;
+		void               release_index();
+
+		/// Build the tree with all shared subtrees written out, replacing the content of 'out'.
+		template<class A>
+		void               expand(tree<T, A>& out) const;
+		/// As above, returning a tree with the default allocator.
+		tree<T>            expand() const;
+
+	private:
+		struct stored_node {
+			T          data;
+			index_type first, count, refs; // children are children_[first..first+count)
+			size_t     size;               // nodes in the subtree written out
+		};
+
+		Hash                     hash_;
+		Equal                    equal_;
+		std::vector<stored_node> nodes_;
+		std::vector<index_type>  children_, heads_;
+		/// Stored nodes by the hash of their value and children.
+		std::unordered_multimap<size_t, index_type> index_;
+		bool                     indexed_;
+
+		/// The stored node equal to one with 'data' and the children in 'kids', which is
+		/// added if there is none yet.
+		index_type         intern_(const T& data, const index_type *kids, index_type count);
+};
+
+/// Make a deduplicated copy of a tree.
+template<class T, class A>
+dag_tree<T> hash_cons(const tree<T, A>& tr)
+	{
+	return dag_tree<T>(tr);
+	}
+
+
+template<class T, class Hash, class Equal>
+dag_tree<T, Hash, Equal>::dag_tree(Hash hash, Equal equal)
+	: hash_(hash), equal_(equal), indexed_(true)
+	{
+	}
+
+template<class T, class Hash, class Equal>
+template<class A>
+dag_tree<T, Hash, Equal>::dag_tree(const tree<T, A>& tr, Hash hash, Equal equal)
+	: hash_(hash), equal_(equal), indexed_(true)
+	{
+	add(tr);
+	}
+
+template<class T, class Hash, class Equal>
+typename dag_tree<T, Hash, Equal>::index_type dag_tree<T, Hash, Equal>::intern_(const T& data,
+																										  const index_type *kids, index_type count)
+	{
+	size_t h=hash_combine_(hash_(data), count);
+	for(index_type i=0; i<count; ++i)
+		h=hash_combine_(h, kids[i]);
+
+	auto range=index_.equal_range(h);
+	for(auto it=range.first; it!=range.second; ++it) {
+		const stored_node& n=nodes_[it->second];
+		if(n.count==count && equal_(n.data, data)
+			&& std::equal(kids, kids+count, children_.begin()+n.first))
+			return it->second;
+		}
+
+	if(nodes_.size()>=0xffffffff || children_.size()+count>=0xffffffff)
+		throw std::length_error("dag_tree: too many nodes for 32-bit indices");
+	stored_node n={ data, index_type(children_.size()), count, 0, 1 };
+	for(index_type i=0; i<count; ++i) {
+		children_.push_back(kids[i]);
+		++nodes_[kids[i]].refs;
+		n.size+=nodes_[kids[i]].size;
+		}
+	index_type ret=index_type(nodes_.size());
+	nodes_.push_back(n);
+	index_.insert(std::make_pair(h, ret));
+	return ret;
+	}
+
+template<class T, class Hash, class Equal>
+template<class A>
+typename dag_tree<T, Hash, Equal>::sibling_iterator dag_tree<T, Hash, Equal>::add(const tree<T, A>&,
+																										const typename tree<T, A>::iterator_base& top)
+	{
+	typedef typename A::value_type tree_node;
+
+	if(!indexed_)
+		throw std::logic_error("dag_tree: cannot add after release_index()");
+	// Post-order, keeping the stored nodes of the subtrees done whose parent is still to
+	// come; the children of a node are the last ones on the stack when it is reached.
+	std::vector<index_type> done;
+	const tree_node *n=top.node;
+	while(n->first_child!=0)
+		n=n->first_child;
+	while(true) {
+		index_type count=0;
+		for(const tree_node *ch=n->first_child; ch!=0; ch=ch->next_sibling)
+			++count;
+		index_type id=intern_(n->data, done.data()+done.size()-count, count);
+		done.resize(done.size()-count);
+		if(n==top.node) {
+			++nodes_[id].refs;
+			heads_.push_back(id);
+			return sibling_iterator(this, heads_.data()+heads_.size()-1);
+			}
+		done.push_back(id);
+		if(n->next_sibling!=0) {
+			n=n->next_sibling;
+			while(n->first_child!=0)
+				n=n->first_child;
+			}
+		else n=n->parent;
+		}
+	}
+
+template<class T, class Hash, class Equal>
+template<class A>
+void dag_tree<T, Hash, Equal>::add(const tree<T, A>& tr)
+	{
+	for(typename tree<T, A>::sibling_iterator it=tr.begin(); it!=tr.end(); ++it)
+		add(tr, it);
+	}
+
+template<class T, class Hash, class Equal>
+typename dag_tree<T, Hash, Equal>::pre_order_iterator dag_tree<T, Hash, Equal>::begin() const
+	{
+	pre_order_iterator ret;
+	ret.tr=this;
+	if(!heads_.empty())
+		ret.path_.push_back(std::make_pair(heads_.data(), heads_.data()+heads_.size()));
+	return ret;
+	}
+
+template<class T, class Hash, class Equal>
+typename dag_tree<T, Hash, Equal>::pre_order_iterator dag_tree<T, Hash, Equal>::end() const
+	{
+	pre_order_iterator ret;
+	ret.tr=this;
+	return ret;
+	}
+
+template<class T, class Hash, class Equal>
+typename dag_tree<T, Hash, Equal>::sibling_iterator dag_tree<T, Hash, Equal>::begin_heads() const
+	{
+	return sibling_iterator(this, heads_.data());
+	}
+
+template<class T, class Hash, class Equal>
+typename dag_tree<T, Hash, Equal>::sibling_iterator dag_tree<T, Hash, Equal>::end_heads() const
+	{
+	return sibling_iterator(this, heads_.data()+heads_.size());
+	}
+
+template<class T, class Hash, class Equal>
+template<class Iter>
+typename dag_tree<T, Hash, Equal>::sibling_iterator dag_tree<T, Hash, Equal>::begin(const Iter& it) const
+	{
+	return sibling_iterator(this, children_.data()+nodes_[it.node()].first);
+	}
+
+template<class T, class Hash, class Equal>
+template<class Iter>
+typename dag_tree<T, Hash, Equal>::sibling_iterator dag_tree<T, Hash, Equal>::end(const Iter& it) const
+	{
+	const stored_node& n=nodes_[it.node()];
+	return sibling_iterator(this, children_.data()+n.first+n.count);
+	}
+
+template<class T, class Hash, class Equal>
+size_t dag_tree<T, Hash, Equal>::size() const
+	{
+	size_t ret=0;
+	for(index_type h: heads_)
+		ret+=nodes_[h].size;
+	return ret;
+	}
+
+template<class T, class Hash, class Equal>
+template<class Iter>
+size_t dag_tree<T, Hash, Equal>::size(const Iter& it) const
+	{
+	return nodes_[it.node()].size;
+	}
+
+template<class T, class Hash, class Equal>
+bool dag_tree<T, Hash, Equal>::empty() const
+	{
+	return heads_.empty();
+	}
+
+template<class T, class Hash, class Equal>
+int dag_tree<T, Hash, Equal>::depth(const pre_order_iterator& it) const
+	{
+	return int(it.path_.size())-1;
+	}
+
+template<class T, class Hash, class Equal>
+template<class Iter>
+unsigned int dag_tree<T, Hash, Equal>::number_of_children(const Iter& it) const
+	{
+	return nodes_[it.node()].count;
+	}
+
+template<class T, class Hash, class Equal>
+template<class Iter>
+unsigned int dag_tree<T, Hash, Equal>::references(const Iter& it) const
+	{
+	return nodes_[it.node()].refs;
+	}
+
+template<class T, class Hash, class Equal>
+size_t dag_tree<T, Hash, Equal>::stored() const
+	{
+	return nodes_.size();
+	}
+
+template<class T, class Hash, class Equal>
+size_t dag_tree<T, Hash, Equal>::memory() const
+	{
+	return nodes_.capacity()*sizeof(stored_node)+(children_.capacity()+heads_.capacity())*sizeof(index_type);
+	}
+
+template<class T, class Hash, class Equal>
+void dag_tree<T, Hash, Equal>::release_index()
+	{
+	std::unordered_multimap<size_t, index_type>().swap(index_);
+	indexed_=false;
+	}
+
+template<class T, class Hash, class Equal>
+template<class A>
+void dag_tree<T, Hash, Equal>::expand(tree<T, A>& out) const
+	{
+	out.clear();
+	// The node last added at each depth, whose children come next.
+	std::vector<typename tree<T, A>::iterator> at;
+	for(pre_order_iterator it=begin(); it!=end(); ++it) {
+		size_t d=it.path_.size()-1;
+		at.resize(d);
+		if(d==0) at.push_back(out.insert(out.end(), *it));
+		else     at.push_back(out.append_child(at[d-1], *it));
+		}
+	}
+
+template<class T, class Hash, class Equal>
+tree<T> dag_tree<T, Hash, Equal>::expand() const
+	{
+	tree<T> ret;
+	expand(ret);
+	return ret;
+	}
+
+
+template<class T, class Hash, class Equal>
+dag_tree<T, Hash, Equal>::pre_order_iterator::pre_order_iterator()
+	: tr(0), skip_current_children_(false)
+	{
+	}
+
+template<class T, class Hash, class Equal>
+const T& dag_tree<T, Hash, Equal>::pre_order_iterator::operator*() const
+	{
+	return tr->nodes_[node()].data;
+	}
+
+template<class T, class Hash, class Equal>
+const T* dag_tree<T, Hash, Equal>::pre_order_iterator::operator->() const
+	{
+	return &tr->nodes_[node()].data;
+	}
+
+template<class T, class Hash, class Equal>
+bool dag_tree<T, Hash, Equal>::pre_order_iterator::operator==(const pre_order_iterator& other) const
+	{
+	return path_==other.path_;
+	}
+
+template<class T, class Hash, class Equal>
+bool dag_tree<T, Hash, Equal>::pre_order_iterator::operator!=(const pre_order_iterator& other) const
+	{
+	return !(*this==other);
+	}
+
+template<class T, class Hash, class Equal>
+typename dag_tree<T, Hash, Equal>::pre_order_iterator& dag_tree<T, Hash, Equal>::pre_order_iterator::operator++()
+	{
+	const stored_node& n=tr->nodes_[node()];
+	if(!skip_current_children_ && n.count>0) {
+		const index_type *first=tr->children_.data()+n.first;
+		path_.push_back(std::make_pair(first, first+n.count));
+		return *this;
+		}
+	skip_current_children_=false;
+	while(!path_.empty() && ++path_.back().first==path_.back().second)
+		path_.pop_back();
+	return *this;
+	}
+
+template<class T, class Hash, class Equal>
+typename dag_tree<T, Hash, Equal>::pre_order_iterator dag_tree<T, Hash, Equal>::pre_order_iterator::operator++(int)
+	{
+	pre_order_iterator copy(*this);
+	++(*this);
+	return copy;
+	}
+
+template<class T, class Hash, class Equal>
+void dag_tree<T, Hash, Equal>::pre_order_iterator::skip_children()
+	{
+	skip_current_children_=true;
+	}
+
+template<class T, class Hash, class Equal>
+typename dag_tree<T, Hash, Equal>::index_type dag_tree<T, Hash, Equal>::pre_order_iterator::node() const
+	{
+	return *path_.back().first;
+	}
+
+
+template<class T, class Hash, class Equal>
+dag_tree<T, Hash, Equal>::sibling_iterator::sibling_iterator()
+	: tr(0), pos(0)
+	{
+	}
+
+template<class T, class Hash, class Equal>
+dag_tree<T, Hash, Equal>::sibling_iterator::sibling_iterator(const dag_tree *t, const index_type *p)
+	: tr(t), pos(p)
+	{
+	}
+
+template<class T, class Hash, class Equal>
+dag_tree<T, Hash, Equal>::sibling_iterator::sibling_iterator(const pre_order_iterator& other)
+	: tr(other.tr), pos(other.path_.back().first)
+	{
+	}
+
+template<class T, class Hash, class Equal>
+const T& dag_tree<T, Hash, Equal>::sibling_iterator::operator*() const
+	{
+	return tr->nodes_[*pos].data;
+	}
+
+template<class T, class Hash, class Equal>
+const T* dag_tree<T, Hash, Equal>::sibling_iterator::operator->() const
+	{
+	return &tr->nodes_[*pos].data;
+	}
+
+template<class T, class Hash, class Equal>
+bool dag_tree<T, Hash, Equal>::sibling_iterator::operator==(const sibling_iterator& other) const
+	{
+	return pos==other.pos;
+	}
+
+template<class T, class Hash, class Equal>
+bool dag_tree<T, Hash, Equal>::sibling_iterator::operator!=(const sibling_iterator& other) const
+	{
+	return pos!=other.pos;
+	}
+
+template<class T, class Hash, class Equal>
+typename dag_tree<T, Hash, Equal>::sibling_iterator& dag_tree<T, Hash, Equal>::sibling_iterator::operator++()
+	{
+	++pos;
+	return *this;
+	}
+
+template<class T, class Hash, class Equal>
+typename dag_tree<T, Hash, Equal>::sibling_iterator dag_tree<T, Hash, Equal>::sibling_iterator::operator++(int)
+	{
+	sibling_iterator copy(*this);
+	++pos;
+	return copy;
+	}
+
+template<class T, class Hash, class Equal>
+typename dag_tree<T, Hash, Equal>::index_type dag_tree<T, Hash, Equal>::sibling_iterator::node() const
+	{
+	return *pos;
+	}
+
+}
+
+#endif
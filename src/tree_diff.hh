@@ -0,0 +1,385 @@
+/*
+
+	Differences between trees as edit scripts: diff(a, b) lists the inserts,
+	erases, changes of value and moves which turn tree a into tree b, and
+	apply_patch carries them out, so that a copy of a kept elsewhere can be
+	brought up to date by sending the patch instead of all of b. Matching
+	goes top-down, one list of siblings at a time, and takes subtrees with
+	equal hashes (see tree_hash.hh) as they are, so that the work and the
+	size of the patch both grow with the parts of the trees that differ.
+
+   This program is free software: you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef tree_diff_hh_
+#define tree_diff_hh_
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "tree.hh"
+#include "tree_hash.hh"
+
+namespace kptree {
+
+/// One step of a tree_patch. Paths are as for tree::path_from_iterator taken from the
+/// first top node (tree::begin()), so their first entry numbers the top-level nodes, and
+/// refer to the tree as it is when the step is applied, after all steps before it.
+template<class T>
+struct tree_edit {
+	enum kind_type { insert, erase, replace, move };
+
+	kind_type         kind;
+	/// The node erased, or given a new value; for insert and move, the place the node
+	/// ends up at (for a move, counted among its new siblings once it has been taken out).
+	std::vector<int>  path;
+	/// For move: the node which moves, with everything below it.
+	std::vector<int>  from;
+	/// For insert: the subtree to insert, with a single top node.
+	tree<T>           subtree;
+	/// For replace: the new value (the children stay).
+	T                 value;
+};
+
+template<class T>
+using tree_patch = std::vector<tree_edit<T> >;
+
+/// Edit script which turns 'a' into 'b'. Nodes whose data is equal (using 'equal') are
+/// kept where possible, siblings which swapped places are moved, and subtrees of 'a'
+/// equal to those in the same list of siblings in 'b' are not looked into any further.
+/// Moves only happen between siblings; a subtree which went elsewhere is erased and
+/// inserted again.
+template<class T, class A, class Hash=std::hash<T>, class Equal=std::equal_to<T> >
+tree_patch<T> diff(const tree<T, A>& a, const tree<T, A>& b, Hash hash=Hash(), Equal equal=Equal());
+
+/// Carry out the steps of 'patch' on 'tr', in one tree::batch(). Throws std::range_error
+/// if a path does not lead to a node, which means the tree is not the one the patch was
+/// made for; the steps before that have been carried out.
+template<class T, class A>
+void apply_patch(tree<T, A>& tr, const tree_patch<T>& patch);
+
+
+/// Fenwick tree over the places in a list of siblings which hold a node, to turn a place
+/// into a position among the siblings in logarithmic time.
+class diff_places_ {
+	public:
+		explicit diff_places_(size_t n) : counts_(n+1, 0) {}
+		void   set(size_t place, int d)
+			{
+			for(++place; place<counts_.size(); place+=place&(-place))
+				counts_[place]+=d;
+			}
+		/// Number of places before 'place' which hold a node.
+		int    before(size_t place) const
+			{
+			int ret=0;
+			for(; place>0; place-=place&(-place))
+				ret+=counts_[place];
+			return ret;
+			}
+	private:
+		std::vector<int> counts_;
+};
+
+/// Positions in 'seq' of a longest strictly increasing subsequence, in order.
+inline std::vector<size_t> diff_increasing_(const std::vector<size_t>& seq)
+	{
+	std::vector<size_t> tails, prev(seq.size(), size_t(-1));
+	for(size_t i=0; i<seq.size(); ++i) {
+		size_t lo=0, hi=tails.size();
+		while(lo<hi) {
+			size_t mid=(lo+hi)/2;
+			if(seq[tails[mid]]<seq[i]) lo=mid+1;
+			else                       hi=mid;
+			}
+		if(lo>0) prev[i]=tails[lo-1];
+		if(lo==tails.size()) tails.push_back(i);
+		else                 tails[lo]=i;
+		}
+	std::vector<size_t> ret;
+	for(size_t i=tails.empty()?size_t(-1):tails.back(); i!=size_t(-1); i=prev[i])
+		ret.push_back(i);
+	std::reverse(ret.begin(), ret.end());
+	return ret;
+	}
+
+/// Copy everything below node 'from' (of any tree type) below 'top', which holds a copy
+/// of 'from' itself already.
+template<class To, class Node>
+void diff_copy_below_(To& tr, typename To::iterator top, const Node *from)
+	{
+	const Node *s=from;
+	typename To::iterator d=top;
+	for(;;) {
+		if(s->first_child!=0) {
+			s=s->first_child;
+			d=tr.append_child(d, s->data);
+			continue;
+			}
+		while(s!=from && s->next_sibling==0) {
+			s=s->parent;
+			d=tr.parent(d);
+			}
+		if(s==from)
+			return;
+		s=s->next_sibling;
+		d=tr.append_child(tr.parent(d), s->data);
+		}
+	}
+
+template<class T, class A, class Hash, class Equal>
+tree_patch<T> diff(const tree<T, A>& a, const tree<T, A>& b, Hash hash, Equal equal)
+	{
+	typedef typename A::value_type                      tree_node;
+	typedef typename tree<T, A>::iterator               iterator;
+	typedef typename tree<T, A>::sibling_iterator       sibling_iterator;
+	typedef std::unordered_map<const tree_node *, std::pair<size_t, size_t> > info_t;
+
+	tree_patch<T> patch;
+
+	// Hash and size of every subtree of both trees.
+	info_t info;
+	info.reserve(a.size()+b.size());
+	for(sibling_iterator top=a.begin(); top!=a.end(); ++top)
+		hash_subtree_pass_(top.node, hash, [&info](const tree_node *n, size_t h, size_t size) {
+			info[n]=std::make_pair(h, size);
+			});
+	for(sibling_iterator top=b.begin(); top!=b.end(); ++top)
+		hash_subtree_pass_(top.node, hash, [&info](const tree_node *n, size_t h, size_t size) {
+			info[n]=std::make_pair(h, size);
+			});
+
+	// Pairs of nodes, one in each tree, whose children still have to be matched, with the
+	// path to them; null nodes stand for the top level.
+	struct pending {
+		const tree_node  *a, *b;
+		std::vector<int>  path;
+	};
+	std::vector<pending> todo(1, pending{0, 0, std::vector<int>()});
+	std::vector<iterator> as, bs;
+	while(!todo.empty()) {
+		pending p=std::move(todo.back());
+		todo.pop_back();
+		as.clear();
+		bs.clear();
+		sibling_iterator ab=p.a?a.begin(iterator(const_cast<tree_node *>(p.a))):sibling_iterator(a.begin());
+		sibling_iterator ae=p.a?a.end(iterator(const_cast<tree_node *>(p.a))):sibling_iterator(a.end());
+		sibling_iterator bb=p.b?b.begin(iterator(const_cast<tree_node *>(p.b))):sibling_iterator(b.begin());
+		sibling_iterator be=p.b?b.end(iterator(const_cast<tree_node *>(p.b))):sibling_iterator(b.end());
+		for(; ab!=ae; ++ab) as.push_back(ab);
+		for(; bb!=be; ++bb) bs.push_back(bb);
+
+		// Match children of b to those of a: equal subtrees first, then equal values, then
+		// whatever is left over in order. 'same' marks matches with equal subtrees.
+		const size_t none=size_t(-1);
+		std::vector<size_t> match_a(as.size(), none), match_b(bs.size(), none);
+		std::vector<bool>   same(bs.size(), false);
+		std::unordered_map<size_t, std::vector<size_t> > by_hash;
+		for(size_t i=0; i<as.size(); ++i)
+			by_hash[info[as[i].node].first].push_back(i);
+		for(size_t j=0; j<bs.size(); ++j) {
+			typename std::unordered_map<size_t, std::vector<size_t> >::iterator fnd=by_hash.find(info[bs[j].node].first);
+			if(fnd==by_hash.end()) continue;
+			for(size_t i: fnd->second)
+				if(match_a[i]==none && info[as[i].node].second==info[bs[j].node].second
+					&& a.equal_subtree(as[i], bs[j], equal)) {
+					match_a[i]=j;
+					match_b[j]=i;
+					same[j]=true;
+					break;
+					}
+			}
+		by_hash.clear();
+		for(size_t i=0; i<as.size(); ++i)
+			if(match_a[i]==none)
+				by_hash[hash(*as[i])].push_back(i);
+		for(size_t j=0; j<bs.size(); ++j) {
+			if(match_b[j]!=none) continue;
+			typename std::unordered_map<size_t, std::vector<size_t> >::iterator fnd=by_hash.find(hash(*bs[j]));
+			if(fnd==by_hash.end()) continue;
+			for(size_t i: fnd->second)
+				if(match_a[i]==none && equal(*as[i], *bs[j])) {
+					match_a[i]=j;
+					match_b[j]=i;
+					break;
+					}
+			}
+		for(size_t i=0, j=0; i<as.size(); ++i) {
+			if(match_a[i]!=none) continue;
+			while(j<bs.size() && match_b[j]!=none) ++j;
+			if(j==bs.size()) break;
+			match_a[i]=j;
+			match_b[j]=i;
+			}
+
+		// Erase what is not matched, from the back so that the paths stay right.
+		p.path.push_back(0);
+		for(size_t i=as.size(); i-->0; )
+			if(match_a[i]==none) {
+				p.path.back()=int(i);
+				patch.push_back(tree_edit<T>());
+				patch.back().kind=tree_edit<T>::erase;
+				patch.back().path=p.path;
+				}
+
+		// The remaining children of a in order, with their places in b. The longest run of
+		// those already in the right order stays, the others move.
+		std::vector<size_t> order;
+		for(size_t i=0; i<as.size(); ++i)
+			if(match_a[i]!=none)
+				order.push_back(match_a[i]);
+		std::vector<size_t> staying=diff_increasing_(order);
+		std::vector<bool> stays(bs.size(), false);
+		for(size_t k: staying)
+			stays[order[k]]=true;
+
+		// Every node of b which does not stay goes in right after the one before it in b, so
+		// after the last staying node before it: the children are laid out as groups of a
+		// staying node, the nodes which go in after it in the order of b, and the nodes of a
+		// after it which are still to move away. Places are numbered in that layout.
+		std::vector<size_t> group_start(staying.size()+2, 0), place_b(bs.size()), place_a(order.size());
+		for(size_t j=0, g=0; j<bs.size(); ++j) {
+			if(stays[j]) ++g;
+			else         ++group_start[g+1];
+			}
+		for(size_t k=0, g=0, s=0; k<order.size(); ++k) {
+			if(s<staying.size() && staying[s]==k) { ++g; ++s; }
+			else                                  ++group_start[g+1];
+			}
+		for(size_t g=1; g<group_start.size(); ++g)
+			group_start[g]+=group_start[g-1]+(g>1?1:0);
+		std::vector<size_t> next(group_start);
+		for(size_t g=1; g<next.size(); ++g)
+			++next[g]; // past the staying node
+		for(size_t j=0, g=0; j<bs.size(); ++j) {
+			if(stays[j]) { ++g; continue; }
+			place_b[j]=next[g]++;
+			}
+		diff_places_ places(group_start.back());
+		for(size_t k=0, g=0, s=0; k<order.size(); ++k) {
+			if(s<staying.size() && staying[s]==k) {
+				++g;
+				++s;
+				place_a[k]=group_start[g];
+				}
+			else place_a[k]=next[g]++;
+			places.set(place_a[k], 1);
+			}
+		std::vector<size_t> rank_of(bs.size(), none);
+		for(size_t k=0; k<order.size(); ++k)
+			rank_of[order[k]]=k;
+
+		for(size_t j=0; j<bs.size(); ++j) {
+			if(stays[j]) continue;
+			if(match_b[j]==none) {
+				p.path.back()=places.before(place_b[j]);
+				places.set(place_b[j], 1);
+				patch.push_back(tree_edit<T>());
+				patch.back().kind=tree_edit<T>::insert;
+				patch.back().path=p.path;
+				tree<T>& sub=patch.back().subtree;
+				diff_copy_below_(sub, sub.set_head(*bs[j]), bs[j].node);
+				continue;
+				}
+			size_t k=rank_of[j];
+			int    from=places.before(place_a[k]);
+			places.set(place_a[k], -1);
+			int    to=places.before(place_b[j]);
+			places.set(place_b[j], 1);
+			if(from==to) continue;
+			patch.push_back(tree_edit<T>());
+			patch.back().kind=tree_edit<T>::move;
+			p.path.back()=from;
+			patch.back().from=p.path;
+			p.path.back()=to;
+			patch.back().path=p.path;
+			}
+
+		// The children are in the order of b now; give matched ones their new values and
+		// look at the children of those which differ.
+		for(size_t j=0; j<bs.size(); ++j) {
+			if(match_b[j]==none || same[j]) continue;
+			p.path.back()=int(j);
+			if(!equal(*as[match_b[j]], *bs[j])) {
+				patch.push_back(tree_edit<T>());
+				patch.back().kind=tree_edit<T>::replace;
+				patch.back().path=p.path;
+				patch.back().value=*bs[j];
+				}
+			todo.push_back(pending{as[match_b[j]].node, bs[j].node, p.path});
+			}
+		}
+	return patch;
+	}
+
+template<class T, class A>
+void apply_patch(tree<T, A>& tr, const tree_patch<T>& patch)
+	{
+	typedef typename tree<T, A>::iterator         iterator;
+	typedef typename tree<T, A>::sibling_iterator sibling_iterator;
+
+	typename tree<T, A>::batch_scope scope=tr.batch();
+	std::vector<int> parent;
+	for(const tree_edit<T>& e: patch) {
+		if(e.path.empty())
+			throw std::range_error("kptree::apply_patch: empty path");
+		// The siblings among which the step ends up, and the place among them.
+		parent.assign(e.path.begin(), e.path.end()-1);
+		iterator top;
+		if(!parent.empty()) top=tr.iterator_from_path(parent, tr.begin());
+		sibling_iterator first=parent.empty()?sibling_iterator(tr.begin()):tr.begin(top);
+		sibling_iterator last =parent.empty()?sibling_iterator(tr.end())  :tr.end(top);
+		switch(e.kind) {
+			case tree_edit<T>::erase:
+				tr.erase(tr.iterator_from_path(e.path, tr.begin()));
+				break;
+			case tree_edit<T>::replace:
+				*tr.iterator_from_path(e.path, tr.begin())=e.value;
+				break;
+			case tree_edit<T>::insert: {
+				if(e.subtree.empty())
+					throw std::range_error("kptree::apply_patch: nothing to insert");
+				sibling_iterator at=first;
+				for(int i=0; i<e.path.back() && at!=last; ++i) ++at;
+				iterator ins;
+				if(at!=last)              ins=tr.insert(iterator(at), *e.subtree.begin());
+				else if(!parent.empty())  ins=tr.append_child(top, *e.subtree.begin());
+				else if(tr.empty())       ins=tr.set_head(*e.subtree.begin());
+				else                      ins=tr.insert_after(iterator(tr.feet->prev_sibling), *e.subtree.begin());
+				diff_copy_below_(tr, ins, e.subtree.begin().node);
+				break;
+				}
+			case tree_edit<T>::move: {
+				sibling_iterator src=tr.iterator_from_path(e.from, tr.begin());
+				sibling_iterator at=first;
+				if(at==src) ++at;
+				for(int i=0; i<e.path.back() && at!=last; ++i) {
+					++at;
+					if(at==src) ++at;
+					}
+				tr.move_before(at, src);
+				break;
+				}
+			}
+		}
+	scope.commit();
+	}
+
+}
+
+#endif
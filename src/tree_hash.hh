@@ -0,0 +1,226 @@
+/*
+
+	Structural hashes of subtrees: the hash of a node combines that of its
+	value with the hashes of the subtrees of its children, in order, so
+	that equal subtrees (in the sense of tree::equal_subtree) get equal
+	hashes. They are computed bottom-up in one post-order pass, and can be
+	kept per node, so that comparing subtrees, looking for one and finding
+	all duplicates take a hash comparison for most candidates instead of
+	a walk over both subtrees.
+
+   This program is free software: you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef tree_hash_hh_
+#define tree_hash_hh_
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "tree.hh"
+
+namespace kptree {
+
+/// Hash of the subtree at node 'top' of 'tr', as described above.
+template<class T, class A, class Hash=std::hash<T> >
+size_t hash_subtree(const tree<T, A>& tr, const typename tree<T, A>::iterator_base& top, Hash hash=Hash());
+
+/// Hashes of the subtrees of a tree, remembered per node once computed. Any change to
+/// the shape of the tree (see tree::epoch) makes it start afresh; changes to values are
+/// not noticed, so call clear() after those. Lookups change the object, so one should
+/// not be used from several threads at once.
+template<class T, class A=std::allocator<tree_node_<T> >, class Hash=std::hash<T> >
+class subtree_hash {
+	public:
+		typedef tree<T, A>                           tree_type;
+		typedef typename tree_type::iterator_base    iterator_base;
+		typedef typename tree_type::iterator         iterator;
+		typedef typename tree_type::sibling_iterator sibling_iterator;
+
+		explicit subtree_hash(const tree_type&, Hash hash=Hash());
+
+		/// Hash of the subtree at 'it'. If it is not known yet, it is computed together with
+		/// those of all nodes below it.
+		size_t   operator()(const iterator_base& it);
+		/// Whether the subtrees at 'one' and 'two' are equal, as tree::equal_subtree, which
+		/// is only asked if their hashes are the same.
+		bool     equal(const iterator_base& one, const iterator_base& two);
+		/// The first node in the range from..to (in pre-order) with a subtree equal to the
+		/// one at 'pattern', which may be in another tree; 'to' if there is none. As
+		/// tree::find_subtree for a single subtree, comparing hashes first.
+		iterator find(const iterator_base& pattern, iterator from, iterator to);
+		/// Forget all hashes.
+		void     clear();
+		/// Number of nodes whose hash is known.
+		size_t   size() const { return cache_.size(); }
+
+	private:
+		typedef typename A::value_type tree_node;
+
+		const tree_type  *tree_;
+		Hash              hash_;
+		unsigned long     epoch_;
+		std::unordered_map<const tree_node *, size_t> cache_;
+};
+
+/// Groups of two or more equal subtrees in 'tr', leaving out those of fewer than
+/// 'min_nodes' nodes (so by default single nodes which happen to have equal values).
+/// Each group lists its subtrees in pre-order, and the groups come in the pre-order of
+/// their first subtree. The nodes below duplicates are duplicates as well, and get
+/// groups of their own.
+template<class T, class A, class Hash=std::hash<T> >
+std::vector<std::vector<typename tree<T, A>::iterator> >
+find_duplicate_subtrees(const tree<T, A>& tr, size_t min_nodes=2, Hash hash=Hash());
+
+
+/// Mixes the hash of a child subtree into that of its parent.
+inline size_t hash_combine_(size_t seed, size_t h)
+	{
+	return seed ^ (h + size_t(0x9e3779b97f4a7c15ULL) + (seed<<6) + (seed>>2));
+	}
+
+/// One post-order pass over the subtree at 'top', calling visit(node, hash, size) for
+/// every node once the hashes of its children are known. An explicit stack holds the
+/// hashes and sizes of the subtrees done whose parent is still to come.
+template<class Node, class Hash, class Visit>
+size_t hash_subtree_pass_(Node *top, Hash& hash, Visit visit)
+	{
+	std::vector<std::pair<size_t, size_t> > done;
+	Node *n=top;
+	while(n->first_child!=0)
+		n=n->first_child;
+	while(true) {
+		size_t h=hash(n->data), size=1, children=0;
+		for(Node *ch=n->first_child; ch!=0; ch=ch->next_sibling)
+			++children;
+		h=hash_combine_(h, children);
+		for(size_t i=done.size()-children; i<done.size(); ++i) {
+			h=hash_combine_(h, done[i].first);
+			size+=done[i].second;
+			}
+		done.resize(done.size()-children);
+		visit(n, h, size);
+		if(n==top)
+			return h;
+		done.push_back(std::make_pair(h, size));
+		// On to the next node in post-order: the first leaf below the next sibling, or
+		// the parent once all siblings are done.
+		if(n->next_sibling!=0) {
+			n=n->next_sibling;
+			while(n->first_child!=0)
+				n=n->first_child;
+			}
+		else n=n->parent;
+		}
+	}
+
+template<class T, class A, class Hash>
+size_t hash_subtree(const tree<T, A>&, const typename tree<T, A>::iterator_base& top, Hash hash)
+	{
+	return hash_subtree_pass_(top.node, hash, [](const typename A::value_type *, size_t, size_t) {});
+	}
+
+
+template<class T, class A, class Hash>
+subtree_hash<T, A, Hash>::subtree_hash(const tree_type& tr, Hash hash)
+	: tree_(&tr), hash_(hash), epoch_(tr.epoch())
+	{
+	}
+
+template<class T, class A, class Hash>
+size_t subtree_hash<T, A, Hash>::operator()(const iterator_base& it)
+	{
+	unsigned long now=tree_->epoch();
+	if(now!=epoch_) {
+		clear();
+		epoch_=now;
+		}
+	typename std::unordered_map<const tree_node *, size_t>::const_iterator fnd=cache_.find(it.node);
+	if(fnd!=cache_.end())
+		return fnd->second;
+	return hash_subtree_pass_(it.node, hash_, [this](const tree_node *n, size_t h, size_t) { cache_[n]=h; });
+	}
+
+template<class T, class A, class Hash>
+bool subtree_hash<T, A, Hash>::equal(const iterator_base& one, const iterator_base& two)
+	{
+	if((*this)(one)!=(*this)(two))
+		return false;
+	return tree_->equal_subtree(iterator(one.node), iterator(two.node));
+	}
+
+template<class T, class A, class Hash>
+typename subtree_hash<T, A, Hash>::iterator subtree_hash<T, A, Hash>::find(const iterator_base& pattern,
+																								  iterator from, iterator to)
+	{
+	size_t h=hash_subtree_pass_(pattern.node, hash_, [](const tree_node *, size_t, size_t) {});
+	for(; from!=to; ++from)
+		if((*this)(from)==h && tree_->equal_subtree(iterator(pattern.node), from))
+			return from;
+	return to;
+	}
+
+template<class T, class A, class Hash>
+void subtree_hash<T, A, Hash>::clear()
+	{
+	cache_.clear();
+	}
+
+
+template<class T, class A, class Hash>
+std::vector<std::vector<typename tree<T, A>::iterator> >
+find_duplicate_subtrees(const tree<T, A>& tr, size_t min_nodes, Hash hash)
+	{
+	typedef typename A::value_type         tree_node;
+	typedef typename tree<T, A>::iterator  iterator;
+
+	std::unordered_map<const tree_node *, std::pair<size_t, size_t> > info;
+	for(typename tree<T, A>::sibling_iterator top=tr.begin(); top!=tr.end(); ++top)
+		hash_subtree_pass_(top.node, hash, [&info](const tree_node *n, size_t h, size_t size) {
+			info[n]=std::make_pair(h, size);
+			});
+
+	// Groups so far, and the groups with subtrees of each hash: usually one, more than one
+	// only if different subtrees have the same hash.
+	std::vector<std::vector<iterator> > groups;
+	std::unordered_map<size_t, std::vector<size_t> > by_hash;
+	for(iterator it=tr.begin(); it!=tr.end(); ++it) {
+		const std::pair<size_t, size_t>& hs=info[it.node];
+		if(hs.second<min_nodes) continue;
+		std::vector<size_t>& candidates=by_hash[hs.first];
+		bool placed=false;
+		for(size_t c=0; c<candidates.size() && !placed; ++c) {
+			std::vector<iterator>& group=groups[candidates[c]];
+			if(info[group.front().node].second==hs.second && tr.equal_subtree(group.front(), it)) {
+				group.push_back(it);
+				placed=true;
+				}
+			}
+		if(!placed) {
+			candidates.push_back(groups.size());
+			groups.push_back(std::vector<iterator>(1, it));
+			}
+		}
+
+	std::vector<std::vector<iterator> > ret;
+	for(size_t g=0; g<groups.size(); ++g)
+		if(groups[g].size()>1)
+			ret.push_back(std::move(groups[g]));
+	return ret;
+	}
+
+}
+
+#endif
@@ -0,0 +1,292 @@
+/*
+
+	Parallel traversal of the templated tree.hh class: visit, reduce or
+	sort all nodes of a subtree, with the work split over sibling
+	subtrees and handed out to a set of threads; and parallel building
+	of subtrees which then get moved into a tree in one go.
+
+	The functions here need to be compiled with thread support (-pthread
+	with gcc and clang).
+
+   This program is free software: you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef tree_parallel_hh_
+#define tree_parallel_hh_
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "tree.hh"
+
+namespace kptree {
+
+/// Call f on the data of 'top' and of every node below it. Calls for different nodes may
+/// run concurrently, in no particular order. Subtrees with at most 'grain' nodes are
+/// handled by a single thread; 'grain=0' picks a value from the size of the subtree.
+/// Only nodes which keep their subtree sizes (tree_node_counted_ and the like) know how
+/// big a subtree is, so 'grain' is ignored for all others, which get split into a few
+/// tasks for every thread instead.
+/// With 'threads=0' one thread per hardware thread is used. If f throws, the remaining
+/// work is abandoned and the first exception is rethrown.
+template<class T, class A, class F>
+void parallel_for_each(tree<T, A>& tr, typename tree<T, A>::iterator top, F f,
+							  size_t grain=0, unsigned int threads=0);
+
+/// Combine transform(x) for the data x of 'top' and of every node below it, using the
+/// binary operation 'reduce' (which should be associative and commutative), starting
+/// from 'init'. Splitting and threads as for parallel_for_each.
+template<class T, class A, class R, class Reduce, class Transform>
+R parallel_transform_reduce(const tree<T, A>& tr, typename tree<T, A>::iterator top, R init,
+									 Reduce reduce, Transform transform, size_t grain=0, unsigned int threads=0);
+
+/// As parallel_transform_reduce, combining the data of the nodes themselves.
+template<class T, class A, class R, class Reduce>
+R parallel_reduce(const tree<T, A>& tr, typename tree<T, A>::iterator top, R init,
+						Reduce reduce, size_t grain=0, unsigned int threads=0);
+
+/// Stable sort of the children of 'top' and of every node below it, the same as
+/// tr.sort(tr.begin(top), tr.end(top), comp, true), with different child lists sorted
+/// at the same time. Splitting and threads as for parallel_for_each; a single long list
+/// of children is still sorted by one thread. Nothing else may use the tree meanwhile.
+template<class T, class A, class StrictWeakOrdering>
+void parallel_sort(tree<T, A>& tr, typename tree<T, A>::iterator top, StrictWeakOrdering comp,
+						 size_t grain=0, unsigned int threads=0);
+/// As above, sorting with operator< (pass std::less<T>() to choose a grain or threads).
+template<class T, class A>
+void parallel_sort(tree<T, A>& tr, typename tree<T, A>::iterator top);
+
+/// Call factory(i), which returns a tree, for all i in [0, n), with different calls running
+/// at the same time, and return the trees in order of i. Threads and exceptions as for
+/// parallel_for_each.
+template<class Factory>
+auto parallel_build(size_t n, Factory factory, unsigned int threads=0)
+	-> std::vector<decltype(factory(size_t(0)))>;
+/// As above, and move the nodes of all trees in below 'loc', as its last children in order
+/// of i, in one go. Returns iterator to the first node moved in, or 'loc' if there were
+/// none. The trees are built with allocators of their own, so this is only available for
+/// stateless allocators (std::allocator and the like).
+template<class T, class A, class Factory>
+typename tree<T, A>::iterator parallel_build(tree<T, A>& tr, typename tree<T, A>::iterator loc, size_t n,
+															Factory factory, unsigned int threads=0);
+
+
+
+/// Number of threads to use when the caller asked for 'threads' (0 meaning all there are).
+inline unsigned int parallel_threads_(unsigned int threads)
+	{
+	if(threads==0)
+		threads=std::thread::hardware_concurrency();
+	return threads==0?1:threads;
+	}
+
+/// Cut the subtree at 'top' into nodes to be visited on their own ('single') and nodes
+/// to be visited together with everything below them ('whole'). With counted nodes the
+/// size of each subtree is known and anything above 'grain' nodes gets split. Otherwise
+/// the tree is split breadth-first until there are a few tasks for every thread, or until
+/// as many nodes have been split off (which on a long chain gives a single task), and
+/// 'grain' is not used: finding the sizes would take a walk over the whole subtree.
+template<class T, class A>
+void parallel_split_(const tree<T, A>& tr, typename tree<T, A>::iterator top, size_t grain, unsigned int threads,
+							std::vector<typename A::value_type *>& single,
+							std::vector<typename A::value_type *>& whole)
+	{
+	typedef typename A::value_type tree_node;
+	const bool   counted=tree_node_traits_<tree_node>::counted;
+	const size_t target=8*threads;
+
+	if(counted && grain==0)
+		grain=std::max<size_t>(tr.size(top)/target, 1);
+
+	std::vector<tree_node *> pending(1, top.node);
+	size_t next=0;
+	while(next<pending.size()) {
+		tree_node *n=pending[next++];
+		bool split=false;
+		if(n->first_child!=0) {
+			if(counted) split=(tr.size(typename tree<T, A>::iterator(n))>grain);
+			else        split=(whole.size()+pending.size()-next<target && single.size()<target);
+			}
+		if(split) {
+			single.push_back(n);
+			for(tree_node *ch=n->first_child; ch!=0; ch=ch->next_sibling)
+				pending.push_back(ch);
+			}
+		else whole.push_back(n);
+		}
+	}
+
+/// Run work(i) for all i in [0, tasks) on 'threads' threads (the calling one included),
+/// handing out the next task to whichever thread is free.
+template<class Work>
+void parallel_run_(size_t tasks, unsigned int threads, Work work)
+	{
+	std::atomic<size_t> next(0);
+	std::atomic<bool>   failed(false);
+	std::exception_ptr  error;
+	std::mutex          error_mutex;
+
+	auto worker=[&]() {
+		for(;;) {
+			size_t i=next++;
+			if(i>=tasks || failed) return;
+			try {
+				work(i);
+				}
+			catch(...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if(!failed) error=std::current_exception();
+				failed=true;
+				return;
+				}
+			}
+		};
+
+	if(threads>tasks) threads=tasks;
+	std::vector<std::thread> pool;
+	for(unsigned int t=1; t<threads; ++t)
+		pool.push_back(std::thread(worker));
+	worker();
+	for(size_t t=0; t<pool.size(); ++t)
+		pool[t].join();
+
+	if(error) std::rethrow_exception(error);
+	}
+
+template<class T, class A, class F>
+void parallel_for_each(tree<T, A>& tr, typename tree<T, A>::iterator top, F f,
+							  size_t grain, unsigned int threads)
+	{
+	typedef typename A::value_type tree_node;
+	assert(top.node!=0);
+
+	threads=parallel_threads_(threads);
+	std::vector<tree_node *> single, whole;
+	parallel_split_(tr, top, grain, threads, single, whole);
+
+	for(size_t i=0; i<single.size(); ++i)
+		f(single[i]->data);
+
+	parallel_run_(whole.size(), threads, [&](size_t i) {
+		typename tree<T, A>::iterator it(whole[i]), eit(whole[i]);
+		eit.skip_children();
+		++eit;
+		while(it!=eit) {
+			f(*it);
+			++it;
+			}
+		});
+	}
+
+template<class T, class A, class R, class Reduce, class Transform>
+R parallel_transform_reduce(const tree<T, A>& tr, typename tree<T, A>::iterator top, R init,
+									 Reduce reduce, Transform transform, size_t grain, unsigned int threads)
+	{
+	typedef typename A::value_type tree_node;
+	assert(top.node!=0);
+
+	threads=parallel_threads_(threads);
+	std::vector<tree_node *> single, whole;
+	parallel_split_(tr, top, grain, threads, single, whole);
+
+	for(size_t i=0; i<single.size(); ++i)
+		init=reduce(init, transform(single[i]->data));
+
+	// Each task starts from its own first node, so 'init' enters the result only once.
+	std::vector<R> partial(whole.size(), init);
+	parallel_run_(whole.size(), threads, [&](size_t i) {
+		typename tree<T, A>::iterator it(whole[i]), eit(whole[i]);
+		eit.skip_children();
+		++eit;
+		R acc=transform(*it);
+		++it;
+		while(it!=eit) {
+			acc=reduce(acc, transform(*it));
+			++it;
+			}
+		partial[i]=acc;
+		});
+
+	for(size_t i=0; i<partial.size(); ++i)
+		init=reduce(init, partial[i]);
+	return init;
+	}
+
+template<class T, class A, class R, class Reduce>
+R parallel_reduce(const tree<T, A>& tr, typename tree<T, A>::iterator top, R init,
+						Reduce reduce, size_t grain, unsigned int threads)
+	{
+	return parallel_transform_reduce(tr, top, init, reduce, [](const T& x) -> const T& { return x; },
+												grain, threads);
+	}
+
+template<class T, class A, class StrictWeakOrdering>
+void parallel_sort(tree<T, A>& tr, typename tree<T, A>::iterator top, StrictWeakOrdering comp,
+						 size_t grain, unsigned int threads)
+	{
+	typedef typename A::value_type tree_node;
+	assert(top.node!=0);
+
+	threads=parallel_threads_(threads);
+	std::vector<tree_node *> single, whole;
+	parallel_split_(tr, top, grain, threads, single, whole);
+
+	// Each child list belongs to one task: those of the 'single' nodes on their own, those
+	// in the subtrees of 'whole' nodes by a deep sort. Sorting a list only relinks its own
+	// nodes, and the tree-wide bookkeeping is settled by the first sort, done up front.
+	auto work=[&](size_t i) {
+		tree_node *n=(i<single.size())?single[i]:whole[i-single.size()];
+		typename tree<T, A>::iterator it(n);
+		tr.sort(tr.begin(it), tr.end(it), comp, i>=single.size());
+		};
+	size_t tasks=single.size()+whole.size();
+	work(0);
+	parallel_run_(tasks-1, threads, [&](size_t i) { work(i+1); });
+	}
+
+template<class T, class A>
+void parallel_sort(tree<T, A>& tr, typename tree<T, A>::iterator top)
+	{
+	parallel_sort(tr, top, std::less<T>());
+	}
+
+template<class Factory>
+auto parallel_build(size_t n, Factory factory, unsigned int threads)
+	-> std::vector<decltype(factory(size_t(0)))>
+	{
+	std::vector<decltype(factory(size_t(0)))> ret(n);
+	parallel_run_(n, parallel_threads_(threads), [&](size_t i) { ret[i]=factory(i); });
+	return ret;
+	}
+
+template<class T, class A, class Factory>
+typename tree<T, A>::iterator parallel_build(tree<T, A>& tr, typename tree<T, A>::iterator loc, size_t n,
+															Factory factory, unsigned int threads)
+	{
+	static_assert(std::is_same<decltype(factory(size_t(0))), tree<T, A> >::value,
+					  "parallel_build: the factory has to return trees of the same type");
+	static_assert(std::is_empty<A>::value,
+					  "parallel_build: nodes of trees with their own allocators cannot be moved between them");
+	std::vector<tree<T, A> > built=parallel_build(n, factory, threads);
+	return tr.move_in_below(loc, built.begin(), built.end());
+	}
+
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+
+	Cache from paths (as for tree::iterator_from_path) to the nodes they
+	lead to, for programs which keep addressing the same nodes of a tree
+	by path. The least recently used entries make way for new ones, and
+	any change to the shape of the tree (see tree::epoch) empties it.
+
+   This program is free software: you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef tree_path_cache_hh_
+#define tree_path_cache_hh_
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include "tree.hh"
+
+namespace kptree {
+
+/// Nodes of 'tr' by their path from tr.begin(), remembering the last 'capacity' paths
+/// looked up, so that those take one hash lookup instead of a walk along the path. The
+/// tree may change at any time; the next lookup then starts afresh. Lookups change the
+/// cache, so one cache should not be used from several threads at once.
+template<class T, class A=std::allocator<tree_node_<T> >, unsigned int N=16>
+class path_cache {
+	public:
+		typedef tree<T, A>                  tree_type;
+		typedef tree_path<N>                path_type;
+		typedef typename tree_type::iterator iterator;
+
+		explicit path_cache(const tree_type& tr, size_t capacity=1024);
+
+		/// The node at 'path', as tr.iterator_from_path(path, tr.begin()); throws
+		/// std::range_error in the same way if there is no such node.
+		iterator find(const path_type& path);
+		/// Forget all paths.
+		void     clear();
+
+		size_t   size() const     { return index_.size(); }
+		size_t   capacity() const { return capacity_; }
+		/// Number of lookups answered from the cache and by walking the tree.
+		size_t   hits() const     { return hits_; }
+		size_t   misses() const   { return misses_; }
+
+	private:
+		typedef std::list<std::pair<path_type, iterator> > lru_type; // most recent first
+
+		const tree_type& tree_;
+		size_t           capacity_, hits_, misses_;
+		unsigned long    epoch_;
+		lru_type         lru_;
+		std::unordered_map<path_type, typename lru_type::iterator, typename path_type::hasher> index_;
+};
+
+template<class T, class A, unsigned int N>
+path_cache<T, A, N>::path_cache(const tree_type& tr, size_t capacity)
+	: tree_(tr), capacity_(capacity), hits_(0), misses_(0), epoch_(tr.epoch())
+	{
+	}
+
+template<class T, class A, unsigned int N>
+typename path_cache<T, A, N>::iterator path_cache<T, A, N>::find(const path_type& path)
+	{
+	unsigned long now=tree_.epoch();
+	if(now!=epoch_) {
+		clear();
+		epoch_=now;
+		}
+
+	auto found=index_.find(path);
+	if(found!=index_.end()) {
+		++hits_;
+		lru_.splice(lru_.begin(), lru_, found->second);
+		return found->second->second;
+		}
+
+	++misses_;
+	iterator it=tree_.iterator_from_path(path, tree_.begin());
+	if(capacity_==0) return it;
+	if(index_.size()==capacity_) {
+		// Reuse the entry of the least recently used path.
+		index_.erase(lru_.back().first);
+		lru_.splice(lru_.begin(), lru_, std::prev(lru_.end()));
+		lru_.front().first=path;
+		lru_.front().second=it;
+		}
+	else
+		lru_.emplace_front(path, it);
+	index_.emplace(path, lru_.begin());
+	return it;
+	}
+
+template<class T, class A, unsigned int N>
+void path_cache<T, A, N>::clear()
+	{
+	index_.clear();
+	lru_.clear();
+	}
+
+}
+
+#endif
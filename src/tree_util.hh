@@ -6,8 +6,9 @@
 
 	Copyright (C) 2001-2009  Kasper Peeters <kasper.peeters@aei.mpg.de>
 
-	(At the moment this only contains a printing utility, thanks to Linda
-	Buisman <linda.buisman@studentmail.newcastle.edu.au>)
+	(The bracketed printing utility is thanks to Linda Buisman
+	<linda.buisman@studentmail.newcastle.edu.au>; it is matched by a
+	parser for the same format.)
 
    This program is free software: you can redistribute it and/or
    modify it under the terms of the GNU General Public License as
@@ -27,7 +28,13 @@
 #ifndef tree_util_hh_
 #define tree_util_hh_
 
+#include <cstdlib>
+#include <cerrno>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 #include "tree.hh"
 
 namespace kptree {
@@ -39,21 +46,114 @@ template<class T>
 void print_subtree_bracketed(const tree<T>& t, typename tree<T>::iterator iRoot, 
 									  std::ostream& str=std::cout);
 
+/// Read trees in the format written by print_tree_bracketed, one head per line, and
+/// replace the content of 'tr' with them. Node labels are converted with operator>>
+/// (taken whole for std::string) after stripping surrounding blanks; they cannot contain
+/// '(', ')', ',' or a newline. Blank lines are skipped, and newlines inside brackets are
+/// ignored. Throws std::runtime_error on malformed input.
+template<class T>
+void parse_bracketed(std::istream& str, tree<T>& tr);
+
+
+
+/// Output buffer for the bracketed printer, handed on to the stream in large blocks.
+class bracketed_writer_ {
+	public:
+		explicit bracketed_writer_(std::ostream& str) : str_(str) {}
+		~bracketed_writer_() { flush(); }
+
+		void put(char c)
+			{
+			buf_+=c;
+			if(buf_.size()>=block_) flush();
+			}
+		void put(const char *s)
+			{
+			buf_+=s;
+			if(buf_.size()>=block_) flush();
+			}
+		template<class T>
+		void put_value(const T& x)
+			{
+			append_(x, std::integral_constant<bool, (std::is_integral<T>::value && sizeof(T)>1)>());
+			if(buf_.size()>=block_) flush();
+			}
+		void flush()
+			{
+			str_.write(buf_.data(), buf_.size());
+			buf_.clear();
+			}
+
+	private:
+		static const size_t block_=65536;
 
+		std::ostream&      str_;
+		std::string        buf_;
+		std::ostringstream tmp_;
 
-// Iterate over all roots (the head) and print each one on a new line
-// by calling printSingleRoot.
+		/// Integers other than characters print their decimal digits, as with operator<<.
+		template<class T>
+		void append_(const T& x, std::true_type)
+			{
+			char digits[24];
+			char *end=digits+sizeof(digits), *p=end;
+			typename std::make_unsigned<T>::type u=x;
+			if(x<0) u=0-u;
+			do {
+				*--p=char('0'+u%10);
+				u/=10;
+				} while(u!=0);
+			if(x<0) *--p='-';
+			buf_.append(p, end);
+			}
+		template<class T>
+		void append_(const T& x, std::false_type)
+			{
+			tmp_.str(std::string());
+			tmp_ << x;
+			buf_+=tmp_.str();
+			}
+		void append_(const std::string& x, std::false_type) { buf_+=x; }
+};
 
+/// Print the subtree at 'top' into 'out' by walking down first children and back up
+/// through parents, so that the stack does not grow with the depth of the tree.
 template<class T>
-void print_tree_bracketed(const tree<T>& t, std::ostream& str) 
+void print_subtree_bracketed_(typename tree<T>::iterator top, bracketed_writer_& out)
 	{
-	int headCount = t.number_of_siblings(t.begin());
-	int headNum = 0;
-	for(typename tree<T>::sibling_iterator iRoots = t.begin(); iRoots != t.end(); ++iRoots, ++headNum) {
-		print_subtree_bracketed(t,iRoots,str);
-		if (headNum != headCount) {
-			str << std::endl;
+	typedef typename tree<T>::iterator_base iterator_base;
+	typedef decltype(iterator_base().node) node_ptr;
+
+	node_ptr root=top.node;
+	node_ptr n=root;
+	for(;;) {
+		out.put_value(n->data);
+		if(n->first_child!=0) {
+			out.put('(');
+			n=n->first_child;
+			continue;
+			}
+		while(n!=root && n->next_sibling==0) {
+			out.put(')');
+			n=n->parent;
 			}
+		if(n==root) break;
+		out.put(", ");
+		n=n->next_sibling;
+		}
+	}
+
+// Iterate over all roots (the head) and print each one on a new line.
+
+template<class T>
+void print_tree_bracketed(const tree<T>& t, std::ostream& str) 
+	{
+	if(t.empty()) return;
+	bracketed_writer_ out(str);
+	for(typename tree<T>::sibling_iterator iRoots = t.begin(); iRoots != t.end(); ++iRoots) {
+		if(iRoots != t.begin())
+			out.put('\n');
+		print_subtree_bracketed_<T>(iRoots, out);
 		}
 	}
 
@@ -64,27 +164,134 @@ template<class T>
 void print_subtree_bracketed(const tree<T>& t, typename tree<T>::iterator iRoot, std::ostream& str) 
 	{
 	if(t.empty()) return;
-	if (t.number_of_children(iRoot) == 0) {
-		str << *iRoot;	
-		}
-	else {
-		// parent
-		str << *iRoot;
-		str << "(";
-		// child1, ..., childn
-		int siblingCount = t.number_of_siblings(t.begin(iRoot));
-		int siblingNum;
-		typename tree<T>::sibling_iterator iChildren;
-		for (iChildren = t.begin(iRoot), siblingNum = 0; iChildren != t.end(iRoot); ++iChildren, ++siblingNum) {
-			// recursively print child
-			print_subtree_bracketed(t,iChildren,str);
-			// comma after every child except the last one
-			if (siblingNum != siblingCount ) {
-				str << ", ";
+	bracketed_writer_ out(str);
+	print_subtree_bracketed_<T>(iRoot, out);
+	}
+
+
+/// Convert a label to a node value; std::string is taken as it is, integers (other than
+/// characters) go through strtoll/strtoull and anything else through operator>>.
+class bracketed_reader_ {
+	public:
+		template<class T>
+		bool value(const std::string& s, T& x)
+			{
+			return convert_(s, x, std::integral_constant<int, (std::is_integral<T>::value && sizeof(T)>1)
+												 ? (std::is_signed<T>::value?1:2) : 0>());
+			}
+
+	private:
+		std::istringstream tmp_;
+
+		template<class T>
+		bool convert_(const std::string& s, T& x, std::integral_constant<int, 0>)
+			{
+			tmp_.clear();
+			tmp_.str(s);
+			return (tmp_ >> x) && (tmp_ >> std::ws).eof();
+			}
+		bool convert_(const std::string& s, std::string& x, std::integral_constant<int, 0>)
+			{
+			x=s;
+			return true;
+			}
+		template<class T>
+		bool convert_(const std::string& s, T& x, std::integral_constant<int, 1>)
+			{
+			char *end;
+			errno=0;
+			long long v=std::strtoll(s.c_str(), &end, 10);
+			x=T(v);
+			return !s.empty() && *end==0 && errno==0 && (long long)(x)==v;
+			}
+		template<class T>
+		bool convert_(const std::string& s, T& x, std::integral_constant<int, 2>)
+			{
+			char *end;
+			errno=0;
+			unsigned long long v=std::strtoull(s.c_str(), &end, 10);
+			x=T(v);
+			return !s.empty() && s[0]!='-' && *end==0 && errno==0 && (unsigned long long)(x)==v;
+			}
+};
+
+template<class T>
+void parse_bracketed(std::istream& str, tree<T>& tr)
+	{
+	typedef typename tree<T>::iterator_base iterator_base;
+	typedef decltype(iterator_base().node) node_ptr;
+	const size_t block=65536;
+
+	tr.clear();
+	bracketed_reader_ reader;
+	std::string label;      // text since the last delimiter, leading blanks skipped
+	size_t      kept=0;     // length of 'label' up to its last non-blank character
+	node_ptr    parent=0;   // node whose children are being read, 0 at the top
+	node_ptr    last=0;     // node made last
+	bool        closed=false; // just seen ')', so no label can follow
+	size_t      offset=0;
+	std::string buf(block, '\0');
+
+	auto fail=[&](const char *what) {
+		throw std::runtime_error(std::string("parse_bracketed: ")+what+" at offset "+std::to_string(offset));
+		};
+	// Make the node for the label read so far, as the next child of 'parent'.
+	auto make=[&]() {
+		label.resize(kept);
+		T val;
+		if(!reader.value(label, val))
+			fail(("cannot convert '"+label+"'").c_str());
+		if(parent==0) last=tr.insert(tr.end(), std::move(val)).node;
+		else          last=tr.append_child(typename tree<T>::iterator(parent), std::move(val)).node;
+		label.clear();
+		kept=0;
+		};
+
+	for(;;) {
+		str.read(&buf[0], block);
+		size_t got=str.gcount();
+		if(got==0) break;
+		for(size_t i=0; i<got; ++i, ++offset) {
+			char c=buf[i];
+			switch(c) {
+				case '(':
+					if(closed) fail("'(' after ')'");
+					make();
+					parent=last;
+					break;
+				case ',':
+					if(parent==0) fail("',' outside brackets");
+					if(!closed) make();
+					closed=false;
+					break;
+				case ')':
+					if(parent==0) fail("unbalanced ')'");
+					if(!closed) make();
+					last=parent;
+					parent=parent->parent;
+					closed=true;
+					break;
+				case '\n':
+					if(parent!=0) break;
+					if(!closed && kept>0) make();
+					label.clear();
+					kept=0;
+					closed=false;
+					break;
+				case ' ':
+				case '\t':
+				case '\r':
+					if(!label.empty()) label+=c;
+					break;
+				default:
+					if(closed) fail("text after ')'");
+					label+=c;
+					kept=label.size();
 				}
 			}
-		str << ")";
 		}
+	if(parent!=0) fail("missing ')'");
+	if(!closed && kept>0) make();
 	}
 
 }
@@ -0,0 +1,329 @@
+/*
+
+	Lazy alternatives to tree::subtree() and tree::insert_subtree(), for
+	programs which take subtrees out of a tree mostly to read them. A
+	subtree_view walks a range of siblings and everything below them in
+	place, without copying any nodes. A deferred_subtree or
+	deferred_insert reads through such a view until it is first written
+	to, and only then makes the copy that subtree() or insert_subtree()
+	would have made straight away; one which is never written to never
+	copies anything.
+
+	Until the copy is made, values are read from the source tree, so
+	changes to them show through. Any change to the shape of the source
+	(see tree::epoch), or for a deferred insert also of the destination,
+	makes one which has not been written to yet throw std::logic_error on
+	its next use.
+
+   This program is free software: you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef tree_view_hh_
+#define tree_view_hh_
+
+#include <stdexcept>
+#include "tree.hh"
+
+namespace kptree {
+
+/// The siblings from 'from' up to 'to' in a tree, plus all their children, iterated as
+/// if they were the heads of a tree of their own: what tr.subtree(from, to) would
+/// return, without the copy. Any change to the shape of the tree may leave the view
+/// pointing at nodes which are no longer in the range.
+template<class T, class A=std::allocator<tree_node_<T> > >
+class subtree_view {
+	public:
+		typedef tree<T, A>                              tree_type;
+		typedef typename tree_type::iterator_base       iterator_base;
+		typedef typename tree_type::pre_order_iterator  pre_order_iterator;
+		typedef typename tree_type::post_order_iterator post_order_iterator;
+		typedef typename tree_type::sibling_iterator    sibling_iterator;
+		typedef pre_order_iterator                      iterator;
+
+		subtree_view(const tree_type&, sibling_iterator from, sibling_iterator to);
+		/// The node at 'top' and everything below it.
+		subtree_view(const tree_type&, const iterator_base& top);
+
+		/// Pre-order and post-order iterators over the nodes in the view.
+		pre_order_iterator  begin() const      { return begin_; }
+		pre_order_iterator  end() const        { return end_; }
+		post_order_iterator begin_post() const { return begin_post_; }
+		post_order_iterator end_post() const   { return end_post_; }
+		/// The siblings at the top of the view.
+		sibling_iterator    begin_heads() const { return from_; }
+		sibling_iterator    end_heads() const   { return to_; }
+		/// Children of a node in the view.
+		static sibling_iterator begin(const iterator_base& it) { return tree_type::begin(it); }
+		static sibling_iterator end(const iterator_base& it)   { return tree_type::end(it); }
+
+		bool   empty() const { return from_==to_; }
+		/// Number of nodes in the view.
+		size_t size() const;
+		/// Distance of a node in the view from the siblings at the top (which have depth 0).
+		int    depth(const iterator_base&) const;
+		/// A copy of the nodes in the view, as tr.subtree(from, to).
+		tree_type copy() const;
+		/// The tree the nodes belong to.
+		const tree_type& source() const { return *tree_; }
+
+	private:
+		typedef typename A::value_type tree_node;
+
+		void init_();
+
+		const tree_type     *tree_;
+		sibling_iterator     from_, to_;
+		pre_order_iterator   begin_, end_;
+		post_order_iterator  begin_post_, end_post_;
+};
+
+/// What tr.subtree(from, to) returns, copied from 'tr' only when it is first written to:
+/// until then view() reads the nodes of 'tr'.
+template<class T, class A=std::allocator<tree_node_<T> > >
+class deferred_subtree {
+	public:
+		typedef tree<T, A>                           tree_type;
+		typedef subtree_view<T, A>                   view_type;
+		typedef typename tree_type::sibling_iterator sibling_iterator;
+
+		deferred_subtree(const tree_type&, sibling_iterator from, sibling_iterator to);
+
+		/// The nodes of the subtree: those in the source tree, or the copy once it is made.
+		view_type  view() const;
+		/// The copy, made on the first call; changes to it leave the source alone.
+		tree_type& write();
+		/// Whether the copy has been made.
+		bool       written() const { return written_; }
+
+	private:
+		void check_() const;
+
+		const tree_type  *source_;
+		sibling_iterator  from_, to_;
+		unsigned long     epoch_;
+		bool              written_;
+		tree_type         copy_;
+};
+
+/// What dest.insert_subtree(position, subtree) does, done only when first written to:
+/// until then 'dest' is left alone, and view() reads the nodes below 'subtree' in the
+/// tree they are in. A handle which is never written to inserts nothing. 'position'
+/// has to stay where it is, so a change to the shape of 'dest' counts as well as one to
+/// that of the source.
+template<class T, class A=std::allocator<tree_node_<T> > >
+class deferred_insert {
+	public:
+		typedef tree<T, A>                        tree_type;
+		typedef subtree_view<T, A>                view_type;
+		typedef typename tree_type::iterator_base iterator_base;
+		typedef typename tree_type::iterator      iterator;
+
+		/// 'subtree' is a node of 'source', which may be 'dest' itself.
+		deferred_insert(tree_type& dest, iterator position, const tree_type& source, const iterator_base& subtree);
+
+		/// The nodes to be inserted, or those inserted once the insert is done.
+		view_type view() const;
+		/// Insert the copy on the first call, returning the inserted node (as insert_subtree
+		/// does) on this and any later call.
+		iterator  write();
+		/// Whether the insert has been done.
+		bool      written() const { return written_; }
+
+	private:
+		void check_() const;
+
+		tree_type        *dest_;
+		iterator          position_;
+		const tree_type  *source_;
+		iterator          subtree_;
+		unsigned long     epoch_, dest_epoch_;
+		bool              written_;
+};
+
+/// Shorthands for the constructors above.
+template<class T, class A>
+subtree_view<T, A> view(const tree<T, A>& tr, typename tree<T, A>::sibling_iterator from,
+								typename tree<T, A>::sibling_iterator to)
+	{
+	return subtree_view<T, A>(tr, from, to);
+	}
+
+template<class T, class A>
+deferred_subtree<T, A> defer_subtree(const tree<T, A>& tr, typename tree<T, A>::sibling_iterator from,
+												 typename tree<T, A>::sibling_iterator to)
+	{
+	return deferred_subtree<T, A>(tr, from, to);
+	}
+
+template<class T, class A>
+deferred_insert<T, A> defer_insert_subtree(tree<T, A>& dest, typename tree<T, A>::iterator position,
+														 const tree<T, A>& source, const typename tree<T, A>::iterator_base& subtree)
+	{
+	return deferred_insert<T, A>(dest, position, source, subtree);
+	}
+
+
+template<class T, class A>
+subtree_view<T, A>::subtree_view(const tree_type& tr, sibling_iterator from, sibling_iterator to)
+	: tree_(&tr), from_(from), to_(to)
+	{
+	init_();
+	}
+
+template<class T, class A>
+subtree_view<T, A>::subtree_view(const tree_type& tr, const iterator_base& top)
+	: tree_(&tr), from_(top), to_(top)
+	{
+	++to_;
+	init_();
+	}
+
+template<class T, class A>
+void subtree_view<T, A>::init_()
+	{
+	if(from_==to_) return; // all iterators stay at 0, and compare equal
+
+	begin_=pre_order_iterator(from_.node);
+	// The node after the range in pre-order is the first one after it which is not
+	// below it: the end of the siblings leads on to where the parent's subtree ends.
+	if(to_.node!=0)
+		end_=pre_order_iterator(to_.node);
+	else {
+		end_=pre_order_iterator(to_.parent_);
+		end_.skip_children();
+		++end_;
+		}
+
+	tree_node *n=from_.node;
+	while(n->first_child!=0)
+		n=n->first_child;
+	begin_post_=post_order_iterator(n);
+	// In post-order, the range is followed by the first leaf below the next sibling,
+	// or by the parent if there is none.
+	if(to_.node!=0) {
+		n=to_.node;
+		while(n->first_child!=0)
+			n=n->first_child;
+		end_post_=post_order_iterator(n);
+		}
+	else end_post_=post_order_iterator(to_.parent_);
+	}
+
+template<class T, class A>
+size_t subtree_view<T, A>::size() const
+	{
+	size_t ret=0;
+	for(sibling_iterator it=from_; it!=to_; ++it)
+		ret+=tree_->size(it);
+	return ret;
+	}
+
+template<class T, class A>
+int subtree_view<T, A>::depth(const iterator_base& it) const
+	{
+	tree_node *top=from_.node?from_.node->parent:to_.parent_, *n=it.node;
+	int ret=0;
+	while(n->parent!=top) {
+		n=n->parent;
+		++ret;
+		}
+	return ret;
+	}
+
+template<class T, class A>
+typename subtree_view<T, A>::tree_type subtree_view<T, A>::copy() const
+	{
+	tree_type ret(tree_->get_allocator());
+	if(from_!=to_)
+		tree_->subtree(ret, from_, to_);
+	return ret;
+	}
+
+
+template<class T, class A>
+deferred_subtree<T, A>::deferred_subtree(const tree_type& tr, sibling_iterator from, sibling_iterator to)
+	: source_(&tr), from_(from), to_(to), epoch_(tr.epoch()), written_(false), copy_(tr.get_allocator())
+	{
+	}
+
+template<class T, class A>
+void deferred_subtree<T, A>::check_() const
+	{
+	if(source_->epoch()!=epoch_)
+		throw std::logic_error("deferred_subtree: source tree changed before the copy was made");
+	}
+
+template<class T, class A>
+typename deferred_subtree<T, A>::view_type deferred_subtree<T, A>::view() const
+	{
+	if(written_)
+		return view_type(copy_, copy_.begin(), copy_.end());
+	check_();
+	return view_type(*source_, from_, to_);
+	}
+
+template<class T, class A>
+typename deferred_subtree<T, A>::tree_type& deferred_subtree<T, A>::write()
+	{
+	if(!written_) {
+		check_();
+		if(from_!=to_)
+			source_->subtree(copy_, from_, to_);
+		written_=true;
+		}
+	return copy_;
+	}
+
+
+template<class T, class A>
+deferred_insert<T, A>::deferred_insert(tree_type& dest, iterator position, const tree_type& source,
+													const iterator_base& subtree)
+	: dest_(&dest), position_(position), source_(&source), subtree_(subtree), epoch_(source.epoch()),
+	  dest_epoch_(dest.epoch()), written_(false)
+	{
+	}
+
+template<class T, class A>
+void deferred_insert<T, A>::check_() const
+	{
+	if(source_->epoch()!=epoch_)
+		throw std::logic_error("deferred_insert: source tree changed before the insert was done");
+	if(dest_->epoch()!=dest_epoch_)
+		throw std::logic_error("deferred_insert: destination tree changed before the insert was done");
+	}
+
+template<class T, class A>
+typename deferred_insert<T, A>::view_type deferred_insert<T, A>::view() const
+	{
+	if(written_)
+		return view_type(*dest_, position_);
+	check_();
+	return view_type(*source_, subtree_);
+	}
+
+template<class T, class A>
+typename deferred_insert<T, A>::iterator deferred_insert<T, A>::write()
+	{
+	if(!written_) {
+		check_();
+		position_=dest_->insert_subtree(position_, subtree_);
+		written_=true;
+		}
+	return position_;
+	}
+
+}
+
+#endif